@@ -0,0 +1,573 @@
+/*
+ * GStreamer
+ * Copyright (C) 2005 Thomas Vander Stichele <thomas@apestaart.org>
+ * Copyright (C) 2005 Ronald S. Bultje <rbultje@ronald.bitfreak.net>
+ * Copyright (C) 2024 Lorenzo Miniero <lorenzo@meetecho.com>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ *
+ * Alternatively, the contents of this file may be used under the
+ * GNU Lesser General Public License Version 2.1 (the "LGPL"), in
+ * which case the following provisions apply instead of the ones
+ * mentioned above:
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 02111-1307, USA.
+ */
+
+/**
+ * SECTION:element-mjranalyze
+ *
+ * Analyzes an MJR recording in a single pass, without decoding anything,
+ * and posts an element message with a "mjr-analysis" structure when done:
+ * the structure contains statistics on losses, reordering, jitter (based
+ * on the received time of each packet), bitrate and keyframes, and can
+ * optionally include per-second histograms too.
+ *
+ * <refsect2>
+ * <title>Example launch line</title>
+ * |[
+ * gst-launch-1.0 -m filesrc location=rec-sample-video.mjr ! mjranalyze histograms=true
+ * ]|
+ * </refsect2>
+ */
+
+#ifdef HAVE_CONFIG_H
+#  include <config.h>
+#endif
+
+#include <gst/gst.h>
+
+#include "gstmjranalyze.h"
+
+enum {
+	LAST_SIGNAL
+};
+
+enum {
+	PROP_0,
+	PROP_SILENT,
+	PROP_HISTOGRAMS
+};
+
+/* How much of each packet we look at (RTP headers and payload descriptors) */
+#define GST_MJR_ANALYZE_PEEK_SIZE	256
+/* How many recent sequence numbers we track, to detect duplicates */
+#define GST_MJR_ANALYZE_SEQ_WINDOW	16384
+
+/* Pad templates: we just take MJR buffers in */
+static GstStaticPadTemplate sinktemplate = GST_STATIC_PAD_TEMPLATE("sink",
+	GST_PAD_SINK,
+	GST_PAD_ALWAYS,
+	GST_STATIC_CAPS_ANY
+);
+
+#define gst_mjr_analyze_parent_class parent_class
+	G_DEFINE_TYPE(GstMjrAnalyze, gst_mjr_analyze, GST_TYPE_BASE_SINK);
+
+GST_ELEMENT_REGISTER_DEFINE(mjranalyze, "mjranalyze", GST_RANK_NONE,
+	GST_TYPE_MJR_ANALYZE);
+
+/* Property setters/getters */
+static void gst_mjr_analyze_set_property(GObject *object,
+	guint prop_id, const GValue *value, GParamSpec *pspec);
+static void gst_mjr_analyze_get_property(GObject *object,
+	guint prop_id, GValue *value, GParamSpec *pspec);
+
+/* Sink methods */
+static gboolean gst_mjr_analyze_start(GstBaseSink *sink);
+static gboolean gst_mjr_analyze_stop(GstBaseSink *sink);
+static gboolean gst_mjr_analyze_event(GstBaseSink *sink, GstEvent *event);
+static GstFlowReturn gst_mjr_analyze_render(GstBaseSink *sink, GstBuffer *buf);
+
+/* Initialize the mjranalyze's class */
+static void gst_mjr_analyze_class_init(GstMjrAnalyzeClass *klass) {
+	GObjectClass *gobject_class;
+	GstElementClass *gstelement_class;
+	GstBaseSinkClass *gstbasesink_class;
+
+	gobject_class = (GObjectClass *)klass;
+	gstelement_class = (GstElementClass *)klass;
+	gstbasesink_class = (GstBaseSinkClass *)klass;
+
+	gobject_class->set_property = gst_mjr_analyze_set_property;
+	gobject_class->get_property = gst_mjr_analyze_get_property;
+
+	g_object_class_install_property(gobject_class, PROP_SILENT,
+		g_param_spec_boolean("silent", "Silent", "Don't produce verbose output",
+			TRUE, G_PARAM_READWRITE | GST_PARAM_MUTABLE_PLAYING));
+	g_object_class_install_property(gobject_class, PROP_HISTOGRAMS,
+		g_param_spec_boolean("histograms", "Histograms", "Include per-second histograms in the analysis",
+			FALSE, G_PARAM_READWRITE | GST_PARAM_MUTABLE_READY));
+
+	gstbasesink_class->start = GST_DEBUG_FUNCPTR(gst_mjr_analyze_start);
+	gstbasesink_class->stop = GST_DEBUG_FUNCPTR(gst_mjr_analyze_stop);
+	gstbasesink_class->event = GST_DEBUG_FUNCPTR(gst_mjr_analyze_event);
+	gstbasesink_class->render = GST_DEBUG_FUNCPTR(gst_mjr_analyze_render);
+
+	gst_element_class_set_details_simple(gstelement_class,
+		"Janus MJR Analyzer",
+		"Sink/Analyzer",
+		"Analyze the RTP packets in MJR recordings",
+		"Lorenzo Miniero <lorenzo@meetecho.com>");
+	gst_element_class_add_static_pad_template(gstelement_class, &sinktemplate);
+}
+
+/* Initialize the new element */
+static void gst_mjr_analyze_init(GstMjrAnalyze *analyze) {
+	analyze->silent = TRUE;
+	analyze->histograms = FALSE;
+	analyze->adapter = NULL;
+	analyze->state = gst_mjr_analyze_state_header;
+	memset(&analyze->stats, 0, sizeof(analyze->stats));
+	/* We don't care about timing, we just go through the data */
+	gst_base_sink_set_sync(GST_BASE_SINK(analyze), FALSE);
+}
+
+/* Property setter */
+static void gst_mjr_analyze_set_property(GObject *object, guint prop_id, const GValue *value, GParamSpec *pspec) {
+	GstMjrAnalyze *analyze = GST_MJR_ANALYZE(object);
+	/* Set the specified property */
+	switch(prop_id) {
+		case PROP_SILENT:
+			analyze->silent = g_value_get_boolean(value);
+			break;
+		case PROP_HISTOGRAMS:
+			analyze->histograms = g_value_get_boolean(value);
+			break;
+		default:
+			G_OBJECT_WARN_INVALID_PROPERTY_ID(object, prop_id, pspec);
+			break;
+	}
+}
+
+/* Property getter */
+static void gst_mjr_analyze_get_property(GObject *object, guint prop_id, GValue *value, GParamSpec *pspec) {
+	GstMjrAnalyze *analyze = GST_MJR_ANALYZE(object);
+	/* Get the specified property */
+	switch(prop_id) {
+		case PROP_SILENT:
+			g_value_set_boolean(value, analyze->silent);
+			break;
+		case PROP_HISTOGRAMS:
+			g_value_set_boolean(value, analyze->histograms);
+			break;
+		default:
+			G_OBJECT_WARN_INVALID_PROPERTY_ID(object, prop_id, pspec);
+			break;
+	}
+}
+
+/* Start: reset the parser and the statistics */
+static gboolean gst_mjr_analyze_start(GstBaseSink *sink) {
+	GstMjrAnalyze *analyze = GST_MJR_ANALYZE(sink);
+	analyze->adapter = gst_adapter_new();
+	analyze->state = gst_mjr_analyze_state_header;
+	analyze->json_len = 0;
+	memset(&analyze->info, 0, sizeof(analyze->info));
+	analyze->clock_rate = 0;
+	memset(&analyze->stats, 0, sizeof(analyze->stats));
+	gst_mjr_timestamp_reset(&analyze->stats.ts);
+	analyze->stats.seen = gst_mjr_seq_window_new(GST_MJR_ANALYZE_SEQ_WINDOW);
+	analyze->stats.bytes_per_second = g_array_new(FALSE, TRUE, sizeof(guint64));
+	analyze->stats.packets_per_second = g_array_new(FALSE, TRUE, sizeof(guint64));
+	analyze->block = g_byte_array_new();
+	return TRUE;
+}
+
+/* Stop: get rid of the resources */
+static gboolean gst_mjr_analyze_stop(GstBaseSink *sink) {
+	GstMjrAnalyze *analyze = GST_MJR_ANALYZE(sink);
+	g_clear_object(&analyze->adapter);
+	gst_mjr_seq_window_free(analyze->stats.seen);
+	analyze->stats.seen = NULL;
+	if(analyze->stats.bytes_per_second != NULL) {
+		g_array_free(analyze->stats.bytes_per_second, TRUE);
+		analyze->stats.bytes_per_second = NULL;
+	}
+	if(analyze->stats.packets_per_second != NULL) {
+		g_array_free(analyze->stats.packets_per_second, TRUE);
+		analyze->stats.packets_per_second = NULL;
+	}
+	if(analyze->block != NULL) {
+		g_byte_array_free(analyze->block, TRUE);
+		analyze->block = NULL;
+	}
+	return TRUE;
+}
+
+/* Done with a sequence of packets with the same SSRC, update the totals */
+static void gst_mjr_analyze_close_ssrc(GstMjrAnalyze *analyze) {
+	gst_mjr_analyze_stats *stats = &analyze->stats;
+	if(stats->seq_initialized) {
+		stats->expected += stats->max_seq - stats->base_seq + 1;
+		stats->received += stats->seq_received;
+	}
+	if(stats->ts.initialized)
+		stats->rtp_duration += stats->max_ext_ts - stats->min_ext_ts;
+	stats->seq_initialized = FALSE;
+	gst_mjr_seq_window_free(stats->seen);
+	stats->seen = gst_mjr_seq_window_new(GST_MJR_ANALYZE_SEQ_WINDOW);
+	stats->seq_received = 0;
+	stats->jitter_initialized = FALSE;
+	gst_mjr_timestamp_reset(&stats->ts);
+	stats->min_ext_ts = 0;
+	stats->max_ext_ts = 0;
+	stats->last_keyframe_ts = 0;
+	stats->keyframes_in_ssrc = 0;
+}
+
+/* Analyze an RTP packet: we may only have access to part of it */
+static void gst_mjr_analyze_packet(GstMjrAnalyze *analyze, const guint8 *data, gsize available,
+		guint16 len, guint32 received) {
+	gst_mjr_analyze_stats *stats = &analyze->stats;
+	if(len < 12 || available < 12)
+		return;
+	gst_mjr_rtp *rtp = (gst_mjr_rtp *)data;
+	guint32 ssrc = g_ntohl(rtp->ssrc);
+	guint16 seq = g_ntohs(rtp->seq_number);
+	stats->packets++;
+	stats->bytes += len;
+	if(stats->packets == 1) {
+		stats->first_ssrc = ssrc;
+		stats->ssrc = ssrc;
+	} else if(ssrc != stats->ssrc) {
+		/* SSRC change, sequence numbers and timestamps start from scratch */
+		stats->ssrc_changes++;
+		stats->ssrc = ssrc;
+		gst_mjr_analyze_close_ssrc(analyze);
+	}
+	/* Losses and reordering: duplicates (e.g., retransmissions of packets
+	 * that had been received already) are counted separately, and not as
+	 * received packets, or they'd hide actual losses */
+	gboolean duplicate = gst_mjr_seq_window_check(stats->seen, seq);
+	if(duplicate) {
+		stats->duplicates++;
+	} else {
+		stats->seq_received++;
+		if(!stats->seq_initialized) {
+			stats->seq_initialized = TRUE;
+			stats->ext_seq = 0;
+			stats->base_seq = 0;
+			stats->max_seq = 0;
+		} else {
+			stats->ext_seq += (gint16)(seq - stats->last_seq);
+			if(stats->ext_seq > stats->max_seq) {
+				stats->max_seq = stats->ext_seq;
+			} else {
+				stats->reordered++;
+				guint depth = stats->max_seq - stats->ext_seq;
+				if(depth > stats->max_reorder_depth)
+					stats->max_reorder_depth = depth;
+				if(stats->ext_seq < stats->base_seq)
+					stats->base_seq = stats->ext_seq;
+			}
+		}
+		stats->last_seq = seq;
+	}
+	/* Timing and jitter, using the received time (not available in legacy recordings) */
+	gint64 ext_ts = gst_mjr_timestamp_update(&stats->ts, g_ntohl(rtp->timestamp));
+	if(ext_ts < stats->min_ext_ts)
+		stats->min_ext_ts = ext_ts;
+	if(ext_ts > stats->max_ext_ts)
+		stats->max_ext_ts = ext_ts;
+	if(!duplicate && !analyze->info.legacy && analyze->clock_rate > 0) {
+		gint64 arrival = (gint64)received * analyze->clock_rate / 1000;
+		gint64 transit = arrival - ext_ts;
+		if(stats->jitter_initialized) {
+			gint64 d = transit - stats->last_transit;
+			if(d < 0)
+				d = -d;
+			stats->jitter += ((gdouble)d - stats->jitter) / 16.0;
+			if(stats->jitter > stats->max_jitter)
+				stats->max_jitter = stats->jitter;
+		}
+		stats->jitter_initialized = TRUE;
+		stats->last_transit = transit;
+	}
+	/* Keyframes */
+	if(analyze->info.video) {
+		gsize header = gst_mjr_rtp_header_size(data, MIN(available, len));
+		if(header > 0 && gst_mjr_is_keyframe(analyze->info.codec, data + header, MIN(available, len) - header) &&
+				(stats->keyframes_in_ssrc == 0 || ext_ts != stats->last_keyframe_ts)) {
+			if(stats->keyframes_in_ssrc > 0) {
+				gint64 interval = ext_ts - stats->last_keyframe_ts;
+				if(interval > 0) {
+					if(stats->min_keyframe_interval == 0 || interval < stats->min_keyframe_interval)
+						stats->min_keyframe_interval = interval;
+					if(interval > stats->max_keyframe_interval)
+						stats->max_keyframe_interval = interval;
+					stats->sum_keyframe_interval += interval;
+					stats->keyframe_intervals++;
+				}
+			}
+			stats->keyframes++;
+			stats->keyframes_in_ssrc++;
+			stats->last_keyframe_ts = ext_ts;
+		}
+	}
+	/* Per-second histograms */
+	gint64 second = 0;
+	if(!analyze->info.legacy)
+		second = received / 1000;
+	else if(analyze->clock_rate > 0 && ext_ts > 0)
+		second = (stats->rtp_duration + ext_ts) / analyze->clock_rate;
+	if(second >= stats->bytes_per_second->len) {
+		g_array_set_size(stats->bytes_per_second, second + 1);
+		g_array_set_size(stats->packets_per_second, second + 1);
+	}
+	g_array_index(stats->bytes_per_second, guint64, second) += len;
+	g_array_index(stats->packets_per_second, guint64, second)++;
+}
+
+/* Helper to add an histogram to a structure */
+static void gst_mjr_analyze_add_histogram(GstStructure *structure, const char *name,
+		GArray *values, guint64 multiplier) {
+	GValue array = G_VALUE_INIT;
+	g_value_init(&array, GST_TYPE_ARRAY);
+	guint i = 0;
+	for(i=0; i<values->len; i++) {
+		GValue value = G_VALUE_INIT;
+		g_value_init(&value, G_TYPE_UINT64);
+		g_value_set_uint64(&value, g_array_index(values, guint64, i) * multiplier);
+		gst_value_array_append_value(&array, &value);
+		g_value_unset(&value);
+	}
+	gst_structure_take_value(structure, name, &array);
+}
+
+/* We're done: post a message with the results of the analysis */
+static void gst_mjr_analyze_post_results(GstMjrAnalyze *analyze) {
+	gst_mjr_analyze_stats *stats = &analyze->stats;
+	gst_mjr_analyze_close_ssrc(analyze);
+	/* Use the received time for the duration, if we have it */
+	guint clock_rate = analyze->clock_rate ? analyze->clock_rate : 1;
+	GstClockTime duration = gst_util_uint64_scale(stats->rtp_duration, GST_SECOND, clock_rate);
+	if(!analyze->info.legacy && stats->bytes_per_second->len > 0)
+		duration = MAX(duration, (GstClockTime)(stats->bytes_per_second->len - 1) * GST_SECOND);
+	guint64 lost = stats->expected > stats->received ? stats->expected - stats->received : 0;
+	guint64 max_bitrate = 0;
+	guint i = 0;
+	for(i=0; i<stats->bytes_per_second->len; i++) {
+		if(g_array_index(stats->bytes_per_second, guint64, i) * 8 > max_bitrate)
+			max_bitrate = g_array_index(stats->bytes_per_second, guint64, i) * 8;
+	}
+	GstStructure *structure = gst_structure_new("mjr-analysis",
+		"media", G_TYPE_STRING, analyze->info.video ? "video" : "audio",
+		"codec", G_TYPE_STRING, gst_mjr_codec_string(analyze->info.codec),
+		"created", G_TYPE_INT64, analyze->info.created,
+		"written", G_TYPE_INT64, analyze->info.written,
+		"ssrc", G_TYPE_UINT, stats->first_ssrc,
+		"ssrc-changes", G_TYPE_UINT, stats->ssrc_changes,
+		"packets", G_TYPE_UINT64, stats->packets,
+		"bytes", G_TYPE_UINT64, stats->bytes,
+		"duration", G_TYPE_UINT64, duration,
+		"expected", G_TYPE_UINT64, stats->expected,
+		"lost", G_TYPE_UINT64, lost,
+		"loss-percent", G_TYPE_DOUBLE, stats->expected ? (gdouble)lost * 100.0 / (gdouble)stats->expected : 0.0,
+		"duplicates", G_TYPE_UINT64, stats->duplicates,
+		"reordered", G_TYPE_UINT64, stats->reordered,
+		"max-reorder-depth", G_TYPE_UINT, stats->max_reorder_depth,
+		"jitter", G_TYPE_DOUBLE, stats->jitter * 1000.0 / clock_rate,
+		"max-jitter", G_TYPE_DOUBLE, stats->max_jitter * 1000.0 / clock_rate,
+		"avg-bitrate", G_TYPE_UINT64, duration ? gst_util_uint64_scale(stats->bytes * 8, GST_SECOND, duration) : 0,
+		"max-bitrate", G_TYPE_UINT64, max_bitrate,
+		NULL);
+	if(analyze->info.video) {
+		gst_structure_set(structure,
+			"keyframes", G_TYPE_UINT, stats->keyframes,
+			"min-keyframe-interval", G_TYPE_DOUBLE, stats->min_keyframe_interval * 1000.0 / clock_rate,
+			"max-keyframe-interval", G_TYPE_DOUBLE, stats->max_keyframe_interval * 1000.0 / clock_rate,
+			"avg-keyframe-interval", G_TYPE_DOUBLE, stats->keyframe_intervals ?
+				(stats->sum_keyframe_interval * 1000.0 / clock_rate) / stats->keyframe_intervals : 0.0,
+			NULL);
+	}
+	if(analyze->histograms) {
+		gst_mjr_analyze_add_histogram(structure, "bitrate-histogram", stats->bytes_per_second, 8);
+		gst_mjr_analyze_add_histogram(structure, "packets-histogram", stats->packets_per_second, 1);
+	}
+	if(!analyze->silent) {
+		gchar *text = gst_structure_to_string(structure);
+		g_print("[mjranalyze] %s\n", text);
+		g_free(text);
+	}
+	gst_element_post_message(GST_ELEMENT(analyze),
+		gst_message_new_element(GST_OBJECT(analyze), structure));
+}
+
+/* Handle events: we post the results when we get an EOS */
+static gboolean gst_mjr_analyze_event(GstBaseSink *sink, GstEvent *event) {
+	GstMjrAnalyze *analyze = GST_MJR_ANALYZE(sink);
+	if(GST_EVENT_TYPE(event) == GST_EVENT_EOS && analyze->state >= gst_mjr_analyze_state_packets)
+		gst_mjr_analyze_post_results(analyze);
+	return GST_BASE_SINK_CLASS(parent_class)->event(sink, event);
+}
+
+/* Render function, where we parse the records and analyze the packets */
+static GstFlowReturn gst_mjr_analyze_render(GstBaseSink *sink, GstBuffer *buf) {
+	GstMjrAnalyze *analyze = GST_MJR_ANALYZE(sink);
+	gst_adapter_push(analyze->adapter, gst_buffer_ref(buf));
+	while(TRUE) {
+		gsize available = gst_adapter_available(analyze->adapter);
+		if(analyze->state == gst_mjr_analyze_state_header) {
+			/* MJR header, followed by the length of the info header */
+			if(available < GST_MJR_HEADER_SIZE + GST_MJR_JSON_LENGTH_SIZE)
+				break;
+			const guint8 *data = gst_adapter_map(analyze->adapter, GST_MJR_HEADER_SIZE + GST_MJR_JSON_LENGTH_SIZE);
+			if(!gst_mjr_check_header((const char *)data, &analyze->info.legacy, &analyze->info.compressed)) {
+				gst_adapter_unmap(analyze->adapter);
+				GST_ELEMENT_ERROR(analyze, STREAM, DECODE, (NULL), ("Not an MJR file, or unsupported version."));
+				return GST_FLOW_ERROR;
+			}
+			guint16 len = 0;
+			memcpy(&len, data + GST_MJR_HEADER_SIZE, sizeof(len));
+			gst_adapter_unmap(analyze->adapter);
+			gst_adapter_flush(analyze->adapter, GST_MJR_HEADER_SIZE + GST_MJR_JSON_LENGTH_SIZE);
+			analyze->json_len = g_ntohs(len);
+			analyze->state = gst_mjr_analyze_state_json;
+		} else if(analyze->state == gst_mjr_analyze_state_json) {
+			/* Info header */
+			if(available < analyze->json_len)
+				break;
+			const guint8 *data = gst_adapter_map(analyze->adapter, analyze->json_len);
+			gchar *error = NULL;
+			gboolean compressed = analyze->info.compressed;
+			gboolean res = gst_mjr_parse_info((const char *)data, analyze->json_len,
+				analyze->info.legacy, &analyze->info, &error);
+			analyze->info.compressed = compressed;
+			gst_adapter_unmap(analyze->adapter);
+			if(!res) {
+				GST_ELEMENT_ERROR(analyze, STREAM, DECODE, (NULL), ("%s", error));
+				g_free(error);
+				return GST_FLOW_ERROR;
+			}
+			gst_adapter_flush(analyze->adapter, analyze->json_len);
+			analyze->clock_rate = gst_mjr_get_clock_rate(analyze->info.codec);
+			analyze->state = analyze->info.compressed ?
+				gst_mjr_analyze_state_blocks : gst_mjr_analyze_state_packets;
+		} else if(analyze->state == gst_mjr_analyze_state_index) {
+			/* We don't need the index of compressed files */
+			gst_adapter_flush(analyze->adapter, available);
+			break;
+		} else if(analyze->state == gst_mjr_analyze_state_blocks) {
+			/* Compressed blocks of records */
+			if(available < GST_MJR_BLOCK_HEADER_SIZE)
+				break;
+			const guint8 *data = gst_adapter_map(analyze->adapter, GST_MJR_BLOCK_HEADER_SIZE);
+			gst_mjr_block block;
+			gboolean index = FALSE;
+			gboolean res = gst_mjr_parse_block((const char *)data, &block, &index);
+			gst_adapter_unmap(analyze->adapter);
+			if(!res && index) {
+				analyze->state = gst_mjr_analyze_state_index;
+				continue;
+			} else if(!res) {
+				GST_ELEMENT_ERROR(analyze, STREAM, DECODE, (NULL), ("Invalid block."));
+				return GST_FLOW_ERROR;
+			}
+			if(available < GST_MJR_BLOCK_HEADER_SIZE + (gsize)block.compressed_size)
+				break;
+			data = gst_adapter_map(analyze->adapter, GST_MJR_BLOCK_HEADER_SIZE + block.compressed_size);
+			g_byte_array_set_size(analyze->block, block.size);
+			res = gst_mjr_block_decompress(data + GST_MJR_BLOCK_HEADER_SIZE, block.compressed_size,
+				analyze->block->data, block.size);
+			gst_adapter_unmap(analyze->adapter);
+			gst_adapter_flush(analyze->adapter, GST_MJR_BLOCK_HEADER_SIZE + block.compressed_size);
+			if(!res) {
+				GST_ELEMENT_ERROR(analyze, STREAM, DECODE, (NULL), ("Error decompressing block."));
+				return GST_FLOW_ERROR;
+			}
+			/* Records in the block are the same as in uncompressed files */
+			guint offset = 0;
+			while(offset + GST_MJR_FRAME_HEADER_SIZE <= analyze->block->len) {
+				const guint8 *record = analyze->block->data + offset;
+				guint32 received = 0;
+				memcpy(&received, record + 4, sizeof(received));
+				guint16 len = 0;
+				memcpy(&len, record + 8, sizeof(len));
+				len = g_ntohs(len);
+				if(memcmp(record, "MEET", 4) ||
+						offset + GST_MJR_FRAME_HEADER_SIZE + len > analyze->block->len) {
+					GST_ELEMENT_ERROR(analyze, STREAM, DECODE, (NULL), ("Invalid data."));
+					return GST_FLOW_ERROR;
+				}
+				guint16 original = 0;
+				guint16 stored = gst_mjr_record_length(&analyze->info,
+					record + GST_MJR_FRAME_HEADER_SIZE, len, &original);
+				gst_mjr_analyze_packet(analyze, record + GST_MJR_FRAME_HEADER_SIZE,
+					stored, original, g_ntohl(received));
+				offset += GST_MJR_FRAME_HEADER_SIZE + len;
+			}
+		} else {
+			/* Records: we only peek at the beginning of the packets */
+			if(available < GST_MJR_FRAME_HEADER_SIZE)
+				break;
+			const guint8 *data = gst_adapter_map(analyze->adapter, GST_MJR_FRAME_HEADER_SIZE);
+			if(data[0] != 'M' || data[1] != 'E' || data[2] != 'E' || data[3] != 'T') {
+				gst_adapter_unmap(analyze->adapter);
+				GST_ELEMENT_ERROR(analyze, STREAM, DECODE, (NULL), ("Invalid data."));
+				return GST_FLOW_ERROR;
+			}
+			guint32 received = 0;
+			if(!analyze->info.legacy) {
+				memcpy(&received, data + 4, sizeof(received));
+				received = g_ntohl(received);
+			}
+			guint16 len = 0;
+			memcpy(&len, data + 8, sizeof(len));
+			len = g_ntohs(len);
+			gst_adapter_unmap(analyze->adapter);
+			if(available < GST_MJR_FRAME_HEADER_SIZE + (gsize)len)
+				break;
+			if(analyze->info.snaplen > 0) {
+				/* Truncated packet, the original length is at the end of the record */
+				data = gst_adapter_map(analyze->adapter, GST_MJR_FRAME_HEADER_SIZE + len);
+				guint16 original = 0;
+				guint16 stored = gst_mjr_record_length(&analyze->info,
+					data + GST_MJR_FRAME_HEADER_SIZE, len, &original);
+				gst_mjr_analyze_packet(analyze, data + GST_MJR_FRAME_HEADER_SIZE,
+					MIN(stored, GST_MJR_ANALYZE_PEEK_SIZE), original, received);
+			} else {
+				gsize peek = MIN(len, GST_MJR_ANALYZE_PEEK_SIZE);
+				data = gst_adapter_map(analyze->adapter, GST_MJR_FRAME_HEADER_SIZE + peek);
+				gst_mjr_analyze_packet(analyze, data + GST_MJR_FRAME_HEADER_SIZE, peek, len, received);
+			}
+			gst_adapter_unmap(analyze->adapter);
+			gst_adapter_flush(analyze->adapter, GST_MJR_FRAME_HEADER_SIZE + len);
+		}
+	}
+	return GST_FLOW_OK;
+}
+
+/* Register the element in the plugin */
+gboolean mjr_analyze_register(GstPlugin *plugin) {
+	return GST_ELEMENT_REGISTER(mjranalyze, plugin);
+}
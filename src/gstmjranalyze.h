@@ -0,0 +1,117 @@
+/*
+ * GStreamer
+ * Copyright (C) 2005 Thomas Vander Stichele <thomas@apestaart.org>
+ * Copyright (C) 2005 Ronald S. Bultje <rbultje@ronald.bitfreak.net>
+ * Copyright (C) 2024 Lorenzo Miniero <lorenzo@meetecho.com>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ *
+ * Alternatively, the contents of this file may be used under the
+ * GNU Lesser General Public License Version 2.1 (the "LGPL"), in
+ * which case the following provisions apply instead of the ones
+ * mentioned above:
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 02111-1307, USA.
+ */
+
+#ifndef __GST_MJR_ANALYZE_H__
+#define __GST_MJR_ANALYZE_H__
+
+#include <gst/gst.h>
+#include <gst/base/gstbasesink.h>
+#include <gst/base/gstadapter.h>
+
+#include "gstmjrutils.h"
+
+G_BEGIN_DECLS
+
+#define GST_TYPE_MJR_ANALYZE gst_mjr_analyze_get_type()
+G_DECLARE_FINAL_TYPE(GstMjrAnalyze, gst_mjr_analyze, GST, MJR_ANALYZE, GstBaseSink)
+
+typedef enum gst_mjr_analyze_state {
+	gst_mjr_analyze_state_header,
+	gst_mjr_analyze_state_json,
+	gst_mjr_analyze_state_packets,
+	gst_mjr_analyze_state_blocks,
+	gst_mjr_analyze_state_index,
+} gst_mjr_analyze_state;
+
+/* Statistics on the recording */
+typedef struct gst_mjr_analyze_stats {
+	guint64 packets, bytes;
+	/* SSRC info */
+	guint32 first_ssrc, ssrc;
+	guint ssrc_changes;
+	/* Losses and reordering, for the current SSRC and overall */
+	gboolean seq_initialized;
+	gst_mjr_seq_window *seen;
+	guint16 last_seq;
+	gint64 ext_seq, base_seq, max_seq;
+	guint64 seq_received, received, expected, reordered, duplicates;
+	guint max_reorder_depth;
+	/* Jitter, in RTP timestamp units */
+	gst_mjr_timestamp ts;
+	gboolean jitter_initialized;
+	gint64 last_transit;
+	gdouble jitter, max_jitter;
+	gint64 min_ext_ts, max_ext_ts;
+	gint64 rtp_duration;
+	/* Keyframes */
+	guint keyframes, keyframes_in_ssrc, keyframe_intervals;
+	gint64 last_keyframe_ts;
+	gint64 min_keyframe_interval, max_keyframe_interval, sum_keyframe_interval;
+	/* Per-second histograms */
+	GArray *bytes_per_second, *packets_per_second;
+} gst_mjr_analyze_stats;
+
+struct _GstMjrAnalyze {
+	GstBaseSink parent;
+	gboolean silent;
+	gboolean histograms;
+
+	/* MJR related stuff */
+	GstAdapter *adapter;
+	gst_mjr_analyze_state state;
+	gsize json_len;
+	gst_mjr_info info;
+	guint32 clock_rate;
+	GByteArray *block;
+
+	/* Statistics */
+	gst_mjr_analyze_stats stats;
+};
+
+G_END_DECLS
+
+gboolean mjr_analyze_register(GstPlugin *plugin);
+
+#endif /* __GST_MJR_ANALYZE_H__ */
@@ -0,0 +1,546 @@
+/*
+ * GStreamer
+ * Copyright (C) 2005 Thomas Vander Stichele <thomas@apestaart.org>
+ * Copyright (C) 2005 Ronald S. Bultje <rbultje@ronald.bitfreak.net>
+ * Copyright (C) 2024 Lorenzo Miniero <lorenzo@meetecho.com>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ *
+ * Alternatively, the contents of this file may be used under the
+ * GNU Lesser General Public License Version 2.1 (the "LGPL"), in
+ * which case the following provisions apply instead of the ones
+ * mentioned above:
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 02111-1307, USA.
+ */
+
+/**
+ * SECTION:element-mjrarchivedemux
+ *
+ * Extracts the MJR files bundled in a session archive, as written by
+ * mjrarchivemux, each on a different source pad: each stream can then be
+ * processed with mjrdemux as if it were read from the original MJR file.
+ * When upstream supports pull mode, the table of contents is read before
+ * anything else, so that all pads (and their names, as title tags) are
+ * known in advance; in push mode, pads are added as the streams are met
+ * in the archive instead, and names are only known at the end.
+ *
+ * <refsect2>
+ * <title>Example launch line</title>
+ * |[
+ * gst-launch-1.0 filesrc location=session.mjra ! mjrarchivedemux name=d \
+ *   d.src_0 ! mjrdemux ! rtpopusdepay ! opusdec ! autoaudiosink \
+ *   d.src_1 ! mjrdemux ! rtpvp8depay ! vp8dec ! autovideosink
+ * ]|
+ * </refsect2>
+ */
+
+#ifdef HAVE_CONFIG_H
+#  include <config.h>
+#endif
+
+#include <gst/gst.h>
+
+#include "gstmjrarchivedemux.h"
+
+/* How much we read at a time, in pull mode */
+#define GST_MJR_ARCHIVE_DEMUX_CHUNK_SIZE	(64*1024)
+
+enum {
+	LAST_SIGNAL
+};
+
+enum {
+	PROP_0,
+	PROP_SILENT
+};
+
+/* Pad templates: we take a session archive in and shoot MJR files out */
+static GstStaticPadTemplate sinktemplate = GST_STATIC_PAD_TEMPLATE("sink",
+	GST_PAD_SINK,
+	GST_PAD_ALWAYS,
+	GST_STATIC_CAPS_ANY
+);
+static GstStaticPadTemplate srctemplate = GST_STATIC_PAD_TEMPLATE("src_%u",
+	GST_PAD_SRC,
+	GST_PAD_SOMETIMES,
+	GST_STATIC_CAPS_ANY
+);
+
+#define gst_mjr_archive_demux_parent_class parent_class
+	G_DEFINE_TYPE(GstMjrArchiveDemux, gst_mjr_archive_demux, GST_TYPE_ELEMENT);
+
+GST_ELEMENT_REGISTER_DEFINE(mjrarchivedemux, "mjrarchivedemux", GST_RANK_NONE,
+	GST_TYPE_MJR_ARCHIVE_DEMUX);
+
+/* Property setters/getters */
+static void gst_mjr_archive_demux_set_property(GObject *object,
+	guint prop_id, const GValue *value, GParamSpec *pspec);
+static void gst_mjr_archive_demux_get_property(GObject *object,
+	guint prop_id, GValue *value, GParamSpec *pspec);
+static void gst_mjr_archive_demux_finalize(GObject *object);
+
+/* GstElement methods */
+static GstStateChangeReturn gst_mjr_archive_demux_change_state(GstElement *element,
+	GstStateChange transition);
+
+/* Pad methods */
+static gboolean gst_mjr_archive_demux_sink_activate(GstPad *pad, GstObject *parent);
+static gboolean gst_mjr_archive_demux_sink_activate_mode(GstPad *pad,
+	GstObject *parent, GstPadMode mode, gboolean active);
+static gboolean gst_mjr_archive_demux_sink_event(GstPad *pad,
+	GstObject *parent, GstEvent *event);
+static GstFlowReturn gst_mjr_archive_demux_chain(GstPad *pad,
+	GstObject *parent, GstBuffer *buf);
+static void gst_mjr_archive_demux_loop(gpointer user_data);
+
+/* Initialize the mjrarchivedemux's class */
+static void gst_mjr_archive_demux_class_init(GstMjrArchiveDemuxClass *klass) {
+	GObjectClass *gobject_class;
+	GstElementClass *gstelement_class;
+
+	gobject_class = (GObjectClass *)klass;
+	gstelement_class = (GstElementClass *)klass;
+
+	gobject_class->set_property = gst_mjr_archive_demux_set_property;
+	gobject_class->get_property = gst_mjr_archive_demux_get_property;
+	gobject_class->finalize = gst_mjr_archive_demux_finalize;
+
+	g_object_class_install_property(gobject_class, PROP_SILENT,
+		g_param_spec_boolean("silent", "Silent", "Don't produce verbose output",
+			TRUE, G_PARAM_READWRITE | GST_PARAM_MUTABLE_PLAYING));
+
+	gstelement_class->change_state = GST_DEBUG_FUNCPTR(gst_mjr_archive_demux_change_state);
+
+	gst_element_class_set_details_simple(gstelement_class,
+		"Janus MJR Session Archive Demuxer",
+		"Codec/Demuxer",
+		"Extract the MJR recordings bundled in a session archive",
+		"Lorenzo Miniero <lorenzo@meetecho.com>");
+	gst_element_class_add_static_pad_template(gstelement_class, &srctemplate);
+	gst_element_class_add_static_pad_template(gstelement_class, &sinktemplate);
+}
+
+/* Free an output */
+static void gst_mjr_archive_demux_output_free(gst_mjr_archive_demux_output *output) {
+	g_free(output->name);
+	g_free(output);
+}
+
+/* Initialize the new element */
+static void gst_mjr_archive_demux_init(GstMjrArchiveDemux *demux) {
+	demux->silent = TRUE;
+	demux->adapter = gst_adapter_new();
+	demux->state = GST_MJR_ARCHIVE_DEMUX_HEADER;
+	demux->toc = NULL;
+	demux->pull = FALSE;
+	demux->group_id = 0;
+	demux->outputs = g_hash_table_new_full(NULL, NULL,
+		NULL, (GDestroyNotify)gst_mjr_archive_demux_output_free);
+	demux->flowcombiner = gst_flow_combiner_new();
+	demux->sinkpad = gst_pad_new_from_static_template(&sinktemplate, "sink");
+	gst_pad_set_activate_function(demux->sinkpad,
+		GST_DEBUG_FUNCPTR(gst_mjr_archive_demux_sink_activate));
+	gst_pad_set_activatemode_function(demux->sinkpad,
+		GST_DEBUG_FUNCPTR(gst_mjr_archive_demux_sink_activate_mode));
+	gst_pad_set_event_function(demux->sinkpad,
+		GST_DEBUG_FUNCPTR(gst_mjr_archive_demux_sink_event));
+	gst_pad_set_chain_function(demux->sinkpad,
+		GST_DEBUG_FUNCPTR(gst_mjr_archive_demux_chain));
+	gst_element_add_pad(GST_ELEMENT(demux), demux->sinkpad);
+}
+
+/* Property setter */
+static void gst_mjr_archive_demux_set_property(GObject *object, guint prop_id, const GValue *value, GParamSpec *pspec) {
+	GstMjrArchiveDemux *demux = GST_MJR_ARCHIVE_DEMUX(object);
+	/* Set the specified property */
+	switch(prop_id) {
+		case PROP_SILENT:
+			demux->silent = g_value_get_boolean(value);
+			break;
+		default:
+			G_OBJECT_WARN_INVALID_PROPERTY_ID(object, prop_id, pspec);
+			break;
+	}
+}
+
+/* Property getter */
+static void gst_mjr_archive_demux_get_property(GObject *object, guint prop_id, GValue *value, GParamSpec *pspec) {
+	GstMjrArchiveDemux *demux = GST_MJR_ARCHIVE_DEMUX(object);
+	/* Get the specified property */
+	switch(prop_id) {
+		case PROP_SILENT:
+			g_value_set_boolean(value, demux->silent);
+			break;
+		default:
+			G_OBJECT_WARN_INVALID_PROPERTY_ID(object, prop_id, pspec);
+			break;
+	}
+}
+
+/* Cleanup */
+static void gst_mjr_archive_demux_finalize(GObject *object) {
+	GstMjrArchiveDemux *demux = GST_MJR_ARCHIVE_DEMUX(object);
+	g_object_unref(demux->adapter);
+	g_hash_table_destroy(demux->outputs);
+	gst_flow_combiner_free(demux->flowcombiner);
+	if(demux->toc != NULL)
+		g_ptr_array_free(demux->toc, TRUE);
+	G_OBJECT_CLASS(parent_class)->finalize(object);
+}
+
+/* Go back to the initial state, removing all the pads we added */
+static void gst_mjr_archive_demux_reset(GstMjrArchiveDemux *demux) {
+	GHashTableIter iter;
+	gpointer value = NULL;
+	g_hash_table_iter_init(&iter, demux->outputs);
+	while(g_hash_table_iter_next(&iter, NULL, &value)) {
+		gst_mjr_archive_demux_output *output = value;
+		gst_flow_combiner_remove_pad(demux->flowcombiner, output->srcpad);
+		gst_element_remove_pad(GST_ELEMENT(demux), output->srcpad);
+	}
+	g_hash_table_remove_all(demux->outputs);
+	gst_flow_combiner_reset(demux->flowcombiner);
+	gst_adapter_clear(demux->adapter);
+	demux->state = GST_MJR_ARCHIVE_DEMUX_HEADER;
+	demux->segment_id = 0;
+	demux->segment_left = 0;
+	if(demux->toc != NULL)
+		g_ptr_array_free(demux->toc, TRUE);
+	demux->toc = NULL;
+	demux->offset = 0;
+	demux->end = 0;
+	demux->no_more_pads = FALSE;
+}
+
+/* Handle state changes */
+static GstStateChangeReturn gst_mjr_archive_demux_change_state(GstElement *element, GstStateChange transition) {
+	GstMjrArchiveDemux *demux = GST_MJR_ARCHIVE_DEMUX(element);
+	GstStateChangeReturn ret = GST_ELEMENT_CLASS(parent_class)->change_state(element, transition);
+	if(ret == GST_STATE_CHANGE_FAILURE)
+		return ret;
+	if(transition == GST_STATE_CHANGE_PAUSED_TO_READY)
+		gst_mjr_archive_demux_reset(demux);
+	return ret;
+}
+
+/* Get the output for a stream, creating a new source pad if needed */
+static gst_mjr_archive_demux_output *gst_mjr_archive_demux_get_output(GstMjrArchiveDemux *demux,
+		guint32 id, const gchar *name) {
+	gst_mjr_archive_demux_output *output = g_hash_table_lookup(demux->outputs, GUINT_TO_POINTER(id));
+	if(output != NULL)
+		return output;
+	gchar *pad_name = g_strdup_printf("src_%" G_GUINT32_FORMAT, id);
+	GstPad *srcpad = gst_pad_new_from_static_template(&srctemplate, pad_name);
+	g_free(pad_name);
+	gst_pad_use_fixed_caps(srcpad);
+	gst_pad_set_active(srcpad, TRUE);
+	output = g_malloc0(sizeof(gst_mjr_archive_demux_output));
+	output->srcpad = srcpad;
+	output->id = id;
+	output->name = g_strdup(name);
+	g_hash_table_insert(demux->outputs, GUINT_TO_POINTER(id), output);
+	/* Each stream is a separate MJR file */
+	if(g_hash_table_size(demux->outputs) == 1)
+		demux->group_id = gst_util_group_id_next();
+	gchar *stream_id = gst_pad_create_stream_id_printf(srcpad,
+		GST_ELEMENT(demux), "%08x", id);
+	GstEvent *event = gst_event_new_stream_start(stream_id);
+	gst_event_set_group_id(event, demux->group_id);
+	g_free(stream_id);
+	gst_pad_store_sticky_event(srcpad, event);
+	gst_event_unref(event);
+	GstSegment segment;
+	gst_segment_init(&segment, GST_FORMAT_BYTES);
+	event = gst_event_new_segment(&segment);
+	gst_pad_store_sticky_event(srcpad, event);
+	gst_event_unref(event);
+	if(name != NULL) {
+		event = gst_event_new_tag(gst_tag_list_new(GST_TAG_TITLE, name, NULL));
+		gst_pad_store_sticky_event(srcpad, event);
+		gst_event_unref(event);
+	}
+	if(!demux->silent)
+		g_print("[mjrarchivedemux] New stream %" G_GUINT32_FORMAT ", adding pad\n", id);
+	gst_element_add_pad(GST_ELEMENT(demux), srcpad);
+	gst_flow_combiner_add_pad(demux->flowcombiner, srcpad);
+	return output;
+}
+
+/* We know about all the streams there are */
+static void gst_mjr_archive_demux_no_more_pads(GstMjrArchiveDemux *demux) {
+	if(demux->no_more_pads)
+		return;
+	demux->no_more_pads = TRUE;
+	gst_element_no_more_pads(GST_ELEMENT(demux));
+}
+
+/* Parse as much of the archive as we have in the adapter, pushing data
+ * on the source pads as we find it */
+static GstFlowReturn gst_mjr_archive_demux_process(GstMjrArchiveDemux *demux) {
+	GstFlowReturn ret = GST_FLOW_OK;
+	while(ret == GST_FLOW_OK) {
+		gsize available = gst_adapter_available(demux->adapter);
+		if(demux->state == GST_MJR_ARCHIVE_DEMUX_HEADER) {
+			if(available < GST_MJR_ARCHIVE_HEADER_SIZE)
+				break;
+			const char *data = gst_adapter_map(demux->adapter, GST_MJR_ARCHIVE_HEADER_SIZE);
+			gboolean valid = gst_mjr_archive_check_header(data);
+			gst_adapter_unmap(demux->adapter);
+			if(!valid) {
+				GST_ELEMENT_ERROR(demux, STREAM, DEMUX, (NULL), ("Not a session archive"));
+				return GST_FLOW_ERROR;
+			}
+			gst_adapter_flush(demux->adapter, GST_MJR_ARCHIVE_HEADER_SIZE);
+			demux->state = GST_MJR_ARCHIVE_DEMUX_SEGMENT;
+		} else if(demux->state == GST_MJR_ARCHIVE_DEMUX_SEGMENT) {
+			if(available < GST_MJR_ARCHIVE_SEGMENT_SIZE)
+				break;
+			const char *data = gst_adapter_map(demux->adapter, GST_MJR_ARCHIVE_SEGMENT_SIZE);
+			gboolean toc = FALSE;
+			gboolean valid = gst_mjr_archive_parse_segment(data,
+				&demux->segment_id, &demux->segment_left, &toc);
+			gst_adapter_unmap(demux->adapter);
+			if(toc) {
+				/* No more segments, what's left is the table of contents */
+				demux->state = GST_MJR_ARCHIVE_DEMUX_TOC;
+				gst_mjr_archive_demux_no_more_pads(demux);
+				break;
+			}
+			if(!valid) {
+				GST_ELEMENT_ERROR(demux, STREAM, DEMUX, (NULL), ("Invalid segment in session archive"));
+				return GST_FLOW_ERROR;
+			}
+			gst_adapter_flush(demux->adapter, GST_MJR_ARCHIVE_SEGMENT_SIZE);
+			demux->state = GST_MJR_ARCHIVE_DEMUX_DATA;
+		} else if(demux->state == GST_MJR_ARCHIVE_DEMUX_DATA) {
+			if(available == 0)
+				break;
+			/* Pass along whatever we have of this segment */
+			gsize size = MIN(available, demux->segment_left);
+			gst_mjr_archive_demux_output *output = gst_mjr_archive_demux_get_output(demux,
+				demux->segment_id, NULL);
+			GstBuffer *outbuf = gst_adapter_take_buffer(demux->adapter, size);
+			GST_BUFFER_OFFSET(outbuf) = output->size;
+			output->size += size;
+			demux->segment_left -= size;
+			if(demux->segment_left == 0)
+				demux->state = GST_MJR_ARCHIVE_DEMUX_SEGMENT;
+			ret = gst_pad_push(output->srcpad, outbuf);
+			ret = gst_flow_combiner_update_pad_flow(demux->flowcombiner, output->srcpad, ret);
+		} else {
+			/* Table of contents, we'll parse it at the end */
+			break;
+		}
+	}
+	return ret;
+}
+
+/* We're done: check the table of contents, and end all streams */
+static void gst_mjr_archive_demux_finish(GstMjrArchiveDemux *demux) {
+	if(demux->toc == NULL && demux->state == GST_MJR_ARCHIVE_DEMUX_TOC) {
+		gsize available = gst_adapter_available(demux->adapter);
+		gchar *error = NULL;
+		if(available > 0) {
+			const guint8 *data = gst_adapter_map(demux->adapter, available);
+			demux->toc = gst_mjr_archive_parse_toc(data, available, &error);
+			gst_adapter_unmap(demux->adapter);
+		}
+		if(demux->toc == NULL && !demux->silent)
+			g_print("[mjrarchivedemux] %s\n", error ? error : "Missing table of contents.");
+		g_free(error);
+	} else if(demux->toc == NULL && !demux->silent) {
+		g_print("[mjrarchivedemux] Truncated session archive, no table of contents\n");
+	}
+	guint i = 0;
+	for(i=0; demux->toc != NULL && i<demux->toc->len; i++) {
+		gst_mjr_archive_stream *stream = g_ptr_array_index(demux->toc, i);
+		gst_mjr_archive_demux_output *output = gst_mjr_archive_demux_get_output(demux,
+			stream->id, stream->name);
+		if(output->name == NULL && stream->name != NULL) {
+			/* We only know the name of the stream now */
+			output->name = g_strdup(stream->name);
+			gst_pad_push_event(output->srcpad,
+				gst_event_new_tag(gst_tag_list_new(GST_TAG_TITLE, stream->name, NULL)));
+		}
+		if(output->size != stream->size && !demux->silent) {
+			g_print("[mjrarchivedemux] Stream %" G_GUINT32_FORMAT " has %" G_GUINT64_FORMAT
+				" bytes, expected %" G_GUINT64_FORMAT "\n", stream->id, output->size, stream->size);
+		}
+	}
+	gst_mjr_archive_demux_no_more_pads(demux);
+	GHashTableIter iter;
+	gpointer value = NULL;
+	g_hash_table_iter_init(&iter, demux->outputs);
+	while(g_hash_table_iter_next(&iter, NULL, &value)) {
+		gst_mjr_archive_demux_output *output = value;
+		gst_pad_push_event(output->srcpad, gst_event_new_eos());
+	}
+	if(g_hash_table_size(demux->outputs) == 0)
+		GST_ELEMENT_ERROR(demux, STREAM, DEMUX, (NULL), ("No streams in session archive"));
+}
+
+/* Read the trailer and table of contents of the archive, in pull mode,
+ * so that we can add all pads before we start */
+static void gst_mjr_archive_demux_read_toc(GstMjrArchiveDemux *demux) {
+	gint64 size = 0;
+	demux->end = G_MAXUINT64;
+	if(!gst_pad_peer_query_duration(demux->sinkpad, GST_FORMAT_BYTES, &size) ||
+			size < GST_MJR_ARCHIVE_HEADER_SIZE + GST_MJR_ARCHIVE_TOC_SIZE + GST_MJR_ARCHIVE_TRAILER_SIZE)
+		return;
+	GstBuffer *buf = NULL;
+	if(gst_pad_pull_range(demux->sinkpad, size - GST_MJR_ARCHIVE_TRAILER_SIZE,
+			GST_MJR_ARCHIVE_TRAILER_SIZE, &buf) != GST_FLOW_OK)
+		return;
+	char trailer[GST_MJR_ARCHIVE_TRAILER_SIZE];
+	gsize read = gst_buffer_extract(buf, 0, trailer, sizeof(trailer));
+	gst_buffer_unref(buf);
+	guint64 toc_offset = 0;
+	if(read < sizeof(trailer) || !gst_mjr_archive_parse_trailer(trailer, &toc_offset) ||
+			toc_offset < GST_MJR_ARCHIVE_HEADER_SIZE ||
+			toc_offset > (guint64)size - GST_MJR_ARCHIVE_TRAILER_SIZE) {
+		if(!demux->silent)
+			g_print("[mjrarchivedemux] No trailer, reading the whole archive\n");
+		return;
+	}
+	buf = NULL;
+	if(gst_pad_pull_range(demux->sinkpad, toc_offset,
+			size - GST_MJR_ARCHIVE_TRAILER_SIZE - toc_offset, &buf) != GST_FLOW_OK)
+		return;
+	GstMapInfo map;
+	gst_buffer_map(buf, &map, GST_MAP_READ);
+	gchar *error = NULL;
+	demux->toc = gst_mjr_archive_parse_toc(map.data, map.size, &error);
+	gst_buffer_unmap(buf, &map);
+	gst_buffer_unref(buf);
+	if(demux->toc == NULL) {
+		if(!demux->silent)
+			g_print("[mjrarchivedemux] %s\n", error);
+		g_free(error);
+		return;
+	}
+	/* We know all the streams already */
+	demux->end = toc_offset;
+	guint i = 0;
+	for(i=0; i<demux->toc->len; i++) {
+		gst_mjr_archive_stream *stream = g_ptr_array_index(demux->toc, i);
+		gst_mjr_archive_demux_get_output(demux, stream->id, stream->name);
+	}
+	gst_mjr_archive_demux_no_more_pads(demux);
+	if(!demux->silent)
+		g_print("[mjrarchivedemux] Session archive has %u streams\n", demux->toc->len);
+}
+
+/* Task to read the archive, in pull mode */
+static void gst_mjr_archive_demux_loop(gpointer user_data) {
+	GstMjrArchiveDemux *demux = GST_MJR_ARCHIVE_DEMUX(user_data);
+	if(demux->end == 0)
+		gst_mjr_archive_demux_read_toc(demux);
+	GstFlowReturn ret = GST_FLOW_EOS;
+	GstBuffer *buf = NULL;
+	if(demux->offset < demux->end) {
+		ret = gst_pad_pull_range(demux->sinkpad, demux->offset,
+			MIN(GST_MJR_ARCHIVE_DEMUX_CHUNK_SIZE, demux->end - demux->offset), &buf);
+	}
+	if(ret == GST_FLOW_OK) {
+		demux->offset += gst_buffer_get_size(buf);
+		gst_adapter_push(demux->adapter, buf);
+		ret = gst_mjr_archive_demux_process(demux);
+	}
+	if(ret != GST_FLOW_OK) {
+		gst_pad_pause_task(demux->sinkpad);
+		if(ret == GST_FLOW_EOS) {
+			gst_mjr_archive_demux_finish(demux);
+		} else if(ret != GST_FLOW_FLUSHING) {
+			GST_ELEMENT_FLOW_ERROR(demux, ret);
+			gst_mjr_archive_demux_finish(demux);
+		}
+	}
+}
+
+/* Check if we can work in pull mode */
+static gboolean gst_mjr_archive_demux_sink_activate(GstPad *pad, GstObject *parent) {
+	GstQuery *query = gst_query_new_scheduling();
+	gboolean pull = FALSE;
+	if(gst_pad_peer_query(pad, query))
+		pull = gst_query_has_scheduling_mode_with_flags(query, GST_PAD_MODE_PULL, GST_SCHEDULING_FLAG_SEEKABLE);
+	gst_query_unref(query);
+	return gst_pad_activate_mode(pad, pull ? GST_PAD_MODE_PULL : GST_PAD_MODE_PUSH, TRUE);
+}
+
+/* Activate the sink pad in push or pull mode */
+static gboolean gst_mjr_archive_demux_sink_activate_mode(GstPad *pad,
+		GstObject *parent, GstPadMode mode, gboolean active) {
+	GstMjrArchiveDemux *demux = GST_MJR_ARCHIVE_DEMUX(parent);
+	if(mode == GST_PAD_MODE_PUSH) {
+		demux->pull = FALSE;
+		return TRUE;
+	} else if(mode == GST_PAD_MODE_PULL) {
+		demux->pull = active;
+		if(active)
+			return gst_pad_start_task(pad, gst_mjr_archive_demux_loop, demux, NULL);
+		return gst_pad_stop_task(pad);
+	}
+	return FALSE;
+}
+
+/* Handles sink events */
+static gboolean gst_mjr_archive_demux_sink_event(GstPad *pad, GstObject *parent, GstEvent *event) {
+	GstMjrArchiveDemux *demux = GST_MJR_ARCHIVE_DEMUX(parent);
+	switch(GST_EVENT_TYPE(event)) {
+		case GST_EVENT_EOS:
+			gst_mjr_archive_demux_finish(demux);
+			gst_event_unref(event);
+			return TRUE;
+		case GST_EVENT_STREAM_START:
+		case GST_EVENT_CAPS:
+		case GST_EVENT_SEGMENT:
+			/* Each source pad has its own */
+			gst_event_unref(event);
+			return TRUE;
+		default:
+			break;
+	}
+	return gst_pad_event_default(pad, parent, event);
+}
+
+/* Chain function, in push mode */
+static GstFlowReturn gst_mjr_archive_demux_chain(GstPad *pad, GstObject *parent, GstBuffer *buf) {
+	GstMjrArchiveDemux *demux = GST_MJR_ARCHIVE_DEMUX(parent);
+	gst_adapter_push(demux->adapter, buf);
+	return gst_mjr_archive_demux_process(demux);
+}
+
+/* Register the element in the plugin */
+gboolean mjr_archive_demux_register(GstPlugin *plugin) {
+	return GST_ELEMENT_REGISTER(mjrarchivedemux, plugin);
+}
@@ -0,0 +1,486 @@
+/*
+ * GStreamer
+ * Copyright (C) 2005 Thomas Vander Stichele <thomas@apestaart.org>
+ * Copyright (C) 2005 Ronald S. Bultje <rbultje@ronald.bitfreak.net>
+ * Copyright (C) 2024 Lorenzo Miniero <lorenzo@meetecho.com>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ *
+ * Alternatively, the contents of this file may be used under the
+ * GNU Lesser General Public License Version 2.1 (the "LGPL"), in
+ * which case the following provisions apply instead of the ones
+ * mentioned above:
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 02111-1307, USA.
+ */
+
+/**
+ * SECTION:element-mjrarchivemux
+ *
+ * Bundles many MJR files (e.g., all the recordings of a session, as
+ * written by as many mjrmux instances) in a single session archive. The
+ * MJR data received on each sink pad is written in segments, and a table
+ * of contents listing all streams and their segments is written at the
+ * end: each stream, once its segments are concatenated, is exactly the
+ * MJR file that was received. Streams are named after the title tag they
+ * receive, if any, or after the sink pad they were received on otherwise.
+ *
+ * <refsect2>
+ * <title>Example launch line</title>
+ * |[
+ * gst-launch-1.0 mjrarchivemux name=a ! filesink location=session.mjra \
+ *   filesrc location=rec-sample-audio.mjr ! a.sink_0 \
+ *   filesrc location=rec-sample-video.mjr ! a.sink_1
+ * ]|
+ * </refsect2>
+ */
+
+#ifdef HAVE_CONFIG_H
+#  include <config.h>
+#endif
+
+#include <gst/gst.h>
+
+#include "gstmjrarchivemux.h"
+
+enum {
+	LAST_SIGNAL
+};
+
+enum {
+	PROP_0,
+	PROP_SILENT,
+	PROP_SEGMENT_SIZE
+};
+
+/* Pad templates: we take MJR files in and shoot a session archive out */
+static GstStaticPadTemplate srctemplate = GST_STATIC_PAD_TEMPLATE("src",
+	GST_PAD_SRC,
+	GST_PAD_ALWAYS,
+	GST_STATIC_CAPS_ANY
+);
+static GstStaticPadTemplate sinktemplate = GST_STATIC_PAD_TEMPLATE("sink_%u",
+	GST_PAD_SINK,
+	GST_PAD_REQUEST,
+	GST_STATIC_CAPS_ANY
+);
+
+#define gst_mjr_archive_mux_parent_class parent_class
+	G_DEFINE_TYPE(GstMjrArchiveMux, gst_mjr_archive_mux, GST_TYPE_ELEMENT);
+
+GST_ELEMENT_REGISTER_DEFINE(mjrarchivemux, "mjrarchivemux", GST_RANK_NONE,
+	GST_TYPE_MJR_ARCHIVE_MUX);
+
+/* Property setters/getters */
+static void gst_mjr_archive_mux_set_property(GObject *object,
+	guint prop_id, const GValue *value, GParamSpec *pspec);
+static void gst_mjr_archive_mux_get_property(GObject *object,
+	guint prop_id, GValue *value, GParamSpec *pspec);
+static void gst_mjr_archive_mux_finalize(GObject *object);
+
+/* GstElement methods */
+static GstStateChangeReturn gst_mjr_archive_mux_change_state(GstElement *element,
+	GstStateChange transition);
+static GstPad *gst_mjr_archive_mux_request_new_pad(GstElement *element,
+	GstPadTemplate *templ, const gchar *name, const GstCaps *caps);
+static void gst_mjr_archive_mux_release_pad(GstElement *element, GstPad *pad);
+
+/* Pad methods */
+static gboolean gst_mjr_archive_mux_sink_event(GstPad *pad,
+	GstObject *parent, GstEvent *event);
+static GstFlowReturn gst_mjr_archive_mux_chain(GstPad *pad,
+	GstObject *parent, GstBuffer *buf);
+
+/* Initialize the mjrarchivemux's class */
+static void gst_mjr_archive_mux_class_init(GstMjrArchiveMuxClass *klass) {
+	GObjectClass *gobject_class;
+	GstElementClass *gstelement_class;
+
+	gobject_class = (GObjectClass *)klass;
+	gstelement_class = (GstElementClass *)klass;
+
+	gobject_class->set_property = gst_mjr_archive_mux_set_property;
+	gobject_class->get_property = gst_mjr_archive_mux_get_property;
+	gobject_class->finalize = gst_mjr_archive_mux_finalize;
+
+	g_object_class_install_property(gobject_class, PROP_SILENT,
+		g_param_spec_boolean("silent", "Silent", "Don't produce verbose output",
+			TRUE, G_PARAM_READWRITE | GST_PARAM_MUTABLE_PLAYING));
+	g_object_class_install_property(gobject_class, PROP_SEGMENT_SIZE,
+		g_param_spec_uint("segment-size", "Segment size", "How much data of a stream to write in a single segment",
+			1024, GST_MJR_ARCHIVE_MAX_SEGMENT_SIZE, GST_MJR_ARCHIVE_DEFAULT_SEGMENT_SIZE,
+			G_PARAM_READWRITE | GST_PARAM_MUTABLE_READY));
+
+	gstelement_class->change_state = GST_DEBUG_FUNCPTR(gst_mjr_archive_mux_change_state);
+	gstelement_class->request_new_pad = GST_DEBUG_FUNCPTR(gst_mjr_archive_mux_request_new_pad);
+	gstelement_class->release_pad = GST_DEBUG_FUNCPTR(gst_mjr_archive_mux_release_pad);
+
+	gst_element_class_set_details_simple(gstelement_class,
+		"Janus MJR Session Archive Muxer",
+		"Codec/Muxer",
+		"Bundle many MJR recordings in a single session archive",
+		"Lorenzo Miniero <lorenzo@meetecho.com>");
+	gst_element_class_add_static_pad_template(gstelement_class, &srctemplate);
+	gst_element_class_add_static_pad_template(gstelement_class, &sinktemplate);
+}
+
+/* Free an input */
+static void gst_mjr_archive_mux_input_free(gst_mjr_archive_mux_input *input) {
+	g_byte_array_free(input->pending, TRUE);
+	g_free(input);
+}
+
+/* Initialize the new element */
+static void gst_mjr_archive_mux_init(GstMjrArchiveMux *mux) {
+	mux->silent = TRUE;
+	mux->segment_size = GST_MJR_ARCHIVE_DEFAULT_SEGMENT_SIZE;
+	g_mutex_init(&mux->mutex);
+	mux->inputs = g_ptr_array_new_with_free_func((GDestroyNotify)gst_mjr_archive_mux_input_free);
+	mux->streams = g_ptr_array_new_with_free_func((GDestroyNotify)gst_mjr_archive_stream_free);
+	mux->next_id = 0;
+	mux->started = FALSE;
+	mux->done = FALSE;
+	mux->offset = 0;
+	g_queue_init(&mux->queue);
+	mux->last_flow = GST_FLOW_OK;
+	mux->srcpad = gst_pad_new_from_static_template(&srctemplate, "src");
+	gst_pad_use_fixed_caps(mux->srcpad);
+	gst_element_add_pad(GST_ELEMENT(mux), mux->srcpad);
+}
+
+/* Property setter */
+static void gst_mjr_archive_mux_set_property(GObject *object, guint prop_id, const GValue *value, GParamSpec *pspec) {
+	GstMjrArchiveMux *mux = GST_MJR_ARCHIVE_MUX(object);
+	/* Set the specified property */
+	switch(prop_id) {
+		case PROP_SILENT:
+			mux->silent = g_value_get_boolean(value);
+			break;
+		case PROP_SEGMENT_SIZE:
+			mux->segment_size = g_value_get_uint(value);
+			break;
+		default:
+			G_OBJECT_WARN_INVALID_PROPERTY_ID(object, prop_id, pspec);
+			break;
+	}
+}
+
+/* Property getter */
+static void gst_mjr_archive_mux_get_property(GObject *object, guint prop_id, GValue *value, GParamSpec *pspec) {
+	GstMjrArchiveMux *mux = GST_MJR_ARCHIVE_MUX(object);
+	/* Get the specified property */
+	switch(prop_id) {
+		case PROP_SILENT:
+			g_value_set_boolean(value, mux->silent);
+			break;
+		case PROP_SEGMENT_SIZE:
+			g_value_set_uint(value, mux->segment_size);
+			break;
+		default:
+			G_OBJECT_WARN_INVALID_PROPERTY_ID(object, prop_id, pspec);
+			break;
+	}
+}
+
+/* Cleanup */
+static void gst_mjr_archive_mux_finalize(GObject *object) {
+	GstMjrArchiveMux *mux = GST_MJR_ARCHIVE_MUX(object);
+	g_ptr_array_free(mux->inputs, TRUE);
+	g_ptr_array_free(mux->streams, TRUE);
+	g_queue_clear_full(&mux->queue, (GDestroyNotify)gst_mini_object_unref);
+	g_mutex_clear(&mux->mutex);
+	G_OBJECT_CLASS(parent_class)->finalize(object);
+}
+
+/* Reset the archive, keeping the inputs we have */
+static void gst_mjr_archive_mux_reset(GstMjrArchiveMux *mux) {
+	g_mutex_lock(&mux->mutex);
+	/* Streams of pads that were released are forgotten */
+	GPtrArray *streams = g_ptr_array_new_with_free_func((GDestroyNotify)gst_mjr_archive_stream_free);
+	guint i = 0;
+	for(i=0; i<mux->inputs->len; i++) {
+		gst_mjr_archive_mux_input *input = g_ptr_array_index(mux->inputs, i);
+		input->stream = gst_mjr_archive_stream_new(input->stream->id, input->stream->name);
+		g_ptr_array_add(streams, input->stream);
+		g_byte_array_set_size(input->pending, 0);
+		input->eos = FALSE;
+	}
+	g_ptr_array_free(mux->streams, TRUE);
+	mux->streams = streams;
+	mux->started = FALSE;
+	mux->done = FALSE;
+	mux->offset = 0;
+	g_queue_clear_full(&mux->queue, (GDestroyNotify)gst_mini_object_unref);
+	mux->last_flow = GST_FLOW_OK;
+	g_mutex_unlock(&mux->mutex);
+}
+
+/* Handle state changes */
+static GstStateChangeReturn gst_mjr_archive_mux_change_state(GstElement *element, GstStateChange transition) {
+	GstMjrArchiveMux *mux = GST_MJR_ARCHIVE_MUX(element);
+	if(transition == GST_STATE_CHANGE_READY_TO_PAUSED)
+		gst_mjr_archive_mux_reset(mux);
+	return GST_ELEMENT_CLASS(parent_class)->change_state(element, transition);
+}
+
+/* Create a new sink pad, and the stream it will feed */
+static GstPad *gst_mjr_archive_mux_request_new_pad(GstElement *element,
+		GstPadTemplate *templ, const gchar *name, const GstCaps *caps) {
+	GstMjrArchiveMux *mux = GST_MJR_ARCHIVE_MUX(element);
+	g_mutex_lock(&mux->mutex);
+	guint32 id = mux->next_id;
+	if(name != NULL && sscanf(name, "sink_%" G_GUINT32_FORMAT, &id) != 1) {
+		g_mutex_unlock(&mux->mutex);
+		return NULL;
+	}
+	guint i = 0;
+	for(i=0; i<mux->streams->len; i++) {
+		gst_mjr_archive_stream *stream = g_ptr_array_index(mux->streams, i);
+		if(stream->id == id) {
+			/* There's a stream with this ID already */
+			g_mutex_unlock(&mux->mutex);
+			return NULL;
+		}
+	}
+	if(id >= mux->next_id)
+		mux->next_id = id + 1;
+	gchar *pad_name = g_strdup_printf("sink_%" G_GUINT32_FORMAT, id);
+	GstPad *sinkpad = gst_pad_new_from_template(templ, pad_name);
+	gst_mjr_archive_mux_input *input = g_malloc0(sizeof(gst_mjr_archive_mux_input));
+	input->sinkpad = sinkpad;
+	input->stream = gst_mjr_archive_stream_new(id, pad_name);
+	input->pending = g_byte_array_new();
+	g_free(pad_name);
+	g_ptr_array_add(mux->inputs, input);
+	g_ptr_array_add(mux->streams, input->stream);
+	gst_pad_set_element_private(sinkpad, input);
+	g_mutex_unlock(&mux->mutex);
+	gst_pad_set_event_function(sinkpad,
+		GST_DEBUG_FUNCPTR(gst_mjr_archive_mux_sink_event));
+	gst_pad_set_chain_function(sinkpad,
+		GST_DEBUG_FUNCPTR(gst_mjr_archive_mux_chain));
+	gst_pad_set_active(sinkpad, TRUE);
+	gst_element_add_pad(element, sinkpad);
+	if(!mux->silent)
+		g_print("[mjrarchivemux] New stream %" G_GUINT32_FORMAT "\n", id);
+	return sinkpad;
+}
+
+/* Push the buffers and events we queued, in order: the stream lock of the
+ * source pad makes sure only one thread pushes at a time, while the lock
+ * is only held to dequeue, so that other streams are never blocked on it
+ * while a push is (e.g., while the sink is prerolling) */
+static GstFlowReturn gst_mjr_archive_mux_push_queued(GstMjrArchiveMux *mux) {
+	GST_PAD_STREAM_LOCK(mux->srcpad);
+	g_mutex_lock(&mux->mutex);
+	GstMiniObject *item = NULL;
+	while((item = g_queue_pop_head(&mux->queue)) != NULL) {
+		g_mutex_unlock(&mux->mutex);
+		GstFlowReturn res = GST_FLOW_OK;
+		if(GST_IS_BUFFER(item))
+			res = gst_pad_push(mux->srcpad, GST_BUFFER(item));
+		else
+			gst_pad_push_event(mux->srcpad, GST_EVENT(item));
+		g_mutex_lock(&mux->mutex);
+		if(res != GST_FLOW_OK)
+			mux->last_flow = res;
+	}
+	GstFlowReturn ret = mux->last_flow;
+	g_mutex_unlock(&mux->mutex);
+	GST_PAD_STREAM_UNLOCK(mux->srcpad);
+	return ret;
+}
+
+/* Queue the header of the archive, if we haven't yet (must be called with the lock) */
+static void gst_mjr_archive_mux_start(GstMjrArchiveMux *mux) {
+	if(mux->started)
+		return;
+	mux->started = TRUE;
+	gchar *stream_id = gst_pad_create_stream_id(mux->srcpad, GST_ELEMENT(mux), NULL);
+	g_queue_push_tail(&mux->queue, gst_event_new_stream_start(stream_id));
+	g_free(stream_id);
+	GstSegment segment;
+	gst_segment_init(&segment, GST_FORMAT_BYTES);
+	g_queue_push_tail(&mux->queue, gst_event_new_segment(&segment));
+	GstBuffer *outbuf = gst_buffer_new_memdup("MJRA0001", GST_MJR_ARCHIVE_HEADER_SIZE);
+	GST_BUFFER_OFFSET(outbuf) = 0;
+	mux->offset = GST_MJR_ARCHIVE_HEADER_SIZE;
+	g_queue_push_tail(&mux->queue, outbuf);
+}
+
+/* Queue a segment with (part of) the pending data of an input (must be called with the lock) */
+static void gst_mjr_archive_mux_queue_segment(GstMjrArchiveMux *mux,
+		gst_mjr_archive_mux_input *input, guint length) {
+	gst_mjr_archive_mux_start(mux);
+	if(length == 0)
+		return;
+	GstBuffer *outbuf = gst_buffer_new_allocate(NULL, GST_MJR_ARCHIVE_SEGMENT_SIZE + length, NULL);
+	GstMapInfo map;
+	gst_buffer_map(outbuf, &map, GST_MAP_WRITE);
+	gst_mjr_archive_write_segment((char *)map.data, input->stream->id, length);
+	memcpy(map.data + GST_MJR_ARCHIVE_SEGMENT_SIZE, input->pending->data, length);
+	gst_buffer_unmap(outbuf, &map);
+	g_byte_array_remove_range(input->pending, 0, length);
+	/* Keep track of where the segment is, for the table of contents */
+	gst_mjr_archive_segment segment;
+	segment.offset = mux->offset + GST_MJR_ARCHIVE_SEGMENT_SIZE;
+	segment.length = length;
+	g_array_append_val(input->stream->segments, segment);
+	input->stream->size += length;
+	GST_BUFFER_OFFSET(outbuf) = mux->offset;
+	mux->offset += GST_MJR_ARCHIVE_SEGMENT_SIZE + length;
+	g_queue_push_tail(&mux->queue, outbuf);
+}
+
+/* An input is done: queue what's left, and if all inputs are done, queue
+ * the table of contents and the end of the stream (must be called with the lock) */
+static void gst_mjr_archive_mux_input_done(GstMjrArchiveMux *mux, gst_mjr_archive_mux_input *input) {
+	if(input->eos)
+		return;
+	input->eos = TRUE;
+	if(!mux->done && input->pending->len > 0)
+		gst_mjr_archive_mux_queue_segment(mux, input, input->pending->len);
+	guint i = 0;
+	for(i=0; i<mux->inputs->len; i++) {
+		gst_mjr_archive_mux_input *other = g_ptr_array_index(mux->inputs, i);
+		if(!other->eos)
+			return;
+	}
+	if(mux->done)
+		return;
+	mux->done = TRUE;
+	gst_mjr_archive_mux_start(mux);
+	GByteArray *toc = gst_mjr_archive_write_toc(mux->streams, mux->offset);
+	GstBuffer *outbuf = gst_buffer_new_wrapped(toc->data, toc->len);
+	GST_BUFFER_OFFSET(outbuf) = mux->offset;
+	mux->offset += toc->len;
+	g_byte_array_free(toc, FALSE);
+	g_queue_push_tail(&mux->queue, outbuf);
+	g_queue_push_tail(&mux->queue, gst_event_new_eos());
+	if(!mux->silent) {
+		g_print("[mjrarchivemux] Wrote %u streams (%" G_GUINT64_FORMAT " bytes)\n",
+			mux->streams->len, mux->offset);
+	}
+}
+
+/* A sink pad is being removed */
+static void gst_mjr_archive_mux_release_pad(GstElement *element, GstPad *pad) {
+	GstMjrArchiveMux *mux = GST_MJR_ARCHIVE_MUX(element);
+	g_mutex_lock(&mux->mutex);
+	gst_mjr_archive_mux_input *input = gst_pad_get_element_private(pad);
+	if(input != NULL) {
+		/* Whatever we received so far stays in the archive */
+		gst_mjr_archive_mux_input_done(mux, input);
+		gst_pad_set_element_private(pad, NULL);
+		g_ptr_array_remove(mux->inputs, input);
+	}
+	g_mutex_unlock(&mux->mutex);
+	gst_mjr_archive_mux_push_queued(mux);
+	gst_element_remove_pad(element, pad);
+}
+
+/* Handles sink events */
+static gboolean gst_mjr_archive_mux_sink_event(GstPad *pad, GstObject *parent, GstEvent *event) {
+	GstMjrArchiveMux *mux = GST_MJR_ARCHIVE_MUX(parent);
+	gst_mjr_archive_mux_input *input = gst_pad_get_element_private(pad);
+	switch(GST_EVENT_TYPE(event)) {
+		case GST_EVENT_TAG: {
+			/* Use the title as the name of the stream, if there is one */
+			GstTagList *tags = NULL;
+			gchar *title = NULL;
+			gst_event_parse_tag(event, &tags);
+			if(gst_tag_list_get_string(tags, GST_TAG_TITLE, &title)) {
+				g_mutex_lock(&mux->mutex);
+				g_free(input->stream->name);
+				input->stream->name = title;
+				g_mutex_unlock(&mux->mutex);
+			}
+			gst_event_unref(event);
+			return TRUE;
+		}
+		case GST_EVENT_EOS: {
+			/* Write what's left of this stream, and if it was the last one,
+			 * the table of contents too, and end the archive */
+			g_mutex_lock(&mux->mutex);
+			gst_mjr_archive_mux_input_done(mux, input);
+			g_mutex_unlock(&mux->mutex);
+			gst_event_unref(event);
+			gst_mjr_archive_mux_push_queued(mux);
+			return TRUE;
+		}
+		case GST_EVENT_STREAM_START:
+		case GST_EVENT_CAPS:
+		case GST_EVENT_SEGMENT:
+		case GST_EVENT_FLUSH_START:
+		case GST_EVENT_FLUSH_STOP:
+			/* We send our own, or don't care */
+			gst_event_unref(event);
+			return TRUE;
+		default:
+			break;
+	}
+	return gst_pad_event_default(pad, parent, event);
+}
+
+/* Chain function, where we write the data we receive in segments */
+static GstFlowReturn gst_mjr_archive_mux_chain(GstPad *pad, GstObject *parent, GstBuffer *buf) {
+	GstMjrArchiveMux *mux = GST_MJR_ARCHIVE_MUX(parent);
+	gst_mjr_archive_mux_input *input = gst_pad_get_element_private(pad);
+	g_mutex_lock(&mux->mutex);
+	if(mux->done || input->eos) {
+		g_mutex_unlock(&mux->mutex);
+		gst_buffer_unref(buf);
+		return GST_FLOW_EOS;
+	}
+	if(mux->last_flow != GST_FLOW_OK) {
+		/* Pushing failed already, don't queue anything else */
+		GstFlowReturn ret = mux->last_flow;
+		g_mutex_unlock(&mux->mutex);
+		gst_buffer_unref(buf);
+		return ret;
+	}
+	GstMapInfo map;
+	gst_buffer_map(buf, &map, GST_MAP_READ);
+	g_byte_array_append(input->pending, map.data, map.size);
+	gst_buffer_unmap(buf, &map);
+	gst_buffer_unref(buf);
+	while(input->pending->len >= mux->segment_size)
+		gst_mjr_archive_mux_queue_segment(mux, input, mux->segment_size);
+	g_mutex_unlock(&mux->mutex);
+	/* Push what we queued (and what other streams did in the meanwhile) */
+	return gst_mjr_archive_mux_push_queued(mux);
+}
+
+/* Register the element in the plugin */
+gboolean mjr_archive_mux_register(GstPlugin *plugin) {
+	return GST_ELEMENT_REGISTER(mjrarchivemux, plugin);
+}
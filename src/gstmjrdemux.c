@@ -62,8 +62,6 @@
 
 #include <gst/gst.h>
 
-#include <json-glib/json-glib.h>
-
 #include "gstmjrdemux.h"
 #include "gstmjrutils.h"
 
@@ -75,9 +73,24 @@ enum {
 	PROP_0,
 	PROP_SILENT,
 	PROP_SSRC,
-	PROP_RANDOM_SSRC
+	PROP_RANDOM_SSRC,
+	PROP_LOOP,
+	PROP_QOS,
+	PROP_MAX_SPATIAL_LAYER,
+	PROP_MAX_TEMPORAL_LAYER,
+	PROP_REFERENCE_TIMESTAMPS,
+	PROP_RING_SIZE
 };
 
+/* How late downstream must be before we start skipping to the next keyframe */
+#define GST_MJR_DEMUX_QOS_LATENESS	(40 * GST_MSECOND)
+/* How much of a record we look at, when looking for a keyframe */
+#define GST_MJR_DEMUX_PEEK_SIZE	64
+/* Initial size of the buffer we read headers and packets to */
+#define GST_MJR_DEMUX_BUFFER_SIZE	1500
+/* How many buffers/events the push task gets from the ring at most in one go */
+#define GST_MJR_DEMUX_PUSH_BATCH	32
+
 /* Pad templates: we take buffers in and shoot RTP out */
 static GstStaticPadTemplate srctemplate = GST_STATIC_PAD_TEMPLATE("src",
 	GST_PAD_SRC,
@@ -96,16 +109,30 @@ static GstStaticPadTemplate sinktemplate = GST_STATIC_PAD_TEMPLATE("sink",
 GST_ELEMENT_REGISTER_DEFINE(mjrdemux, "mjrdemux", GST_RANK_NONE,
 	GST_TYPE_MJR_DEMUX);
 
-/* Property setters/getters: currently unused */
+/* Property setters/getters */
 static void gst_mjr_demux_set_property(GObject *object,
 	guint prop_id, const GValue *value, GParamSpec *pspec);
 static void gst_mjr_demux_get_property(GObject *object,
 	guint prop_id, GValue *value, GParamSpec *pspec);
+static void gst_mjr_demux_finalize(GObject *object);
 
-/* Chain function, where we'll process the MJR buffers */
+/* State changes */
+static GstStateChangeReturn gst_mjr_demux_change_state(GstElement *element,
+	GstStateChange transition);
+
+/* Pad events and chain function, where we'll process the MJR buffers */
+static gboolean gst_mjr_demux_sink_event(GstPad *pad,
+	GstObject *parent, GstEvent *event);
+static gboolean gst_mjr_demux_src_event(GstPad *pad,
+	GstObject *parent, GstEvent *event);
 static GstFlowReturn gst_mjr_demux_chain(GstPad *pad,
 	GstObject *parent, GstBuffer *buf);
 
+/* Task to replay packets from memory, when looping */
+static void gst_mjr_demux_loop(gpointer user_data);
+/* Task to push what the chain function queued in the ring, if any */
+static void gst_mjr_demux_push_loop(gpointer user_data);
+
 /* Initialize the mjrdemux's class */
 static void gst_mjr_demux_class_init(GstMjrDemuxClass *klass) {
 	GObjectClass *gobject_class;
@@ -116,6 +143,7 @@ static void gst_mjr_demux_class_init(GstMjrDemuxClass *klass) {
 
 	gobject_class->set_property = gst_mjr_demux_set_property;
 	gobject_class->get_property = gst_mjr_demux_get_property;
+	gobject_class->finalize = gst_mjr_demux_finalize;
 
 	g_object_class_install_property (gobject_class, PROP_SILENT,
 		g_param_spec_boolean ("silent", "Silent", "Don't produce verbose output",
@@ -126,6 +154,26 @@ static void gst_mjr_demux_class_init(GstMjrDemuxClass *klass) {
 	g_object_class_install_property (gobject_class, PROP_RANDOM_SSRC,
 		g_param_spec_boolean("randomize-ssrc", "Random SSRC", "Use a random SSRC for the outgoing RTP traffic",
 			FALSE, G_PARAM_WRITABLE));
+	g_object_class_install_property (gobject_class, PROP_LOOP,
+		g_param_spec_boolean("loop", "Loop", "Replay the recording in a loop, from memory, as a continuous RTP stream",
+			FALSE, G_PARAM_READWRITE | GST_PARAM_MUTABLE_READY));
+	g_object_class_install_property (gobject_class, PROP_QOS,
+		g_param_spec_boolean("qos", "QoS", "Skip to the next keyframe when downstream reports it's late",
+			TRUE, G_PARAM_READWRITE | GST_PARAM_MUTABLE_PLAYING));
+	g_object_class_install_property (gobject_class, PROP_MAX_SPATIAL_LAYER,
+		g_param_spec_int("max-spatial-layer", "Max spatial layer", "Drop packets of higher spatial layers, for VP9 and AV1 (-1=keep all)",
+			-1, 7, -1, G_PARAM_READWRITE | GST_PARAM_MUTABLE_PLAYING));
+	g_object_class_install_property (gobject_class, PROP_MAX_TEMPORAL_LAYER,
+		g_param_spec_int("max-temporal-layer", "Max temporal layer", "Drop packets of higher temporal layers, for VP8, VP9 and AV1 (-1=keep all)",
+			-1, 7, -1, G_PARAM_READWRITE | GST_PARAM_MUTABLE_PLAYING));
+	g_object_class_install_property (gobject_class, PROP_REFERENCE_TIMESTAMPS,
+		g_param_spec_boolean("reference-timestamps", "Reference timestamps", "Add the wallclock time each packet was received at to buffers, as a reference timestamp",
+			TRUE, G_PARAM_READWRITE | GST_PARAM_MUTABLE_PLAYING));
+	g_object_class_install_property (gobject_class, PROP_RING_SIZE,
+		g_param_spec_uint("ring-size", "Ring size", "Push packets from a separate thread, through a ring of this many buffers (0=push from the parsing thread; ignored when looping)",
+			0, 65536, 0, G_PARAM_READWRITE | GST_PARAM_MUTABLE_READY));
+
+	gstelement_class->change_state = GST_DEBUG_FUNCPTR(gst_mjr_demux_change_state);
 
 	gst_element_class_set_details_simple(gstelement_class,
 		"Janus MJR Demuxer",
@@ -142,24 +190,66 @@ static void gst_mjr_demux_init(GstMjrDemux *demux) {
 	demux->silent = TRUE;
 	demux->state = gst_mjr_demux_state_waiting_header;
 	demux->legacy = FALSE;
+	demux->compressed = FALSE;
 	demux->video = FALSE;
 	demux->codec = 0;
 	demux->ssrc = 0;
+	demux->buffer_size = GST_MJR_DEMUX_BUFFER_SIZE;
+	demux->buffer = g_malloc(demux->buffer_size);
 	demux->reading = 0;
 	demux->offset = 0;
 	demux->pending = 0;
 	demux->created = 0;
 	demux->written = 0;
+	memset(&demux->block, 0, sizeof(demux->block));
+	demux->block_data = g_byte_array_new();
+	demux->block_records = g_byte_array_new();
 	demux->initialized = FALSE;
-	demux->last_ts = 0;
+	gst_mjr_timestamp_reset(&demux->rtp_ts);
 	demux->timestamp = 0;
 	demux->out_ssrc = 0;
+	demux->have_group_id = FALSE;
+	demux->group_id = 0;
+	demux->payload_type = -1;
+	demux->reference_timestamps = TRUE;
+	demux->reference_caps = gst_caps_new_empty_simple("timestamp/x-unix");
+	demux->received = 0;
+	demux->max_spatial = -1;
+	demux->max_temporal = -1;
+	demux->dd_ext_id = 0;
+	demux->snaplen = 0;
+	memset(&demux->dd, 0, sizeof(demux->dd));
+	demux->layer_dropped = 0;
+	demux->qos = TRUE;
+	demux->qos_skipping = FALSE;
+	demux->qos_discont = FALSE;
+	demux->qos_skipped = 0;
+	demux->packet_len = 0;
+	demux->skip = 0;
+	demux->loop = FALSE;
+	demux->loop_full = FALSE;
+	demux->loop_arena = NULL;
+	demux->loop_data = NULL;
+	demux->loop_packets = g_array_new(FALSE, FALSE, sizeof(gst_mjr_packet));
+	gst_mjr_timestamp_reset(&demux->loop_ts);
+	demux->loop_index = 0;
+	demux->loop_iteration = 0;
+	demux->loop_seq_span = 0;
+	demux->loop_ts_span = 0;
+	demux->ring_size = 0;
+	demux->ring = NULL;
+	demux->push_task = FALSE;
+	demux->push_flow = GST_FLOW_OK;
 	/* Setup pads and chain */
 	demux->sinkpad = gst_pad_new_from_static_template(&sinktemplate, "sink");
+	gst_pad_set_event_function(demux->sinkpad,
+		GST_DEBUG_FUNCPTR(gst_mjr_demux_sink_event));
 	gst_pad_set_chain_function(demux->sinkpad,
 		GST_DEBUG_FUNCPTR(gst_mjr_demux_chain));
 	gst_element_add_pad(GST_ELEMENT(demux), demux->sinkpad);
 	demux->srcpad = gst_pad_new_from_static_template(&srctemplate, "src");
+	gst_pad_set_event_function(demux->srcpad,
+		GST_DEBUG_FUNCPTR(gst_mjr_demux_src_event));
 	gst_element_add_pad(GST_ELEMENT(demux), demux->srcpad);
 }
 
@@ -177,6 +267,28 @@ static void gst_mjr_demux_set_property(GObject *object, guint prop_id, const GVa
 		case PROP_RANDOM_SSRC:
 			demux->out_ssrc = g_random_int();
 			break;
+		case PROP_LOOP:
+			demux->loop = g_value_get_boolean(value);
+			break;
+		case PROP_QOS:
+			GST_OBJECT_LOCK(demux);
+			demux->qos = g_value_get_boolean(value);
+			if(!demux->qos)
+				demux->qos_skipping = FALSE;
+			GST_OBJECT_UNLOCK(demux);
+			break;
+		case PROP_MAX_SPATIAL_LAYER:
+			demux->max_spatial = g_value_get_int(value);
+			break;
+		case PROP_MAX_TEMPORAL_LAYER:
+			demux->max_temporal = g_value_get_int(value);
+			break;
+		case PROP_REFERENCE_TIMESTAMPS:
+			demux->reference_timestamps = g_value_get_boolean(value);
+			break;
+		case PROP_RING_SIZE:
+			demux->ring_size = g_value_get_uint(value);
+			break;
 		default:
 			G_OBJECT_WARN_INVALID_PROPERTY_ID(object, prop_id, pspec);
 			break;
@@ -194,23 +306,610 @@ static void gst_mjr_demux_get_property(GObject *object, guint prop_id, GValue *v
 		case PROP_SSRC:
 			g_value_set_uint(value, demux->out_ssrc);
 			break;
+		case PROP_LOOP:
+			g_value_set_boolean(value, demux->loop);
+			break;
+		case PROP_QOS:
+			g_value_set_boolean(value, demux->qos);
+			break;
+		case PROP_MAX_SPATIAL_LAYER:
+			g_value_set_int(value, demux->max_spatial);
+			break;
+		case PROP_MAX_TEMPORAL_LAYER:
+			g_value_set_int(value, demux->max_temporal);
+			break;
+		case PROP_REFERENCE_TIMESTAMPS:
+			g_value_set_boolean(value, demux->reference_timestamps);
+			break;
+		case PROP_RING_SIZE:
+			g_value_set_uint(value, demux->ring_size);
+			break;
 		default:
 			G_OBJECT_WARN_INVALID_PROPERTY_ID(object, prop_id, pspec);
 			break;
 	}
 }
 
+/* Get rid of the packets we stored in memory for looping, if any */
+static void gst_mjr_demux_loop_reset(GstMjrDemux *demux) {
+	if(demux->loop_arena != NULL) {
+		g_byte_array_unref(demux->loop_arena);
+		demux->loop_arena = NULL;
+	}
+	if(demux->loop_data != NULL) {
+		g_bytes_unref(demux->loop_data);
+		demux->loop_data = NULL;
+	}
+	g_array_set_size(demux->loop_packets, 0);
+	demux->loop_full = FALSE;
+	gst_mjr_timestamp_reset(&demux->loop_ts);
+	demux->loop_index = 0;
+	demux->loop_iteration = 0;
+	demux->loop_seq_span = 0;
+	demux->loop_ts_span = 0;
+}
+
+/* Cleanup */
+static void gst_mjr_demux_finalize(GObject *object) {
+	GstMjrDemux *demux = GST_MJR_DEMUX(object);
+	gst_mjr_demux_loop_reset(demux);
+	g_array_free(demux->loop_packets, TRUE);
+	g_byte_array_free(demux->block_data, TRUE);
+	g_byte_array_free(demux->block_records, TRUE);
+	gst_caps_unref(demux->reference_caps);
+	g_free(demux->buffer);
+	G_OBJECT_CLASS(parent_class)->finalize(object);
+}
+
+/* State changes */
+static GstStateChangeReturn gst_mjr_demux_change_state(GstElement *element, GstStateChange transition) {
+	GstMjrDemux *demux = GST_MJR_DEMUX(element);
+	switch(transition) {
+		case GST_STATE_CHANGE_READY_TO_PAUSED:
+			if(demux->ring_size > 0 && !demux->loop) {
+				/* Looping has its own task already, so we only use the ring when not looping */
+				demux->ring = gst_mjr_ring_new(demux->ring_size);
+				demux->push_task = FALSE;
+				demux->push_flow = GST_FLOW_OK;
+			}
+			break;
+		case GST_STATE_CHANGE_PAUSED_TO_READY:
+			/* Wake up the push task, if it's waiting, so that it can be stopped */
+			if(demux->ring != NULL)
+				gst_mjr_ring_set_flushing(demux->ring, TRUE);
+			break;
+		default:
+			break;
+	}
+	GstStateChangeReturn ret = GST_ELEMENT_CLASS(parent_class)->change_state(element, transition);
+	if(ret == GST_STATE_CHANGE_FAILURE)
+		return ret;
+	switch(transition) {
+		case GST_STATE_CHANGE_PAUSED_TO_READY:
+			/* The pads are inactive now, so the loop and push tasks are stopped too */
+			gst_mjr_demux_loop_reset(demux);
+			if(demux->ring != NULL) {
+				gst_mjr_ring_free(demux->ring, (GDestroyNotify)gst_mini_object_unref);
+				demux->ring = NULL;
+			}
+			break;
+		default:
+			break;
+	}
+	return ret;
+}
+
+/* Store a packet in memory, so that we can loop it later */
+static void gst_mjr_demux_loop_store(GstMjrDemux *demux, const char *data, guint16 len) {
+	if(len < 12) {
+		/* Too short to be an RTP packet */
+		return;
+	}
+	if(demux->loop_data != NULL || demux->loop_full) {
+		/* We're replaying already, or we can't store any more packets */
+		return;
+	}
+	if(demux->loop_arena == NULL)
+		demux->loop_arena = g_byte_array_new();
+	if(demux->loop_arena->len + len > GST_MJR_PACKETS_MAX_SIZE) {
+		/* We'll only loop the packets we have so far */
+		demux->loop_full = TRUE;
+		GST_ELEMENT_WARNING(demux, RESOURCE, NO_SPACE_LEFT, (NULL),
+			("Recording too large to be kept in memory, only the first %u packets (%u bytes) will be looped",
+			demux->loop_packets->len, demux->loop_arena->len));
+		return;
+	}
+	gst_mjr_rtp *rtp = (gst_mjr_rtp *)data;
+	gst_mjr_packet packet;
+	packet.offset = demux->loop_arena->len;
+	packet.len = len;
+	packet.ext_ts = gst_mjr_timestamp_update(&demux->loop_ts, g_ntohl(rtp->timestamp));
+	g_byte_array_append(demux->loop_arena, (const guint8 *)data, len);
+	g_array_append_val(demux->loop_packets, packet);
+}
+
+/* We've read the whole recording: start replaying it from memory */
+static gboolean gst_mjr_demux_loop_start(GstMjrDemux *demux) {
+	/* Figure out how much we need to shift sequence numbers and timestamps
+	 * at each iteration, to make the RTP stream continuous */
+	gst_mjr_packets_get_spans(demux->loop_arena->data, demux->loop_packets,
+		gst_mjr_get_clock_rate(demux->codec), &demux->loop_seq_span, &demux->loop_ts_span);
+	/* Freeze the packets, so that buffers can reference them directly */
+	demux->loop_data = g_byte_array_free_to_bytes(demux->loop_arena);
+	demux->loop_arena = NULL;
+	demux->loop_index = 0;
+	demux->loop_iteration = 1;
+	if(!demux->silent) {
+		g_print("[mjrdemux] Looping %u packets (seq span %" G_GUINT16_FORMAT ", ts span %" G_GINT64_FORMAT ")\n",
+			demux->loop_packets->len, demux->loop_seq_span, demux->loop_ts_span);
+	}
+	return gst_pad_start_task(demux->srcpad, gst_mjr_demux_loop, demux, NULL);
+}
+
+/* Task to replay packets from memory, when looping */
+static void gst_mjr_demux_loop(gpointer user_data) {
+	GstMjrDemux *demux = GST_MJR_DEMUX(user_data);
+	gst_mjr_packet *packet = &g_array_index(demux->loop_packets, gst_mjr_packet, demux->loop_index);
+	gint64 ts_shift = demux->loop_iteration * demux->loop_ts_span;
+	GstBuffer *outbuf = gst_mjr_packet_to_buffer(demux->loop_data, packet,
+		demux->loop_iteration * demux->loop_seq_span, ts_shift, demux->out_ssrc);
+	GST_BUFFER_TIMESTAMP(outbuf) = gst_mjr_timestamp_to_time(packet->ext_ts + ts_shift,
+		gst_mjr_get_clock_rate(demux->codec));
+	if(!demux->silent) {
+		g_print("[mjrdemux][RTP][loop %" G_GUINT64_FORMAT "] Packet %u/%u, pts=%" G_GUINT64_FORMAT "\n",
+			demux->loop_iteration, demux->loop_index + 1, demux->loop_packets->len, GST_BUFFER_TIMESTAMP(outbuf));
+	}
+	GstFlowReturn ret = gst_pad_push(demux->srcpad, outbuf);
+	if(ret != GST_FLOW_OK) {
+		if(ret != GST_FLOW_FLUSHING && ret != GST_FLOW_EOS)
+			GST_ELEMENT_FLOW_ERROR(demux, ret);
+		if(ret == GST_FLOW_EOS)
+			gst_pad_push_event(demux->srcpad, gst_event_new_eos());
+		gst_pad_pause_task(demux->srcpad);
+		return;
+	}
+	/* Move to the next packet, and to the next iteration if needed */
+	demux->loop_index++;
+	if(demux->loop_index == demux->loop_packets->len) {
+		demux->loop_index = 0;
+		demux->loop_iteration++;
+	}
+}
+
+/* Queue a buffer or an event in the ring, starting the push task if needed */
+static GstFlowReturn gst_mjr_demux_ring_push(GstMjrDemux *demux, GstMiniObject *item) {
+	if(!demux->push_task) {
+		demux->push_task = TRUE;
+		gst_pad_start_task(demux->srcpad, gst_mjr_demux_push_loop, demux, NULL);
+	}
+	if(!gst_mjr_ring_push(demux->ring, item)) {
+		/* We're flushing, or the push task stopped because of an error */
+		gst_mini_object_unref(item);
+		GstFlowReturn ret = g_atomic_int_get(&demux->push_flow);
+		return ret != GST_FLOW_OK ? ret : GST_FLOW_FLUSHING;
+	}
+	return GST_FLOW_OK;
+}
+
+/* Pass a buffer along, either directly or via the ring */
+static GstFlowReturn gst_mjr_demux_push_buffer(GstMjrDemux *demux, GstBuffer *buffer) {
+	if(demux->ring == NULL)
+		return gst_pad_push(demux->srcpad, buffer);
+	return gst_mjr_demux_ring_push(demux, GST_MINI_OBJECT_CAST(buffer));
+}
+
+/* Pass an event along, either directly or via the ring */
+static gboolean gst_mjr_demux_push_event(GstMjrDemux *demux, GstEvent *event) {
+	if(demux->ring == NULL)
+		return gst_pad_push_event(demux->srcpad, event);
+	return gst_mjr_demux_ring_push(demux, GST_MINI_OBJECT_CAST(event)) == GST_FLOW_OK;
+}
+
+/* Task to push what the chain function queued in the ring: consecutive
+ * buffers are pushed as a single list, events in between them in order */
+static void gst_mjr_demux_push_loop(gpointer user_data) {
+	GstMjrDemux *demux = GST_MJR_DEMUX(user_data);
+	gpointer items[GST_MJR_DEMUX_PUSH_BATCH];
+	guint count = gst_mjr_ring_pop(demux->ring, items, GST_MJR_DEMUX_PUSH_BATCH);
+	if(count == 0) {
+		/* We're flushing or shutting down */
+		gst_pad_pause_task(demux->srcpad);
+		return;
+	}
+	GstFlowReturn ret = GST_FLOW_OK;
+	GstBufferList *list = NULL;
+	gboolean eos = FALSE;
+	guint i = 0;
+	for(i = 0; i < count; i++) {
+		if(ret != GST_FLOW_OK) {
+			/* Something went wrong, get rid of the rest */
+			gst_mini_object_unref(GST_MINI_OBJECT_CAST(items[i]));
+			continue;
+		}
+		if(GST_IS_BUFFER(items[i])) {
+			if(list == NULL)
+				list = gst_buffer_list_new_sized(count - i);
+			gst_buffer_list_add(list, GST_BUFFER_CAST(items[i]));
+			continue;
+		}
+		/* It's an event: push the buffers that came before it first */
+		if(list != NULL) {
+			ret = gst_pad_push_list(demux->srcpad, list);
+			list = NULL;
+			if(ret != GST_FLOW_OK) {
+				gst_mini_object_unref(GST_MINI_OBJECT_CAST(items[i]));
+				continue;
+			}
+		}
+		GstEvent *event = GST_EVENT_CAST(items[i]);
+		if(GST_EVENT_TYPE(event) == GST_EVENT_EOS)
+			eos = TRUE;
+		gst_pad_push_event(demux->srcpad, event);
+	}
+	if(list != NULL)
+		ret = gst_pad_push_list(demux->srcpad, list);
+	if(ret != GST_FLOW_OK) {
+		/* Let the chain function know, so that it stops too */
+		g_atomic_int_set(&demux->push_flow, ret);
+		gst_mjr_ring_set_flushing(demux->ring, TRUE);
+		if(ret != GST_FLOW_FLUSHING && ret != GST_FLOW_EOS)
+			GST_ELEMENT_FLOW_ERROR(demux, ret);
+		if(ret == GST_FLOW_EOS)
+			gst_pad_push_event(demux->srcpad, gst_event_new_eos());
+		gst_pad_pause_task(demux->srcpad);
+	} else if(eos) {
+		/* Nothing else will come until we're flushed */
+		gst_pad_pause_task(demux->srcpad);
+	}
+}
+
+/* Handles sink events */
+static gboolean gst_mjr_demux_sink_event(GstPad *pad, GstObject *parent, GstEvent *event) {
+	GstMjrDemux *demux = GST_MJR_DEMUX(parent);
+	switch(GST_EVENT_TYPE(event)) {
+		case GST_EVENT_EOS:
+			if(demux->loop && demux->loop_data != NULL) {
+				/* We're replaying the packets from memory already */
+				gst_event_unref(event);
+				return TRUE;
+			}
+			if(demux->loop && demux->loop_arena != NULL && demux->loop_packets->len > 0) {
+				/* Don't forward the EOS, replay the packets from memory instead */
+				gst_event_unref(event);
+				return gst_mjr_demux_loop_start(demux);
+			}
+			break;
+		case GST_EVENT_STREAM_START:
+			/* We send our own when we parse the header, but in the same group */
+			demux->have_group_id = gst_event_parse_group_id(event, &demux->group_id);
+			gst_event_unref(event);
+			return TRUE;
+		case GST_EVENT_CAPS:
+		case GST_EVENT_SEGMENT:
+			/* Upstream sends us MJR bytes, we send RTP packets in time */
+			gst_event_unref(event);
+			return TRUE;
+		case GST_EVENT_FLUSH_START:
+			if(demux->ring != NULL || demux->loop) {
+				/* Unblock the push (or loop) task and wait for it to pause */
+				if(demux->ring != NULL)
+					gst_mjr_ring_set_flushing(demux->ring, TRUE);
+				gboolean res = gst_pad_event_default(pad, parent, event);
+				gst_pad_pause_task(demux->srcpad);
+				return res;
+			}
+			break;
+		case GST_EVENT_FLUSH_STOP:
+			if(demux->ring != NULL) {
+				/* The push task is paused, so we can start from scratch */
+				gst_mjr_ring_drain(demux->ring, (GDestroyNotify)gst_mini_object_unref);
+				gst_mjr_ring_set_flushing(demux->ring, FALSE);
+				g_atomic_int_set(&demux->push_flow, GST_FLOW_OK);
+				demux->push_task = FALSE;
+			}
+			if(demux->loop) {
+				/* The loop task is paused, store the packets from scratch */
+				gst_mjr_demux_loop_reset(demux);
+			}
+			break;
+		default:
+			break;
+	}
+	if(demux->ring != NULL && GST_EVENT_IS_SERIALIZED(event) &&
+			GST_EVENT_TYPE(event) != GST_EVENT_FLUSH_STOP) {
+		/* Keep serialized events in order with the buffers we queued */
+		return gst_mjr_demux_push_event(demux, event);
+	}
+	return gst_pad_event_default(pad, parent, event);
+}
+
+/* Handles source events: we only care about QoS */
+static gboolean gst_mjr_demux_src_event(GstPad *pad, GstObject *parent, GstEvent *event) {
+	GstMjrDemux *demux = GST_MJR_DEMUX(parent);
+	if(GST_EVENT_TYPE(event) == GST_EVENT_QOS) {
+		GstQOSType type;
+		gdouble proportion = 0.0;
+		GstClockTimeDiff diff = 0;
+		GstClockTime timestamp = GST_CLOCK_TIME_NONE;
+		gst_event_parse_qos(event, &type, &proportion, &diff, &timestamp);
+		GST_OBJECT_LOCK(demux);
+		if(demux->qos && demux->video && diff > (GstClockTimeDiff)GST_MJR_DEMUX_QOS_LATENESS &&
+				!demux->qos_skipping) {
+			/* Downstream is late: there's no point in sending packets that
+			 * can't be decoded anyway, so skip to the next keyframe */
+			demux->qos_skipping = TRUE;
+			if(!demux->silent) {
+				g_print("[mjrdemux] Downstream is %" G_GINT64_FORMAT "ms late, skipping to the next keyframe\n",
+					diff / GST_MSECOND);
+			}
+		}
+		GST_OBJECT_UNLOCK(demux);
+	}
+	return gst_pad_event_default(pad, parent, event);
+}
+
+/* Check if a packet should be skipped because of QoS: we stop skipping
+ * when we find the beginning of a keyframe (which may be partial, as
+ * we may only have access to the beginning of the packet) */
+static gboolean gst_mjr_demux_qos_skip(GstMjrDemux *demux, const char *data, gsize len) {
+	GST_OBJECT_LOCK(demux);
+	gboolean skipping = demux->qos_skipping;
+	GST_OBJECT_UNLOCK(demux);
+	if(!skipping)
+		return FALSE;
+	gsize header = gst_mjr_rtp_header_size((const guint8 *)data, len);
+	if(header > 0 && gst_mjr_is_keyframe(demux->codec, (const guint8 *)data + header, len - header)) {
+		/* Keyframe, stop skipping */
+		GST_OBJECT_LOCK(demux);
+		demux->qos_skipping = FALSE;
+		GST_OBJECT_UNLOCK(demux);
+		demux->qos_discont = TRUE;
+		if(!demux->silent) {
+			g_print("[mjrdemux] Found keyframe after skipping %" G_GUINT64_FORMAT " packets\n",
+				demux->qos_skipped);
+		}
+		demux->qos_skipped = 0;
+		return FALSE;
+	}
+	demux->qos_skipped++;
+	return TRUE;
+}
+
+/* Check if a packet belongs to a layer higher than the ones we want, in
+ * which case it's dropped; if not, we fix its sequence number to account
+ * for the packets we dropped, and set the marker bit if it's the end of
+ * a frame in the highest spatial layer we're forwarding */
+static gboolean gst_mjr_demux_layer_drop(GstMjrDemux *demux, char *data, guint16 len) {
+	gint max_spatial = demux->max_spatial, max_temporal = demux->max_temporal;
+	if(max_spatial < 0 && max_temporal < 0 && demux->layer_dropped == 0)
+		return FALSE;
+	gst_mjr_rtp *rtp = (gst_mjr_rtp *)data;
+	int spatial = 0, temporal = 0;
+	gboolean end_of_frame = FALSE;
+	if(gst_mjr_get_layers(demux->codec, (const guint8 *)data, len,
+			demux->dd_ext_id, &demux->dd, &spatial, &temporal, &end_of_frame)) {
+		if((max_spatial >= 0 && spatial > max_spatial) ||
+				(max_temporal >= 0 && temporal > max_temporal)) {
+			demux->layer_dropped++;
+			return TRUE;
+		}
+		if(max_spatial >= 0 && spatial == max_spatial && end_of_frame)
+			rtp->markerbit = 1;
+	}
+	rtp->seq_number = g_htons(g_ntohs(rtp->seq_number) - demux->layer_dropped);
+	return FALSE;
+}
+
+/* Create the caps for the source pad: the payload type is only added
+ * when we know it, that is after we get the first packet */
+static GstCaps *gst_mjr_demux_get_caps(GstMjrDemux *demux) {
+	GstCaps *caps = gst_caps_new_simple("application/x-rtp",
+		"media", G_TYPE_STRING, (demux->video ? "video" : "audio"),
+		"encoding-name", G_TYPE_STRING, gst_mjr_get_encoding_name(demux->codec),
+		"clock-rate", G_TYPE_INT, gst_mjr_get_clock_rate(demux->codec),
+		NULL);
+	if(demux->payload_type >= 0)
+		gst_caps_set_simple(caps, "payload", G_TYPE_INT, demux->payload_type, NULL);
+	return caps;
+}
+
+/* Set the caps on the source pad */
+static gboolean gst_mjr_demux_set_caps(GstMjrDemux *demux) {
+	GstCaps *caps = gst_mjr_demux_get_caps(demux);
+	gboolean res = gst_mjr_demux_push_event(demux, gst_event_new_caps(caps));
+	if(!demux->silent) {
+		char *caps_str = gst_caps_to_string(caps);
+		g_print("[mjrdemux] Caps %s set to '%s'\n", (res ? "successfully" : "NOT"), caps_str);
+		g_free(caps_str);
+	}
+	gst_caps_unref(caps);
+	return res;
+}
+
+/* We parsed the header, so we know what's in the recording: announce the
+ * stream right away, so that downstream can get ready before any packet */
+static void gst_mjr_demux_start_stream(GstMjrDemux *demux) {
+	gchar *stream_id = gst_pad_create_stream_id(demux->srcpad, GST_ELEMENT(demux), NULL);
+	GstEvent *event = gst_event_new_stream_start(stream_id);
+	if(!demux->have_group_id) {
+		demux->group_id = gst_util_group_id_next();
+		demux->have_group_id = TRUE;
+	}
+	gst_event_set_group_id(event, demux->group_id);
+	GstCaps *caps = gst_mjr_demux_get_caps(demux);
+	GstStream *stream = gst_stream_new(stream_id, caps,
+		demux->video ? GST_STREAM_TYPE_VIDEO : GST_STREAM_TYPE_AUDIO, GST_STREAM_FLAG_SELECT);
+	gst_caps_unref(caps);
+	g_free(stream_id);
+	gst_event_set_stream(event, stream);
+	gst_mjr_demux_push_event(demux, event);
+	gst_mjr_demux_set_caps(demux);
+	/* There's a single stream in MJR files, but playbin3 and decodebin3
+	 * rely on the collection to know what they're dealing with */
+	GstStreamCollection *collection = gst_stream_collection_new(NULL);
+	gst_stream_collection_add_stream(collection, stream);
+	gst_element_post_message(GST_ELEMENT(demux),
+		gst_message_new_stream_collection(GST_OBJECT(demux), collection));
+	gst_mjr_demux_push_event(demux, gst_event_new_stream_collection(collection));
+	gst_object_unref(collection);
+	/* Notify new segment */
+	GstSegment segment;
+	gst_segment_init(&segment, GST_FORMAT_TIME);
+	gst_mjr_demux_push_event(demux, gst_event_new_segment(&segment));
+	/* Finally, the tags */
+	GstTagList *tags = gst_tag_list_new(demux->video ? GST_TAG_VIDEO_CODEC : GST_TAG_AUDIO_CODEC,
+		gst_mjr_get_encoding_name(demux->codec), NULL);
+	if(!demux->legacy && demux->created > 0) {
+		GstDateTime *created = gst_date_time_new_from_unix_epoch_utc_usecs(demux->created);
+		gst_tag_list_add(tags, GST_TAG_MERGE_REPLACE, GST_TAG_DATE_TIME, created, NULL);
+		gst_date_time_unref(created);
+	}
+	gst_mjr_demux_push_event(demux, gst_event_new_tag(tags));
+}
+
+/* Make sure the buffer we read headers and packets to is large enough */
+static void gst_mjr_demux_buffer_reserve(GstMjrDemux *demux, gsize size) {
+	if(size <= demux->buffer_size)
+		return;
+	if(!demux->silent)
+		g_print("[mjrdemux] Growing the read buffer to %" G_GSIZE_FORMAT " bytes\n", size);
+	demux->buffer = g_realloc(demux->buffer, size);
+	demux->buffer_size = size;
+}
+
+/* Process an RTP packet to create a buffer to pass along */
+static GstFlowReturn gst_mjr_demux_handle_packet(GstMjrDemux *demux, char *data, guint16 len) {
+	if(demux->snaplen > 0 && len >= GST_MJR_SNAPLEN_TRAILER_SIZE) {
+		/* Get rid of the original length, we only pass along what we have */
+		len -= GST_MJR_SNAPLEN_TRAILER_SIZE;
+	}
+	if(len < 12) {
+		/* Too short to be an RTP packet, skip it */
+		return GST_FLOW_OK;
+	}
+	gst_mjr_rtp *rtp = (gst_mjr_rtp *)data;
+	if(!demux->silent) {
+		g_print("[mjrdemux][RTP] seq=%5" G_GUINT16_FORMAT ", ts=%10" G_GUINT32_FORMAT "\n",
+			g_ntohs(rtp->seq_number), g_ntohl(rtp->timestamp));
+	}
+	/* Process the RTP packet to create a buffer to pass along */
+	if(demux->ssrc == 0)
+		demux->ssrc = g_ntohl(rtp->ssrc);
+	if(g_ntohl(rtp->ssrc) != demux->ssrc) {
+		/* Ignore packet */
+	} else if(gst_mjr_demux_layer_drop(demux, data, len)) {
+		/* Layer we're not interested in, drop the packet */
+	} else {
+		if(!demux->initialized) {
+			/* Now that we know the payload type, update the caps */
+			demux->initialized = TRUE;
+			demux->payload_type = rtp->type;
+			gst_mjr_demux_set_caps(demux);
+		}
+		/* Turn timestamp in timing information */
+		/* Wrap-arounds and reordering are taken care of when unwrapping,
+		 * and there's no error accumulating as we scale the whole thing */
+		gint64 ext_ts = gst_mjr_timestamp_update(&demux->rtp_ts, g_ntohl(rtp->timestamp));
+		demux->timestamp = gst_mjr_timestamp_to_time(ext_ts, gst_mjr_get_clock_rate(demux->codec));
+		if(!demux->silent)
+			g_print("[mjrdemux][RTP] Computed timestamp: %" G_GUINT64_FORMAT "\n", demux->timestamp);
+		/* If we're looping, keep the original packet in memory */
+		if(demux->loop)
+			gst_mjr_demux_loop_store(demux, data, len);
+		/* Check if we need to overwrite the SSRC */
+		if(demux->out_ssrc)
+			rtp->ssrc = g_htonl(demux->out_ssrc);
+		/* Create a buffer and pass it along the pad */
+		GstBuffer *outbuf = gst_buffer_new_memdup(data, len);
+		GST_BUFFER_TIMESTAMP(outbuf) = demux->timestamp;
+		if(demux->reference_timestamps && !demux->legacy && demux->written > 0) {
+			/* Wallclock time of when the packet was received, so that
+			 * different recordings can be aligned downstream */
+			gst_buffer_add_reference_timestamp_meta(outbuf, demux->reference_caps,
+				(demux->written + (gint64)demux->received * 1000) * GST_USECOND, GST_CLOCK_TIME_NONE);
+		}
+		if(demux->qos_discont) {
+			/* First packet after we skipped some */
+			GST_BUFFER_FLAG_SET(outbuf, GST_BUFFER_FLAG_DISCONT);
+			demux->qos_discont = FALSE;
+		}
+		GstFlowReturn res = gst_mjr_demux_push_buffer(demux, outbuf);
+		if(res != GST_FLOW_OK) {
+			/* When using the ring, the push task already took care of this */
+			if(demux->ring == NULL) {
+				GST_ELEMENT_ERROR(demux, CORE, PAD, (NULL),
+					("Error pushing buffer to pad (%d)", res));
+			}
+			return res;
+		}
+	}
+	return GST_FLOW_OK;
+}
+
+/* Process all the records in a decompressed block */
+static GstFlowReturn gst_mjr_demux_handle_block(GstMjrDemux *demux) {
+	guint offset = 0;
+	guint16 len = 0;
+	char *data = (char *)demux->block_records->data;
+	while(offset < demux->block_records->len) {
+		if(demux->block_records->len - offset < GST_MJR_FRAME_HEADER_SIZE ||
+				data[offset] != 'M' || data[offset+1] != 'E' || data[offset+2] != 'E' || data[offset+3] != 'T') {
+			GST_ELEMENT_ERROR(demux, STREAM, DECODE, (NULL), ("Invalid data."));
+			return GST_FLOW_ERROR;
+		}
+		guint32 received = 0;
+		memcpy(&received, data + offset + 4, sizeof(received));
+		demux->received = g_ntohl(received);
+		memcpy(&len, data + offset + 8, sizeof(len));
+		len = g_ntohs(len);
+		offset += GST_MJR_FRAME_HEADER_SIZE;
+		if(demux->block_records->len - offset < len) {
+			GST_ELEMENT_ERROR(demux, STREAM, DECODE, (NULL), ("Invalid packet length. (%" G_GUINT16_FORMAT ")", len));
+			return GST_FLOW_ERROR;
+		}
+		if(gst_mjr_demux_qos_skip(demux, data + offset, len)) {
+			/* Downstream is late, skip this packet */
+			offset += len;
+			continue;
+		}
+		GstFlowReturn ret = gst_mjr_demux_handle_packet(demux, data + offset, len);
+		if(ret != GST_FLOW_OK)
+			return ret;
+		offset += len;
+	}
+	return GST_FLOW_OK;
+}
+
 /* Chain function, where we actually demux buffers to RTP packets */
 static GstFlowReturn gst_mjr_demux_chain(GstPad *pad, GstObject *parent, GstBuffer *buf) {
 	GstMjrDemux *demux = GST_MJR_DEMUX(parent);
+	if(demux->ring != NULL) {
+		/* Check if the push task stopped because of something downstream */
+		GstFlowReturn flow = g_atomic_int_get(&demux->push_flow);
+		if(flow != GST_FLOW_OK) {
+			gst_buffer_unref(buf);
+			return flow;
+		}
+	}
 	/* Process the incoming buffer */
 	GstFlowReturn ret = GST_FLOW_OK;
 	if(!demux->silent)
 		g_print("[mjrdemux] Got buffer of %zu bytes\n", gst_buffer_get_size(buf));
 	gsize buf_offset = 0;
 	guint16 len = 0;
-	gst_mjr_rtp *rtp = NULL;
 	while(gst_buffer_get_size(buf) > 0) {
+		if(demux->state == gst_mjr_demux_state_reading_index) {
+			/* We're past the last block, nothing else to do */
+			break;
+		}
+		if(demux->skip > 0) {
+			/* We're skipping the rest of a packet, without copying it */
+			gsize skipped = MIN(demux->skip, gst_buffer_get_size(buf) - buf_offset);
+			buf_offset += skipped;
+			demux->skip -= skipped;
+			if(demux->skip > 0)
+				break;
+		}
 		if(demux->state == gst_mjr_demux_state_waiting_header) {
 			/* We've just started, and are waiting for the MJR header */
 			demux->state = gst_mjr_demux_state_reading_header;
@@ -223,7 +922,10 @@ static GstFlowReturn gst_mjr_demux_chain(GstPad *pad, GstObject *parent, GstBuff
 			g_print("[mjrdemux] Reading %" G_GSIZE_FORMAT " bytes at offset %" G_GSIZE_FORMAT " to position %" G_GSIZE_FORMAT "\n",
 				demux->pending, buf_offset, demux->offset);
 		}
-		gsize extracted = gst_buffer_extract(buf, buf_offset, demux->buffer + demux->offset, demux->pending);
+		char *target = demux->buffer;
+		if(demux->state == gst_mjr_demux_state_reading_block)
+			target = (char *)demux->block_data->data;
+		gsize extracted = gst_buffer_extract(buf, buf_offset, target + demux->offset, demux->pending);
 		buf_offset += extracted;
 		demux->offset += extracted;
 		demux->pending -= extracted;
@@ -239,23 +941,15 @@ static GstFlowReturn gst_mjr_demux_chain(GstPad *pad, GstObject *parent, GstBuff
 				ret = GST_FLOW_ERROR;
 				break;
 			}
-			if(demux->buffer[1] == 'J' && demux->buffer[2] == 'R' && demux->buffer[3] == '0' && demux->buffer[4] == '0' &&
-					demux->buffer[5] == '0' && demux->buffer[6] == '0' && demux->buffer[7] == '2') {
-				/* New format (MJR00002) */
-				if(!demux->silent)
-					g_print("[mjrdemux] New MJR format\n");
-			} else if(demux->buffer[1] == 'E' && demux->buffer[2] == 'E' && demux->buffer[3] == 'T' && demux->buffer[4] == 'E' &&
-					demux->buffer[5] == 'C' && demux->buffer[6] == 'H' && demux->buffer[7] == 'O') {
-				/* Legacy format (MEETECHO) */
-				if(!demux->silent)
-					g_print("[mjrdemux] Legacy MJR format\n");
-				demux->legacy = TRUE;
-			} else {
+			if(!gst_mjr_check_header(demux->buffer, &demux->legacy, &demux->compressed)) {
 				/* Not an MJR file */
 				GST_ELEMENT_ERROR(demux, STREAM, DECODE, (NULL), ("Not an MJR file, or unsupported version."));
 				ret = GST_FLOW_ERROR;
 				break;
 			}
+			if(!demux->silent)
+				g_print("[mjrdemux] %s MJR format%s\n", demux->legacy ? "Legacy" : "New",
+					demux->compressed ? " (compressed)" : "");
 			/* Done, change state */
 			demux->state = gst_mjr_demux_state_waiting_json;
 			/* The MJR JSON header is prefixed by a 2 bytes length */
@@ -267,17 +961,8 @@ static GstFlowReturn gst_mjr_demux_chain(GstPad *pad, GstObject *parent, GstBuff
 			/* If we got here we have the length of the JSON header */
 			memcpy(&len, demux->buffer, sizeof(len));
 			len = g_ntohs(len);
-			if(demux->legacy && len != 5) {
-				/* Legacy MJR files always have only either "audio" or "video" */
-				GST_ELEMENT_ERROR(demux, STREAM, DECODE, (NULL), ("Invalid header length for legacy MJR file."));
-				ret = GST_FLOW_ERROR;
-				break;
-			} else if(len > 1500) {
-				/* Too big */
-				GST_ELEMENT_ERROR(demux, STREAM, DECODE, (NULL), ("Invalid header length. (%" G_GUINT16_FORMAT ")", len));
-				ret = GST_FLOW_ERROR;
-				break;
-			}
+			/* Leave room for a null terminator too */
+			gst_mjr_demux_buffer_reserve(demux, (gsize)len + 1);
 			/* Done, change state */
 			demux->state = gst_mjr_demux_state_reading_json;
 			/* Read as many bytes as we were told to expect */
@@ -286,88 +971,82 @@ static GstFlowReturn gst_mjr_demux_chain(GstPad *pad, GstObject *parent, GstBuff
 			demux->pending = demux->reading;
 			continue;
 		} else if(demux->state == gst_mjr_demux_state_reading_json) {
-			/* Check if this is a legacy or new recording */
-			if(demux->legacy) {
-				/* Just check if this is audio or video */
-				if(demux->buffer[0] == 'a') {
-					/* Audio, so Opus in legacy MJR format */
-					if(!demux->silent)
-						g_print("[mjrdemux] Audio MJR file (legacy, assuming opus)\n");
-					demux->video = FALSE;
-					demux->codec = GST_MJR_OPUS;
-				} else if(demux->buffer[0] == 'v') {
-					/* Video, so VP8 in legacy MJR format */
-					if(!demux->silent)
-						g_print("[mjrdemux] Video MJR file (legacy, assuming VP8)\n");
-					demux->video = TRUE;
-					demux->codec = GST_MJR_VP8;
-				} else {
-					/* Unsupported format */
-					GST_ELEMENT_ERROR(demux, STREAM, DECODE, (NULL), ("Unsupported media format."));
-					ret = GST_FLOW_ERROR;
-					break;
-				}
-			} else {
-				/* Parse the header for info on codecs, start times, etc. */
+			/* Parse the header for info on codecs, start times, etc. */
+			if(!demux->legacy && !demux->silent) {
 				demux->buffer[demux->reading] = '\0';
-				if(!demux->silent)
-					g_print("[mjrdemux] JSON header: %s\n", demux->buffer);
-				GError *error = NULL;
-				JsonParser *parser = json_parser_new();
-				if(!json_parser_load_from_data(parser, demux->buffer, -1, &error)) {
-					GST_ELEMENT_ERROR(demux, STREAM, DECODE, (NULL), ("Invalid JSON header."));
-					ret = GST_FLOW_ERROR;
-					g_object_unref(parser);
-					break;
-				}
-				JsonReader *reader = json_reader_new(json_parser_get_root(parser));
-				json_reader_read_member(reader, "t");
-				const gchar *t = json_reader_get_string_value(reader);
-				json_reader_end_member(reader);
-				json_reader_read_member(reader, "c");
-				const gchar *c = json_reader_get_string_value(reader);
-				json_reader_end_member(reader);
-				json_reader_read_member(reader, "s");
-				guint64 s = json_reader_get_int_value(reader);
-				json_reader_end_member(reader);
-				json_reader_read_member(reader, "u");
-				guint64 u = json_reader_get_int_value(reader);
-				json_reader_end_member(reader);
-				if(!t || !c || !s || !u) {
-					GST_ELEMENT_ERROR(demux, STREAM, DECODE, (NULL), ("Invalid JSON header."));
-					ret = GST_FLOW_ERROR;
-					g_object_unref(reader);
-					g_object_unref(parser);
-					break;
-				}
-				if(!strcasecmp(t, "v")) {
-					demux->video = TRUE;
-				} else if(!strcasecmp(t, "a")) {
-					demux->video = FALSE;
-				} else if(!strcasecmp(t, "d")) {
-					GST_ELEMENT_ERROR(demux, STREAM, DECODE, (NULL), ("Unsupported media format."));
-					ret = GST_FLOW_ERROR;
-					g_object_unref(reader);
-					g_object_unref(parser);
-					break;
-				}
-				demux->codec = gst_mjr_get_codec(c, &demux->video);
-				if(!demux->codec) {
-					GST_ELEMENT_ERROR(demux, STREAM, DECODE, (NULL), ("Unsupported codec (%s).", c));
-					ret = GST_FLOW_ERROR;
-					g_object_unref(reader);
-					g_object_unref(parser);
+				g_print("[mjrdemux] JSON header: %s\n", demux->buffer);
+			}
+			gst_mjr_info info;
+			gchar *error = NULL;
+			if(!gst_mjr_parse_info(demux->buffer, demux->reading, demux->legacy, &info, &error)) {
+				GST_ELEMENT_ERROR(demux, STREAM, DECODE, (NULL), ("%s", error));
+				g_free(error);
+				ret = GST_FLOW_ERROR;
+				break;
+			}
+			if(demux->legacy && !demux->silent) {
+				g_print("[mjrdemux] %s MJR file (legacy, assuming %s)\n",
+					info.video ? "Video" : "Audio", info.video ? "VP8" : "opus");
+			}
+			demux->video = info.video;
+			demux->codec = info.codec;
+			demux->created = info.created;
+			demux->written = info.written;
+			demux->dd_ext_id = info.dd_ext_id;
+			demux->snaplen = info.snaplen;
+			if(demux->snaplen > 0 && !demux->silent)
+				g_print("[mjrdemux] Recording only has the first %" G_GUINT16_FORMAT " bytes of each payload\n", demux->snaplen);
+			gst_mjr_demux_start_stream(demux);
+			/* Done, change state */
+			if(demux->compressed) {
+				/* Records are in compressed blocks, prefixed by a 16 bytes header */
+				demux->state = gst_mjr_demux_state_waiting_block;
+				demux->reading = GST_MJR_BLOCK_HEADER_SIZE;
+			} else {
+				/* RTP packets are prefixed by a 8 bytes payload and a 2 bytes length header */
+				demux->state = gst_mjr_demux_state_waiting_packet;
+				demux->reading = 10;
+			}
+			demux->offset = 0;
+			demux->pending = demux->reading;
+			continue;
+		} else if(demux->state == gst_mjr_demux_state_waiting_block) {
+			/* If we got here we have the header of a block, or the beginning of the index */
+			gboolean index = FALSE;
+			if(!gst_mjr_parse_block(demux->buffer, &demux->block, &index)) {
+				if(index) {
+					/* No more blocks, we can ignore the rest of the file */
+					if(!demux->silent)
+						g_print("[mjrdemux] Reached the index of the compressed file\n");
+					demux->state = gst_mjr_demux_state_reading_index;
 					break;
 				}
-				demux->created = s;
-				demux->written = u;
-				g_object_unref(reader);
-				g_object_unref(parser);
+				GST_ELEMENT_ERROR(demux, STREAM, DECODE, (NULL), ("Invalid block."));
+				ret = GST_FLOW_ERROR;
+				break;
 			}
 			/* Done, change state */
-			demux->state = gst_mjr_demux_state_waiting_packet;
-			/* RTP packets are prefixed by a 8 bytes payload and a 2 bytes length header */
-			demux->reading = 10;
+			demux->state = gst_mjr_demux_state_reading_block;
+			g_byte_array_set_size(demux->block_data, demux->block.compressed_size);
+			demux->reading = demux->block.compressed_size;
+			demux->offset = 0;
+			demux->pending = demux->reading;
+			continue;
+		} else if(demux->state == gst_mjr_demux_state_reading_block) {
+			/* We got a whole block: decompress it and process its records */
+			g_byte_array_set_size(demux->block_records, demux->block.size);
+			if(!gst_mjr_block_decompress(demux->block_data->data, demux->block.compressed_size,
+					demux->block_records->data, demux->block.size)) {
+				GST_ELEMENT_ERROR(demux, STREAM, DECODE, (NULL), ("Error decompressing block."));
+				ret = GST_FLOW_ERROR;
+				break;
+			}
+			ret = gst_mjr_demux_handle_block(demux);
+			if(ret != GST_FLOW_OK)
+				break;
+			/* Done, change state */
+			demux->state = gst_mjr_demux_state_waiting_block;
+			demux->reading = GST_MJR_BLOCK_HEADER_SIZE;
 			demux->offset = 0;
 			demux->pending = demux->reading;
 			continue;
@@ -379,76 +1058,55 @@ static GstFlowReturn gst_mjr_demux_chain(GstPad *pad, GstObject *parent, GstBuff
 				ret = GST_FLOW_ERROR;
 				break;
 			}
-			/* FIXME We could read the "Received time" from there too,
-			 * but we ignore it for now, and move right to the length */
+			/* Legacy recordings have no received time there */
+			if(!demux->legacy) {
+				guint32 received = 0;
+				memcpy(&received, demux->buffer + 4, sizeof(received));
+				demux->received = g_ntohl(received);
+			}
 			memcpy(&len, demux->buffer + 8, sizeof(len));
 			len = g_ntohs(len);
-			if(len > 1500) {
-				/* Too big */
-				GST_ELEMENT_ERROR(demux, STREAM, DECODE, (NULL), ("Invalid packet length. (%" G_GUINT16_FORMAT ")", len));
-				ret = GST_FLOW_ERROR;
-				break;
-			}
+			/* Records can be as large as 64k (e.g., RTP over TCP or loopback) */
+			gst_mjr_demux_buffer_reserve(demux, len);
 			/* Done, change state */
-			demux->state = gst_mjr_demux_state_reading_packet;
-			/* Read as many bytes as we were told to expect */
-			demux->reading = len;
+			GST_OBJECT_LOCK(demux);
+			gboolean skipping = demux->qos_skipping;
+			GST_OBJECT_UNLOCK(demux);
+			if(skipping) {
+				/* Only read the beginning of the packet for now: we'll
+				 * read the rest only if it turns out to be a keyframe */
+				demux->state = gst_mjr_demux_state_peeking_packet;
+				demux->packet_len = len;
+				demux->reading = MIN(len, GST_MJR_DEMUX_PEEK_SIZE);
+			} else {
+				demux->state = gst_mjr_demux_state_reading_packet;
+				/* Read as many bytes as we were told to expect */
+				demux->reading = len;
+			}
+			demux->offset = 0;
+			demux->pending = demux->reading;
+			continue;
+		} else if(demux->state == gst_mjr_demux_state_peeking_packet) {
+			/* We got the beginning of a packet, check if it's a keyframe */
+			if(!gst_mjr_demux_qos_skip(demux, demux->buffer, demux->reading)) {
+				/* It is, read the rest of the packet */
+				demux->state = gst_mjr_demux_state_reading_packet;
+				demux->reading = demux->packet_len;
+				demux->pending = demux->reading - demux->offset;
+				continue;
+			}
+			/* It's not, skip the rest of the packet */
+			demux->skip = demux->packet_len - demux->reading;
+			demux->state = gst_mjr_demux_state_waiting_packet;
+			demux->reading = 10;
 			demux->offset = 0;
 			demux->pending = demux->reading;
 			continue;
 		} else if(demux->state == gst_mjr_demux_state_reading_packet) {
 			/* We got an RTP packet */
-			rtp = (gst_mjr_rtp *)demux->buffer;
-			if(!demux->silent) {
-				g_print("[mjrdemux][RTP] seq=%5" G_GUINT16_FORMAT ", ts=%10" G_GUINT32_FORMAT "\n",
-					g_ntohs(rtp->seq_number), g_ntohl(rtp->timestamp));
-			}
-			/* Process the RTP packet to create a buffer to pass along */
-			if(demux->ssrc == 0)
-				demux->ssrc = g_ntohl(rtp->ssrc);
-			if(g_ntohl(rtp->ssrc) != demux->ssrc) {
-				/* Ignore packet */
-			} else {
-				/* Turn timestamp in timing information */
-				if(!demux->initialized) {
-					demux->initialized = TRUE;
-					demux->last_ts = g_ntohl(rtp->timestamp);
-					/* Update the caps on the source pad */
-					GstCaps *newcaps = gst_caps_new_simple("application/x-rtp",
-						"media", G_TYPE_STRING, (demux->video ? "video" : "audio"),
-						"encoding-name", G_TYPE_STRING, gst_mjr_get_encoding_name(demux->codec),
-						"clock-rate", G_TYPE_INT, gst_mjr_get_clock_rate(demux->codec),
-						"payload", G_TYPE_INT, rtp->type,
-						NULL);
-					gboolean res = gst_pad_set_caps(demux->srcpad, newcaps);
-					char *caps_str = gst_caps_to_string(newcaps);
-					g_print("[mjrdemux] Caps %s set to '%s'\n", (res ? "successfully" : "NOT"), caps_str);
-					g_free(caps_str);
-					/* Notify new segment */
-					GstSegment segment;
-					gst_segment_init(&segment, GST_FORMAT_TIME);
-					GstEvent *event = gst_event_new_segment(&segment);
-					gst_pad_push_event(demux->srcpad, event);
-				}
-				double diff = (double)(g_ntohl(rtp->timestamp) - demux->last_ts)/(double)gst_mjr_get_clock_rate(demux->codec);
-				demux->timestamp += diff * G_USEC_PER_SEC * 1000;
-				if(!demux->silent)
-					g_print("[mjrdemux][RTP] Computed timestamp: %" G_GUINT64_FORMAT "\n", demux->timestamp);
-				demux->last_ts = g_ntohl(rtp->timestamp);
-				/* Check if we need to overwrite the SSRC */
-				if(demux->out_ssrc)
-					rtp->ssrc = g_htonl(demux->out_ssrc);
-				/* Create a buffer and pass it along the pad */
-				GstBuffer *outbuf = gst_buffer_new_memdup(demux->buffer, demux->reading);
-				GST_BUFFER_TIMESTAMP(outbuf) = demux->timestamp;
-				GstFlowReturn res = gst_pad_push(demux->srcpad, outbuf);
-				if(res != GST_FLOW_OK) {
-					GST_ELEMENT_ERROR(demux, CORE, PAD, (NULL),
-						("Error pushing buffer to pad (%d)", res));
-					ret = res;
-					break;
-				}
-			}
+			ret = gst_mjr_demux_handle_packet(demux, demux->buffer, demux->reading);
+			if(ret != GST_FLOW_OK)
+				break;
 			/* Done, change state */
 			demux->state = gst_mjr_demux_state_waiting_packet;
 			/* Next packet */
@@ -49,6 +49,9 @@
 
 #include <gst/gst.h>
 
+#include "gstmjrreader.h"
+#include "gstmjrring.h"
+
 G_BEGIN_DECLS
 
 #define GST_TYPE_MJR_DEMUX gst_mjr_demux_get_type()
@@ -61,6 +64,10 @@ typedef enum gst_mjr_demux_state {
 	gst_mjr_demux_state_reading_json,
 	gst_mjr_demux_state_waiting_packet,
 	gst_mjr_demux_state_reading_packet,
+	gst_mjr_demux_state_peeking_packet,
+	gst_mjr_demux_state_waiting_block,
+	gst_mjr_demux_state_reading_block,
+	gst_mjr_demux_state_reading_index,
 } gst_mjr_demux_state;
 
 struct _GstMjrDemux {
@@ -70,19 +77,74 @@ struct _GstMjrDemux {
 	/* MJR related stuff */
 	gst_mjr_demux_state state;
 	gboolean legacy;
+	gboolean compressed;
 	gboolean video;
 	int codec;
 	guint32 ssrc;
-	char buffer[1500];
+	/* Where we read headers and packets to: it starts small, and grows
+	 * when we find larger records, up to the maximum record size */
+	char *buffer;
+	gsize buffer_size;
 	gsize reading, offset, pending;
 	gint64 created, written;
+	/* Recordings written with a snaplen have a trailer after each packet */
+	guint16 snaplen;
+	/* Compressed files: current block, before and after decompressing it */
+	gst_mjr_block block;
+	GByteArray *block_data, *block_records;
 
-	/* Output */
+	/* Output: we announce the stream as soon as we've parsed the header,
+	 * reusing the group of the upstream stream-start, if any */
 	guint32 out_ssrc;
+	gboolean have_group_id;
+	guint group_id;
+	gint payload_type;
+	/* Wallclock time each packet was received at, as a reference timestamp */
+	gboolean reference_timestamps;
+	GstCaps *reference_caps;
+	guint32 received;
+
+	/* Layers: packets of spatial/temporal layers higher than the ones we're
+	 * interested in are dropped, and sequence numbers are rewritten to hide
+	 * the gaps; for AV1, we need the dependency descriptor for that */
+	gint max_spatial, max_temporal;
+	guint8 dd_ext_id;
+	gst_mjr_dd_structure dd;
+	guint16 layer_dropped;
+
+	/* QoS: when downstream is late, we skip packets until the next keyframe,
+	 * only looking at the beginning of each record to find it */
+	gboolean qos;
+	gboolean qos_skipping, qos_discont;
+	guint64 qos_skipped;
+	guint16 packet_len;
+	gsize skip;
+
+	/* Looping: packets are stored in memory the first time (up to a
+	 * maximum size), and then replayed from there, updating the RTP info
+	 * at each iteration */
+	gboolean loop, loop_full;
+	GByteArray *loop_arena;
+	GBytes *loop_data;
+	GArray *loop_packets;
+	gst_mjr_timestamp loop_ts;
+	guint loop_index;
+	guint64 loop_iteration;
+	guint16 loop_seq_span;
+	gint64 loop_ts_span;
+
+	/* Pushing: if a ring size is configured, the chain function only
+	 * parses, and buffers and serialized events are pushed downstream in
+	 * batches by a separate task on the source pad */
+	guint ring_size;
+	gst_mjr_ring *ring;
+	gboolean push_task;
+	volatile gint push_flow;
 
-	/* Timing */
+	/* Timing: RTP timestamps are unwrapped to 64 bits, and buffer
+	 * timestamps are computed relative to the first packet */
 	gboolean initialized;
-	guint32 last_ts;
+	gst_mjr_timestamp rtp_ts;
 	GstClockTime timestamp;
 
 	/* Pads */
@@ -0,0 +1,626 @@
+/*
+ * GStreamer
+ * Copyright (C) 2005 Thomas Vander Stichele <thomas@apestaart.org>
+ * Copyright (C) 2005 Ronald S. Bultje <rbultje@ronald.bitfreak.net>
+ * Copyright (C) 2024 Lorenzo Miniero <lorenzo@meetecho.com>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ *
+ * Alternatively, the contents of this file may be used under the
+ * GNU Lesser General Public License Version 2.1 (the "LGPL"), in
+ * which case the following provisions apply instead of the ones
+ * mentioned above:
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 02111-1307, USA.
+ */
+
+/**
+ * SECTION:element-mjrexport
+ *
+ * Converts an MJR recording to a pcap or rtpdump file, without demuxing it
+ * to RTP buffers first: each record is written straight to a large output
+ * buffer with the framing of the target format (fake IPv4 and UDP headers,
+ * in case of pcap), using the time the packet was received as its time in
+ * the capture. Output buffers are only pushed when full, or when the end
+ * of the recording is reached.
+ *
+ * <refsect2>
+ * <title>Example launch line</title>
+ * |[
+ * gst-launch-1.0 filesrc location=rec-sample-video.mjr ! mjrexport format=pcap ! filesink location=rec-sample-video.pcap
+ * ]|
+ * </refsect2>
+ */
+
+#ifdef HAVE_CONFIG_H
+#  include <config.h>
+#endif
+
+#include <gst/gst.h>
+
+#include "gstmjrexport.h"
+
+enum {
+	LAST_SIGNAL
+};
+
+enum {
+	PROP_0,
+	PROP_SILENT,
+	PROP_FORMAT,
+	PROP_BUFFER_SIZE,
+	PROP_PORT
+};
+
+/* Default size of the output buffers */
+#define GST_MJR_EXPORT_BUFFER_SIZE	(1024*1024)
+/* Size of the fake IPv4 and UDP headers we add in pcap files */
+#define GST_MJR_EXPORT_IP_UDP_SIZE	28
+/* Size of the pcap file and record headers */
+#define GST_MJR_EXPORT_PCAP_HEADER_SIZE		24
+#define GST_MJR_EXPORT_PCAP_RECORD_SIZE		16
+/* Size of the rtpdump binary file header and packet header */
+#define GST_MJR_EXPORT_RTPDUMP_HEADER_SIZE	16
+#define GST_MJR_EXPORT_RTPDUMP_RECORD_SIZE	8
+/* Address we pretend packets were sent to and from (127.0.0.1) */
+#define GST_MJR_EXPORT_ADDRESS		0x7F000001
+
+/* Pad templates: we take MJR buffers in and shoot pcap or rtpdump out */
+static GstStaticPadTemplate srctemplate = GST_STATIC_PAD_TEMPLATE("src",
+	GST_PAD_SRC,
+	GST_PAD_ALWAYS,
+	GST_STATIC_CAPS("application/vnd.tcpdump.pcap; application/x-rtpdump")
+);
+static GstStaticPadTemplate sinktemplate = GST_STATIC_PAD_TEMPLATE("sink",
+	GST_PAD_SINK,
+	GST_PAD_ALWAYS,
+	GST_STATIC_CAPS_ANY
+);
+
+#define gst_mjr_export_parent_class parent_class
+	G_DEFINE_TYPE(GstMjrExport, gst_mjr_export, GST_TYPE_ELEMENT);
+
+GST_ELEMENT_REGISTER_DEFINE(mjrexport, "mjrexport", GST_RANK_NONE,
+	GST_TYPE_MJR_EXPORT);
+
+/* Formats we can export to */
+GType gst_mjr_export_format_get_type(void) {
+	static GType type = 0;
+	static const GEnumValue formats[] = {
+		{ gst_mjr_export_format_pcap, "pcap file, with fake IPv4/UDP headers", "pcap" },
+		{ gst_mjr_export_format_rtpdump, "rtpdump file", "rtpdump" },
+		{ 0, NULL, NULL }
+	};
+	if(g_once_init_enter(&type)) {
+		GType new_type = g_enum_register_static("GstMjrExportFormat", formats);
+		g_once_init_leave(&type, new_type);
+	}
+	return type;
+}
+
+/* Property setters/getters */
+static void gst_mjr_export_set_property(GObject *object,
+	guint prop_id, const GValue *value, GParamSpec *pspec);
+static void gst_mjr_export_get_property(GObject *object,
+	guint prop_id, GValue *value, GParamSpec *pspec);
+
+/* GstElement methods */
+static GstStateChangeReturn gst_mjr_export_change_state(GstElement *element,
+	GstStateChange transition);
+
+/* Pad methods */
+static gboolean gst_mjr_export_sink_event(GstPad *pad,
+	GstObject *parent, GstEvent *event);
+static GstFlowReturn gst_mjr_export_chain(GstPad *pad,
+	GstObject *parent, GstBuffer *buf);
+
+/* Initialize the mjrexport's class */
+static void gst_mjr_export_class_init(GstMjrExportClass *klass) {
+	GObjectClass *gobject_class;
+	GstElementClass *gstelement_class;
+
+	gobject_class = (GObjectClass *)klass;
+	gstelement_class = (GstElementClass *)klass;
+
+	gobject_class->set_property = gst_mjr_export_set_property;
+	gobject_class->get_property = gst_mjr_export_get_property;
+
+	g_object_class_install_property(gobject_class, PROP_SILENT,
+		g_param_spec_boolean("silent", "Silent", "Don't produce verbose output",
+			TRUE, G_PARAM_READWRITE | GST_PARAM_MUTABLE_PLAYING));
+	g_object_class_install_property(gobject_class, PROP_FORMAT,
+		g_param_spec_enum("format", "Format", "Format to export the recording to",
+			gst_mjr_export_format_get_type(), gst_mjr_export_format_pcap,
+			G_PARAM_READWRITE | GST_PARAM_MUTABLE_READY));
+	g_object_class_install_property(gobject_class, PROP_BUFFER_SIZE,
+		g_param_spec_uint("buffer-size", "Buffer size", "Size of the output buffers",
+			4096, G_MAXINT, GST_MJR_EXPORT_BUFFER_SIZE, G_PARAM_READWRITE | GST_PARAM_MUTABLE_READY));
+	g_object_class_install_property(gobject_class, PROP_PORT,
+		g_param_spec_uint("port", "Port", "UDP port to use in the exported packets",
+			1, G_MAXUINT16, 5000, G_PARAM_READWRITE | GST_PARAM_MUTABLE_READY));
+
+	gstelement_class->change_state = GST_DEBUG_FUNCPTR(gst_mjr_export_change_state);
+
+	gst_element_class_set_details_simple(gstelement_class,
+		"Janus MJR Exporter",
+		"Codec/Converter",
+		"Export MJR recordings to pcap or rtpdump files",
+		"Lorenzo Miniero <lorenzo@meetecho.com>");
+	gst_element_class_add_static_pad_template(gstelement_class, &srctemplate);
+	gst_element_class_add_static_pad_template(gstelement_class, &sinktemplate);
+}
+
+/* Initialize the new element */
+static void gst_mjr_export_init(GstMjrExport *export) {
+	export->silent = TRUE;
+	export->format = gst_mjr_export_format_pcap;
+	export->buffer_size = GST_MJR_EXPORT_BUFFER_SIZE;
+	export->port = 5000;
+	export->adapter = NULL;
+	export->block = NULL;
+	export->out = NULL;
+	/* Setup pads and chain */
+	export->sinkpad = gst_pad_new_from_static_template(&sinktemplate, "sink");
+	gst_pad_set_event_function(export->sinkpad,
+		GST_DEBUG_FUNCPTR(gst_mjr_export_sink_event));
+	gst_pad_set_chain_function(export->sinkpad,
+		GST_DEBUG_FUNCPTR(gst_mjr_export_chain));
+	gst_element_add_pad(GST_ELEMENT(export), export->sinkpad);
+	export->srcpad = gst_pad_new_from_static_template(&srctemplate, "src");
+	gst_pad_use_fixed_caps(export->srcpad);
+	gst_element_add_pad(GST_ELEMENT(export), export->srcpad);
+}
+
+/* Property setter */
+static void gst_mjr_export_set_property(GObject *object, guint prop_id, const GValue *value, GParamSpec *pspec) {
+	GstMjrExport *export = GST_MJR_EXPORT(object);
+	/* Set the specified property */
+	switch(prop_id) {
+		case PROP_SILENT:
+			export->silent = g_value_get_boolean(value);
+			break;
+		case PROP_FORMAT:
+			export->format = g_value_get_enum(value);
+			break;
+		case PROP_BUFFER_SIZE:
+			export->buffer_size = g_value_get_uint(value);
+			break;
+		case PROP_PORT:
+			export->port = g_value_get_uint(value);
+			break;
+		default:
+			G_OBJECT_WARN_INVALID_PROPERTY_ID(object, prop_id, pspec);
+			break;
+	}
+}
+
+/* Property getter */
+static void gst_mjr_export_get_property(GObject *object, guint prop_id, GValue *value, GParamSpec *pspec) {
+	GstMjrExport *export = GST_MJR_EXPORT(object);
+	/* Get the specified property */
+	switch(prop_id) {
+		case PROP_SILENT:
+			g_value_set_boolean(value, export->silent);
+			break;
+		case PROP_FORMAT:
+			g_value_set_enum(value, export->format);
+			break;
+		case PROP_BUFFER_SIZE:
+			g_value_set_uint(value, export->buffer_size);
+			break;
+		case PROP_PORT:
+			g_value_set_uint(value, export->port);
+			break;
+		default:
+			G_OBJECT_WARN_INVALID_PROPERTY_ID(object, prop_id, pspec);
+			break;
+	}
+}
+
+/* Get rid of the output buffer we were filling, if any */
+static void gst_mjr_export_drop_output(GstMjrExport *export) {
+	if(export->out == NULL)
+		return;
+	gst_buffer_unmap(export->out, &export->out_map);
+	gst_buffer_unref(export->out);
+	export->out = NULL;
+	export->out_len = 0;
+}
+
+/* Reset the parser and the output */
+static void gst_mjr_export_reset(GstMjrExport *export) {
+	if(export->adapter != NULL)
+		gst_adapter_clear(export->adapter);
+	export->state = gst_mjr_export_state_header;
+	export->json_len = 0;
+	memset(&export->info, 0, sizeof(export->info));
+	export->ts_initialized = FALSE;
+	export->ssrc = 0;
+	gst_mjr_timestamp_reset(&export->ts);
+	export->started = FALSE;
+	gst_mjr_export_drop_output(export);
+	export->offset = 0;
+	export->ip_id = 0;
+	export->packets = 0;
+}
+
+/* Handle state changes */
+static GstStateChangeReturn gst_mjr_export_change_state(GstElement *element, GstStateChange transition) {
+	GstMjrExport *export = GST_MJR_EXPORT(element);
+	switch(transition) {
+		case GST_STATE_CHANGE_READY_TO_PAUSED:
+			export->adapter = gst_adapter_new();
+			export->block = g_byte_array_new();
+			gst_mjr_export_reset(export);
+			break;
+		default:
+			break;
+	}
+	GstStateChangeReturn ret = GST_ELEMENT_CLASS(parent_class)->change_state(element, transition);
+	switch(transition) {
+		case GST_STATE_CHANGE_PAUSED_TO_READY:
+			gst_mjr_export_reset(export);
+			g_clear_object(&export->adapter);
+			if(export->block != NULL) {
+				g_byte_array_free(export->block, TRUE);
+				export->block = NULL;
+			}
+			break;
+		default:
+			break;
+	}
+	return ret;
+}
+
+/* Push the output buffer we've filled so far, if any */
+static GstFlowReturn gst_mjr_export_push(GstMjrExport *export) {
+	if(export->out == NULL || export->out_len == 0)
+		return GST_FLOW_OK;
+	gst_buffer_unmap(export->out, &export->out_map);
+	gst_buffer_set_size(export->out, export->out_len);
+	GstBuffer *outbuf = export->out;
+	GST_BUFFER_OFFSET(outbuf) = export->offset;
+	export->offset += export->out_len;
+	GST_BUFFER_OFFSET_END(outbuf) = export->offset;
+	export->out = NULL;
+	export->out_len = 0;
+	return gst_pad_push(export->srcpad, outbuf);
+}
+
+/* Get a pointer to where we can write the specified amount of bytes in
+ * the output buffer, pushing the current one and creating a new one if
+ * needed: returns NULL in case pushing the current one failed */
+static guint8 *gst_mjr_export_reserve(GstMjrExport *export, gsize size, GstFlowReturn *ret) {
+	*ret = GST_FLOW_OK;
+	if(export->out != NULL && export->out_len + size > export->out_map.size) {
+		*ret = gst_mjr_export_push(export);
+		if(*ret != GST_FLOW_OK)
+			return NULL;
+	}
+	if(export->out == NULL) {
+		export->out = gst_buffer_new_allocate(NULL, MAX(export->buffer_size, size), NULL);
+		gst_buffer_map(export->out, &export->out_map, GST_MAP_WRITE);
+		export->out_len = 0;
+	}
+	guint8 *data = export->out_map.data + export->out_len;
+	export->out_len += size;
+	return data;
+}
+
+/* Helpers to write integers in the output */
+static void gst_mjr_export_write16(guint8 *data, guint16 value) {
+	value = g_htons(value);
+	memcpy(data, &value, sizeof(value));
+}
+static void gst_mjr_export_write32(guint8 *data, guint32 value) {
+	value = g_htonl(value);
+	memcpy(data, &value, sizeof(value));
+}
+
+/* We parsed the MJR header: set the caps and write the file header */
+static GstFlowReturn gst_mjr_export_start(GstMjrExport *export) {
+	gboolean pcap = (export->format == gst_mjr_export_format_pcap);
+	GstCaps *caps = gst_caps_new_empty_simple(pcap ? "application/vnd.tcpdump.pcap" : "application/x-rtpdump");
+	gst_pad_set_caps(export->srcpad, caps);
+	gst_caps_unref(caps);
+	GstSegment segment;
+	gst_segment_init(&segment, GST_FORMAT_BYTES);
+	gst_pad_push_event(export->srcpad, gst_event_new_segment(&segment));
+	export->started = TRUE;
+	GstFlowReturn ret = GST_FLOW_OK;
+	if(pcap) {
+		/* pcap global header, in host byte order */
+		guint8 *data = gst_mjr_export_reserve(export, GST_MJR_EXPORT_PCAP_HEADER_SIZE, &ret);
+		if(data == NULL)
+			return ret;
+		guint32 magic = 0xa1b2c3d4, snaplen = G_MAXUINT16, linktype = 101;
+		guint16 major = 2, minor = 4;
+		gint32 zone = 0;
+		guint32 sigfigs = 0;
+		memcpy(data, &magic, 4);
+		memcpy(data + 4, &major, 2);
+		memcpy(data + 6, &minor, 2);
+		memcpy(data + 8, &zone, 4);
+		memcpy(data + 12, &sigfigs, 4);
+		memcpy(data + 16, &snaplen, 4);
+		memcpy(data + 20, &linktype, 4);
+	} else {
+		/* rtpdump text line, followed by the binary header */
+		gchar *line = g_strdup_printf("#!rtpplay1.0 127.0.0.1/%u\n", export->port);
+		gsize len = strlen(line);
+		guint8 *data = gst_mjr_export_reserve(export, len + GST_MJR_EXPORT_RTPDUMP_HEADER_SIZE, &ret);
+		if(data == NULL) {
+			g_free(line);
+			return ret;
+		}
+		memcpy(data, line, len);
+		g_free(line);
+		data += len;
+		guint64 start = export->info.legacy ? 0 : export->info.written;
+		gst_mjr_export_write32(data, start / G_USEC_PER_SEC);
+		gst_mjr_export_write32(data + 4, start % G_USEC_PER_SEC);
+		gst_mjr_export_write32(data + 8, GST_MJR_EXPORT_ADDRESS);
+		gst_mjr_export_write16(data + 12, export->port);
+		gst_mjr_export_write16(data + 14, 0);
+	}
+	return ret;
+}
+
+/* Write an RTP packet to the output, with the framing of the format we're exporting to */
+static GstFlowReturn gst_mjr_export_packet(GstMjrExport *export, const guint8 *packet, guint16 len, guint32 received) {
+	/* Packets may have been truncated, if the recording has a snaplen */
+	guint16 original = 0;
+	len = gst_mjr_record_length(&export->info, packet, len, &original);
+	if(len < 12)
+		return GST_FLOW_OK;
+	/* Figure out when this packet was received, relative to the beginning */
+	guint64 when = (guint64)received * 1000;
+	if(export->info.legacy) {
+		/* No received time, use the RTP timestamps of the first SSRC */
+		gst_mjr_rtp *rtp = (gst_mjr_rtp *)packet;
+		if(!export->ts_initialized) {
+			export->ts_initialized = TRUE;
+			export->ssrc = g_ntohl(rtp->ssrc);
+		}
+		gint64 ext_ts = 0;
+		if(g_ntohl(rtp->ssrc) == export->ssrc)
+			ext_ts = gst_mjr_timestamp_update(&export->ts, g_ntohl(rtp->timestamp));
+		else
+			ext_ts = export->ts.ext_ts;
+		when = gst_mjr_timestamp_to_time(ext_ts, gst_mjr_get_clock_rate(export->info.codec)) / GST_USECOND;
+	}
+	GstFlowReturn ret = GST_FLOW_OK;
+	if(export->format == gst_mjr_export_format_pcap) {
+		/* pcap record header, plus fake IPv4 and UDP headers */
+		guint16 size = MIN(len, G_MAXUINT16 - GST_MJR_EXPORT_IP_UDP_SIZE);
+		guint16 full = MIN(original, G_MAXUINT16 - GST_MJR_EXPORT_IP_UDP_SIZE);
+		guint8 *data = gst_mjr_export_reserve(export,
+			GST_MJR_EXPORT_PCAP_RECORD_SIZE + GST_MJR_EXPORT_IP_UDP_SIZE + size, &ret);
+		if(data == NULL)
+			return ret;
+		guint64 timestamp = (export->info.legacy ? 0 : export->info.written) + when;
+		guint32 header[4] = {
+			timestamp / G_USEC_PER_SEC, timestamp % G_USEC_PER_SEC,
+			GST_MJR_EXPORT_IP_UDP_SIZE + size, GST_MJR_EXPORT_IP_UDP_SIZE + original
+		};
+		memcpy(data, header, sizeof(header));
+		guint8 *ip = data + GST_MJR_EXPORT_PCAP_RECORD_SIZE;
+		ip[0] = 0x45;
+		ip[1] = 0;
+		gst_mjr_export_write16(ip + 2, GST_MJR_EXPORT_IP_UDP_SIZE + full);
+		gst_mjr_export_write16(ip + 4, export->ip_id++);
+		gst_mjr_export_write16(ip + 6, 0x4000);
+		ip[8] = 64;
+		ip[9] = 17;
+		gst_mjr_export_write16(ip + 10, 0);
+		gst_mjr_export_write32(ip + 12, GST_MJR_EXPORT_ADDRESS);
+		gst_mjr_export_write32(ip + 16, GST_MJR_EXPORT_ADDRESS);
+		/* IPv4 header checksum */
+		guint32 sum = 0;
+		int i = 0;
+		for(i=0; i<20; i+=2)
+			sum += (ip[i] << 8) | ip[i+1];
+		while(sum >> 16)
+			sum = (sum & 0xFFFF) + (sum >> 16);
+		gst_mjr_export_write16(ip + 10, ~sum & 0xFFFF);
+		guint8 *udp = ip + 20;
+		gst_mjr_export_write16(udp, export->port);
+		gst_mjr_export_write16(udp + 2, export->port);
+		gst_mjr_export_write16(udp + 4, 8 + full);
+		gst_mjr_export_write16(udp + 6, 0);
+		memcpy(udp + 8, packet, size);
+	} else {
+		/* rtpdump packet header */
+		guint16 size = MIN(len, G_MAXUINT16 - GST_MJR_EXPORT_RTPDUMP_RECORD_SIZE);
+		guint8 *data = gst_mjr_export_reserve(export, GST_MJR_EXPORT_RTPDUMP_RECORD_SIZE + size, &ret);
+		if(data == NULL)
+			return ret;
+		gst_mjr_export_write16(data, GST_MJR_EXPORT_RTPDUMP_RECORD_SIZE + size);
+		gst_mjr_export_write16(data + 2, original);
+		gst_mjr_export_write32(data + 4, when / 1000);
+		memcpy(data + GST_MJR_EXPORT_RTPDUMP_RECORD_SIZE, packet, size);
+	}
+	export->packets++;
+	return GST_FLOW_OK;
+}
+
+/* Handles sink events */
+static gboolean gst_mjr_export_sink_event(GstPad *pad, GstObject *parent, GstEvent *event) {
+	GstMjrExport *export = GST_MJR_EXPORT(parent);
+	switch(GST_EVENT_TYPE(event)) {
+		case GST_EVENT_CAPS:
+		case GST_EVENT_SEGMENT:
+			/* We'll send our own */
+			gst_event_unref(event);
+			return TRUE;
+		case GST_EVENT_FLUSH_STOP:
+			gst_mjr_export_reset(export);
+			break;
+		case GST_EVENT_EOS:
+			/* Push what we have left */
+			gst_mjr_export_push(export);
+			if(!export->silent)
+				g_print("[mjrexport] Exported %" G_GUINT64_FORMAT " packets\n", export->packets);
+			break;
+		default:
+			break;
+	}
+	return gst_pad_event_default(pad, parent, event);
+}
+
+/* Chain function, where we convert MJR records */
+static GstFlowReturn gst_mjr_export_chain(GstPad *pad, GstObject *parent, GstBuffer *buf) {
+	GstMjrExport *export = GST_MJR_EXPORT(parent);
+	gst_adapter_push(export->adapter, buf);
+	GstFlowReturn ret = GST_FLOW_OK;
+	while(ret == GST_FLOW_OK) {
+		gsize available = gst_adapter_available(export->adapter);
+		if(export->state == gst_mjr_export_state_header) {
+			/* MJR header, followed by the length of the info header */
+			if(available < GST_MJR_HEADER_SIZE + GST_MJR_JSON_LENGTH_SIZE)
+				break;
+			const guint8 *data = gst_adapter_map(export->adapter, GST_MJR_HEADER_SIZE + GST_MJR_JSON_LENGTH_SIZE);
+			if(!gst_mjr_check_header((const char *)data, &export->info.legacy, &export->info.compressed)) {
+				gst_adapter_unmap(export->adapter);
+				GST_ELEMENT_ERROR(export, STREAM, DECODE, (NULL), ("Not an MJR file, or unsupported version."));
+				return GST_FLOW_ERROR;
+			}
+			guint16 len = 0;
+			memcpy(&len, data + GST_MJR_HEADER_SIZE, sizeof(len));
+			gst_adapter_unmap(export->adapter);
+			gst_adapter_flush(export->adapter, GST_MJR_HEADER_SIZE + GST_MJR_JSON_LENGTH_SIZE);
+			export->json_len = g_ntohs(len);
+			export->state = gst_mjr_export_state_json;
+		} else if(export->state == gst_mjr_export_state_json) {
+			/* Info header */
+			if(available < export->json_len)
+				break;
+			const guint8 *data = gst_adapter_map(export->adapter, export->json_len);
+			gchar *error = NULL;
+			gboolean compressed = export->info.compressed;
+			gboolean res = gst_mjr_parse_info((const char *)data, export->json_len,
+				export->info.legacy, &export->info, &error);
+			export->info.compressed = compressed;
+			gst_adapter_unmap(export->adapter);
+			if(!res) {
+				GST_ELEMENT_ERROR(export, STREAM, DECODE, (NULL), ("%s", error));
+				g_free(error);
+				return GST_FLOW_ERROR;
+			}
+			gst_adapter_flush(export->adapter, export->json_len);
+			export->state = export->info.compressed ?
+				gst_mjr_export_state_blocks : gst_mjr_export_state_packets;
+			ret = gst_mjr_export_start(export);
+		} else if(export->state == gst_mjr_export_state_index) {
+			/* We don't need the index of compressed files */
+			gst_adapter_flush(export->adapter, available);
+			break;
+		} else if(export->state == gst_mjr_export_state_blocks) {
+			/* Compressed blocks of records */
+			if(available < GST_MJR_BLOCK_HEADER_SIZE)
+				break;
+			const guint8 *data = gst_adapter_map(export->adapter, GST_MJR_BLOCK_HEADER_SIZE);
+			gst_mjr_block block;
+			gboolean index = FALSE;
+			gboolean res = gst_mjr_parse_block((const char *)data, &block, &index);
+			gst_adapter_unmap(export->adapter);
+			if(!res && index) {
+				export->state = gst_mjr_export_state_index;
+				continue;
+			} else if(!res) {
+				GST_ELEMENT_ERROR(export, STREAM, DECODE, (NULL), ("Invalid block."));
+				return GST_FLOW_ERROR;
+			}
+			if(available < GST_MJR_BLOCK_HEADER_SIZE + (gsize)block.compressed_size)
+				break;
+			data = gst_adapter_map(export->adapter, GST_MJR_BLOCK_HEADER_SIZE + block.compressed_size);
+			g_byte_array_set_size(export->block, block.size);
+			res = gst_mjr_block_decompress(data + GST_MJR_BLOCK_HEADER_SIZE, block.compressed_size,
+				export->block->data, block.size);
+			gst_adapter_unmap(export->adapter);
+			gst_adapter_flush(export->adapter, GST_MJR_BLOCK_HEADER_SIZE + block.compressed_size);
+			if(!res) {
+				GST_ELEMENT_ERROR(export, STREAM, DECODE, (NULL), ("Error decompressing block."));
+				return GST_FLOW_ERROR;
+			}
+			/* Records in the block are the same as in uncompressed files */
+			guint offset = 0;
+			while(ret == GST_FLOW_OK && offset + GST_MJR_FRAME_HEADER_SIZE <= export->block->len) {
+				const guint8 *record = export->block->data + offset;
+				guint32 received = 0;
+				memcpy(&received, record + 4, sizeof(received));
+				guint16 len = 0;
+				memcpy(&len, record + 8, sizeof(len));
+				len = g_ntohs(len);
+				if(memcmp(record, "MEET", 4) ||
+						offset + GST_MJR_FRAME_HEADER_SIZE + len > export->block->len) {
+					GST_ELEMENT_ERROR(export, STREAM, DECODE, (NULL), ("Invalid data."));
+					return GST_FLOW_ERROR;
+				}
+				ret = gst_mjr_export_packet(export, record + GST_MJR_FRAME_HEADER_SIZE,
+					len, g_ntohl(received));
+				offset += GST_MJR_FRAME_HEADER_SIZE + len;
+			}
+		} else {
+			/* Records */
+			if(available < GST_MJR_FRAME_HEADER_SIZE)
+				break;
+			const guint8 *data = gst_adapter_map(export->adapter, GST_MJR_FRAME_HEADER_SIZE);
+			if(data[0] != 'M' || data[1] != 'E' || data[2] != 'E' || data[3] != 'T') {
+				gst_adapter_unmap(export->adapter);
+				GST_ELEMENT_ERROR(export, STREAM, DECODE, (NULL), ("Invalid data."));
+				return GST_FLOW_ERROR;
+			}
+			guint32 received = 0;
+			if(!export->info.legacy) {
+				memcpy(&received, data + 4, sizeof(received));
+				received = g_ntohl(received);
+			}
+			guint16 len = 0;
+			memcpy(&len, data + 8, sizeof(len));
+			len = g_ntohs(len);
+			gst_adapter_unmap(export->adapter);
+			if(available < GST_MJR_FRAME_HEADER_SIZE + (gsize)len)
+				break;
+			data = gst_adapter_map(export->adapter, GST_MJR_FRAME_HEADER_SIZE + len);
+			ret = gst_mjr_export_packet(export, data + GST_MJR_FRAME_HEADER_SIZE, len, received);
+			gst_adapter_unmap(export->adapter);
+			gst_adapter_flush(export->adapter, GST_MJR_FRAME_HEADER_SIZE + len);
+		}
+	}
+	return ret;
+}
+
+/* Register the element in the plugin */
+gboolean mjr_export_register(GstPlugin *plugin) {
+	return GST_ELEMENT_REGISTER(mjrexport, plugin);
+}
@@ -0,0 +1,110 @@
+/*
+ * GStreamer
+ * Copyright (C) 2005 Thomas Vander Stichele <thomas@apestaart.org>
+ * Copyright (C) 2005 Ronald S. Bultje <rbultje@ronald.bitfreak.net>
+ * Copyright (C) 2024 Lorenzo Miniero <lorenzo@meetecho.com>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ *
+ * Alternatively, the contents of this file may be used under the
+ * GNU Lesser General Public License Version 2.1 (the "LGPL"), in
+ * which case the following provisions apply instead of the ones
+ * mentioned above:
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 02111-1307, USA.
+ */
+
+#ifndef __GST_MJR_EXPORT_H__
+#define __GST_MJR_EXPORT_H__
+
+#include <gst/gst.h>
+#include <gst/base/gstadapter.h>
+
+#include "gstmjrutils.h"
+
+G_BEGIN_DECLS
+
+#define GST_TYPE_MJR_EXPORT gst_mjr_export_get_type()
+G_DECLARE_FINAL_TYPE(GstMjrExport, gst_mjr_export, GST, MJR_EXPORT, GstElement)
+
+/* Formats we can export to */
+typedef enum gst_mjr_export_format {
+	gst_mjr_export_format_pcap,
+	gst_mjr_export_format_rtpdump,
+} gst_mjr_export_format;
+
+typedef enum gst_mjr_export_state {
+	gst_mjr_export_state_header,
+	gst_mjr_export_state_json,
+	gst_mjr_export_state_packets,
+	gst_mjr_export_state_blocks,
+	gst_mjr_export_state_index,
+} gst_mjr_export_state;
+
+struct _GstMjrExport {
+	GstElement element;
+	gboolean silent;
+	gst_mjr_export_format format;
+	guint buffer_size;
+	guint port;
+
+	/* MJR related stuff */
+	GstAdapter *adapter;
+	gst_mjr_export_state state;
+	gsize json_len;
+	gst_mjr_info info;
+	GByteArray *block;
+	/* Legacy recordings have no received time, so we use RTP timestamps */
+	gboolean ts_initialized;
+	guint32 ssrc;
+	gst_mjr_timestamp ts;
+
+	/* Output: records are written to a large buffer, that is only pushed
+	 * when full (or at the end of the recording) */
+	gboolean started;
+	GstBuffer *out;
+	GstMapInfo out_map;
+	gsize out_len;
+	guint64 offset;
+	guint16 ip_id;
+	guint64 packets;
+
+	/* Pads */
+	GstPad *sinkpad, *srcpad;
+};
+
+G_END_DECLS
+
+GType gst_mjr_export_format_get_type(void);
+gboolean mjr_export_register(GstPlugin *plugin);
+
+#endif /* __GST_MJR_EXPORT_H__ */
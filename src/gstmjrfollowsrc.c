@@ -0,0 +1,560 @@
+/*
+ * GStreamer
+ * Copyright (C) 2005 Thomas Vander Stichele <thomas@apestaart.org>
+ * Copyright (C) 2005 Ronald S. Bultje <rbultje@ronald.bitfreak.net>
+ * Copyright (C) 2024 Lorenzo Miniero <lorenzo@meetecho.com>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ *
+ * Alternatively, the contents of this file may be used under the
+ * GNU Lesser General Public License Version 2.1 (the "LGPL"), in
+ * which case the following provisions apply instead of the ones
+ * mentioned above:
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 02111-1307, USA.
+ */
+
+/**
+ * SECTION:element-mjrfollowsrc
+ *
+ * Reads an MJR file that may still be being written (e.g., by Janus), and
+ * waits for more data when it gets to the end of it, rather than sending
+ * an EOS: on Linux, inotify is used to be notified as soon as data is
+ * appended, without polling. The EOS is sent when the writer closes the
+ * file (or removes it), or when nothing is written for a configurable
+ * amount of time. The data is meant to be fed to mjrdemux, that will
+ * resume parsing from where it left. For files on high latency storage
+ * (e.g., network filesystems), reads of the next chunks can be issued in
+ * advance on a pool of threads, so that many are in flight at once.
+ *
+ * <refsect2>
+ * <title>Example launch line</title>
+ * |[
+ * gst-launch-1.0 mjrfollowsrc location=rec-sample-video.mjr ! mjrdemux ! udpsink host=127.0.0.1 port=5002
+ * ]|
+ * </refsect2>
+ */
+
+#ifdef HAVE_CONFIG_H
+#  include <config.h>
+#endif
+
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#ifdef HAVE_INOTIFY
+#include <sys/inotify.h>
+#endif
+
+#include <gst/gst.h>
+#include <glib/gstdio.h>
+
+#include "gstmjrfollowsrc.h"
+
+enum {
+	LAST_SIGNAL
+};
+
+enum {
+	PROP_0,
+	PROP_SILENT,
+	PROP_LOCATION,
+	PROP_FOLLOW,
+	PROP_IDLE_TIMEOUT,
+	PROP_READ_AHEAD,
+	PROP_IO_THREADS
+};
+
+/* When inotify is not available, how often we check if the file grew */
+#define GST_MJR_FOLLOW_SRC_POLL_INTERVAL	(10 * GST_MSECOND)
+
+/* Read of a chunk of the file, when reading ahead */
+typedef struct gst_mjr_follow_src_job {
+	GstBuffer *buffer;
+	guint64 offset;
+	gsize size, len;
+	int error;
+	gboolean done, orphaned;
+} gst_mjr_follow_src_job;
+
+/* Pad templates: we just push the content of the file */
+static GstStaticPadTemplate srctemplate = GST_STATIC_PAD_TEMPLATE("src",
+	GST_PAD_SRC,
+	GST_PAD_ALWAYS,
+	GST_STATIC_CAPS_ANY
+);
+
+#define gst_mjr_follow_src_parent_class parent_class
+	G_DEFINE_TYPE(GstMjrFollowSrc, gst_mjr_follow_src, GST_TYPE_PUSH_SRC);
+
+GST_ELEMENT_REGISTER_DEFINE(mjrfollowsrc, "mjrfollowsrc", GST_RANK_NONE,
+	GST_TYPE_MJR_FOLLOW_SRC);
+
+/* Property setters/getters */
+static void gst_mjr_follow_src_set_property(GObject *object,
+	guint prop_id, const GValue *value, GParamSpec *pspec);
+static void gst_mjr_follow_src_get_property(GObject *object,
+	guint prop_id, GValue *value, GParamSpec *pspec);
+static void gst_mjr_follow_src_finalize(GObject *object);
+
+/* Source methods */
+static gboolean gst_mjr_follow_src_start(GstBaseSrc *basesrc);
+static gboolean gst_mjr_follow_src_stop(GstBaseSrc *basesrc);
+static gboolean gst_mjr_follow_src_unlock(GstBaseSrc *basesrc);
+static gboolean gst_mjr_follow_src_unlock_stop(GstBaseSrc *basesrc);
+static GstFlowReturn gst_mjr_follow_src_create(GstPushSrc *pushsrc, GstBuffer **buf);
+
+/* Initialize the mjrfollowsrc's class */
+static void gst_mjr_follow_src_class_init(GstMjrFollowSrcClass *klass) {
+	GObjectClass *gobject_class;
+	GstElementClass *gstelement_class;
+	GstBaseSrcClass *gstbasesrc_class;
+	GstPushSrcClass *gstpushsrc_class;
+
+	gobject_class = (GObjectClass *)klass;
+	gstelement_class = (GstElementClass *)klass;
+	gstbasesrc_class = (GstBaseSrcClass *)klass;
+	gstpushsrc_class = (GstPushSrcClass *)klass;
+
+	gobject_class->set_property = gst_mjr_follow_src_set_property;
+	gobject_class->get_property = gst_mjr_follow_src_get_property;
+	gobject_class->finalize = gst_mjr_follow_src_finalize;
+
+	g_object_class_install_property(gobject_class, PROP_SILENT,
+		g_param_spec_boolean("silent", "Silent", "Don't produce verbose output",
+			TRUE, G_PARAM_READWRITE | GST_PARAM_MUTABLE_PLAYING));
+	g_object_class_install_property(gobject_class, PROP_LOCATION,
+		g_param_spec_string("location", "Location", "MJR file to read",
+			NULL, G_PARAM_READWRITE | GST_PARAM_MUTABLE_READY));
+	g_object_class_install_property(gobject_class, PROP_FOLLOW,
+		g_param_spec_boolean("follow", "Follow", "Wait for more data at the end of the file, until the writer closes it",
+			TRUE, G_PARAM_READWRITE | GST_PARAM_MUTABLE_READY));
+	g_object_class_install_property(gobject_class, PROP_IDLE_TIMEOUT,
+		g_param_spec_uint("idle-timeout", "Idle timeout", "When following, send an EOS if nothing is written for this many milliseconds (0=wait forever)",
+			0, G_MAXUINT, 0, G_PARAM_READWRITE | GST_PARAM_MUTABLE_READY));
+	g_object_class_install_property(gobject_class, PROP_READ_AHEAD,
+		g_param_spec_uint("read-ahead", "Read ahead", "How many chunks of blocksize bytes to read in advance, in parallel (0=read synchronously)",
+			0, 256, 0, G_PARAM_READWRITE | GST_PARAM_MUTABLE_READY));
+	g_object_class_install_property(gobject_class, PROP_IO_THREADS,
+		g_param_spec_uint("io-threads", "I/O threads", "How many threads to use to read ahead",
+			1, 64, 4, G_PARAM_READWRITE | GST_PARAM_MUTABLE_READY));
+
+	gstbasesrc_class->start = GST_DEBUG_FUNCPTR(gst_mjr_follow_src_start);
+	gstbasesrc_class->stop = GST_DEBUG_FUNCPTR(gst_mjr_follow_src_stop);
+	gstbasesrc_class->unlock = GST_DEBUG_FUNCPTR(gst_mjr_follow_src_unlock);
+	gstbasesrc_class->unlock_stop = GST_DEBUG_FUNCPTR(gst_mjr_follow_src_unlock_stop);
+	gstpushsrc_class->create = GST_DEBUG_FUNCPTR(gst_mjr_follow_src_create);
+
+	gst_element_class_set_details_simple(gstelement_class,
+		"Janus MJR Follow Source",
+		"Source/File",
+		"Read an MJR file while it's still being written",
+		"Lorenzo Miniero <lorenzo@meetecho.com>");
+	gst_element_class_add_static_pad_template(gstelement_class, &srctemplate);
+}
+
+/* Initialize the new element */
+static void gst_mjr_follow_src_init(GstMjrFollowSrc *src) {
+	src->silent = TRUE;
+	src->location = NULL;
+	src->fd = -1;
+	src->offset = 0;
+	src->follow = TRUE;
+	src->idle_timeout = 0;
+	src->inotify_fd = -1;
+	src->closed = FALSE;
+	src->poll = gst_poll_new(TRUE);
+	gst_poll_fd_init(&src->pollfd);
+	src->read_ahead = 0;
+	src->io_threads = 4;
+	src->pool = NULL;
+	g_mutex_init(&src->ra_mutex);
+	g_cond_init(&src->ra_cond);
+	g_queue_init(&src->ra_jobs);
+	src->ra_offset = 0;
+	src->ra_flushing = FALSE;
+	gst_base_src_set_format(GST_BASE_SRC(src), GST_FORMAT_BYTES);
+}
+
+/* Property setter */
+static void gst_mjr_follow_src_set_property(GObject *object, guint prop_id, const GValue *value, GParamSpec *pspec) {
+	GstMjrFollowSrc *src = GST_MJR_FOLLOW_SRC(object);
+	/* Set the specified property */
+	switch(prop_id) {
+		case PROP_SILENT:
+			src->silent = g_value_get_boolean(value);
+			break;
+		case PROP_LOCATION:
+			g_free(src->location);
+			src->location = g_value_dup_string(value);
+			break;
+		case PROP_FOLLOW:
+			src->follow = g_value_get_boolean(value);
+			break;
+		case PROP_IDLE_TIMEOUT:
+			src->idle_timeout = g_value_get_uint(value);
+			break;
+		case PROP_READ_AHEAD:
+			src->read_ahead = g_value_get_uint(value);
+			break;
+		case PROP_IO_THREADS:
+			src->io_threads = g_value_get_uint(value);
+			break;
+		default:
+			G_OBJECT_WARN_INVALID_PROPERTY_ID(object, prop_id, pspec);
+			break;
+	}
+}
+
+/* Property getter */
+static void gst_mjr_follow_src_get_property(GObject *object, guint prop_id, GValue *value, GParamSpec *pspec) {
+	GstMjrFollowSrc *src = GST_MJR_FOLLOW_SRC(object);
+	/* Get the specified property */
+	switch(prop_id) {
+		case PROP_SILENT:
+			g_value_set_boolean(value, src->silent);
+			break;
+		case PROP_LOCATION:
+			g_value_set_string(value, src->location);
+			break;
+		case PROP_FOLLOW:
+			g_value_set_boolean(value, src->follow);
+			break;
+		case PROP_IDLE_TIMEOUT:
+			g_value_set_uint(value, src->idle_timeout);
+			break;
+		case PROP_READ_AHEAD:
+			g_value_set_uint(value, src->read_ahead);
+			break;
+		case PROP_IO_THREADS:
+			g_value_set_uint(value, src->io_threads);
+			break;
+		default:
+			G_OBJECT_WARN_INVALID_PROPERTY_ID(object, prop_id, pspec);
+			break;
+	}
+}
+
+/* Cleanup */
+static void gst_mjr_follow_src_finalize(GObject *object) {
+	GstMjrFollowSrc *src = GST_MJR_FOLLOW_SRC(object);
+	g_free(src->location);
+	gst_poll_free(src->poll);
+	g_mutex_clear(&src->ra_mutex);
+	g_cond_clear(&src->ra_cond);
+	G_OBJECT_CLASS(parent_class)->finalize(object);
+}
+
+/* Free a read-ahead job, and its buffer if it's still there */
+static void gst_mjr_follow_src_job_free(gst_mjr_follow_src_job *job) {
+	if(job->buffer != NULL)
+		gst_buffer_unref(job->buffer);
+	g_free(job);
+}
+
+/* Thread pool function, to read a chunk of the file */
+static void gst_mjr_follow_src_job_run(gpointer data, gpointer user_data) {
+	gst_mjr_follow_src_job *job = (gst_mjr_follow_src_job *)data;
+	GstMjrFollowSrc *src = GST_MJR_FOLLOW_SRC(user_data);
+	GstMapInfo map;
+	gst_buffer_map(job->buffer, &map, GST_MAP_WRITE);
+	ssize_t len = 0;
+	do {
+		len = pread(src->fd, map.data, job->size, job->offset);
+	} while(len < 0 && errno == EINTR);
+	int error = len < 0 ? errno : 0;
+	gst_buffer_unmap(job->buffer, &map);
+	g_mutex_lock(&src->ra_mutex);
+	job->len = len > 0 ? len : 0;
+	job->error = error;
+	job->done = TRUE;
+	if(job->orphaned) {
+		/* Nobody's waiting for this anymore */
+		gst_mjr_follow_src_job_free(job);
+	} else {
+		g_cond_broadcast(&src->ra_cond);
+	}
+	g_mutex_unlock(&src->ra_mutex);
+}
+
+/* Get rid of the reads we issued: the ones still in progress are freed
+ * by the thread taking care of them, when they're done (lock held) */
+static void gst_mjr_follow_src_cancel_jobs(GstMjrFollowSrc *src) {
+	gst_mjr_follow_src_job *job = NULL;
+	while((job = g_queue_pop_head(&src->ra_jobs)) != NULL) {
+		if(job->done)
+			gst_mjr_follow_src_job_free(job);
+		else
+			job->orphaned = TRUE;
+	}
+}
+
+/* Start: open the file, and start watching it if needed */
+static gboolean gst_mjr_follow_src_start(GstBaseSrc *basesrc) {
+	GstMjrFollowSrc *src = GST_MJR_FOLLOW_SRC(basesrc);
+	if(src->location == NULL) {
+		GST_ELEMENT_ERROR(src, RESOURCE, NOT_FOUND, (NULL), ("No location specified."));
+		return FALSE;
+	}
+	src->fd = g_open(src->location, O_RDONLY, 0);
+	if(src->fd < 0) {
+		GST_ELEMENT_ERROR(src, RESOURCE, OPEN_READ, (NULL),
+			("Error opening file '%s' (%s).", src->location, g_strerror(errno)));
+		return FALSE;
+	}
+	src->offset = 0;
+	src->closed = FALSE;
+	if(src->read_ahead > 0) {
+		GError *error = NULL;
+		src->pool = g_thread_pool_new(gst_mjr_follow_src_job_run, src, src->io_threads, FALSE, &error);
+		if(src->pool == NULL) {
+			GST_ELEMENT_ERROR(src, RESOURCE, FAILED, (NULL),
+				("Error creating the read-ahead threads (%s).", error ? error->message : "??"));
+			g_clear_error(&error);
+			close(src->fd);
+			src->fd = -1;
+			return FALSE;
+		}
+		src->ra_offset = 0;
+		src->ra_flushing = FALSE;
+	}
+#ifdef HAVE_INOTIFY
+	if(src->follow) {
+		/* Watch the file, so that we know when something is written, or
+		 * when the writer is done with it: if this fails, we poll instead */
+		src->inotify_fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+		if(src->inotify_fd >= 0 && inotify_add_watch(src->inotify_fd, src->location,
+				IN_MODIFY | IN_CLOSE_WRITE | IN_DELETE_SELF | IN_MOVE_SELF) < 0) {
+			close(src->inotify_fd);
+			src->inotify_fd = -1;
+		}
+		if(src->inotify_fd >= 0) {
+			gst_poll_fd_init(&src->pollfd);
+			src->pollfd.fd = src->inotify_fd;
+			gst_poll_add_fd(src->poll, &src->pollfd);
+			gst_poll_fd_ctl_read(src->poll, &src->pollfd, TRUE);
+		} else if(!src->silent) {
+			g_print("[mjrfollowsrc] Couldn't watch '%s', will poll instead\n", src->location);
+		}
+	}
+#endif
+	gst_poll_set_flushing(src->poll, FALSE);
+	return TRUE;
+}
+
+/* Stop: close the file */
+static gboolean gst_mjr_follow_src_stop(GstBaseSrc *basesrc) {
+	GstMjrFollowSrc *src = GST_MJR_FOLLOW_SRC(basesrc);
+	if(src->inotify_fd >= 0) {
+		gst_poll_remove_fd(src->poll, &src->pollfd);
+		close(src->inotify_fd);
+		src->inotify_fd = -1;
+	}
+	if(src->pool != NULL) {
+		/* Wait for the reads in progress, before closing the file */
+		g_mutex_lock(&src->ra_mutex);
+		gst_mjr_follow_src_cancel_jobs(src);
+		g_mutex_unlock(&src->ra_mutex);
+		g_thread_pool_free(src->pool, FALSE, TRUE);
+		src->pool = NULL;
+	}
+	if(src->fd >= 0) {
+		close(src->fd);
+		src->fd = -1;
+	}
+	return TRUE;
+}
+
+/* Interrupt a wait for more data */
+static gboolean gst_mjr_follow_src_unlock(GstBaseSrc *basesrc) {
+	GstMjrFollowSrc *src = GST_MJR_FOLLOW_SRC(basesrc);
+	gst_poll_set_flushing(src->poll, TRUE);
+	g_mutex_lock(&src->ra_mutex);
+	src->ra_flushing = TRUE;
+	g_cond_broadcast(&src->ra_cond);
+	g_mutex_unlock(&src->ra_mutex);
+	return TRUE;
+}
+
+/* Done interrupting */
+static gboolean gst_mjr_follow_src_unlock_stop(GstBaseSrc *basesrc) {
+	GstMjrFollowSrc *src = GST_MJR_FOLLOW_SRC(basesrc);
+	gst_poll_set_flushing(src->poll, FALSE);
+	g_mutex_lock(&src->ra_mutex);
+	src->ra_flushing = FALSE;
+	g_mutex_unlock(&src->ra_mutex);
+	return TRUE;
+}
+
+/* Read the inotify events we got, to check if the writer is done */
+static void gst_mjr_follow_src_read_events(GstMjrFollowSrc *src) {
+#ifdef HAVE_INOTIFY
+	char events[4096] __attribute__ ((aligned(__alignof__(struct inotify_event))));
+	ssize_t len = 0;
+	while((len = read(src->inotify_fd, events, sizeof(events))) > 0) {
+		char *ptr = events;
+		while(ptr < events + len) {
+			struct inotify_event *event = (struct inotify_event *)ptr;
+			if(event->mask & (IN_CLOSE_WRITE | IN_DELETE_SELF | IN_MOVE_SELF)) {
+				if(!src->closed && !src->silent)
+					g_print("[mjrfollowsrc] Writer is done with '%s'\n", src->location);
+				src->closed = TRUE;
+			}
+			ptr += sizeof(struct inotify_event) + event->len;
+		}
+	}
+#endif
+}
+
+/* Get the next chunk of the file when reading ahead, issuing the reads
+ * of the chunks that follow it: a short read means we got to the end
+ * of the file (at least for now), so we cancel the reads after it */
+static GstFlowReturn gst_mjr_follow_src_read_ahead(GstMjrFollowSrc *src, GstBuffer **buf) {
+	guint blocksize = gst_base_src_get_blocksize(GST_BASE_SRC(src));
+	g_mutex_lock(&src->ra_mutex);
+	while(g_queue_get_length(&src->ra_jobs) < src->read_ahead) {
+		gst_mjr_follow_src_job *job = g_malloc0(sizeof(gst_mjr_follow_src_job));
+		job->offset = src->ra_offset;
+		/* Keep reads aligned to the block size */
+		job->size = blocksize - (job->offset % blocksize);
+		job->buffer = gst_buffer_new_allocate(NULL, job->size, NULL);
+		src->ra_offset += job->size;
+		g_queue_push_tail(&src->ra_jobs, job);
+		g_thread_pool_push(src->pool, job, NULL);
+	}
+	gst_mjr_follow_src_job *job = g_queue_peek_head(&src->ra_jobs);
+	while(!job->done && !src->ra_flushing)
+		g_cond_wait(&src->ra_cond, &src->ra_mutex);
+	if(src->ra_flushing) {
+		g_mutex_unlock(&src->ra_mutex);
+		return GST_FLOW_FLUSHING;
+	}
+	g_queue_pop_head(&src->ra_jobs);
+	if(job->error != 0 || job->len < job->size) {
+		/* Start again from where this read ended, next time */
+		gst_mjr_follow_src_cancel_jobs(src);
+		src->ra_offset = job->offset + job->len;
+	}
+	g_mutex_unlock(&src->ra_mutex);
+	if(job->error != 0) {
+		GST_ELEMENT_ERROR(src, RESOURCE, READ, (NULL),
+			("Error reading file '%s' (%s).", src->location, g_strerror(job->error)));
+		gst_mjr_follow_src_job_free(job);
+		return GST_FLOW_ERROR;
+	}
+	gst_buffer_set_size(job->buffer, job->len);
+	*buf = job->buffer;
+	job->buffer = NULL;
+	gst_mjr_follow_src_job_free(job);
+	return GST_FLOW_OK;
+}
+
+/* Read the next chunk of data, waiting for it if needed */
+static GstFlowReturn gst_mjr_follow_src_create(GstPushSrc *pushsrc, GstBuffer **buf) {
+	GstMjrFollowSrc *src = GST_MJR_FOLLOW_SRC(pushsrc);
+	guint blocksize = gst_base_src_get_blocksize(GST_BASE_SRC(src));
+	GstClockTime idle = 0;
+	while(TRUE) {
+		GstBuffer *buffer = NULL;
+		ssize_t len = 0;
+		if(src->pool != NULL) {
+			/* The read was issued already, get its result */
+			GstFlowReturn ret = gst_mjr_follow_src_read_ahead(src, &buffer);
+			if(ret != GST_FLOW_OK)
+				return ret;
+			len = gst_buffer_get_size(buffer);
+		} else {
+			buffer = gst_buffer_new_allocate(NULL, blocksize, NULL);
+			GstMapInfo map;
+			gst_buffer_map(buffer, &map, GST_MAP_WRITE);
+			len = read(src->fd, map.data, blocksize);
+			gst_buffer_unmap(buffer, &map);
+		}
+		if(len < 0) {
+			gst_buffer_unref(buffer);
+			if(errno == EINTR || errno == EAGAIN)
+				continue;
+			GST_ELEMENT_ERROR(src, RESOURCE, READ, (NULL),
+				("Error reading file '%s' (%s).", src->location, g_strerror(errno)));
+			return GST_FLOW_ERROR;
+		}
+		if(len > 0) {
+			/* Got some data, pass it along */
+			gst_buffer_set_size(buffer, len);
+			GST_BUFFER_OFFSET(buffer) = src->offset;
+			src->offset += len;
+			GST_BUFFER_OFFSET_END(buffer) = src->offset;
+			*buf = buffer;
+			return GST_FLOW_OK;
+		}
+		gst_buffer_unref(buffer);
+		/* We're at the end of the file: are we done? */
+		if(!src->follow || src->closed)
+			return GST_FLOW_EOS;
+		if(src->idle_timeout > 0 && idle >= src->idle_timeout * GST_MSECOND) {
+			if(!src->silent)
+				g_print("[mjrfollowsrc] Nothing written to '%s' for a while, we're done\n", src->location);
+			return GST_FLOW_EOS;
+		}
+		/* Wait for more data to be written */
+		GstClockTime timeout = GST_CLOCK_TIME_NONE;
+		if(src->inotify_fd < 0)
+			timeout = GST_MJR_FOLLOW_SRC_POLL_INTERVAL;
+		if(src->idle_timeout > 0) {
+			GstClockTime left = src->idle_timeout * GST_MSECOND - idle;
+			if(!GST_CLOCK_TIME_IS_VALID(timeout) || left < timeout)
+				timeout = left;
+		}
+		GstClockTime before = gst_util_get_timestamp();
+		gint res = gst_poll_wait(src->poll, timeout);
+		idle += gst_util_get_timestamp() - before;
+		if(res < 0) {
+			if(errno == EBUSY)
+				return GST_FLOW_FLUSHING;
+			if(errno == EINTR || errno == EAGAIN)
+				continue;
+			GST_ELEMENT_ERROR(src, RESOURCE, READ, (NULL),
+				("Error waiting for data on '%s' (%s).", src->location, g_strerror(errno)));
+			return GST_FLOW_ERROR;
+		}
+		if(res > 0) {
+			/* Something happened to the file */
+			gst_mjr_follow_src_read_events(src);
+			idle = 0;
+		}
+	}
+}
+
+/* Register the element in the plugin */
+gboolean mjr_follow_src_register(GstPlugin *plugin) {
+	return GST_ELEMENT_REGISTER(mjrfollowsrc, plugin);
+}
@@ -0,0 +1,443 @@
+/*
+ * GStreamer
+ * Copyright (C) 2005 Thomas Vander Stichele <thomas@apestaart.org>
+ * Copyright (C) 2005 Ronald S. Bultje <rbultje@ronald.bitfreak.net>
+ * Copyright (C) 2024 Lorenzo Miniero <lorenzo@meetecho.com>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ *
+ * Alternatively, the contents of this file may be used under the
+ * GNU Lesser General Public License Version 2.1 (the "LGPL"), in
+ * which case the following provisions apply instead of the ones
+ * mentioned above:
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 02111-1307, USA.
+ */
+
+/**
+ * SECTION:tracer-mjrlatency
+ *
+ * A tracer to measure how long RTP packets take to go from an mjrdemux
+ * instance to the sink, when replaying, and from the moment they enter an
+ * mjrmux instance to the moment the MJR data they end up in is handed to
+ * the sink, when recording. Buffers leaving mjrdemux (or entering mjrmux)
+ * are tagged with a meta carrying the time and the RTP sequence number
+ * and timestamp, which is then followed through the pipeline: each time
+ * a tagged buffer is pushed, the time since the previous push is added to
+ * the element pushing it, and when it reaches a sink, the latency since
+ * it was tagged is added to a histogram. The 50th and 99th percentiles
+ * and the maximum latency, and the share of time spent in each element,
+ * are logged every interval (one second by default) as tracer records.
+ * Buffers are only tagged when the tracer is enabled.
+ *
+ * <refsect2>
+ * <title>Example launch line</title>
+ * |[
+ * GST_TRACERS="mjrlatency(interval=5000)" GST_DEBUG="GST_TRACER:7" \
+ *   gst-launch-1.0 filesrc location=rec-sample-video.mjr ! mjrdemux ! \
+ *   rtpvp8depay ! vp8dec ! videoconvert ! autovideosink
+ * ]|
+ * </refsect2>
+ */
+
+#ifdef HAVE_CONFIG_H
+#  include <config.h>
+#endif
+
+#include <gst/gst.h>
+
+#include "gstmjrlatency.h"
+#include "gstmjrdemux.h"
+#include "gstmjrmux.h"
+#include "gstmjrutils.h"
+
+GST_DEBUG_CATEGORY_STATIC(gst_mjr_latency_debug);
+#define GST_CAT_DEFAULT gst_mjr_latency_debug
+
+/* Latencies are counted in log-linear buckets of microseconds: values up
+ * to 8us have their own bucket, and each power of two after that is split
+ * in 8 buckets, which means an error of 12.5% at most */
+#define GST_MJR_LATENCY_BUCKETS		256
+#define GST_MJR_LATENCY_SUB_BUCKETS	8
+
+/* Default interval for logging the statistics */
+#define GST_MJR_LATENCY_DEFAULT_INTERVAL	(1 * GST_SECOND)
+
+/* Meta we attach to buffers, to follow them through the pipeline */
+typedef struct gst_mjr_latency_meta {
+	GstMeta meta;
+	/* Element we started tracking the buffer from */
+	const gchar *origin;
+	/* When we started tracking the buffer, and when it was last pushed */
+	GstClockTime origin_ts, last_ts;
+	/* RTP info of the packet */
+	guint16 seq;
+	guint32 rtp_ts;
+} gst_mjr_latency_meta;
+
+/* Statistics for buffers coming from the same element */
+typedef struct gst_mjr_latency_stats {
+	const gchar *origin, *sink;
+	guint64 count, max;
+	guint64 histogram[GST_MJR_LATENCY_BUCKETS];
+	/* Time buffers spent in each element, and overall */
+	GHashTable *elements;
+	guint64 total;
+} gst_mjr_latency_stats;
+
+/* Records we log */
+static GstTracerRecord *tr_latency = NULL, *tr_element = NULL;
+
+#define gst_mjr_latency_tracer_parent_class parent_class
+	G_DEFINE_TYPE(GstMjrLatencyTracer, gst_mjr_latency_tracer, GST_TYPE_TRACER);
+
+/* Meta API and implementation */
+static GType gst_mjr_latency_meta_api_get_type(void) {
+	static gsize type = 0;
+	static const gchar *tags[] = { NULL };
+	if(g_once_init_enter(&type)) {
+		GType api = gst_meta_api_type_register("GstMjrLatencyMetaAPI", tags);
+		g_once_init_leave(&type, api);
+	}
+	return type;
+}
+
+static gboolean gst_mjr_latency_meta_init(GstMeta *meta, gpointer params, GstBuffer *buffer) {
+	gst_mjr_latency_meta *lmeta = (gst_mjr_latency_meta *)meta;
+	lmeta->origin = NULL;
+	lmeta->origin_ts = GST_CLOCK_TIME_NONE;
+	lmeta->last_ts = GST_CLOCK_TIME_NONE;
+	lmeta->seq = 0;
+	lmeta->rtp_ts = 0;
+	return TRUE;
+}
+
+static const GstMetaInfo *gst_mjr_latency_meta_get_info(void);
+static gboolean gst_mjr_latency_meta_transform(GstBuffer *dest, GstMeta *meta,
+		GstBuffer *buffer, GQuark type, gpointer data) {
+	/* We only care about copies (e.g., depayloaders copying metas from
+	 * the packets to the frames they create out of them) */
+	if(!GST_META_TRANSFORM_IS_COPY(type))
+		return FALSE;
+	gst_mjr_latency_meta *smeta = (gst_mjr_latency_meta *)meta;
+	gst_mjr_latency_meta *dmeta = (gst_mjr_latency_meta *)gst_buffer_add_meta(dest,
+		gst_mjr_latency_meta_get_info(), NULL);
+	if(dmeta == NULL)
+		return FALSE;
+	dmeta->origin = smeta->origin;
+	dmeta->origin_ts = smeta->origin_ts;
+	dmeta->last_ts = smeta->last_ts;
+	dmeta->seq = smeta->seq;
+	dmeta->rtp_ts = smeta->rtp_ts;
+	return TRUE;
+}
+
+static const GstMetaInfo *gst_mjr_latency_meta_get_info(void) {
+	static const GstMetaInfo *info = NULL;
+	if(g_once_init_enter((GstMetaInfo **)&info)) {
+		const GstMetaInfo *meta = gst_meta_register(gst_mjr_latency_meta_api_get_type(),
+			"GstMjrLatencyMeta", sizeof(gst_mjr_latency_meta),
+			gst_mjr_latency_meta_init, NULL, gst_mjr_latency_meta_transform);
+		g_once_init_leave((GstMetaInfo **)&info, (GstMetaInfo *)meta);
+	}
+	return info;
+}
+
+/* Histogram helpers */
+static guint gst_mjr_latency_bucket(guint64 us) {
+	if(us < GST_MJR_LATENCY_SUB_BUCKETS)
+		return us;
+	guint msb = g_bit_storage(us) - 1;
+	guint index = (msb - 2) * GST_MJR_LATENCY_SUB_BUCKETS + ((us >> (msb - 3)) & (GST_MJR_LATENCY_SUB_BUCKETS - 1));
+	return MIN(index, GST_MJR_LATENCY_BUCKETS - 1);
+}
+
+/* Largest value (in microseconds) that ends up in a bucket */
+static guint64 gst_mjr_latency_bucket_value(guint index) {
+	if(index < GST_MJR_LATENCY_SUB_BUCKETS)
+		return index;
+	guint msb = index / GST_MJR_LATENCY_SUB_BUCKETS + 2;
+	guint64 sub = index % GST_MJR_LATENCY_SUB_BUCKETS;
+	return ((GST_MJR_LATENCY_SUB_BUCKETS + sub + 1) << (msb - 3)) - 1;
+}
+
+static GstClockTime gst_mjr_latency_percentile(gst_mjr_latency_stats *stats, guint percent) {
+	guint64 target = (stats->count * percent + 99) / 100, seen = 0;
+	guint i = 0;
+	for(i=0; i<GST_MJR_LATENCY_BUCKETS; i++) {
+		seen += stats->histogram[i];
+		if(seen >= target)
+			return MIN(gst_mjr_latency_bucket_value(i) * GST_USECOND, stats->max);
+	}
+	return stats->max;
+}
+
+/* Statistics helpers */
+static gst_mjr_latency_stats *gst_mjr_latency_stats_new(const gchar *origin) {
+	gst_mjr_latency_stats *stats = g_malloc0(sizeof(gst_mjr_latency_stats));
+	stats->origin = origin;
+	stats->elements = g_hash_table_new_full(NULL, NULL, NULL, g_free);
+	return stats;
+}
+
+static void gst_mjr_latency_stats_free(gst_mjr_latency_stats *stats) {
+	g_hash_table_destroy(stats->elements);
+	g_free(stats);
+}
+
+/* Log the statistics we have, and start from scratch */
+static void gst_mjr_latency_report(GstMjrLatencyTracer *self) {
+	GHashTableIter iter, eiter;
+	gpointer value = NULL, key = NULL;
+	g_hash_table_iter_init(&iter, self->stats);
+	while(g_hash_table_iter_next(&iter, NULL, &value)) {
+		gst_mjr_latency_stats *stats = value;
+		if(stats->count > 0) {
+			gst_tracer_record_log(tr_latency, stats->origin, stats->sink, stats->count,
+				gst_mjr_latency_percentile(stats, 50), gst_mjr_latency_percentile(stats, 99), stats->max);
+		}
+		g_hash_table_iter_init(&eiter, stats->elements);
+		while(g_hash_table_iter_next(&eiter, &key, &value)) {
+			guint64 time = *(guint64 *)value;
+			gst_tracer_record_log(tr_element, stats->origin, (const gchar *)key, time,
+				stats->total > 0 ? (gdouble)time * 100.0 / (gdouble)stats->total : 0.0);
+		}
+		stats->count = 0;
+		stats->max = 0;
+		memset(stats->histogram, 0, sizeof(stats->histogram));
+		g_hash_table_remove_all(stats->elements);
+		stats->total = 0;
+	}
+}
+
+/* Get the element a pad belongs to, skipping ghost pads */
+static GstElement *gst_mjr_latency_get_parent(GstPad *pad) {
+	GstObject *parent = GST_OBJECT_PARENT(pad);
+	if(parent != NULL && GST_IS_GHOST_PAD(parent))
+		parent = GST_OBJECT_PARENT(parent);
+	return (parent != NULL && GST_IS_ELEMENT(parent)) ? GST_ELEMENT_CAST(parent) : NULL;
+}
+
+/* A buffer is being pushed on a pad */
+static void gst_mjr_latency_handle_buffer(GstMjrLatencyTracer *self, GstClockTime ts,
+		GstPad *pad, GstBuffer *buffer) {
+	GstElement *parent = gst_mjr_latency_get_parent(pad);
+	if(parent == NULL)
+		return;
+	/* Check who's going to get it: pushing to a ghost pad doesn't count,
+	 * since we'll see the buffer again when it's pushed to its target */
+	GstPad *peer = GST_PAD_PEER(pad);
+	GstElement *next = NULL;
+	if(peer != NULL && !GST_IS_GHOST_PAD(peer) && GST_IS_ELEMENT(GST_OBJECT_PARENT(peer)))
+		next = GST_ELEMENT_CAST(GST_OBJECT_PARENT(peer));
+	gst_mjr_latency_meta *meta = (gst_mjr_latency_meta *)gst_buffer_get_meta(buffer,
+		gst_mjr_latency_meta_api_get_type());
+	if(meta == NULL) {
+		/* We only start tracking buffers leaving mjrdemux or entering mjrmux */
+		GstElement *origin = NULL;
+		if(GST_IS_MJR_DEMUX(parent))
+			origin = parent;
+		else if(next != NULL && GST_IS_MJR_MUX(next))
+			origin = next;
+		if(origin == NULL || !gst_buffer_is_writable(buffer))
+			return;
+		meta = (gst_mjr_latency_meta *)gst_buffer_add_meta(buffer, gst_mjr_latency_meta_get_info(), NULL);
+		meta->origin = g_intern_string(GST_OBJECT_NAME(origin));
+		meta->origin_ts = ts;
+		meta->last_ts = ts;
+		gst_mjr_rtp rtp;
+		if(gst_buffer_extract(buffer, 0, &rtp, 12) == 12) {
+			meta->seq = g_ntohs(rtp.seq_number);
+			meta->rtp_ts = g_ntohl(rtp.timestamp);
+		}
+		return;
+	}
+	g_mutex_lock(&self->mutex);
+	gst_mjr_latency_stats *stats = g_hash_table_lookup(self->stats, meta->origin);
+	if(stats == NULL) {
+		stats = gst_mjr_latency_stats_new(meta->origin);
+		g_hash_table_insert(self->stats, (gpointer)meta->origin, stats);
+	}
+	/* The time since the buffer was last pushed was spent in this element */
+	if(ts > meta->last_ts) {
+		const gchar *name = g_intern_string(GST_OBJECT_NAME(parent));
+		guint64 *time = g_hash_table_lookup(stats->elements, name);
+		if(time == NULL) {
+			time = g_malloc0(sizeof(guint64));
+			g_hash_table_insert(stats->elements, (gpointer)name, time);
+		}
+		*time += ts - meta->last_ts;
+		stats->total += ts - meta->last_ts;
+	}
+	meta->last_ts = ts;
+	if(next != NULL && GST_OBJECT_FLAG_IS_SET(next, GST_ELEMENT_FLAG_SINK)) {
+		/* The buffer reached a sink */
+		GstClockTime latency = ts > meta->origin_ts ? ts - meta->origin_ts : 0;
+		GST_LOG("%s: packet seq=%" G_GUINT16_FORMAT ", ts=%" G_GUINT32_FORMAT " reached %s in %" GST_TIME_FORMAT,
+			meta->origin, meta->seq, meta->rtp_ts, GST_OBJECT_NAME(next), GST_TIME_ARGS(latency));
+		stats->sink = g_intern_string(GST_OBJECT_NAME(next));
+		stats->count++;
+		stats->histogram[gst_mjr_latency_bucket(latency / GST_USECOND)]++;
+		stats->max = MAX(stats->max, latency);
+	}
+	/* Check if it's time to log what we have */
+	if(!GST_CLOCK_TIME_IS_VALID(self->last_report)) {
+		self->last_report = ts;
+	} else if(ts - self->last_report >= self->interval) {
+		gst_mjr_latency_report(self);
+		self->last_report = ts;
+	}
+	g_mutex_unlock(&self->mutex);
+}
+
+/* Hooks */
+static void gst_mjr_latency_push_pre(GstMjrLatencyTracer *self, GstClockTime ts,
+		GstPad *pad, GstBuffer *buffer) {
+	gst_mjr_latency_handle_buffer(self, ts, pad, buffer);
+}
+
+static void gst_mjr_latency_push_list_pre(GstMjrLatencyTracer *self, GstClockTime ts,
+		GstPad *pad, GstBufferList *list) {
+	guint i = 0, len = gst_buffer_list_length(list);
+	for(i=0; i<len; i++)
+		gst_mjr_latency_handle_buffer(self, ts, pad, gst_buffer_list_get(list, i));
+}
+
+/* Parse the parameters, if any */
+static void gst_mjr_latency_tracer_constructed(GObject *object) {
+	GstMjrLatencyTracer *self = GST_MJR_LATENCY_TRACER(object);
+	G_OBJECT_CLASS(parent_class)->constructed(object);
+	gchar *params = NULL;
+	g_object_get(self, "params", &params, NULL);
+	if(params == NULL)
+		return;
+	gchar *str = g_strdup_printf("mjrlatency,%s", params);
+	GstStructure *s = gst_structure_from_string(str, NULL);
+	g_free(str);
+	g_free(params);
+	if(s == NULL) {
+		GST_WARNING_OBJECT(self, "Invalid parameters, ignoring them");
+		return;
+	}
+	gint interval = 0;
+	if(gst_structure_get_int(s, "interval", &interval) && interval > 0)
+		self->interval = interval * GST_MSECOND;
+	gst_structure_free(s);
+}
+
+/* Cleanup */
+static void gst_mjr_latency_tracer_finalize(GObject *object) {
+	GstMjrLatencyTracer *self = GST_MJR_LATENCY_TRACER(object);
+	g_mutex_lock(&self->mutex);
+	gst_mjr_latency_report(self);
+	g_mutex_unlock(&self->mutex);
+	g_hash_table_destroy(self->stats);
+	g_mutex_clear(&self->mutex);
+	G_OBJECT_CLASS(parent_class)->finalize(object);
+}
+
+/* Initialize the tracer's class */
+static void gst_mjr_latency_tracer_class_init(GstMjrLatencyTracerClass *klass) {
+	GObjectClass *gobject_class = (GObjectClass *)klass;
+	gobject_class->constructed = gst_mjr_latency_tracer_constructed;
+	gobject_class->finalize = gst_mjr_latency_tracer_finalize;
+
+	GST_DEBUG_CATEGORY_INIT(gst_mjr_latency_debug, "mjrlatency", 0, "MJR latency tracer");
+
+	tr_latency = gst_tracer_record_new("mjr-latency.class",
+		"origin", GST_TYPE_STRUCTURE, gst_structure_new("value",
+			"type", G_TYPE_GTYPE, G_TYPE_STRING,
+			"related-to", GST_TYPE_TRACER_VALUE_SCOPE, GST_TRACER_VALUE_SCOPE_ELEMENT,
+			NULL),
+		"sink", GST_TYPE_STRUCTURE, gst_structure_new("value",
+			"type", G_TYPE_GTYPE, G_TYPE_STRING,
+			"related-to", GST_TYPE_TRACER_VALUE_SCOPE, GST_TRACER_VALUE_SCOPE_ELEMENT,
+			NULL),
+		"count", GST_TYPE_STRUCTURE, gst_structure_new("value",
+			"type", G_TYPE_GTYPE, G_TYPE_UINT64,
+			"description", G_TYPE_STRING, "Buffers that reached the sink in this interval",
+			NULL),
+		"p50", GST_TYPE_STRUCTURE, gst_structure_new("value",
+			"type", G_TYPE_GTYPE, G_TYPE_UINT64,
+			"description", G_TYPE_STRING, "50th percentile of the latency in ns",
+			NULL),
+		"p99", GST_TYPE_STRUCTURE, gst_structure_new("value",
+			"type", G_TYPE_GTYPE, G_TYPE_UINT64,
+			"description", G_TYPE_STRING, "99th percentile of the latency in ns",
+			NULL),
+		"max", GST_TYPE_STRUCTURE, gst_structure_new("value",
+			"type", G_TYPE_GTYPE, G_TYPE_UINT64,
+			"description", G_TYPE_STRING, "Maximum latency in ns",
+			NULL),
+		NULL);
+	GST_OBJECT_FLAG_SET(tr_latency, GST_OBJECT_FLAG_MAY_BE_LEAKED);
+	tr_element = gst_tracer_record_new("mjr-latency-element.class",
+		"origin", GST_TYPE_STRUCTURE, gst_structure_new("value",
+			"type", G_TYPE_GTYPE, G_TYPE_STRING,
+			"related-to", GST_TYPE_TRACER_VALUE_SCOPE, GST_TRACER_VALUE_SCOPE_ELEMENT,
+			NULL),
+		"element", GST_TYPE_STRUCTURE, gst_structure_new("value",
+			"type", G_TYPE_GTYPE, G_TYPE_STRING,
+			"related-to", GST_TYPE_TRACER_VALUE_SCOPE, GST_TRACER_VALUE_SCOPE_ELEMENT,
+			NULL),
+		"time", GST_TYPE_STRUCTURE, gst_structure_new("value",
+			"type", G_TYPE_GTYPE, G_TYPE_UINT64,
+			"description", G_TYPE_STRING, "Time buffers spent in the element in this interval, in ns",
+			NULL),
+		"share", GST_TYPE_STRUCTURE, gst_structure_new("value",
+			"type", G_TYPE_GTYPE, G_TYPE_DOUBLE,
+			"description", G_TYPE_STRING, "Share of the overall time buffers spent in the element, in percent",
+			"min", G_TYPE_DOUBLE, 0.0,
+			"max", G_TYPE_DOUBLE, 100.0,
+			NULL),
+		NULL);
+	GST_OBJECT_FLAG_SET(tr_element, GST_OBJECT_FLAG_MAY_BE_LEAKED);
+}
+
+/* Initialize the new tracer */
+static void gst_mjr_latency_tracer_init(GstMjrLatencyTracer *self) {
+	g_mutex_init(&self->mutex);
+	self->interval = GST_MJR_LATENCY_DEFAULT_INTERVAL;
+	self->last_report = GST_CLOCK_TIME_NONE;
+	self->stats = g_hash_table_new_full(NULL, NULL,
+		NULL, (GDestroyNotify)gst_mjr_latency_stats_free);
+	/* Hooks are only installed when the tracer is enabled */
+	gst_tracing_register_hook(GST_TRACER(self), "pad-push-pre",
+		G_CALLBACK(gst_mjr_latency_push_pre));
+	gst_tracing_register_hook(GST_TRACER(self), "pad-push-list-pre",
+		G_CALLBACK(gst_mjr_latency_push_list_pre));
+}
+
+/* Register the tracer in the plugin */
+gboolean mjr_latency_tracer_register(GstPlugin *plugin) {
+	return gst_tracer_register(plugin, "mjrlatency", GST_TYPE_MJR_LATENCY_TRACER);
+}
@@ -65,20 +65,32 @@
 #include <json-glib/json-glib.h>
 
 #include "gstmjrmux.h"
+#include "gstmjrreader.h"
 #include "gstmjrutils.h"
 
 /* Info header in the structured recording */
 static const gchar *header = "MJR00002";
+/* Info header in the structured recording, when compressed */
+static const gchar *compressed_header = "MJRZ0002";
 /* Frame header in the structured recording */
 static const gchar *frame_header = "MEET";
 
 enum {
+	SIGNAL_TRIGGER,
 	LAST_SIGNAL
 };
+static guint gst_mjr_mux_signals[LAST_SIGNAL] = { 0 };
 
 enum {
 	PROP_0,
-	PROP_SILENT
+	PROP_SILENT,
+	PROP_COMPRESS,
+	PROP_BLOCK_SIZE,
+	PROP_DEDUP_WINDOW,
+	PROP_SPLIT_SSRC,
+	PROP_SNAPLEN,
+	PROP_PRE_RECORD_DURATION,
+	PROP_STATS
 };
 
 /* Pad templates: we take RTP in and shoot buffers out */
@@ -87,6 +99,11 @@ static GstStaticPadTemplate srctemplate = GST_STATIC_PAD_TEMPLATE("src",
 	GST_PAD_ALWAYS,
 	GST_STATIC_CAPS_ANY
 );
+static GstStaticPadTemplate ssrctemplate = GST_STATIC_PAD_TEMPLATE("src_%u",
+	GST_PAD_SRC,
+	GST_PAD_SOMETIMES,
+	GST_STATIC_CAPS_ANY
+);
 static GstStaticPadTemplate sinktemplate = GST_STATIC_PAD_TEMPLATE("sink",
 	GST_PAD_SINK,
 	GST_PAD_ALWAYS,
@@ -104,6 +121,10 @@ static void gst_mjr_mux_set_property(GObject *object,
 	guint prop_id, const GValue *value, GParamSpec *pspec);
 static void gst_mjr_mux_get_property(GObject *object,
 	guint prop_id, GValue *value, GParamSpec *pspec);
+static void gst_mjr_mux_finalize(GObject *object);
+
+/* Action signal to start writing, when pre-recording */
+static void gst_mjr_mux_trigger(GstMjrMux *mux);
 
 /* Pad and chain */
 static gboolean gst_mjr_mux_sink_event(GstPad *pad,
@@ -121,10 +142,37 @@ static void gst_mjr_mux_class_init(GstMjrMuxClass *klass) {
 
 	gobject_class->set_property = gst_mjr_mux_set_property;
 	gobject_class->get_property = gst_mjr_mux_get_property;
+	gobject_class->finalize = gst_mjr_mux_finalize;
 
 	g_object_class_install_property(gobject_class, PROP_SILENT,
 		g_param_spec_boolean ("silent", "Silent", "Don't produce verbose output",
 			TRUE, G_PARAM_READWRITE | GST_PARAM_MUTABLE_PLAYING));
+	g_object_class_install_property(gobject_class, PROP_COMPRESS,
+		g_param_spec_boolean("compress", "Compress", "Write a compressed MJR file, with an index of the compressed blocks",
+			FALSE, G_PARAM_READWRITE | GST_PARAM_MUTABLE_READY));
+	g_object_class_install_property(gobject_class, PROP_BLOCK_SIZE,
+		g_param_spec_uint("block-size", "Block size", "Size of the records to compress in a single block, when compressing",
+			1024, GST_MJR_MAX_BLOCK_SIZE - GST_MJR_FRAME_HEADER_SIZE - GST_MJR_MAX_RECORD_SIZE, GST_MJR_DEFAULT_BLOCK_SIZE,
+			G_PARAM_READWRITE | GST_PARAM_MUTABLE_READY));
+	g_object_class_install_property(gobject_class, PROP_DEDUP_WINDOW,
+		g_param_spec_uint("dedup-window", "Duplicates window", "How many recent sequence numbers to track per SSRC, to drop duplicate packets (0=disabled)",
+			0, 16384, 0, G_PARAM_READWRITE | GST_PARAM_MUTABLE_READY));
+	g_object_class_install_property(gobject_class, PROP_SPLIT_SSRC,
+		g_param_spec_boolean("split-ssrc", "Split SSRC", "Write a separate MJR file for each SSRC, on a src_%u pad (where %u is the SSRC)",
+			FALSE, G_PARAM_READWRITE | GST_PARAM_MUTABLE_READY));
+	g_object_class_install_property(gobject_class, PROP_SNAPLEN,
+		g_param_spec_uint("snaplen", "Snaplen", "Only store the RTP header and up to this many bytes of the payload of each packet (0=store whole packets)",
+			0, G_MAXUINT16, 0, G_PARAM_READWRITE | GST_PARAM_MUTABLE_READY));
+	g_object_class_install_property(gobject_class, PROP_PRE_RECORD_DURATION,
+		g_param_spec_uint("pre-record-duration", "Pre-record duration", "Only keep this many milliseconds of the most recent packets in memory, and start writing from them when the trigger signal is emitted (0=write everything)",
+			0, G_MAXUINT, 0, G_PARAM_READWRITE | GST_PARAM_MUTABLE_READY));
+	g_object_class_install_property(gobject_class, PROP_STATS,
+		g_param_spec_boxed("stats", "Statistics", "Statistics on the packets written and dropped",
+			GST_TYPE_STRUCTURE, G_PARAM_READABLE));
+
+	gst_mjr_mux_signals[SIGNAL_TRIGGER] = g_signal_new_class_handler("trigger",
+		G_TYPE_FROM_CLASS(klass), G_SIGNAL_RUN_LAST | G_SIGNAL_ACTION,
+		G_CALLBACK(gst_mjr_mux_trigger), NULL, NULL, NULL, G_TYPE_NONE, 0);
 
 	gst_element_class_set_details_simple(gstelement_class,
 		"Janus MJR Muxer",
@@ -132,17 +180,67 @@ static void gst_mjr_mux_class_init(GstMjrMuxClass *klass) {
 		"Mux RTP packets into an MJR recording",
 		"Lorenzo Miniero <lorenzo@meetecho.com>");
 	gst_element_class_add_static_pad_template(gstelement_class, &srctemplate);
+	gst_element_class_add_static_pad_template(gstelement_class, &ssrctemplate);
 	gst_element_class_add_static_pad_template(gstelement_class, &sinktemplate);
 }
 
+/* Initialize or reset an output */
+static void gst_mjr_mux_output_init(gst_mjr_mux_output *output, GstPad *srcpad, guint32 ssrc) {
+	output->srcpad = srcpad;
+	output->ssrc = ssrc;
+	output->initialized = FALSE;
+	output->written = 0;
+	output->first_ts = 0;
+	output->block = g_byte_array_new();
+	output->block_received = 0;
+	output->index = g_array_new(FALSE, FALSE, sizeof(gst_mjr_mux_index_entry));
+	output->bytes = 0;
+	g_queue_init(&output->pre_record);
+	g_queue_init(&output->pre_keyframes);
+	output->pre_record_bytes = 0;
+}
+
+/* Free a packet held in memory */
+static void gst_mjr_mux_pre_record_entry_free(gst_mjr_mux_pre_record_entry *entry) {
+	if(entry->buffer != NULL)
+		gst_buffer_unref(entry->buffer);
+	g_free(entry);
+}
+
+/* Get rid of the resources of an output */
+static void gst_mjr_mux_output_clear(gst_mjr_mux_output *output) {
+	g_byte_array_free(output->block, TRUE);
+	g_array_free(output->index, TRUE);
+	g_queue_clear(&output->pre_keyframes);
+	g_queue_clear_full(&output->pre_record, (GDestroyNotify)gst_mjr_mux_pre_record_entry_free);
+}
+
+/* Free a per-SSRC output */
+static void gst_mjr_mux_output_free(gst_mjr_mux_output *output) {
+	gst_mjr_mux_output_clear(output);
+	g_free(output);
+}
+
 /* Initialize the new element */
 static void gst_mjr_mux_init(GstMjrMux *mux) {
 	/* Reset private properties: we'll only set them when muxing */
 	mux->silent = TRUE;
-	mux->initialized = FALSE;
 	mux->video = FALSE;
 	mux->codec = 0;
 	mux->created = g_get_real_time();
+	mux->compress = FALSE;
+	mux->block_size = GST_MJR_DEFAULT_BLOCK_SIZE;
+	mux->split_ssrc = FALSE;
+	mux->snaplen = 0;
+	mux->pre_record_duration = 0;
+	mux->triggered = FALSE;
+	mux->live = FALSE;
+	mux->outputs = g_hash_table_new_full(NULL, NULL, NULL, (GDestroyNotify)gst_mjr_mux_output_free);
+	mux->flowcombiner = gst_flow_combiner_new();
+	mux->dedup_window = 0;
+	mux->dedup = g_hash_table_new_full(NULL, NULL, NULL, (GDestroyNotify)gst_mjr_seq_window_free);
+	mux->packets = 0;
+	mux->duplicates = 0;
 	/* Setup pads and chain */
 	mux->sinkpad = gst_pad_new_from_static_template(&sinktemplate, "sink");
 	gst_pad_set_event_function(mux->sinkpad,
@@ -153,6 +251,7 @@ static void gst_mjr_mux_init(GstMjrMux *mux) {
 	mux->srcpad = gst_pad_new_from_static_template(&srctemplate, "src");
 	gst_pad_use_fixed_caps(mux->srcpad);
 	gst_element_add_pad(GST_ELEMENT(mux), mux->srcpad);
+	gst_mjr_mux_output_init(&mux->output, mux->srcpad, 0);
 }
 
 /* Property setter */
@@ -163,6 +262,24 @@ static void gst_mjr_mux_set_property(GObject *object, guint prop_id, const GValu
 		case PROP_SILENT:
 			mux->silent = g_value_get_boolean(value);
 			break;
+		case PROP_COMPRESS:
+			mux->compress = g_value_get_boolean(value);
+			break;
+		case PROP_BLOCK_SIZE:
+			mux->block_size = g_value_get_uint(value);
+			break;
+		case PROP_DEDUP_WINDOW:
+			mux->dedup_window = g_value_get_uint(value);
+			break;
+		case PROP_SPLIT_SSRC:
+			mux->split_ssrc = g_value_get_boolean(value);
+			break;
+		case PROP_SNAPLEN:
+			mux->snaplen = g_value_get_uint(value);
+			break;
+		case PROP_PRE_RECORD_DURATION:
+			mux->pre_record_duration = g_value_get_uint(value);
+			break;
 		default:
 			G_OBJECT_WARN_INVALID_PROPERTY_ID(object, prop_id, pspec);
 			break;
@@ -177,12 +294,440 @@ static void gst_mjr_mux_get_property(GObject *object, guint prop_id, GValue *val
 		case PROP_SILENT:
 			g_value_set_boolean(value, mux->silent);
 			break;
+		case PROP_COMPRESS:
+			g_value_set_boolean(value, mux->compress);
+			break;
+		case PROP_BLOCK_SIZE:
+			g_value_set_uint(value, mux->block_size);
+			break;
+		case PROP_DEDUP_WINDOW:
+			g_value_set_uint(value, mux->dedup_window);
+			break;
+		case PROP_SPLIT_SSRC:
+			g_value_set_boolean(value, mux->split_ssrc);
+			break;
+		case PROP_SNAPLEN:
+			g_value_set_uint(value, mux->snaplen);
+			break;
+		case PROP_PRE_RECORD_DURATION:
+			g_value_set_uint(value, mux->pre_record_duration);
+			break;
+		case PROP_STATS:
+			GST_OBJECT_LOCK(mux);
+			g_value_take_boxed(value, gst_structure_new("application/x-mjrmux-stats",
+				"packets", G_TYPE_UINT64, mux->packets,
+				"duplicates", G_TYPE_UINT64, mux->duplicates,
+				NULL));
+			GST_OBJECT_UNLOCK(mux);
+			break;
 		default:
 			G_OBJECT_WARN_INVALID_PROPERTY_ID(object, prop_id, pspec);
 			break;
 	}
 }
 
+/* Cleanup */
+static void gst_mjr_mux_finalize(GObject *object) {
+	GstMjrMux *mux = GST_MJR_MUX(object);
+	gst_mjr_mux_output_clear(&mux->output);
+	g_hash_table_destroy(mux->outputs);
+	gst_flow_combiner_free(mux->flowcombiner);
+	g_hash_table_destroy(mux->dedup);
+	G_OBJECT_CLASS(parent_class)->finalize(object);
+}
+
+/* Helper to push data we created, keeping track of how much we wrote */
+static GstFlowReturn gst_mjr_mux_push(GstMjrMux *mux, gst_mjr_mux_output *output, GstBuffer *buf) {
+	output->bytes += gst_buffer_get_size(buf);
+	return gst_pad_push(output->srcpad, buf);
+}
+
+/* Write the MJR header and the JSON info header of an output */
+static GstFlowReturn gst_mjr_mux_push_header(GstMjrMux *mux, gst_mjr_mux_output *output) {
+	/* When pre-recording, we already know when the first packet was received */
+	if(output->written == 0)
+		output->written = g_get_real_time();
+	output->bytes = 0;
+	const gchar *mjr_header = mux->compress ? compressed_header : header;
+	GstBuffer *outbuf = gst_buffer_new_memdup(mjr_header, strlen(mjr_header));
+	GstFlowReturn res = gst_mjr_mux_push(mux, output, outbuf);
+	if(res != GST_FLOW_OK)
+		return res;
+	/* Create a JSON header */
+	JsonBuilder *builder = json_builder_new();
+	json_builder_begin_object(builder);
+	json_builder_set_member_name (builder, "t");
+	json_builder_add_string_value(builder, (mux->video ? "v" : "a"));
+	json_builder_set_member_name (builder, "c");
+	json_builder_add_string_value(builder, gst_mjr_codec_string(mux->codec));
+	json_builder_set_member_name (builder, "s");
+	json_builder_add_int_value(builder, mux->created);
+	json_builder_set_member_name (builder, "u");
+	json_builder_add_int_value(builder, output->written);
+	if(mux->compress) {
+		json_builder_set_member_name (builder, "z");
+		json_builder_add_string_value(builder, GST_MJR_COMPRESSION);
+	}
+	if(mux->snaplen > 0) {
+		json_builder_set_member_name (builder, "l");
+		json_builder_add_int_value(builder, mux->snaplen);
+	}
+	json_builder_end_object (builder);
+	JsonGenerator *gen = json_generator_new();
+	JsonNode * root = json_builder_get_root(builder);
+	json_generator_set_root(gen, root);
+	gchar *info_text = json_generator_to_data(gen, NULL);
+	json_node_free(root);
+	g_object_unref(gen);
+	g_object_unref(builder);
+	if(info_text == NULL) {
+		/* Error generating JSON string */
+		GST_ELEMENT_ERROR(mux, STREAM, ENCODE, (NULL), ("Invalid data."));
+		return GST_FLOW_ERROR;
+	}
+	/* First of all, write the size of the JSON string */
+	guint16 len = strlen(info_text);
+	len = g_htons(len);
+	outbuf = gst_buffer_new_memdup(&len, sizeof(len));
+	res = gst_mjr_mux_push(mux, output, outbuf);
+	if(res != GST_FLOW_OK) {
+		g_free(info_text);
+		return res;
+	}
+	/* Now write the JSON string itself */
+	outbuf = gst_buffer_new_memdup(info_text, strlen(info_text));
+	g_free(info_text);
+	return gst_mjr_mux_push(mux, output, outbuf);
+}
+
+/* Compress the records we have so far in a block, and push it */
+static GstFlowReturn gst_mjr_mux_push_block(GstMjrMux *mux, gst_mjr_mux_output *output) {
+	if(output->block->len == 0)
+		return GST_FLOW_OK;
+	GBytes *compressed = gst_mjr_block_compress(output->block->data, output->block->len);
+	if(compressed == NULL) {
+		GST_ELEMENT_ERROR(mux, STREAM, ENCODE, (NULL), ("Error compressing block."));
+		return GST_FLOW_ERROR;
+	}
+	/* Keep track of where this block is, for the index */
+	gst_mjr_mux_index_entry entry;
+	entry.offset = output->bytes;
+	entry.received = output->block_received;
+	g_array_append_val(output->index, entry);
+	/* Prepare the block header */
+	gst_mjr_block block;
+	block.compressed_size = g_bytes_get_size(compressed);
+	block.size = output->block->len;
+	block.received = output->block_received;
+	char header[GST_MJR_BLOCK_HEADER_SIZE];
+	gst_mjr_write_block(header, &block);
+	if(!mux->silent) {
+		g_print("[mjrmux] Compressed block of %" G_GUINT32_FORMAT " bytes to %" G_GUINT32_FORMAT " bytes\n",
+			block.size, block.compressed_size);
+	}
+	g_byte_array_set_size(output->block, 0);
+	/* Push the header and the compressed records as a single buffer */
+	GstBuffer *outbuf = gst_buffer_new_memdup(header, sizeof(header));
+	gst_buffer_append_memory(outbuf, gst_memory_new_wrapped(0,
+		(gpointer)g_bytes_get_data(compressed, NULL), block.compressed_size,
+		0, block.compressed_size, compressed, (GDestroyNotify)g_bytes_unref));
+	return gst_mjr_mux_push(mux, output, outbuf);
+}
+
+/* Push the last block, the index and the trailer of a compressed file */
+static GstFlowReturn gst_mjr_mux_push_index(GstMjrMux *mux, gst_mjr_mux_output *output) {
+	GstFlowReturn ret = gst_mjr_mux_push_block(mux, output);
+	if(ret != GST_FLOW_OK)
+		return ret;
+	guint64 offset = output->bytes;
+	gsize size = GST_MJR_INDEX_HEADER_SIZE + output->index->len * GST_MJR_INDEX_ENTRY_SIZE + GST_MJR_TRAILER_SIZE;
+	char *data = g_malloc(size), *pos = data;
+	memcpy(pos, "MJRI", 4);
+	guint32 value = g_htonl(output->index->len);
+	memcpy(pos + 4, &value, sizeof(value));
+	pos += GST_MJR_INDEX_HEADER_SIZE;
+	guint i = 0;
+	for(i=0; i<output->index->len; i++) {
+		gst_mjr_mux_index_entry *entry = &g_array_index(output->index, gst_mjr_mux_index_entry, i);
+		guint64 entry_offset = GUINT64_TO_BE(entry->offset);
+		memcpy(pos, &entry_offset, sizeof(entry_offset));
+		value = g_htonl(entry->received);
+		memcpy(pos + 8, &value, sizeof(value));
+		pos += GST_MJR_INDEX_ENTRY_SIZE;
+	}
+	/* The trailer tells readers where the index is */
+	offset = GUINT64_TO_BE(offset);
+	memcpy(pos, &offset, sizeof(offset));
+	memcpy(pos + 8, "MJRX", 4);
+	if(!mux->silent)
+		g_print("[mjrmux] Writing index of %u blocks\n", output->index->len);
+	g_array_set_size(output->index, 0);
+	return gst_mjr_mux_push(mux, output, gst_buffer_new_wrapped(data, size));
+}
+
+/* Write an RTP packet to an output */
+static GstFlowReturn gst_mjr_mux_push_packet(GstMjrMux *mux, gst_mjr_mux_output *output, GstBuffer *buf) {
+	GstFlowReturn ret = GST_FLOW_OK;
+	if(!output->initialized) {
+		/* We still need to create the main header, do it now */
+		output->initialized = TRUE;
+		output->first_ts = GST_BUFFER_TIMESTAMP(buf);
+		ret = gst_mjr_mux_push_header(mux, output);
+		if(ret != GST_FLOW_OK) {
+			gst_buffer_unref(buf);
+			return ret;
+		}
+	}
+	/* Prepare a received time */
+	guint64 ts = GST_BUFFER_TIMESTAMP(buf);
+	guint64 recvd = (ts - output->first_ts)/1000000;
+	guint32 recvd32 = recvd;
+	guint16 len = gst_buffer_get_size(buf);
+	guint16 original = len;
+	if(mux->snaplen > 0) {
+		/* Only keep the RTP header and the beginning of the payload: the
+		 * original length of the packet will follow it in the record */
+		GstMapInfo map;
+		gsize header = 12;
+		if(gst_buffer_map(buf, &map, GST_MAP_READ)) {
+			header = MAX(gst_mjr_rtp_header_size(map.data, map.size), 12);
+			gst_buffer_unmap(buf, &map);
+		}
+		len = MIN(len, MIN(header + mux->snaplen, GST_MJR_MAX_RECORD_SIZE - GST_MJR_SNAPLEN_TRAILER_SIZE));
+		if(len < original) {
+			GstBuffer *snapbuf = gst_buffer_copy_region(buf, GST_BUFFER_COPY_MEMORY, 0, len);
+			gst_buffer_unref(buf);
+			buf = snapbuf;
+		}
+	}
+	guint16 record_len = len + (mux->snaplen > 0 ? GST_MJR_SNAPLEN_TRAILER_SIZE : 0);
+	guint16 net_original = g_htons(original);
+	if(mux->compress) {
+		/* Add the record to the current block, rather than pushing it:
+		 * the record itself is exactly the same as in regular files */
+		if(output->block->len == 0)
+			output->block_received = recvd32;
+		guint offset = output->block->len;
+		g_byte_array_set_size(output->block, offset + GST_MJR_FRAME_HEADER_SIZE + record_len);
+		memcpy(output->block->data + offset, frame_header, strlen(frame_header));
+		recvd32 = g_htonl(recvd32);
+		memcpy(output->block->data + offset + 4, &recvd32, sizeof(recvd32));
+		guint16 net_len = g_htons(record_len);
+		memcpy(output->block->data + offset + 8, &net_len, sizeof(net_len));
+		gst_buffer_extract(buf, 0, output->block->data + offset + GST_MJR_FRAME_HEADER_SIZE, len);
+		gst_buffer_unref(buf);
+		if(mux->snaplen > 0) {
+			memcpy(output->block->data + offset + GST_MJR_FRAME_HEADER_SIZE + len,
+				&net_original, sizeof(net_original));
+		}
+		if(output->block->len >= mux->block_size)
+			ret = gst_mjr_mux_push_block(mux, output);
+		return ret;
+	}
+	/* Write the RTP packet to the file, starting from the prefix: we stop
+	 * at the first push that fails, and return that result as it is */
+	GstBuffer *outbuf = gst_buffer_new_memdup(frame_header, strlen(frame_header));
+	ret = gst_mjr_mux_push(mux, output, outbuf);
+	if(ret != GST_FLOW_OK) {
+		gst_buffer_unref(buf);
+		return ret;
+	}
+	recvd32 = g_htonl(recvd32);
+	outbuf = gst_buffer_new_memdup(&recvd32, sizeof(recvd32));
+	ret = gst_mjr_mux_push(mux, output, outbuf);
+	if(ret != GST_FLOW_OK) {
+		gst_buffer_unref(buf);
+		return ret;
+	}
+	/* Write the size of the RTP packet */
+	record_len = g_htons(record_len);
+	outbuf = gst_buffer_new_memdup(&record_len, sizeof(record_len));
+	ret = gst_mjr_mux_push(mux, output, outbuf);
+	if(ret != GST_FLOW_OK) {
+		gst_buffer_unref(buf);
+		return ret;
+	}
+	/* Send the buffer along */
+	ret = gst_mjr_mux_push(mux, output, buf);
+	if(ret == GST_FLOW_OK && mux->snaplen > 0) {
+		/* Followed by its original length */
+		outbuf = gst_buffer_new_memdup(&net_original, sizeof(net_original));
+		ret = gst_mjr_mux_push(mux, output, outbuf);
+	}
+	/* Done */
+	return ret;
+}
+
+/* Hold a packet in memory, rather than writing it, getting rid of the
+ * ones that are too old: for video, we always start from a keyframe, so
+ * we only drop packets when there's a more recent keyframe that is old
+ * enough, and drop everything that comes before the first keyframe */
+static void gst_mjr_mux_pre_record(GstMjrMux *mux, gst_mjr_mux_output *output, GstBuffer *buf) {
+	gst_mjr_mux_pre_record_entry *entry = g_malloc(sizeof(gst_mjr_mux_pre_record_entry));
+	entry->buffer = buf;
+	entry->received = g_get_real_time();
+	g_queue_push_tail(&output->pre_record, entry);
+	output->pre_record_bytes += gst_buffer_get_size(buf);
+	if(mux->video) {
+		GstMapInfo map;
+		if(gst_buffer_map(buf, &map, GST_MAP_READ)) {
+			gsize header = gst_mjr_rtp_header_size(map.data, map.size);
+			if(header > 0 && gst_mjr_is_keyframe(mux->codec, map.data + header, map.size - header))
+				g_queue_push_tail(&output->pre_keyframes, entry);
+			gst_buffer_unmap(buf, &map);
+		}
+	}
+	gint64 duration = (gint64)mux->pre_record_duration * 1000;
+	gst_mjr_mux_pre_record_entry *head = NULL;
+	while((head = g_queue_peek_head(&output->pre_record)) != NULL) {
+		gint64 age = entry->received - head->received;
+		gboolean drop = FALSE;
+		if(age > 2 * duration) {
+			/* Whatever happens, don't keep more than twice as much */
+			drop = TRUE;
+		} else if(!mux->video) {
+			drop = age > duration;
+		} else {
+			gst_mjr_mux_pre_record_entry *keyframe = g_queue_peek_head(&output->pre_keyframes);
+			if(keyframe != NULL && head != keyframe) {
+				/* Can't be decoded without what came before */
+				drop = TRUE;
+			} else if(keyframe != NULL) {
+				gst_mjr_mux_pre_record_entry *next = g_queue_peek_nth(&output->pre_keyframes, 1);
+				drop = next != NULL && entry->received - next->received >= duration;
+			}
+		}
+		if(!drop)
+			break;
+		g_queue_pop_head(&output->pre_record);
+		if(g_queue_peek_head(&output->pre_keyframes) == head)
+			g_queue_pop_head(&output->pre_keyframes);
+		output->pre_record_bytes -= gst_buffer_get_size(head->buffer);
+		gst_mjr_mux_pre_record_entry_free(head);
+	}
+}
+
+/* We've been triggered: write the packets we've been holding in memory */
+static GstFlowReturn gst_mjr_mux_pre_record_flush(GstMjrMux *mux, gst_mjr_mux_output *output) {
+	GstFlowReturn ret = GST_FLOW_OK;
+	gst_mjr_mux_pre_record_entry *entry = g_queue_peek_head(&output->pre_record);
+	if(entry == NULL)
+		return ret;
+	if(!mux->silent) {
+		g_print("[mjrmux] Writing %u packets (%" G_GSIZE_FORMAT " bytes) held in memory\n",
+			g_queue_get_length(&output->pre_record), output->pre_record_bytes);
+	}
+	/* The file was first written to when the oldest packet was received */
+	if(!output->initialized)
+		output->written = entry->received;
+	g_queue_clear(&output->pre_keyframes);
+	while((entry = g_queue_pop_head(&output->pre_record)) != NULL) {
+		GstBuffer *buf = entry->buffer;
+		entry->buffer = NULL;
+		gst_mjr_mux_pre_record_entry_free(entry);
+		if(ret == GST_FLOW_OK)
+			ret = gst_mjr_mux_push_packet(mux, output, buf);
+		else
+			gst_buffer_unref(buf);
+	}
+	output->pre_record_bytes = 0;
+	return ret;
+}
+
+/* We've never been triggered: get rid of the packets we've been holding */
+static void gst_mjr_mux_pre_record_drop(GstMjrMux *mux, gst_mjr_mux_output *output) {
+	if(g_queue_is_empty(&output->pre_record))
+		return;
+	if(!mux->silent) {
+		g_print("[mjrmux] Dropping %u packets (%" G_GSIZE_FORMAT " bytes) held in memory\n",
+			g_queue_get_length(&output->pre_record), output->pre_record_bytes);
+	}
+	g_queue_clear(&output->pre_keyframes);
+	g_queue_clear_full(&output->pre_record, (GDestroyNotify)gst_mjr_mux_pre_record_entry_free);
+	output->pre_record_bytes = 0;
+}
+
+/* Write the packets held in memory for all outputs, and stop holding them */
+static GstFlowReturn gst_mjr_mux_go_live(GstMjrMux *mux) {
+	mux->live = TRUE;
+	GstFlowReturn ret = gst_mjr_mux_pre_record_flush(mux, &mux->output);
+	GHashTableIter iter;
+	gpointer value = NULL;
+	g_hash_table_iter_init(&iter, mux->outputs);
+	while(g_hash_table_iter_next(&iter, NULL, &value)) {
+		gst_mjr_mux_output *output = value;
+		GstFlowReturn res = gst_mjr_mux_pre_record_flush(mux, output);
+		res = gst_flow_combiner_update_pad_flow(mux->flowcombiner, output->srcpad, res);
+		/* When splitting, the main output isn't used, so the combined
+		 * result of the per-SSRC outputs is what we should return */
+		if(mux->split_ssrc)
+			ret = res;
+	}
+	return ret;
+}
+
+/* Action signal to start writing, when pre-recording: we'll actually
+ * write what we have when we get the next packet, in the streaming thread */
+static void gst_mjr_mux_trigger(GstMjrMux *mux) {
+	if(mux->pre_record_duration == 0)
+		return;
+	if(!mux->silent)
+		g_print("[mjrmux] Triggered, going to write the packets held in memory\n");
+	g_atomic_int_set(&mux->triggered, TRUE);
+}
+
+/* Get the output for an SSRC, creating a new source pad if needed */
+static gst_mjr_mux_output *gst_mjr_mux_get_output(GstMjrMux *mux, guint32 ssrc) {
+	gst_mjr_mux_output *output = g_hash_table_lookup(mux->outputs, GUINT_TO_POINTER(ssrc));
+	if(output != NULL)
+		return output;
+	gchar *name = g_strdup_printf("src_%" G_GUINT32_FORMAT, ssrc);
+	GstPad *srcpad = gst_pad_new_from_static_template(&ssrctemplate, name);
+	g_free(name);
+	gst_pad_use_fixed_caps(srcpad);
+	gst_pad_set_active(srcpad, TRUE);
+	output = g_malloc0(sizeof(gst_mjr_mux_output));
+	gst_mjr_mux_output_init(output, srcpad, ssrc);
+	g_hash_table_insert(mux->outputs, GUINT_TO_POINTER(ssrc), output);
+	/* Each MJR file is a separate stream */
+	gchar *stream_id = gst_pad_create_stream_id_printf(srcpad,
+		GST_ELEMENT(mux), "%08x", ssrc);
+	GstEvent *event = gst_event_new_stream_start(stream_id);
+	g_free(stream_id);
+	gst_pad_store_sticky_event(srcpad, event);
+	gst_event_unref(event);
+	GstSegment segment;
+	gst_segment_init(&segment, GST_FORMAT_BYTES);
+	event = gst_event_new_segment(&segment);
+	gst_pad_store_sticky_event(srcpad, event);
+	gst_event_unref(event);
+	if(!mux->silent)
+		g_print("[mjrmux] New SSRC %" G_GUINT32_FORMAT ", adding pad\n", ssrc);
+	gst_element_add_pad(GST_ELEMENT(mux), srcpad);
+	gst_flow_combiner_add_pad(mux->flowcombiner, srcpad);
+	return output;
+}
+
+/* Check if an RTP packet is a duplicate of one we've written recently */
+static gboolean gst_mjr_mux_is_duplicate(GstMjrMux *mux, GstBuffer *buf) {
+	gst_mjr_rtp rtp;
+	if(gst_buffer_extract(buf, 0, &rtp, 12) < 12)
+		return FALSE;
+	guint32 ssrc = g_ntohl(rtp.ssrc);
+	gst_mjr_seq_window *window = g_hash_table_lookup(mux->dedup, GUINT_TO_POINTER(ssrc));
+	if(window == NULL) {
+		window = gst_mjr_seq_window_new(mux->dedup_window);
+		g_hash_table_insert(mux->dedup, GUINT_TO_POINTER(ssrc), window);
+	}
+	if(!gst_mjr_seq_window_check(window, g_ntohs(rtp.seq_number)))
+		return FALSE;
+	if(!mux->silent) {
+		g_print("[mjrmux] Dropping duplicate packet (ssrc=%" G_GUINT32_FORMAT ", seq=%" G_GUINT16_FORMAT ")\n",
+			ssrc, g_ntohs(rtp.seq_number));
+	}
+	return TRUE;
+}
+
 /* Handles sink events */
 static gboolean gst_mjr_mux_sink_event(GstPad *pad, GstObject *parent, GstEvent *event) {
 	GstMjrMux *mux = GST_MJR_MUX(parent);
@@ -231,6 +776,37 @@ static gboolean gst_mjr_mux_sink_event(GstPad *pad, GstObject *parent, GstEvent
 			ret = gst_pad_event_default(pad, parent, event);
 			break;
 		}
+		case GST_EVENT_EOS:
+			if(mux->pre_record_duration > 0 && !mux->live) {
+				if(g_atomic_int_get(&mux->triggered)) {
+					/* We were triggered, but got no packet since then */
+					gst_mjr_mux_go_live(mux);
+				} else {
+					/* We were never triggered, nothing to write */
+					gst_mjr_mux_pre_record_drop(mux, &mux->output);
+					GHashTableIter iter;
+					gpointer value = NULL;
+					g_hash_table_iter_init(&iter, mux->outputs);
+					while(g_hash_table_iter_next(&iter, NULL, &value))
+						gst_mjr_mux_pre_record_drop(mux, (gst_mjr_mux_output *)value);
+				}
+			}
+			/* If we're compressing, we need to write the index before we're done,
+			 * but only for the files we actually wrote a header to */
+			if(mux->compress) {
+				if(mux->output.initialized)
+					gst_mjr_mux_push_index(mux, &mux->output);
+				GHashTableIter iter;
+				gpointer value = NULL;
+				g_hash_table_iter_init(&iter, mux->outputs);
+				while(g_hash_table_iter_next(&iter, NULL, &value)) {
+					gst_mjr_mux_output *output = value;
+					if(output->initialized)
+						gst_mjr_mux_push_index(mux, output);
+				}
+			}
+			ret = gst_pad_event_default(pad, parent, event);
+			break;
 		default:
 			ret = gst_pad_event_default(pad, parent, event);
 			break;
@@ -246,67 +822,56 @@ static GstFlowReturn gst_mjr_mux_chain(GstPad *pad, GstObject *parent, GstBuffer
 	GstFlowReturn ret = GST_FLOW_OK;
 	if(!mux->silent)
 		g_print("[mjrmux] Got buffer of %zu bytes\n", gst_buffer_get_size(buf));
-	if(!mux->initialized) {
-		/* We still need to create the main header, do it now */
-		mux->initialized = TRUE;
-		mux->written = g_get_real_time();
-		mux->first_ts = GST_BUFFER_TIMESTAMP(buf);
-		GstBuffer *outbuf = gst_buffer_new_memdup(header, strlen(header));
-		GstFlowReturn res = gst_pad_push(mux->srcpad, outbuf);
-		/* Create a JSON header */
-		JsonBuilder *builder = json_builder_new();
-		json_builder_begin_object(builder);
-		json_builder_set_member_name (builder, "t");
-		json_builder_add_string_value(builder, (mux->video ? "v" : "a"));
-		json_builder_set_member_name (builder, "c");
-		json_builder_add_string_value(builder, gst_mjr_codec_string(mux->codec));
-		json_builder_set_member_name (builder, "s");
-		json_builder_add_int_value(builder, mux->created);
-		json_builder_set_member_name (builder, "u");
-		json_builder_add_int_value(builder, mux->written);
-		json_builder_end_object (builder);
-		JsonGenerator *gen = json_generator_new();
-		JsonNode * root = json_builder_get_root(builder);
-		json_generator_set_root(gen, root);
-		gchar *info_text = json_generator_to_data(gen, NULL);
-		json_node_free(root);
-		g_object_unref(gen);
-		g_object_unref(builder);
-		if(info_text == NULL) {
-			/* Error generating JSON string */
-			GST_ELEMENT_ERROR(mux, STREAM, ENCODE, (NULL), ("Invalid data."));
+	if(gst_buffer_get_size(buf) > GST_MJR_MAX_RECORD_SIZE) {
+		/* The length of records is 16 bits, so we can't store this packet */
+		GST_ELEMENT_WARNING(mux, STREAM, ENCODE, (NULL),
+			("Dropping packet too large for an MJR record (%" G_GSIZE_FORMAT " bytes)", gst_buffer_get_size(buf)));
+		gst_buffer_unref(buf);
+		return GST_FLOW_OK;
+	}
+	if(mux->dedup_window > 0 && gst_mjr_mux_is_duplicate(mux, buf)) {
+		/* We wrote this packet already, drop it */
+		GST_OBJECT_LOCK(mux);
+		mux->duplicates++;
+		GST_OBJECT_UNLOCK(mux);
+		gst_buffer_unref(buf);
+		return GST_FLOW_OK;
+	}
+	GST_OBJECT_LOCK(mux);
+	mux->packets++;
+	GST_OBJECT_UNLOCK(mux);
+	gboolean pre_record = mux->pre_record_duration > 0 && !mux->live;
+	if(pre_record && g_atomic_int_get(&mux->triggered)) {
+		/* We've been triggered, write what we have and go live */
+		pre_record = FALSE;
+		ret = gst_mjr_mux_go_live(mux);
+		if(ret != GST_FLOW_OK) {
 			gst_buffer_unref(buf);
-			return GST_FLOW_ERROR;
+			return ret;
 		}
-		/* First of all, write the size of the JSON string */
-		guint16 len = strlen(info_text);
-		len = g_htons(len);
-		outbuf = gst_buffer_new_memdup(&len, sizeof(len));
-		res |= gst_pad_push(mux->srcpad, outbuf);
-		/* Now write the JSON string itself */
-		outbuf = gst_buffer_new_memdup(info_text, strlen(info_text));
-		g_free(info_text);
-		res |= gst_pad_push(mux->srcpad, outbuf);
 	}
-	/* Write the RTP packet to the file, starting from the prefix */
-	GstBuffer *outbuf = gst_buffer_new_memdup(frame_header, strlen(frame_header));
-	ret |= gst_pad_push(mux->srcpad, outbuf);
-	/* Prepare a received time */
-	guint64 ts = GST_BUFFER_TIMESTAMP(buf);
-	guint64 recvd = (ts - mux->first_ts)/1000000;
-	guint32 recvd32 = recvd;
-	recvd32 = g_htonl(recvd32);
-	outbuf = gst_buffer_new_memdup(&recvd32, sizeof(recvd32));
-	ret |= gst_pad_push(mux->srcpad, outbuf);
-	/* Write the size of the RTP packet */
-	guint16 len = gst_buffer_get_size(buf);
-	len = g_htons(len);
-	outbuf = gst_buffer_new_memdup(&len, sizeof(len));
-	ret |= gst_pad_push(mux->srcpad, outbuf);
-	/* Send the buffer along */
-	ret |= gst_pad_push(mux->srcpad, buf);
-	/* Done */
-	return ret;
+	if(!mux->split_ssrc) {
+		/* Everything goes to the same MJR file */
+		if(pre_record) {
+			gst_mjr_mux_pre_record(mux, &mux->output, buf);
+			return GST_FLOW_OK;
+		}
+		return gst_mjr_mux_push_packet(mux, &mux->output, buf);
+	}
+	/* Write the packet to the MJR file of its SSRC */
+	gst_mjr_rtp rtp;
+	if(gst_buffer_extract(buf, 0, &rtp, 12) < 12) {
+		/* Not an RTP packet, drop it */
+		gst_buffer_unref(buf);
+		return GST_FLOW_OK;
+	}
+	gst_mjr_mux_output *output = gst_mjr_mux_get_output(mux, g_ntohl(rtp.ssrc));
+	if(pre_record) {
+		gst_mjr_mux_pre_record(mux, output, buf);
+		return GST_FLOW_OK;
+	}
+	ret = gst_mjr_mux_push_packet(mux, output, buf);
+	return gst_flow_combiner_update_pad_flow(mux->flowcombiner, output->srcpad, ret);
 }
 
 /* Register the eleent in the plugin */
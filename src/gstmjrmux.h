@@ -48,21 +48,78 @@
 #define __GST_MJR_MUX_H__
 
 #include <gst/gst.h>
+#include <gst/base/gstflowcombiner.h>
 
 G_BEGIN_DECLS
 
 #define GST_TYPE_MJR_MUX gst_mjr_mux_get_type()
 G_DECLARE_FINAL_TYPE(GstMjrMux, gst_mjr_mux, GST, MJR_MUX, GstElement)
 
+/* Entry in the index of a compressed MJR file */
+typedef struct gst_mjr_mux_index_entry {
+	guint64 offset;
+	guint32 received;
+} gst_mjr_mux_index_entry;
+
+/* Record held in memory, when pre-recording */
+typedef struct gst_mjr_mux_pre_record_entry {
+	GstBuffer *buffer;
+	/* Wallclock time the packet was received at */
+	gint64 received;
+} gst_mjr_mux_pre_record_entry;
+
+/* MJR file we're writing on a source pad */
+typedef struct gst_mjr_mux_output {
+	GstPad *srcpad;
+	guint32 ssrc;
+	gboolean initialized;
+	gint64 written;
+	guint64 first_ts;
+	/* Compression: records are grouped in blocks, which we index */
+	GByteArray *block;
+	guint32 block_received;
+	GArray *index;
+	guint64 bytes;
+	/* Pre-recording: packets we're holding until we're triggered, and
+	 * the ones among them that start a keyframe, for video */
+	GQueue pre_record, pre_keyframes;
+	gsize pre_record_bytes;
+} gst_mjr_mux_output;
+
 struct _GstMjrMux {
 	GstElement element;
 	gboolean silent;
 
 	/* MJR related stuff */
-	gboolean initialized;
 	gboolean video;
 	int codec;
-	gint64 created, written;
+	gint64 created;
+
+	/* Compression */
+	gboolean compress;
+	guint block_size;
+
+	/* Main output, and per-SSRC outputs, if we're splitting */
+	gst_mjr_mux_output output;
+	gboolean split_ssrc;
+	GHashTable *outputs;
+	GstFlowCombiner *flowcombiner;
+
+	/* Headers-only recordings: how much of each payload to keep */
+	guint snaplen;
+
+	/* Pre-recording: only keep the most recent packets in memory, until
+	 * the trigger signal is emitted, and then start writing from them */
+	guint pre_record_duration;
+	volatile gint triggered;
+	gboolean live;
+
+	/* Duplicates detection, with a window per SSRC */
+	guint dedup_window;
+	GHashTable *dedup;
+
+	/* Statistics */
+	guint64 packets, duplicates;
 
 	/* Timing */
 	guint64 first_ts;
@@ -51,12 +51,32 @@
 
 #include "gstmjrdemux.h"
 #include "gstmjrmux.h"
+#include "gstmjrsessionsrc.h"
+#include "gstmjrreplaysrc.h"
+#include "gstmjranalyze.h"
+#include "gstmjrfollowsrc.h"
+#include "gstmjrexport.h"
+#include "gstmjrarchivemux.h"
+#include "gstmjrarchivedemux.h"
+#include "gstmjrremux.h"
+#include "gstmjrlatency.h"
 
 static gboolean mjr_init(GstPlugin *plugin) {
 	gboolean ret = FALSE;
 
 	ret |= mjr_demux_register(plugin);
 	ret |= mjr_mux_register(plugin);
+	ret |= mjr_session_src_register(plugin);
+	ret |= mjr_replay_src_register(plugin);
+	ret |= mjr_analyze_register(plugin);
+	ret |= mjr_follow_src_register(plugin);
+	ret |= mjr_export_register(plugin);
+	ret |= mjr_archive_mux_register(plugin);
+	ret |= mjr_archive_demux_register(plugin);
+	ret |= mjr_remux_register(plugin);
+#ifndef GST_DISABLE_GST_TRACER_HOOKS
+	ret |= mjr_latency_tracer_register(plugin);
+#endif
 
 	return ret;
 }
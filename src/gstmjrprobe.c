@@ -0,0 +1,416 @@
+/*
+ * GStreamer
+ * Copyright (C) 2005 Thomas Vander Stichele <thomas@apestaart.org>
+ * Copyright (C) 2005 Ronald S. Bultje <rbultje@ronald.bitfreak.net>
+ * Copyright (C) 2024 Lorenzo Miniero <lorenzo@meetecho.com>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ *
+ * Alternatively, the contents of this file may be used under the
+ * GNU Lesser General Public License Version 2.1 (the "LGPL"), in
+ * which case the following provisions apply instead of the ones
+ * mentioned above:
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 02111-1307, USA.
+ */
+
+#ifdef HAVE_CONFIG_H
+#  include <config.h>
+#endif
+
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+#include <glib/gstdio.h>
+
+#include "gstmjrprobe.h"
+
+/* How much we read at the beginning and at the end of a recording: the
+ * head should contain the info header and the first record, and the tail
+ * the last records (or, for compressed files, the index and trailer) */
+#define GST_MJR_PROBE_HEAD_SIZE	(8*1024)
+#define GST_MJR_PROBE_TAIL_SIZE	(64*1024)
+/* How many records we look at, at most, to find the first RTP packet */
+#define GST_MJR_PROBE_MAX_RECORDS	16
+
+/* Helper to read a portion of a file: returns how many bytes were read */
+static gsize gst_mjr_probe_read(int fd, guint64 offset, guint8 *data, gsize size) {
+	gsize total = 0;
+	while(total < size) {
+		ssize_t res = pread(fd, data + total, size - total, offset + total);
+		if(res < 0 && errno == EINTR)
+			continue;
+		if(res <= 0)
+			break;
+		total += res;
+	}
+	return total;
+}
+
+/* Helper to make sure we read at least a specific portion of the head */
+static void gst_mjr_probe_grow(int fd, guint8 **head, gsize *head_len, gsize needed) {
+	if(needed <= *head_len)
+		return;
+	*head = g_realloc(*head, needed);
+	*head_len += gst_mjr_probe_read(fd, *head_len, *head + *head_len, needed - *head_len);
+}
+
+/* Helper to take into account a record (prefix included) */
+static void gst_mjr_probe_record(gst_mjr_probe *probe, const guint8 *record) {
+	guint16 len = 0;
+	memcpy(&len, record + 8, sizeof(len));
+	len = g_ntohs(len);
+	const guint8 *data = record + GST_MJR_FRAME_HEADER_SIZE;
+	if(len < 12 || ((gst_mjr_rtp *)data)->version != 2)
+		return;
+	gst_mjr_rtp *rtp = (gst_mjr_rtp *)data;
+	guint32 received = 0;
+	if(!probe->info.legacy) {
+		memcpy(&received, record + 4, sizeof(received));
+		received = g_ntohl(received);
+	}
+	if(!probe->has_packets) {
+		/* First packet */
+		probe->has_packets = TRUE;
+		probe->ssrc = g_ntohl(rtp->ssrc);
+		probe->payload_type = rtp->type;
+		probe->first_ts = g_ntohl(rtp->timestamp);
+		probe->first_received = received;
+	} else if(g_ntohl(rtp->ssrc) != probe->ssrc) {
+		return;
+	}
+	probe->last_ts = g_ntohl(rtp->timestamp);
+	probe->last_received = received;
+}
+
+/* Helper to go through all the records in a buffer, starting from the
+ * specified offset: returns the offset we stopped at, which is where an
+ * incomplete or invalid record was found, or the end of the buffer */
+static gsize gst_mjr_probe_records(gst_mjr_probe *probe, const guint8 *data, gsize len,
+		gsize offset, guint max, gboolean update) {
+	guint count = 0;
+	while(offset + GST_MJR_FRAME_HEADER_SIZE <= len && (max == 0 || count < max)) {
+		if(memcmp(data + offset, "MEET", 4))
+			break;
+		guint16 rlen = 0;
+		memcpy(&rlen, data + offset + 8, sizeof(rlen));
+		rlen = g_ntohs(rlen);
+		if(offset + GST_MJR_FRAME_HEADER_SIZE + rlen > len)
+			break;
+		if(update)
+			gst_mjr_probe_record(probe, data + offset);
+		offset += GST_MJR_FRAME_HEADER_SIZE + rlen;
+		count++;
+	}
+	return offset;
+}
+
+/* Find the last records in the tail of a regular recording: since we don't
+ * know where records start, we look for the earliest "MEET" prefix that
+ * starts a sequence of records reaching the end of the file (or a record
+ * that is still being written) */
+static void gst_mjr_probe_tail(gst_mjr_probe *probe, const guint8 *data, gsize len) {
+	gsize i = 0;
+	for(i=0; i + GST_MJR_FRAME_HEADER_SIZE <= len; i++) {
+		if(data[i] != 'M' || memcmp(data + i, "MEET", 4))
+			continue;
+		gsize end = gst_mjr_probe_records(probe, data, len, i, 0, FALSE);
+		if(end == i)
+			continue;
+		if(end != len && (len - end < 4 ? memcmp(data + end, "MEET", len - end) : memcmp(data + end, "MEET", 4)))
+			continue;
+		/* Found */
+		gst_mjr_probe_records(probe, data, len, i, 0, TRUE);
+		return;
+	}
+}
+
+/* Read and decompress a block of a compressed recording */
+static GByteArray *gst_mjr_probe_block(int fd, guint64 offset, guint64 size) {
+	char header[GST_MJR_BLOCK_HEADER_SIZE];
+	gst_mjr_block block = { 0 };
+	if(offset + sizeof(header) > size ||
+			gst_mjr_probe_read(fd, offset, (guint8 *)header, sizeof(header)) != sizeof(header) ||
+			!gst_mjr_parse_block(header, &block, NULL) ||
+			offset + sizeof(header) + block.compressed_size > size)
+		return NULL;
+	guint8 *compressed = g_malloc(block.compressed_size);
+	GByteArray *records = NULL;
+	if(gst_mjr_probe_read(fd, offset + sizeof(header), compressed, block.compressed_size) == block.compressed_size) {
+		records = g_byte_array_sized_new(block.size);
+		g_byte_array_set_size(records, block.size);
+		if(!gst_mjr_block_decompress(compressed, block.compressed_size, records->data, block.size)) {
+			g_byte_array_free(records, TRUE);
+			records = NULL;
+		}
+	}
+	g_free(compressed);
+	return records;
+}
+
+/* Find the offset of the last block of a compressed recording */
+static guint64 gst_mjr_probe_last_block(int fd, guint64 data_offset, guint64 size) {
+	/* The trailer tells us where the index is, and the index where the last block is */
+	guint8 trailer[GST_MJR_TRAILER_SIZE];
+	guint64 index_offset = 0;
+	if(size >= data_offset + GST_MJR_TRAILER_SIZE &&
+			gst_mjr_probe_read(fd, size - GST_MJR_TRAILER_SIZE, trailer, sizeof(trailer)) == sizeof(trailer) &&
+			!memcmp(trailer + 8, "MJRX", 4)) {
+		memcpy(&index_offset, trailer, sizeof(index_offset));
+		index_offset = GUINT64_FROM_BE(index_offset);
+		guint8 header[GST_MJR_INDEX_HEADER_SIZE];
+		guint32 count = 0;
+		if(index_offset >= data_offset && index_offset + sizeof(header) <= size &&
+				gst_mjr_probe_read(fd, index_offset, header, sizeof(header)) == sizeof(header) &&
+				!memcmp(header, "MJRI", 4)) {
+			memcpy(&count, header + 4, sizeof(count));
+			count = g_ntohl(count);
+		}
+		guint8 entry[GST_MJR_INDEX_ENTRY_SIZE];
+		if(count > 0 && gst_mjr_probe_read(fd, index_offset + sizeof(header) + (guint64)(count - 1) * sizeof(entry),
+				entry, sizeof(entry)) == sizeof(entry)) {
+			guint64 offset = 0;
+			memcpy(&offset, entry, sizeof(offset));
+			return GUINT64_FROM_BE(offset);
+		}
+	}
+	/* No index (e.g., the file is still being written): go through the
+	 * block headers, skipping their content, until we find the last one */
+	guint64 offset = data_offset, last = 0;
+	char header[GST_MJR_BLOCK_HEADER_SIZE];
+	gst_mjr_block block = { 0 };
+	while(offset + sizeof(header) <= size &&
+			gst_mjr_probe_read(fd, offset, (guint8 *)header, sizeof(header)) == sizeof(header) &&
+			gst_mjr_parse_block(header, &block, NULL) &&
+			offset + sizeof(header) + block.compressed_size <= size) {
+		last = offset;
+		offset += sizeof(header) + block.compressed_size;
+	}
+	return last;
+}
+
+/* Probe an MJR file */
+gst_mjr_probe *gst_mjr_probe_file(const char *filename, gchar **error) {
+	if(!filename) {
+		if(error)
+			*error = g_strdup("Missing filename.");
+		return NULL;
+	}
+	int fd = g_open(filename, O_RDONLY, 0);
+	if(fd < 0) {
+		if(error)
+			*error = g_strdup_printf("Error opening file '%s' (%s).", filename, g_strerror(errno));
+		return NULL;
+	}
+	struct stat st;
+	if(fstat(fd, &st) < 0) {
+		if(error)
+			*error = g_strdup_printf("Error accessing file '%s' (%s).", filename, g_strerror(errno));
+		close(fd);
+		return NULL;
+	}
+	gst_mjr_probe *probe = g_malloc0(sizeof(gst_mjr_probe));
+	probe->filename = g_strdup(filename);
+	probe->size = st.st_size;
+	/* Read the head of the file first */
+	gsize head_size = MIN(probe->size, GST_MJR_PROBE_HEAD_SIZE);
+	guint8 *head = g_malloc(MAX(head_size, 1));
+	gsize head_len = gst_mjr_probe_read(fd, 0, head, head_size);
+	gboolean legacy = FALSE, compressed = FALSE;
+	if(head_len < GST_MJR_HEADER_SIZE + GST_MJR_JSON_LENGTH_SIZE ||
+			!gst_mjr_check_header((const char *)head, &legacy, &compressed)) {
+		if(error)
+			*error = g_strdup_printf("Not an MJR file, or unsupported version (%s).", filename);
+		goto error;
+	}
+	guint16 json_len = 0;
+	memcpy(&json_len, head + GST_MJR_HEADER_SIZE, sizeof(json_len));
+	json_len = g_ntohs(json_len);
+	guint64 data_offset = GST_MJR_HEADER_SIZE + GST_MJR_JSON_LENGTH_SIZE + json_len;
+	if(data_offset > probe->size) {
+		if(error)
+			*error = g_strdup_printf("Truncated MJR file (%s).", filename);
+		goto error;
+	}
+	/* Make sure we have the whole info header and, for regular files, the
+	 * whole first record too (which should rarely need another read) */
+	gst_mjr_probe_grow(fd, &head, &head_len, MIN(probe->size, data_offset + GST_MJR_FRAME_HEADER_SIZE));
+	if(!compressed && data_offset + GST_MJR_FRAME_HEADER_SIZE <= head_len) {
+		guint16 first_len = 0;
+		memcpy(&first_len, head + data_offset + 8, sizeof(first_len));
+		first_len = g_ntohs(first_len);
+		gst_mjr_probe_grow(fd, &head, &head_len,
+			MIN(probe->size, data_offset + GST_MJR_FRAME_HEADER_SIZE + first_len));
+	}
+	if(data_offset > head_len ||
+			!gst_mjr_parse_info((const char *)head + GST_MJR_HEADER_SIZE + GST_MJR_JSON_LENGTH_SIZE,
+				json_len, legacy, &probe->info, error)) {
+		if(error && *error == NULL)
+			*error = g_strdup_printf("Truncated MJR file (%s).", filename);
+		goto error;
+	}
+	probe->info.compressed = compressed;
+	if(!compressed) {
+		/* Look for the first RTP packet in the head */
+		gst_mjr_probe_records(probe, head, head_len, data_offset, GST_MJR_PROBE_MAX_RECORDS, TRUE);
+		/* Now look for the last one in the tail */
+		if(probe->has_packets) {
+			guint64 tail_offset = MAX(data_offset, probe->size > GST_MJR_PROBE_TAIL_SIZE ?
+				probe->size - GST_MJR_PROBE_TAIL_SIZE : 0);
+			if(head_len == probe->size) {
+				/* We have the whole file already */
+				gst_mjr_probe_tail(probe, head + tail_offset, head_len - tail_offset);
+			} else {
+				gsize tail_size = probe->size - tail_offset;
+				guint8 *tail = g_malloc(tail_size);
+				tail_size = gst_mjr_probe_read(fd, tail_offset, tail, tail_size);
+				gst_mjr_probe_tail(probe, tail, tail_size);
+				g_free(tail);
+			}
+		}
+	} else {
+		/* The first RTP packet is in the first block */
+		GByteArray *records = gst_mjr_probe_block(fd, data_offset, probe->size);
+		if(records != NULL) {
+			gst_mjr_probe_records(probe, records->data, records->len, 0, GST_MJR_PROBE_MAX_RECORDS, TRUE);
+			g_byte_array_free(records, TRUE);
+		}
+		/* The last one is in the last block */
+		guint64 last = probe->has_packets ? gst_mjr_probe_last_block(fd, data_offset, probe->size) : 0;
+		if(last > data_offset && (records = gst_mjr_probe_block(fd, last, probe->size)) != NULL) {
+			gst_mjr_probe_records(probe, records->data, records->len, 0, 0, TRUE);
+			g_byte_array_free(records, TRUE);
+		}
+	}
+	/* Compute the duration */
+	if(probe->has_packets) {
+		guint32 clock_rate = gst_mjr_get_clock_rate(probe->info.codec);
+		if(!probe->info.legacy && probe->last_received >= probe->first_received) {
+			probe->duration = (GstClockTime)(probe->last_received - probe->first_received) * GST_MSECOND;
+		} else if(clock_rate > 0) {
+			probe->duration = gst_util_uint64_scale(probe->last_ts - probe->first_ts, GST_SECOND, clock_rate);
+		}
+	}
+	g_free(head);
+	close(fd);
+	return probe;
+
+error:
+	g_free(head);
+	close(fd);
+	gst_mjr_probe_free(probe);
+	return NULL;
+}
+
+/* Free the result of a probe */
+void gst_mjr_probe_free(gst_mjr_probe *probe) {
+	if(!probe)
+		return;
+	g_free(probe->filename);
+	g_free(probe);
+}
+
+/* Shared context when probing a directory */
+typedef struct gst_mjr_probe_context {
+	gst_mjr_probe_callback callback;
+	gpointer user_data;
+} gst_mjr_probe_context;
+
+/* Thread pool function to probe a file */
+static void gst_mjr_probe_worker(gpointer data, gpointer user_data) {
+	gchar *filename = (gchar *)data;
+	gst_mjr_probe_context *context = (gst_mjr_probe_context *)user_data;
+	gchar *error = NULL;
+	gst_mjr_probe *probe = gst_mjr_probe_file(filename, &error);
+	if(context->callback)
+		context->callback(filename, probe, error, context->user_data);
+	else
+		gst_mjr_probe_free(probe);
+	g_free(error);
+	g_free(filename);
+}
+
+/* Helper to collect the MJR files in a directory */
+static gboolean gst_mjr_probe_collect(const gchar *directory, gboolean recursive,
+		GPtrArray *files, gchar **error) {
+	GError *err = NULL;
+	GDir *dir = g_dir_open(directory, 0, &err);
+	if(!dir) {
+		if(error)
+			*error = g_strdup_printf("Error opening directory '%s' (%s).", directory, err->message);
+		g_error_free(err);
+		return FALSE;
+	}
+	const gchar *name = NULL;
+	while((name = g_dir_read_name(dir)) != NULL) {
+		gchar *path = g_build_filename(directory, name, NULL);
+		if(g_str_has_suffix(name, ".mjr")) {
+			g_ptr_array_add(files, path);
+		} else {
+			/* Subdirectories we can't read are just skipped */
+			if(recursive && g_file_test(path, G_FILE_TEST_IS_DIR))
+				gst_mjr_probe_collect(path, recursive, files, NULL);
+			g_free(path);
+		}
+	}
+	g_dir_close(dir);
+	return TRUE;
+}
+
+/* Probe all the MJR files in a directory */
+gint gst_mjr_probe_directory(const gchar *directory, gboolean recursive, guint threads,
+		gst_mjr_probe_callback callback, gpointer user_data, gchar **error) {
+	if(!directory) {
+		if(error)
+			*error = g_strdup("Missing directory.");
+		return -1;
+	}
+	GPtrArray *files = g_ptr_array_new();
+	if(!gst_mjr_probe_collect(directory, recursive, files, error)) {
+		g_ptr_array_free(files, TRUE);
+		return -1;
+	}
+	if(threads == 0)
+		threads = g_get_num_processors();
+	gst_mjr_probe_context context = { .callback = callback, .user_data = user_data };
+	GThreadPool *pool = g_thread_pool_new(gst_mjr_probe_worker, &context, threads, TRUE, NULL);
+	guint i = 0;
+	for(i=0; i<files->len; i++)
+		g_thread_pool_push(pool, g_ptr_array_index(files, i), NULL);
+	/* Wait for all files to be probed */
+	g_thread_pool_free(pool, FALSE, TRUE);
+	gint count = files->len;
+	g_ptr_array_free(files, TRUE);
+	return count;
+}
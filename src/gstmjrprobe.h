@@ -0,0 +1,95 @@
+/*
+ * GStreamer
+ * Copyright (C) 2005 Thomas Vander Stichele <thomas@apestaart.org>
+ * Copyright (C) 2005 Ronald S. Bultje <rbultje@ronald.bitfreak.net>
+ * Copyright (C) 2024 Lorenzo Miniero <lorenzo@meetecho.com>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ *
+ * Alternatively, the contents of this file may be used under the
+ * GNU Lesser General Public License Version 2.1 (the "LGPL"), in
+ * which case the following provisions apply instead of the ones
+ * mentioned above:
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 02111-1307, USA.
+ */
+
+#ifndef __GST_MJR_PROBE_H__
+#define __GST_MJR_PROBE_H__
+
+#include <gst/gst.h>
+
+#include "gstmjrutils.h"
+
+/* Info on an MJR recording, obtained by only reading its header, its first
+ * record and a window at the end of the file (or, for compressed files,
+ * the index and the last block), rather than going through all of it */
+typedef struct gst_mjr_probe {
+	gchar *filename;
+	/* Info from the MJR header */
+	gst_mjr_info info;
+	/* Size of the file */
+	guint64 size;
+	/* Whether any RTP packet was found, and the info we got from them:
+	 * only packets with the same SSRC as the first one are considered */
+	gboolean has_packets;
+	guint32 ssrc;
+	guint8 payload_type;
+	guint32 first_ts, last_ts;
+	/* Received time of the first and last packet, in milliseconds since the
+	 * recording was started (always 0 in legacy recordings) */
+	guint32 first_received, last_received;
+	/* Approximate duration of the recording, computed from the received
+	 * times or, in legacy recordings, from the RTP timestamps */
+	GstClockTime duration;
+} gst_mjr_probe;
+
+/* Probe an MJR file: in case of errors, a description is returned in the
+ * error argument, and has to be freed by the caller */
+gst_mjr_probe *gst_mjr_probe_file(const char *filename, gchar **error);
+/* Free the result of a probe */
+void gst_mjr_probe_free(gst_mjr_probe *probe);
+
+/* Callback to notify the result of probing a file in a directory: the
+ * probe is NULL in case of errors, and the error is set instead. The probe
+ * belongs to the caller, who must free it when done. Notice that this is
+ * called from the threads of the pool, and so may be called concurrently */
+typedef void (*gst_mjr_probe_callback)(const gchar *filename, gst_mjr_probe *probe,
+	const gchar *error, gpointer user_data);
+/* Probe all the MJR files in a directory (optionally including its
+ * subdirectories) using a pool of threads (0 means as many as the cores):
+ * returns how many files were probed, or -1 if the directory couldn't be
+ * read, in which case a description is returned in the error argument */
+gint gst_mjr_probe_directory(const gchar *directory, gboolean recursive, guint threads,
+	gst_mjr_probe_callback callback, gpointer user_data, gchar **error);
+
+#endif /* __GST_MJR_PROBE_H__ */
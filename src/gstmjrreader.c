@@ -0,0 +1,633 @@
+/*
+ * GStreamer
+ * Copyright (C) 2005 Thomas Vander Stichele <thomas@apestaart.org>
+ * Copyright (C) 2005 Ronald S. Bultje <rbultje@ronald.bitfreak.net>
+ * Copyright (C) 2024 Lorenzo Miniero <lorenzo@meetecho.com>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ *
+ * Alternatively, the contents of this file may be used under the
+ * GNU Lesser General Public License Version 2.1 (the "LGPL"), in
+ * which case the following provisions apply instead of the ones
+ * mentioned above:
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 02111-1307, USA.
+ */
+
+#ifdef HAVE_CONFIG_H
+#  include <config.h>
+#endif
+
+#include <errno.h>
+
+#include <glib/gstdio.h>
+
+#include "gstmjrreader.h"
+
+/* Size of the stdio buffer we use when reading recordings */
+#define GST_MJR_READER_BUFFER_SIZE	(256*1024)
+
+/* Helper to read exactly the amount of bytes we need */
+static gboolean gst_mjr_reader_read(gst_mjr_reader *reader, void *data, gsize size) {
+	if(size == 0)
+		return TRUE;
+	return fread(data, 1, size, reader->file) == size;
+}
+
+/* Open an MJR file and parse its header */
+gst_mjr_reader *gst_mjr_reader_open(const char *filename, gchar **error) {
+	if(!filename) {
+		if(error)
+			*error = g_strdup("Missing filename.");
+		return NULL;
+	}
+	FILE *file = g_fopen(filename, "rb");
+	if(!file) {
+		if(error)
+			*error = g_strdup_printf("Error opening file '%s' (%s).", filename, g_strerror(errno));
+		return NULL;
+	}
+	gst_mjr_reader *reader = g_malloc0(sizeof(gst_mjr_reader));
+	reader->file = file;
+	reader->filename = g_strdup(filename);
+	setvbuf(reader->file, NULL, _IOFBF, GST_MJR_READER_BUFFER_SIZE);
+	/* Check the MJR header first */
+	gboolean legacy = FALSE, compressed = FALSE;
+	if(!gst_mjr_reader_read(reader, reader->buffer, GST_MJR_HEADER_SIZE) ||
+			!gst_mjr_check_header(reader->buffer, &legacy, &compressed)) {
+		if(error)
+			*error = g_strdup_printf("Not an MJR file, or unsupported version (%s).", filename);
+		gst_mjr_reader_close(reader);
+		return NULL;
+	}
+	/* Now read the info header, and parse it */
+	guint16 len = 0;
+	if(!gst_mjr_reader_read(reader, &len, sizeof(len))) {
+		if(error)
+			*error = g_strdup_printf("Truncated MJR file (%s).", filename);
+		gst_mjr_reader_close(reader);
+		return NULL;
+	}
+	len = g_ntohs(len);
+	if(!gst_mjr_reader_read(reader, reader->buffer, len)) {
+		if(error)
+			*error = g_strdup_printf("Truncated MJR file (%s).", filename);
+		gst_mjr_reader_close(reader);
+		return NULL;
+	}
+	if(!gst_mjr_parse_info(reader->buffer, len, legacy, &reader->info, error)) {
+		gst_mjr_reader_close(reader);
+		return NULL;
+	}
+	reader->info.compressed = compressed;
+	if(compressed) {
+		reader->block = g_byte_array_new();
+		reader->compressed = g_byte_array_new();
+	}
+	reader->data_offset = GST_MJR_HEADER_SIZE + GST_MJR_JSON_LENGTH_SIZE + len;
+	reader->offset = reader->data_offset;
+	reader->record_offset = reader->data_offset;
+	return reader;
+}
+
+/* Read and decompress the next block of records, in compressed files */
+static gst_mjr_reader_result gst_mjr_reader_next_block(gst_mjr_reader *reader, gchar **error) {
+	char header[GST_MJR_BLOCK_HEADER_SIZE];
+	size_t res = fread(header, 1, sizeof(header), reader->file);
+	gboolean index = FALSE;
+	gst_mjr_block block = { 0 };
+	if(res >= 4 && !gst_mjr_parse_block(header, &block, &index) && index) {
+		/* We reached the index, so there are no more blocks: we stay
+		 * here, in case someone asks for the next record again */
+		gst_mjr_reader_seek(reader, reader->offset);
+		return gst_mjr_reader_eof;
+	}
+	if(res < sizeof(header)) {
+		if(ferror(reader->file)) {
+			if(error)
+				*error = g_strdup_printf("Error reading file '%s' (%s).", reader->filename, g_strerror(errno));
+			return gst_mjr_reader_error;
+		}
+		/* End of file, or a block that hasn't been fully written yet */
+		gst_mjr_reader_seek(reader, reader->offset);
+		return gst_mjr_reader_eof;
+	}
+	if(!gst_mjr_parse_block(header, &block, NULL)) {
+		if(error)
+			*error = g_strdup_printf("Invalid block at offset %" G_GOFFSET_FORMAT " (%s).", reader->offset, reader->filename);
+		return gst_mjr_reader_error;
+	}
+	g_byte_array_set_size(reader->compressed, block.compressed_size);
+	if(!gst_mjr_reader_read(reader, reader->compressed->data, block.compressed_size)) {
+		if(ferror(reader->file)) {
+			if(error)
+				*error = g_strdup_printf("Error reading file '%s' (%s).", reader->filename, g_strerror(errno));
+			return gst_mjr_reader_error;
+		}
+		/* Truncated block, rewind to its beginning */
+		gst_mjr_reader_seek(reader, reader->offset);
+		return gst_mjr_reader_eof;
+	}
+	g_byte_array_set_size(reader->block, block.size);
+	if(!gst_mjr_block_decompress(reader->compressed->data, block.compressed_size,
+			reader->block->data, block.size)) {
+		if(error)
+			*error = g_strdup_printf("Error decompressing block at offset %" G_GOFFSET_FORMAT " (%s).", reader->offset, reader->filename);
+		g_byte_array_set_size(reader->block, 0);
+		return gst_mjr_reader_error;
+	}
+	reader->block_offset = 0;
+	reader->record_offset = reader->offset;
+	reader->offset += GST_MJR_BLOCK_HEADER_SIZE + block.compressed_size;
+	return gst_mjr_reader_ok;
+}
+
+/* Read the next record from the current block, in compressed files */
+static gst_mjr_reader_result gst_mjr_reader_next_compressed(gst_mjr_reader *reader, gchar **error) {
+	while(reader->block_offset >= reader->block->len) {
+		gst_mjr_reader_result res = gst_mjr_reader_next_block(reader, error);
+		if(res != gst_mjr_reader_ok)
+			return res;
+	}
+	/* Records in a block are exactly the same as in regular files */
+	const guint8 *prefix = reader->block->data + reader->block_offset;
+	guint16 len = 0;
+	if(reader->block->len - reader->block_offset >= GST_MJR_FRAME_HEADER_SIZE) {
+		memcpy(&len, prefix + 8, sizeof(len));
+		len = g_ntohs(len);
+	}
+	if(reader->block->len - reader->block_offset < GST_MJR_FRAME_HEADER_SIZE + (gsize)len ||
+			prefix[0] != 'M' || prefix[1] != 'E' || prefix[2] != 'E' || prefix[3] != 'T') {
+		/* Not what we were expecting */
+		if(error)
+			*error = g_strdup_printf("Invalid data in block at offset %" G_GOFFSET_FORMAT " (%s).", reader->record_offset, reader->filename);
+		return gst_mjr_reader_error;
+	}
+	guint32 received = 0;
+	memcpy(&received, prefix + 4, sizeof(received));
+	reader->received = g_ntohl(received);
+	memcpy(reader->buffer, prefix + GST_MJR_FRAME_HEADER_SIZE, len);
+	reader->length = gst_mjr_record_length(&reader->info, (const guint8 *)reader->buffer, len, &reader->original);
+	reader->block_offset += GST_MJR_FRAME_HEADER_SIZE + len;
+	return gst_mjr_reader_ok;
+}
+
+/* Read the next record */
+gst_mjr_reader_result gst_mjr_reader_next(gst_mjr_reader *reader, gchar **error) {
+	if(!reader || !reader->file)
+		return gst_mjr_reader_error;
+	if(reader->info.compressed)
+		return gst_mjr_reader_next_compressed(reader, error);
+	char prefix[GST_MJR_FRAME_HEADER_SIZE];
+	size_t res = fread(prefix, 1, sizeof(prefix), reader->file);
+	if(res < sizeof(prefix)) {
+		if(ferror(reader->file)) {
+			if(error)
+				*error = g_strdup_printf("Error reading file '%s' (%s).", reader->filename, g_strerror(errno));
+			return gst_mjr_reader_error;
+		}
+		/* End of file, or a record that hasn't been fully written yet */
+		gst_mjr_reader_seek(reader, reader->offset);
+		return gst_mjr_reader_eof;
+	}
+	if(prefix[0] != 'M' || prefix[1] != 'E' || prefix[2] != 'E' || prefix[3] != 'T') {
+		/* Not what we were expecting */
+		if(error)
+			*error = g_strdup_printf("Invalid data at offset %" G_GOFFSET_FORMAT " (%s).", reader->offset, reader->filename);
+		return gst_mjr_reader_error;
+	}
+	/* Legacy recordings have no received time there, just a longer prefix */
+	guint32 received = 0;
+	if(!reader->info.legacy) {
+		memcpy(&received, prefix + 4, sizeof(received));
+		received = g_ntohl(received);
+	}
+	guint16 len = 0;
+	memcpy(&len, prefix + 8, sizeof(len));
+	len = g_ntohs(len);
+	if(!gst_mjr_reader_read(reader, reader->buffer, len)) {
+		if(ferror(reader->file)) {
+			if(error)
+				*error = g_strdup_printf("Error reading file '%s' (%s).", reader->filename, g_strerror(errno));
+			return gst_mjr_reader_error;
+		}
+		/* Truncated record, rewind to its beginning */
+		gst_mjr_reader_seek(reader, reader->offset);
+		return gst_mjr_reader_eof;
+	}
+	reader->record_offset = reader->offset;
+	reader->received = received;
+	reader->length = gst_mjr_record_length(&reader->info, (const guint8 *)reader->buffer, len, &reader->original);
+	reader->offset += GST_MJR_FRAME_HEADER_SIZE + len;
+	return gst_mjr_reader_ok;
+}
+
+/* Move the reader to a specific record offset in the file */
+gboolean gst_mjr_reader_seek(gst_mjr_reader *reader, goffset offset) {
+	if(!reader || !reader->file || offset < reader->data_offset)
+		return FALSE;
+	/* This also clears the EOF indicator, in case more data was appended */
+	if(fseeko(reader->file, offset, SEEK_SET) < 0)
+		return FALSE;
+	reader->offset = offset;
+	if(reader->block) {
+		/* Whatever was left in the current block is gone */
+		g_byte_array_set_size(reader->block, 0);
+		reader->block_offset = 0;
+	}
+	return TRUE;
+}
+
+/* Find the offset of the block that contains the specified received time
+ * using the index of a compressed file: returns -1 if there's no index */
+static goffset gst_mjr_reader_find_block(gst_mjr_reader *reader, guint32 received) {
+	/* The trailer at the end of the file tells us where the index is */
+	char trailer[GST_MJR_TRAILER_SIZE];
+	if(fseeko(reader->file, -GST_MJR_TRAILER_SIZE, SEEK_END) < 0 ||
+			!gst_mjr_reader_read(reader, trailer, sizeof(trailer)) ||
+			memcmp(trailer + 8, "MJRX", 4))
+		return -1;
+	guint64 index_offset = 0;
+	memcpy(&index_offset, trailer, sizeof(index_offset));
+	index_offset = GUINT64_FROM_BE(index_offset);
+	char header[GST_MJR_INDEX_HEADER_SIZE];
+	if(index_offset < (guint64)reader->data_offset || fseeko(reader->file, index_offset, SEEK_SET) < 0 ||
+			!gst_mjr_reader_read(reader, header, sizeof(header)) || memcmp(header, "MJRI", 4))
+		return -1;
+	guint32 count = 0;
+	memcpy(&count, header + 4, sizeof(count));
+	count = g_ntohl(count);
+	/* Entries are sorted by received time, keep the last one that starts
+	 * at or before the time we're looking for */
+	goffset offset = reader->data_offset;
+	char entry[GST_MJR_INDEX_ENTRY_SIZE];
+	guint32 i = 0;
+	for(i=0; i<count; i++) {
+		if(!gst_mjr_reader_read(reader, entry, sizeof(entry)))
+			return -1;
+		guint32 block_received = 0;
+		memcpy(&block_received, entry + 8, sizeof(block_received));
+		if(g_ntohl(block_received) > received)
+			break;
+		guint64 block_offset = 0;
+		memcpy(&block_offset, entry, sizeof(block_offset));
+		offset = GUINT64_FROM_BE(block_offset);
+	}
+	return offset;
+}
+
+/* Move the reader to the first record received at or after the specified time */
+gboolean gst_mjr_reader_seek_time(gst_mjr_reader *reader, guint32 received, gchar **error) {
+	if(!reader || !reader->file)
+		return FALSE;
+	if(reader->info.legacy) {
+		if(error)
+			*error = g_strdup_printf("Legacy MJR files have no received time (%s).", reader->filename);
+		return FALSE;
+	}
+	goffset offset = reader->data_offset;
+	if(reader->info.compressed) {
+		/* Use the index to skip blocks, if we have one: if we don't (e.g.,
+		 * the file is still being written), we'll just check all blocks */
+		offset = gst_mjr_reader_find_block(reader, received);
+		if(offset < 0)
+			offset = reader->data_offset;
+	}
+	if(!gst_mjr_reader_seek(reader, offset))
+		return FALSE;
+	/* Now go through the records until we find the right one */
+	gst_mjr_reader_result res = gst_mjr_reader_ok;
+	while(TRUE) {
+		goffset record_offset = reader->offset;
+		guint block_offset = reader->block ? reader->block_offset : 0;
+		guint block_len = reader->block ? reader->block->len : 0;
+		res = gst_mjr_reader_next(reader, error);
+		if(res != gst_mjr_reader_ok)
+			return res == gst_mjr_reader_eof;
+		if(reader->received < received)
+			continue;
+		/* Found, go back to the beginning of this record */
+		if(!reader->info.compressed)
+			return gst_mjr_reader_seek(reader, record_offset);
+		if(block_offset < block_len) {
+			/* Same block we already had */
+			reader->block_offset = block_offset;
+		} else {
+			/* First record in a new block */
+			reader->block_offset = 0;
+		}
+		return TRUE;
+	}
+}
+
+/* Skip the specified number of records */
+gst_mjr_reader_result gst_mjr_reader_skip(gst_mjr_reader *reader, guint records, gchar **error) {
+	gst_mjr_reader_result res = gst_mjr_reader_ok;
+	while(records > 0) {
+		res = gst_mjr_reader_next(reader, error);
+		if(res != gst_mjr_reader_ok)
+			return res;
+		records--;
+	}
+	return res;
+}
+
+/* Close an MJR reader and free its resources */
+void gst_mjr_reader_close(gst_mjr_reader *reader) {
+	if(!reader)
+		return;
+	if(reader->file)
+		fclose(reader->file);
+	if(reader->block)
+		g_byte_array_free(reader->block, TRUE);
+	if(reader->compressed)
+		g_byte_array_free(reader->compressed, TRUE);
+	g_free(reader->filename);
+	g_free(reader);
+}
+
+/* Helper to sort file names alphabetically */
+static gint gst_mjr_compare_names(gconstpointer a, gconstpointer b) {
+	return g_strcmp0(*(const gchar **)a, *(const gchar **)b);
+}
+
+/* Get the list of MJR files to read */
+GPtrArray *gst_mjr_list_files(const gchar *locations, const gchar *directory, gchar **error) {
+	GPtrArray *files = g_ptr_array_new_with_free_func(g_free);
+	if(locations) {
+		gchar **list = g_strsplit(locations, ",", -1);
+		guint i = 0;
+		for(i=0; list[i] != NULL; i++) {
+			gchar *location = g_strstrip(list[i]);
+			if(*location != '\0')
+				g_ptr_array_add(files, g_strdup(location));
+		}
+		g_strfreev(list);
+	}
+	if(directory) {
+		GError *err = NULL;
+		GDir *dir = g_dir_open(directory, 0, &err);
+		if(!dir) {
+			if(error)
+				*error = g_strdup_printf("Error opening directory '%s' (%s).", directory, err->message);
+			g_error_free(err);
+			g_ptr_array_free(files, TRUE);
+			return NULL;
+		}
+		/* Sort the files by name, so that the order is always the same */
+		GPtrArray *names = g_ptr_array_new_with_free_func(g_free);
+		const gchar *name = NULL;
+		while((name = g_dir_read_name(dir)) != NULL) {
+			if(g_str_has_suffix(name, ".mjr"))
+				g_ptr_array_add(names, g_strdup(name));
+		}
+		g_dir_close(dir);
+		g_ptr_array_sort(names, gst_mjr_compare_names);
+		guint i = 0;
+		for(i=0; i<names->len; i++)
+			g_ptr_array_add(files, g_build_filename(directory, g_ptr_array_index(names, i), NULL));
+		g_ptr_array_free(names, TRUE);
+	}
+	return files;
+}
+
+/* Load all the RTP packets of an MJR file in memory */
+gst_mjr_recording *gst_mjr_recording_load(const char *filename, gchar **error) {
+	gst_mjr_reader *reader = gst_mjr_reader_open(filename, error);
+	if(!reader)
+		return NULL;
+	gst_mjr_recording *recording = g_malloc0(sizeof(gst_mjr_recording));
+	recording->filename = g_strdup(filename);
+	recording->info = reader->info;
+	recording->packets = g_array_new(FALSE, FALSE, sizeof(gst_mjr_packet));
+	GByteArray *arena = g_byte_array_new();
+	gst_mjr_timestamp ts;
+	gst_mjr_timestamp_reset(&ts);
+	gst_mjr_reader_result res = gst_mjr_reader_ok;
+	while((res = gst_mjr_reader_next(reader, error)) == gst_mjr_reader_ok) {
+		if(reader->length < 12) {
+			/* Too short to be an RTP packet, skip it */
+			continue;
+		}
+		gst_mjr_rtp *rtp = (gst_mjr_rtp *)reader->buffer;
+		if(recording->ssrc == 0) {
+			recording->ssrc = g_ntohl(rtp->ssrc);
+			recording->payload_type = rtp->type;
+		}
+		if(g_ntohl(rtp->ssrc) != recording->ssrc) {
+			/* Ignore packet */
+			continue;
+		}
+		if(arena->len + reader->length > GST_MJR_PACKETS_MAX_SIZE) {
+			/* Packets are addressed with 32-bit offsets, we can't go on */
+			if(error)
+				*error = g_strdup_printf("Recording too large to be loaded in memory, over %u bytes (%s).",
+					GST_MJR_PACKETS_MAX_SIZE, filename);
+			res = gst_mjr_reader_error;
+			break;
+		}
+		gst_mjr_packet packet;
+		packet.offset = arena->len;
+		packet.len = reader->length;
+		packet.ext_ts = gst_mjr_timestamp_update(&ts, g_ntohl(rtp->timestamp));
+		g_byte_array_append(arena, (const guint8 *)reader->buffer, reader->length);
+		g_array_append_val(recording->packets, packet);
+	}
+	gst_mjr_reader_close(reader);
+	recording->data = g_byte_array_free_to_bytes(arena);
+	if(res == gst_mjr_reader_error) {
+		gst_mjr_recording_free(recording);
+		return NULL;
+	}
+	gst_mjr_packets_get_spans(g_bytes_get_data(recording->data, NULL), recording->packets,
+		gst_mjr_get_clock_rate(recording->info.codec), &recording->seq_span, &recording->ts_span);
+	return recording;
+}
+
+/* Split an MJR recording in chunks starting at keyframe boundaries */
+GArray *gst_mjr_split_chunks(const char *filename, guint chunks, guint32 *ssrc, gchar **error) {
+	if(chunks == 0)
+		chunks = 1;
+	gst_mjr_reader *reader = gst_mjr_reader_open(filename, error);
+	if(!reader)
+		return NULL;
+	/* Go through the whole recording once, and keep track of where
+	 * each frame that could be used to start a new chunk begins */
+	GArray *candidates = g_array_new(FALSE, FALSE, sizeof(gst_mjr_chunk));
+	gst_mjr_timestamp ts;
+	gst_mjr_timestamp_reset(&ts);
+	guint32 first_ssrc = 0, last_ts = 0;
+	guint64 packets = 0;
+	goffset block_offset = -1;
+	guint skip = 0;
+	gst_mjr_reader_result res = gst_mjr_reader_ok;
+	while((res = gst_mjr_reader_next(reader, error)) == gst_mjr_reader_ok) {
+		/* Keep track of how many records in the same block we read */
+		if(reader->record_offset != block_offset) {
+			block_offset = reader->record_offset;
+			skip = 0;
+		} else {
+			skip++;
+		}
+		if(reader->length < 12)
+			continue;
+		gst_mjr_rtp *rtp = (gst_mjr_rtp *)reader->buffer;
+		if(first_ssrc == 0)
+			first_ssrc = g_ntohl(rtp->ssrc);
+		if(g_ntohl(rtp->ssrc) != first_ssrc)
+			continue;
+		gint64 ext_ts = gst_mjr_timestamp_update(&ts, g_ntohl(rtp->timestamp));
+		gboolean new_frame = (packets == 0 || g_ntohl(rtp->timestamp) != last_ts);
+		last_ts = g_ntohl(rtp->timestamp);
+		if(new_frame) {
+			gsize header = gst_mjr_rtp_header_size((const guint8 *)reader->buffer, reader->length);
+			if(header > 0 && gst_mjr_is_keyframe(reader->info.codec,
+					(const guint8 *)reader->buffer + header, reader->length - header)) {
+				gst_mjr_chunk candidate;
+				candidate.offset = reader->info.compressed ? block_offset : reader->record_offset;
+				candidate.skip = reader->info.compressed ? skip : 0;
+				/* For now, use this to store the index of the packet */
+				candidate.packets = packets;
+				candidate.ext_ts = ext_ts;
+				g_array_append_val(candidates, candidate);
+			}
+		}
+		packets++;
+	}
+	gst_mjr_reader_close(reader);
+	if(res == gst_mjr_reader_error) {
+		g_array_free(candidates, TRUE);
+		return NULL;
+	}
+	if(candidates->len == 0) {
+		if(error)
+			*error = g_strdup_printf("No keyframes in the recording (%s).", filename);
+		g_array_free(candidates, TRUE);
+		return NULL;
+	}
+	/* Now pick the keyframes closest to the ideal chunk boundaries */
+	GArray *result = g_array_new(FALSE, FALSE, sizeof(gst_mjr_chunk));
+	guint i = 0, c = 0;
+	for(c=0; c<chunks; c++) {
+		guint64 target = packets * c / chunks;
+		while(i < candidates->len && g_array_index(candidates, gst_mjr_chunk, i).packets < target)
+			i++;
+		if(i == candidates->len)
+			break;
+		gst_mjr_chunk *candidate = &g_array_index(candidates, gst_mjr_chunk, i);
+		if(result->len > 0 && g_array_index(result, gst_mjr_chunk, result->len-1).packets == candidate->packets)
+			continue;
+		g_array_append_val(result, *candidate);
+	}
+	g_array_free(candidates, TRUE);
+	/* Turn the packet indexes in packet counts */
+	for(i=0; i<result->len; i++) {
+		gst_mjr_chunk *chunk = &g_array_index(result, gst_mjr_chunk, i);
+		guint64 end = (i == result->len-1) ? packets : g_array_index(result, gst_mjr_chunk, i+1).packets;
+		chunk->packets = end - chunk->packets;
+	}
+	if(ssrc)
+		*ssrc = first_ssrc;
+	return result;
+}
+
+/* Free an MJR recording loaded in memory */
+void gst_mjr_recording_free(gst_mjr_recording *recording) {
+	if(!recording)
+		return;
+	g_free(recording->filename);
+	if(recording->data)
+		g_bytes_unref(recording->data);
+	if(recording->packets)
+		g_array_free(recording->packets, TRUE);
+	g_free(recording);
+}
+
+/* Compute by how much sequence numbers and timestamps must be shifted when looping */
+void gst_mjr_packets_get_spans(const guint8 *data, GArray *packets, guint32 clock_rate,
+		guint16 *seq_span, gint64 *ts_span) {
+	if(packets->len == 0) {
+		*seq_span = 0;
+		*ts_span = 0;
+		return;
+	}
+	/* For timestamps, we add the average distance between frames to the
+	 * overall span, so that the first frame doesn't overlap with the last */
+	gst_mjr_packet *packet = &g_array_index(packets, gst_mjr_packet, 0);
+	guint16 last_seq = g_ntohs(((gst_mjr_rtp *)(data + packet->offset))->seq_number);
+	/* Sequence numbers are extended the same way timestamps are, or the
+	 * span would be wrong as soon as they wrap within the recording */
+	gint64 ext_seq = 0, max_seq = 0;
+	gint64 max_ts = 0, prev_ts = 0;
+	guint frames = 1, i = 0;
+	for(i=0; i<packets->len; i++) {
+		packet = &g_array_index(packets, gst_mjr_packet, i);
+		guint16 seq = g_ntohs(((gst_mjr_rtp *)(data + packet->offset))->seq_number);
+		ext_seq += (gint16)(seq - last_seq);
+		last_seq = seq;
+		if(ext_seq > max_seq)
+			max_seq = ext_seq;
+		if(packet->ext_ts > max_ts)
+			max_ts = packet->ext_ts;
+		if(packet->ext_ts != prev_ts) {
+			frames++;
+			prev_ts = packet->ext_ts;
+		}
+	}
+	*seq_span = (max_seq + 1) & 0xFFFF;
+	if(frames > 1)
+		*ts_span = max_ts + max_ts / (frames - 1);
+	else
+		*ts_span = clock_rate / 50;
+}
+
+/* Create a buffer out of a packet in memory */
+GstBuffer *gst_mjr_packet_to_buffer(GBytes *data, const gst_mjr_packet *packet,
+		guint16 seq_shift, guint32 ts_shift, guint32 ssrc) {
+	gsize size = 0;
+	const guint8 *bytes = g_bytes_get_data(data, &size);
+	gst_mjr_rtp rtp;
+	memcpy(&rtp, bytes + packet->offset, 12);
+	guint16 seq = g_ntohs(rtp.seq_number) + seq_shift;
+	guint32 ts = g_ntohl(rtp.timestamp) + ts_shift;
+	rtp.seq_number = g_htons(seq);
+	rtp.timestamp = g_htonl(ts);
+	if(ssrc)
+		rtp.ssrc = g_htonl(ssrc);
+	GstBuffer *buffer = gst_buffer_new_memdup(&rtp, 12);
+	if(packet->len > 12) {
+		gst_buffer_append_memory(buffer, gst_memory_new_wrapped(GST_MEMORY_FLAG_READONLY,
+			(gpointer)bytes, size, packet->offset + 12, packet->len - 12,
+			g_bytes_ref(data), (GDestroyNotify)g_bytes_unref));
+	}
+	return buffer;
+}
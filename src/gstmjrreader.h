@@ -0,0 +1,169 @@
+/*
+ * GStreamer
+ * Copyright (C) 2005 Thomas Vander Stichele <thomas@apestaart.org>
+ * Copyright (C) 2005 Ronald S. Bultje <rbultje@ronald.bitfreak.net>
+ * Copyright (C) 2024 Lorenzo Miniero <lorenzo@meetecho.com>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ *
+ * Alternatively, the contents of this file may be used under the
+ * GNU Lesser General Public License Version 2.1 (the "LGPL"), in
+ * which case the following provisions apply instead of the ones
+ * mentioned above:
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 02111-1307, USA.
+ */
+
+#ifndef __GST_MJR_READER_H__
+#define __GST_MJR_READER_H__
+
+#include <stdio.h>
+
+#include <gst/gst.h>
+
+#include "gstmjrutils.h"
+
+/* Maximum size of an MJR record, as its length is a 16-bit integer */
+#define GST_MJR_MAX_RECORD_SIZE	65535
+
+/* Synchronous MJR file reader, for elements that access recordings directly */
+typedef struct gst_mjr_reader {
+	FILE *file;
+	gchar *filename;
+	/* Info from the MJR header */
+	gst_mjr_info info;
+	/* Offset in the file of the first and of the next record (or, for
+	 * compressed files, of the first and of the next block) */
+	goffset data_offset, offset;
+	/* Last record we read (for compressed files, the offset of its block):
+	 * the length is the one of the packet we have, which may be shorter
+	 * than the original one if the recording was written with a snaplen */
+	goffset record_offset;
+	guint32 received;
+	guint16 length, original;
+	char buffer[GST_MJR_MAX_RECORD_SIZE+1];
+	/* Compressed files only: current block, decompressed, and our position in it */
+	GByteArray *block, *compressed;
+	guint block_offset;
+} gst_mjr_reader;
+
+/* Result of a record read */
+typedef enum gst_mjr_reader_result {
+	gst_mjr_reader_error = -1,
+	gst_mjr_reader_eof = 0,
+	gst_mjr_reader_ok = 1,
+} gst_mjr_reader_result;
+
+/* Open an MJR file and parse its header: in case of errors, a description
+ * is returned in the error argument, and has to be freed by the caller */
+gst_mjr_reader *gst_mjr_reader_open(const char *filename, gchar **error);
+/* Read the next record: a truncated record at the end of the file (e.g.,
+ * because it's still being written) is reported as EOF, and the reader is
+ * rewinded to the beginning of that record, so that it can be read again */
+gst_mjr_reader_result gst_mjr_reader_next(gst_mjr_reader *reader, gchar **error);
+/* Move the reader to a specific record offset in the file (for compressed
+ * files, the offset must be the one of a block) */
+gboolean gst_mjr_reader_seek(gst_mjr_reader *reader, goffset offset);
+/* Move the reader to the first record received at or after the specified
+ * time (in milliseconds, relative to the first record): for compressed
+ * files, the index is used to find the right block, when available */
+gboolean gst_mjr_reader_seek_time(gst_mjr_reader *reader, guint32 received, gchar **error);
+/* Skip the specified number of records */
+gst_mjr_reader_result gst_mjr_reader_skip(gst_mjr_reader *reader, guint records, gchar **error);
+/* Close an MJR reader and free its resources */
+void gst_mjr_reader_close(gst_mjr_reader *reader);
+
+/* Chunk of an MJR recording that can be processed independently, as it
+ * starts with a keyframe: to read it, seek to the offset and skip the
+ * specified number of records (for compressed files, where the offset is
+ * the one of a block), and then read the specified number of packets */
+typedef struct gst_mjr_chunk {
+	goffset offset;
+	guint skip;
+	guint64 packets;
+	/* Extended RTP timestamp of the first packet, relative to the first
+	 * packet in the recording, which can be used to compute its PTS */
+	gint64 ext_ts;
+} gst_mjr_chunk;
+
+/* Split an MJR recording in (up to) the specified number of chunks, with
+ * roughly the same number of packets each, starting at keyframe boundaries:
+ * only packets with the same SSRC as the first one are taken into account */
+GArray *gst_mjr_split_chunks(const char *filename, guint chunks, guint32 *ssrc, gchar **error);
+
+/* Get the list of MJR files to read, out of a comma separated list of files
+ * and/or a directory (whose MJR files are added sorted by name) */
+GPtrArray *gst_mjr_list_files(const gchar *locations, const gchar *directory, gchar **error);
+
+/* How many bytes of packets can be stored in memory at most for a single
+ * recording (packets are addressed with 32-bit offsets, so it can't be
+ * over 4GB anyway) */
+#define GST_MJR_PACKETS_MAX_SIZE	(1024 * 1024 * 1024)
+
+/* Descriptor of an RTP packet stored in memory */
+typedef struct gst_mjr_packet {
+	guint32 offset;
+	guint16 len;
+	gint64 ext_ts;
+} gst_mjr_packet;
+
+/* MJR recording fully loaded in memory, with a compact descriptor per packet */
+typedef struct gst_mjr_recording {
+	gchar *filename;
+	gst_mjr_info info;
+	/* RTP info */
+	guint32 ssrc;
+	guint8 payload_type;
+	/* Packets */
+	GBytes *data;
+	GArray *packets;
+	/* How much to shift sequence numbers and timestamps when looping */
+	guint16 seq_span;
+	gint64 ts_span;
+} gst_mjr_recording;
+
+/* Load all the RTP packets of an MJR file in memory */
+gst_mjr_recording *gst_mjr_recording_load(const char *filename, gchar **error);
+/* Free an MJR recording loaded in memory */
+void gst_mjr_recording_free(gst_mjr_recording *recording);
+
+/* Compute by how much sequence numbers and timestamps must be shifted at each
+ * iteration when looping packets, for the RTP stream to look continuous */
+void gst_mjr_packets_get_spans(const guint8 *data, GArray *packets, guint32 clock_rate,
+	guint16 *seq_span, gint64 *ts_span);
+/* Create a buffer out of a packet in memory, shifting its sequence number and
+ * timestamp and overwriting its SSRC (if not 0): only the fixed RTP header is
+ * copied, while the rest of the packet is referenced from memory */
+GstBuffer *gst_mjr_packet_to_buffer(GBytes *data, const gst_mjr_packet *packet,
+	guint16 seq_shift, guint32 ts_shift, guint32 ssrc);
+
+#endif /* __GST_MJR_READER_H__ */
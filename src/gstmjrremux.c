@@ -0,0 +1,550 @@
+/*
+ * GStreamer
+ * Copyright (C) 2005 Thomas Vander Stichele <thomas@apestaart.org>
+ * Copyright (C) 2005 Ronald S. Bultje <rbultje@ronald.bitfreak.net>
+ * Copyright (C) 2024 Lorenzo Miniero <lorenzo@meetecho.com>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ *
+ * Alternatively, the contents of this file may be used under the
+ * GNU Lesser General Public License Version 2.1 (the "LGPL"), in
+ * which case the following provisions apply instead of the ones
+ * mentioned above:
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 02111-1307, USA.
+ */
+
+/**
+ * SECTION:element-mjrremux
+ *
+ * Trims, cuts and concatenates MJR files, working on whole records rather
+ * than on RTP packets: records are copied untouched between the cut
+ * points, and when more recordings are concatenated, the records of the
+ * ones that follow the first only get their received time, and the
+ * sequence number, timestamp and SSRC of their RTP packets, shifted to
+ * make them follow the ones written so far. The result is a new MJR
+ * file, whose header is the one of the first recording.
+ *
+ * <refsect2>
+ * <title>Example launch line</title>
+ * |[
+ * gst-launch-1.0 mjrremux locations=rec-sample-video.mjr start=600000 ! filesink location=trimmed.mjr
+ * ]|
+ * </refsect2>
+ */
+
+#ifdef HAVE_CONFIG_H
+#  include <config.h>
+#endif
+
+#include <errno.h>
+
+#include <gst/gst.h>
+
+#include <json-glib/json-glib.h>
+
+#include "gstmjrremux.h"
+#include "gstmjrutils.h"
+
+enum {
+	LAST_SIGNAL
+};
+
+enum {
+	PROP_0,
+	PROP_SILENT,
+	PROP_LOCATIONS,
+	PROP_DIRECTORY,
+	PROP_START,
+	PROP_STOP,
+	PROP_KEYFRAME,
+	PROP_BUFFER_SIZE
+};
+
+/* Default size of the buffers we push */
+#define GST_MJR_REMUX_DEFAULT_BUFFER_SIZE	(1024*1024)
+
+/* Pad templates: we push a new MJR file */
+static GstStaticPadTemplate srctemplate = GST_STATIC_PAD_TEMPLATE("src",
+	GST_PAD_SRC,
+	GST_PAD_ALWAYS,
+	GST_STATIC_CAPS_ANY
+);
+
+#define gst_mjr_remux_parent_class parent_class
+	G_DEFINE_TYPE(GstMjrRemux, gst_mjr_remux, GST_TYPE_PUSH_SRC);
+
+GST_ELEMENT_REGISTER_DEFINE(mjrremux, "mjrremux", GST_RANK_NONE,
+	GST_TYPE_MJR_REMUX);
+
+/* Property setters/getters */
+static void gst_mjr_remux_set_property(GObject *object,
+	guint prop_id, const GValue *value, GParamSpec *pspec);
+static void gst_mjr_remux_get_property(GObject *object,
+	guint prop_id, GValue *value, GParamSpec *pspec);
+static void gst_mjr_remux_finalize(GObject *object);
+
+/* Source methods */
+static gboolean gst_mjr_remux_start(GstBaseSrc *basesrc);
+static gboolean gst_mjr_remux_stop(GstBaseSrc *basesrc);
+static GstFlowReturn gst_mjr_remux_create(GstPushSrc *pushsrc, GstBuffer **buf);
+
+/* Initialize the mjrremux's class */
+static void gst_mjr_remux_class_init(GstMjrRemuxClass *klass) {
+	GObjectClass *gobject_class;
+	GstElementClass *gstelement_class;
+	GstBaseSrcClass *gstbasesrc_class;
+	GstPushSrcClass *gstpushsrc_class;
+
+	gobject_class = (GObjectClass *)klass;
+	gstelement_class = (GstElementClass *)klass;
+	gstbasesrc_class = (GstBaseSrcClass *)klass;
+	gstpushsrc_class = (GstPushSrcClass *)klass;
+
+	gobject_class->set_property = gst_mjr_remux_set_property;
+	gobject_class->get_property = gst_mjr_remux_get_property;
+	gobject_class->finalize = gst_mjr_remux_finalize;
+
+	g_object_class_install_property(gobject_class, PROP_SILENT,
+		g_param_spec_boolean("silent", "Silent", "Don't produce verbose output",
+			TRUE, G_PARAM_READWRITE | GST_PARAM_MUTABLE_PLAYING));
+	g_object_class_install_property(gobject_class, PROP_LOCATIONS,
+		g_param_spec_string("locations", "Locations", "Comma separated list of MJR files to concatenate",
+			NULL, G_PARAM_READWRITE | GST_PARAM_MUTABLE_READY));
+	g_object_class_install_property(gobject_class, PROP_DIRECTORY,
+		g_param_spec_string("directory", "Directory", "Folder to concatenate all MJR files from",
+			NULL, G_PARAM_READWRITE | GST_PARAM_MUTABLE_READY));
+	g_object_class_install_property(gobject_class, PROP_START,
+		g_param_spec_uint("start", "Start", "Drop the records received before this time (in milliseconds)",
+			0, G_MAXUINT32, 0, G_PARAM_READWRITE | GST_PARAM_MUTABLE_READY));
+	g_object_class_install_property(gobject_class, PROP_STOP,
+		g_param_spec_uint("stop", "Stop", "Drop the records received after this time (in milliseconds, 0=until the end)",
+			0, G_MAXUINT32, 0, G_PARAM_READWRITE | GST_PARAM_MUTABLE_READY));
+	g_object_class_install_property(gobject_class, PROP_KEYFRAME,
+		g_param_spec_boolean("keyframe", "Keyframe", "For video, start from the first keyframe after the start time",
+			TRUE, G_PARAM_READWRITE | GST_PARAM_MUTABLE_READY));
+	g_object_class_install_property(gobject_class, PROP_BUFFER_SIZE,
+		g_param_spec_uint("buffer-size", "Buffer size", "Size of the output buffers",
+			1024, G_MAXINT32, GST_MJR_REMUX_DEFAULT_BUFFER_SIZE, G_PARAM_READWRITE | GST_PARAM_MUTABLE_READY));
+
+	gstbasesrc_class->start = GST_DEBUG_FUNCPTR(gst_mjr_remux_start);
+	gstbasesrc_class->stop = GST_DEBUG_FUNCPTR(gst_mjr_remux_stop);
+	gstpushsrc_class->create = GST_DEBUG_FUNCPTR(gst_mjr_remux_create);
+
+	gst_element_class_set_details_simple(gstelement_class,
+		"Janus MJR Remuxer",
+		"Source/File",
+		"Trim, cut and concatenate MJR files without demuxing them",
+		"Lorenzo Miniero <lorenzo@meetecho.com>");
+	gst_element_class_add_static_pad_template(gstelement_class, &srctemplate);
+}
+
+/* Initialize the new element */
+static void gst_mjr_remux_init(GstMjrRemux *src) {
+	src->silent = TRUE;
+	src->locations = NULL;
+	src->directory = NULL;
+	src->start = 0;
+	src->stop = 0;
+	src->keyframe = TRUE;
+	src->buffer_size = GST_MJR_REMUX_DEFAULT_BUFFER_SIZE;
+	src->files = NULL;
+	src->reader = NULL;
+	src->header = NULL;
+	gst_base_src_set_format(GST_BASE_SRC(src), GST_FORMAT_BYTES);
+}
+
+/* Property setter */
+static void gst_mjr_remux_set_property(GObject *object, guint prop_id, const GValue *value, GParamSpec *pspec) {
+	GstMjrRemux *src = GST_MJR_REMUX(object);
+	/* Set the specified property */
+	switch(prop_id) {
+		case PROP_SILENT:
+			src->silent = g_value_get_boolean(value);
+			break;
+		case PROP_LOCATIONS:
+			g_free(src->locations);
+			src->locations = g_value_dup_string(value);
+			break;
+		case PROP_DIRECTORY:
+			g_free(src->directory);
+			src->directory = g_value_dup_string(value);
+			break;
+		case PROP_START:
+			src->start = g_value_get_uint(value);
+			break;
+		case PROP_STOP:
+			src->stop = g_value_get_uint(value);
+			break;
+		case PROP_KEYFRAME:
+			src->keyframe = g_value_get_boolean(value);
+			break;
+		case PROP_BUFFER_SIZE:
+			src->buffer_size = g_value_get_uint(value);
+			break;
+		default:
+			G_OBJECT_WARN_INVALID_PROPERTY_ID(object, prop_id, pspec);
+			break;
+	}
+}
+
+/* Property getter */
+static void gst_mjr_remux_get_property(GObject *object, guint prop_id, GValue *value, GParamSpec *pspec) {
+	GstMjrRemux *src = GST_MJR_REMUX(object);
+	/* Get the specified property */
+	switch(prop_id) {
+		case PROP_SILENT:
+			g_value_set_boolean(value, src->silent);
+			break;
+		case PROP_LOCATIONS:
+			g_value_set_string(value, src->locations);
+			break;
+		case PROP_DIRECTORY:
+			g_value_set_string(value, src->directory);
+			break;
+		case PROP_START:
+			g_value_set_uint(value, src->start);
+			break;
+		case PROP_STOP:
+			g_value_set_uint(value, src->stop);
+			break;
+		case PROP_KEYFRAME:
+			g_value_set_boolean(value, src->keyframe);
+			break;
+		case PROP_BUFFER_SIZE:
+			g_value_set_uint(value, src->buffer_size);
+			break;
+		default:
+			G_OBJECT_WARN_INVALID_PROPERTY_ID(object, prop_id, pspec);
+			break;
+	}
+}
+
+/* Cleanup */
+static void gst_mjr_remux_finalize(GObject *object) {
+	GstMjrRemux *src = GST_MJR_REMUX(object);
+	g_free(src->locations);
+	g_free(src->directory);
+	G_OBJECT_CLASS(parent_class)->finalize(object);
+}
+
+/* Create the header of the new file out of the one of the first recording:
+ * since we never compress, that's the only thing we may have to change */
+static GstBuffer *gst_mjr_remux_header(GstMjrRemux *src) {
+	gst_mjr_reader *reader = src->reader;
+	gsize len = reader->data_offset - GST_MJR_HEADER_SIZE - GST_MJR_JSON_LENGTH_SIZE;
+	goffset offset = reader->offset;
+	if(fseeko(reader->file, GST_MJR_HEADER_SIZE + GST_MJR_JSON_LENGTH_SIZE, SEEK_SET) < 0 ||
+			fread(reader->buffer, 1, len, reader->file) < len) {
+		gst_mjr_reader_seek(reader, offset);
+		return NULL;
+	}
+	gst_mjr_reader_seek(reader, offset);
+	JsonParser *parser = json_parser_new();
+	if(!json_parser_load_from_data(parser, reader->buffer, len, NULL) ||
+			!JSON_NODE_HOLDS_OBJECT(json_parser_get_root(parser))) {
+		g_object_unref(parser);
+		return NULL;
+	}
+	JsonObject *object = json_node_get_object(json_parser_get_root(parser));
+	if(json_object_has_member(object, "z"))
+		json_object_remove_member(object, "z");
+	JsonGenerator *gen = json_generator_new();
+	json_generator_set_root(gen, json_parser_get_root(parser));
+	gsize info_len = 0;
+	gchar *info_text = json_generator_to_data(gen, &info_len);
+	g_object_unref(gen);
+	g_object_unref(parser);
+	if(info_text == NULL || info_len > G_MAXUINT16) {
+		g_free(info_text);
+		return NULL;
+	}
+	GstBuffer *buf = gst_buffer_new_allocate(NULL, GST_MJR_HEADER_SIZE + GST_MJR_JSON_LENGTH_SIZE + info_len, NULL);
+	guint16 net_len = g_htons(info_len);
+	gst_buffer_fill(buf, 0, "MJR00002", GST_MJR_HEADER_SIZE);
+	gst_buffer_fill(buf, GST_MJR_HEADER_SIZE, &net_len, sizeof(net_len));
+	gst_buffer_fill(buf, GST_MJR_HEADER_SIZE + GST_MJR_JSON_LENGTH_SIZE, info_text, info_len);
+	g_free(info_text);
+	return buf;
+}
+
+/* Open the next file in the list: returns EOS if there are no more files */
+static GstFlowReturn gst_mjr_remux_open_next(GstMjrRemux *src) {
+	if(src->reader != NULL) {
+		gst_mjr_reader_close(src->reader);
+		src->reader = NULL;
+		src->file_index++;
+	}
+	if(src->file_index >= src->files->len)
+		return GST_FLOW_EOS;
+	const char *filename = g_ptr_array_index(src->files, src->file_index);
+	gchar *error = NULL;
+	src->reader = gst_mjr_reader_open(filename, &error);
+	if(src->reader == NULL) {
+		GST_ELEMENT_ERROR(src, RESOURCE, OPEN_READ, (NULL), ("%s", error));
+		g_free(error);
+		return GST_FLOW_ERROR;
+	}
+	if(src->reader->info.legacy) {
+		/* We need the received time to cut, and a recent header to concatenate */
+		GST_ELEMENT_ERROR(src, STREAM, FORMAT, (NULL), ("Legacy MJR files can't be remuxed (%s).", filename));
+		return GST_FLOW_ERROR;
+	}
+	if(src->file_index == 0) {
+		src->info = src->reader->info;
+	} else if(src->reader->info.snaplen != src->info.snaplen) {
+		GST_ELEMENT_ERROR(src, STREAM, FORMAT, (NULL),
+			("Can't concatenate recordings with a different snaplen (%s).", filename));
+		return GST_FLOW_ERROR;
+	} else if(src->reader->info.codec != src->info.codec) {
+		GST_ELEMENT_ERROR(src, STREAM, FORMAT, (NULL),
+			("Can't concatenate %s to %s recordings (%s).", gst_mjr_codec_string(src->reader->info.codec),
+				gst_mjr_codec_string(src->info.codec), filename));
+		return GST_FLOW_ERROR;
+	}
+	src->file_started = FALSE;
+	if(src->file_index == 0) {
+		/* The header of the first file is the one we'll use */
+		src->header = gst_mjr_remux_header(src);
+		if(src->header == NULL) {
+			GST_ELEMENT_ERROR(src, STREAM, FORMAT, (NULL), ("Invalid MJR header (%s).", filename));
+			return GST_FLOW_ERROR;
+		}
+	}
+	if(src->file_index == 0 && src->start > 0) {
+		/* Skip the records before the start time right away */
+		if(!gst_mjr_reader_seek_time(src->reader, src->start, &error)) {
+			GST_ELEMENT_ERROR(src, RESOURCE, READ, (NULL), ("%s", error ? error : "Error seeking."));
+			g_free(error);
+			return GST_FLOW_ERROR;
+		}
+	}
+	if(!src->silent)
+		g_print("[mjrremux] Reading %s\n", filename);
+	return GST_FLOW_OK;
+}
+
+/* Start: get the list of files, and open the first one */
+static gboolean gst_mjr_remux_start(GstBaseSrc *basesrc) {
+	GstMjrRemux *src = GST_MJR_REMUX(basesrc);
+	gchar *error = NULL;
+	src->files = gst_mjr_list_files(src->locations, src->directory, &error);
+	if(src->files == NULL) {
+		GST_ELEMENT_ERROR(src, RESOURCE, NOT_FOUND, (NULL), ("%s", error));
+		g_free(error);
+		return FALSE;
+	}
+	src->file_index = 0;
+	src->header = NULL;
+	src->started = FALSE;
+	src->done = FALSE;
+	src->offset = 0;
+	src->records = 0;
+	src->ssrc = 0;
+	src->last_seq = 0;
+	src->last_ts = 0;
+	src->last_received = 0;
+	return gst_mjr_remux_open_next(src) == GST_FLOW_OK;
+}
+
+/* Stop: close the file we were reading */
+static gboolean gst_mjr_remux_stop(GstBaseSrc *basesrc) {
+	GstMjrRemux *src = GST_MJR_REMUX(basesrc);
+	if(src->reader != NULL)
+		gst_mjr_reader_close(src->reader);
+	src->reader = NULL;
+	if(src->header != NULL)
+		gst_buffer_unref(src->header);
+	src->header = NULL;
+	if(src->files != NULL)
+		g_ptr_array_free(src->files, TRUE);
+	src->files = NULL;
+	return TRUE;
+}
+
+/* Figure out how to shift the records of a file we're concatenating,
+ * given its first RTP packet */
+static void gst_mjr_remux_file_start(GstMjrRemux *src, gst_mjr_rtp *rtp) {
+	src->file_started = TRUE;
+	src->file_ssrc = g_ntohl(rtp->ssrc);
+	if(src->file_index == 0 || src->records == 0) {
+		/* Nothing to rewrite, we keep the records untouched */
+		src->ssrc = src->file_ssrc;
+		src->received_shift = 0;
+		src->seq_shift = 0;
+		src->ts_shift = 0;
+		return;
+	}
+	/* Place the records where they belong in time, according to when the
+	 * files were written, unless that would overlap what we wrote already */
+	gint64 received_shift = (src->reader->info.written - src->info.written) / 1000;
+	if(src->reader->info.written == 0 || src->info.written == 0 ||
+			(gint64)src->reader->received + received_shift <= (gint64)src->last_received)
+		received_shift = (gint64)src->last_received + 1 - src->reader->received;
+	src->received_shift = received_shift;
+	/* Make the RTP stream continuous, accounting for the gap in between */
+	guint32 gap = src->reader->received + received_shift - src->last_received;
+	guint32 clock_rate = gst_mjr_get_clock_rate(src->info.codec);
+	src->seq_shift = src->last_seq + 1 - g_ntohs(rtp->seq_number);
+	src->ts_shift = src->last_ts + (guint32)gst_util_uint64_scale(gap, clock_rate, 1000) - g_ntohl(rtp->timestamp);
+	if(!src->silent) {
+		g_print("[mjrremux] Shifting by %" G_GINT64_FORMAT "ms (seq %" G_GUINT16_FORMAT ", ts %" G_GUINT32_FORMAT ")\n",
+			received_shift, src->seq_shift, src->ts_shift);
+	}
+}
+
+/* Copy the record we just read to the output, rewriting it if needed:
+ * returns FALSE if we reached the stop time */
+static gboolean gst_mjr_remux_record(GstMjrRemux *src, GByteArray *out) {
+	gst_mjr_reader *reader = src->reader;
+	guint16 len = reader->length;
+	gst_mjr_rtp *rtp = len >= 12 ? (gst_mjr_rtp *)reader->buffer : NULL;
+	if(rtp != NULL && !src->file_started)
+		gst_mjr_remux_file_start(src, rtp);
+	gint64 received = (gint64)reader->received + src->received_shift;
+	if(received < 0)
+		received = 0;
+	if(!src->started) {
+		/* We're still looking for where to start */
+		if(received < src->start)
+			return TRUE;
+		if(src->keyframe && src->info.video) {
+			if(rtp == NULL || !src->file_started || g_ntohl(rtp->ssrc) != src->file_ssrc)
+				return TRUE;
+			gsize header = gst_mjr_rtp_header_size((const guint8 *)reader->buffer, len);
+			if(header == 0 || !gst_mjr_is_keyframe(src->info.codec,
+					(const guint8 *)reader->buffer + header, len - header))
+				return TRUE;
+		}
+		src->started = TRUE;
+		if(!src->silent)
+			g_print("[mjrremux] Starting at %" G_GINT64_FORMAT "ms\n", received);
+	}
+	if(src->stop > 0 && received > src->stop)
+		return FALSE;
+	if(rtp != NULL && src->file_started && g_ntohl(rtp->ssrc) == src->file_ssrc) {
+		if(src->file_index > 0) {
+			rtp->seq_number = g_htons(g_ntohs(rtp->seq_number) + src->seq_shift);
+			rtp->timestamp = g_htonl(g_ntohl(rtp->timestamp) + src->ts_shift);
+			rtp->ssrc = g_htonl(src->ssrc);
+		}
+		src->last_seq = g_ntohs(rtp->seq_number);
+		src->last_ts = g_ntohl(rtp->timestamp);
+	}
+	src->last_received = received;
+	src->records++;
+	/* Write the record, and the original length of the packet if truncated */
+	guint16 record_len = len + (src->info.snaplen > 0 ? GST_MJR_SNAPLEN_TRAILER_SIZE : 0);
+	guint offset = out->len;
+	g_byte_array_set_size(out, offset + GST_MJR_FRAME_HEADER_SIZE + record_len);
+	memcpy(out->data + offset, "MEET", 4);
+	guint32 recvd32 = g_htonl(src->last_received);
+	memcpy(out->data + offset + 4, &recvd32, sizeof(recvd32));
+	guint16 net_len = g_htons(record_len);
+	memcpy(out->data + offset + 8, &net_len, sizeof(net_len));
+	memcpy(out->data + offset + GST_MJR_FRAME_HEADER_SIZE, reader->buffer, len);
+	if(src->info.snaplen > 0) {
+		guint16 original = g_htons(reader->original);
+		memcpy(out->data + offset + GST_MJR_FRAME_HEADER_SIZE + len, &original, sizeof(original));
+	}
+	return TRUE;
+}
+
+/* Fill a buffer with the next records */
+static GstFlowReturn gst_mjr_remux_create(GstPushSrc *pushsrc, GstBuffer **buf) {
+	GstMjrRemux *src = GST_MJR_REMUX(pushsrc);
+	if(src->header != NULL) {
+		*buf = src->header;
+		src->header = NULL;
+		GST_BUFFER_OFFSET(*buf) = 0;
+		src->offset = gst_buffer_get_size(*buf);
+		return GST_FLOW_OK;
+	}
+	GByteArray *out = g_byte_array_sized_new(src->buffer_size + GST_MJR_FRAME_HEADER_SIZE + G_MAXUINT16);
+	GstFlowReturn ret = GST_FLOW_OK;
+	gchar *error = NULL;
+	while(!src->done && out->len < src->buffer_size) {
+		if(src->started && src->stop == 0 && src->files->len == 1 && !src->info.compressed) {
+			/* We're trimming a single file, and have nothing more to check:
+			 * just copy the rest of the file as it is */
+			guint offset = out->len;
+			g_byte_array_set_size(out, src->buffer_size);
+			size_t read = fread(out->data + offset, 1, src->buffer_size - offset, src->reader->file);
+			g_byte_array_set_size(out, offset + read);
+			if(read == 0) {
+				if(ferror(src->reader->file)) {
+					GST_ELEMENT_ERROR(src, RESOURCE, READ, (NULL),
+						("Error reading file '%s' (%s).", src->reader->filename, g_strerror(errno)));
+					ret = GST_FLOW_ERROR;
+					break;
+				}
+				src->done = TRUE;
+			}
+			continue;
+		}
+		gst_mjr_reader_result res = gst_mjr_reader_next(src->reader, &error);
+		if(res == gst_mjr_reader_error) {
+			GST_ELEMENT_ERROR(src, RESOURCE, READ, (NULL), ("%s", error));
+			g_free(error);
+			ret = GST_FLOW_ERROR;
+			break;
+		} else if(res == gst_mjr_reader_eof) {
+			/* Move on to the next file, if any */
+			ret = gst_mjr_remux_open_next(src);
+			if(ret == GST_FLOW_EOS) {
+				ret = GST_FLOW_OK;
+				src->done = TRUE;
+			} else if(ret != GST_FLOW_OK) {
+				break;
+			}
+			continue;
+		}
+		if(!gst_mjr_remux_record(src, out))
+			src->done = TRUE;
+	}
+	if(ret != GST_FLOW_OK || out->len == 0) {
+		g_byte_array_free(out, TRUE);
+		if(ret == GST_FLOW_OK && !src->silent)
+			g_print("[mjrremux] Done, %" G_GUINT64_FORMAT " bytes written\n", src->offset);
+		return ret != GST_FLOW_OK ? ret : GST_FLOW_EOS;
+	}
+	gsize size = out->len;
+	*buf = gst_buffer_new_wrapped(g_byte_array_free(out, FALSE), size);
+	GST_BUFFER_OFFSET(*buf) = src->offset;
+	src->offset += size;
+	return GST_FLOW_OK;
+}
+
+/* Register the element in the plugin */
+gboolean mjr_remux_register(GstPlugin *plugin) {
+	return GST_ELEMENT_REGISTER(mjrremux, plugin);
+}
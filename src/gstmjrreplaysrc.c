@@ -0,0 +1,546 @@
+/*
+ * GStreamer
+ * Copyright (C) 2005 Thomas Vander Stichele <thomas@apestaart.org>
+ * Copyright (C) 2005 Ronald S. Bultje <rbultje@ronald.bitfreak.net>
+ * Copyright (C) 2024 Lorenzo Miniero <lorenzo@meetecho.com>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ *
+ * Alternatively, the contents of this file may be used under the
+ * GNU Lesser General Public License Version 2.1 (the "LGPL"), in
+ * which case the following provisions apply instead of the ones
+ * mentioned above:
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 02111-1307, USA.
+ */
+
+/**
+ * SECTION:element-mjrreplaysrc
+ *
+ * Replays many MJR recordings at the same time as separate RTP streams,
+ * e.g., to simulate a large number of publishers. Recordings are loaded
+ * in memory once, and can be shared by multiple streams, each with its
+ * own SSRC: the packets of all streams are sent from a few worker threads,
+ * that schedule them using a hierarchical timer wheel.
+ *
+ * <refsect2>
+ * <title>Example launch line</title>
+ * |[
+ * gst-launch-1.0 mjrreplaysrc locations=rec-sample-video.mjr copies=2 loop=true name=r \
+ *     r.src_0 ! udpsink port=5002 sync=false r.src_1 ! udpsink port=5004 sync=false
+ * ]|
+ * </refsect2>
+ */
+
+#ifdef HAVE_CONFIG_H
+#  include <config.h>
+#endif
+
+#include <gst/gst.h>
+
+#include "gstmjrreplaysrc.h"
+#include "gstmjrutils.h"
+
+enum {
+	LAST_SIGNAL
+};
+
+enum {
+	PROP_0,
+	PROP_SILENT,
+	PROP_LOCATIONS,
+	PROP_DIRECTORY,
+	PROP_COPIES,
+	PROP_WORKERS,
+	PROP_LOOP,
+	PROP_SSRC,
+	PROP_SPREAD
+};
+
+/* Pad templates: we read files, and shoot RTP out on one pad per stream */
+static GstStaticPadTemplate srctemplate = GST_STATIC_PAD_TEMPLATE("src_%u",
+	GST_PAD_SRC,
+	GST_PAD_SOMETIMES,
+	GST_STATIC_CAPS("application/x-rtp")
+);
+
+#define gst_mjr_replay_src_parent_class parent_class
+	G_DEFINE_TYPE(GstMjrReplaySrc, gst_mjr_replay_src, GST_TYPE_ELEMENT);
+
+GST_ELEMENT_REGISTER_DEFINE(mjrreplaysrc, "mjrreplaysrc", GST_RANK_NONE,
+	GST_TYPE_MJR_REPLAY_SRC);
+
+/* Property setters/getters */
+static void gst_mjr_replay_src_set_property(GObject *object,
+	guint prop_id, const GValue *value, GParamSpec *pspec);
+static void gst_mjr_replay_src_get_property(GObject *object,
+	guint prop_id, GValue *value, GParamSpec *pspec);
+static void gst_mjr_replay_src_finalize(GObject *object);
+
+/* State changes, where we load the recordings and start/stop the workers */
+static GstStateChangeReturn gst_mjr_replay_src_change_state(GstElement *element,
+	GstStateChange transition);
+
+/* Initialize the mjrreplaysrc's class */
+static void gst_mjr_replay_src_class_init(GstMjrReplaySrcClass *klass) {
+	GObjectClass *gobject_class;
+	GstElementClass *gstelement_class;
+
+	gobject_class = (GObjectClass *)klass;
+	gstelement_class = (GstElementClass *)klass;
+
+	gobject_class->set_property = gst_mjr_replay_src_set_property;
+	gobject_class->get_property = gst_mjr_replay_src_get_property;
+	gobject_class->finalize = gst_mjr_replay_src_finalize;
+
+	g_object_class_install_property(gobject_class, PROP_SILENT,
+		g_param_spec_boolean("silent", "Silent", "Don't produce verbose output",
+			TRUE, G_PARAM_READWRITE | GST_PARAM_MUTABLE_PLAYING));
+	g_object_class_install_property(gobject_class, PROP_LOCATIONS,
+		g_param_spec_string("locations", "Locations", "Comma separated list of MJR files to replay",
+			NULL, G_PARAM_READWRITE | GST_PARAM_MUTABLE_READY));
+	g_object_class_install_property(gobject_class, PROP_DIRECTORY,
+		g_param_spec_string("directory", "Directory", "Folder to replay all MJR files from",
+			NULL, G_PARAM_READWRITE | GST_PARAM_MUTABLE_READY));
+	g_object_class_install_property(gobject_class, PROP_COPIES,
+		g_param_spec_uint("copies", "Copies", "How many streams should replay each recording",
+			1, G_MAXUINT16, 1, G_PARAM_READWRITE | GST_PARAM_MUTABLE_READY));
+	g_object_class_install_property(gobject_class, PROP_WORKERS,
+		g_param_spec_uint("workers", "Workers", "How many threads to use to send packets",
+			1, 256, 1, G_PARAM_READWRITE | GST_PARAM_MUTABLE_READY));
+	g_object_class_install_property(gobject_class, PROP_LOOP,
+		g_param_spec_boolean("loop", "Loop", "Replay the recordings in a loop, as continuous RTP streams",
+			FALSE, G_PARAM_READWRITE | GST_PARAM_MUTABLE_READY));
+	g_object_class_install_property(gobject_class, PROP_SSRC,
+		g_param_spec_uint("ssrc", "SSRC", "SSRC of the first stream, incremented for each of the others (random SSRCs if 0)",
+			0, G_MAXUINT32, 0, G_PARAM_READWRITE | GST_PARAM_MUTABLE_READY));
+	g_object_class_install_property(gobject_class, PROP_SPREAD,
+		g_param_spec_uint("spread", "Spread", "Interval (in milliseconds) to spread the start of the streams over",
+			0, G_MAXUINT32, 0, G_PARAM_READWRITE | GST_PARAM_MUTABLE_READY));
+
+	gstelement_class->change_state = GST_DEBUG_FUNCPTR(gst_mjr_replay_src_change_state);
+
+	gst_element_class_set_details_simple(gstelement_class,
+		"Janus MJR Replay Source",
+		"Source/Network/RTP",
+		"Replay many MJR recordings as separate RTP streams",
+		"Lorenzo Miniero <lorenzo@meetecho.com>");
+	gst_element_class_add_static_pad_template(gstelement_class, &srctemplate);
+}
+
+/* Initialize the new element */
+static void gst_mjr_replay_src_init(GstMjrReplaySrc *src) {
+	src->silent = TRUE;
+	src->locations = NULL;
+	src->directory = NULL;
+	src->copies = 1;
+	src->n_workers = 1;
+	src->loop = FALSE;
+	src->ssrc = 0;
+	src->spread = 0;
+	src->recordings = g_ptr_array_new();
+	src->streams = g_ptr_array_new();
+	src->workers = NULL;
+	src->group_id = 0;
+	src->running = 0;
+	src->paused = FALSE;
+	g_mutex_init(&src->mutex);
+	g_cond_init(&src->cond);
+	src->start_time = 0;
+	src->elapsed = 0;
+}
+
+/* Property setter */
+static void gst_mjr_replay_src_set_property(GObject *object, guint prop_id, const GValue *value, GParamSpec *pspec) {
+	GstMjrReplaySrc *src = GST_MJR_REPLAY_SRC(object);
+	/* Set the specified property */
+	switch(prop_id) {
+		case PROP_SILENT:
+			src->silent = g_value_get_boolean(value);
+			break;
+		case PROP_LOCATIONS:
+			g_free(src->locations);
+			src->locations = g_value_dup_string(value);
+			break;
+		case PROP_DIRECTORY:
+			g_free(src->directory);
+			src->directory = g_value_dup_string(value);
+			break;
+		case PROP_COPIES:
+			src->copies = g_value_get_uint(value);
+			break;
+		case PROP_WORKERS:
+			src->n_workers = g_value_get_uint(value);
+			break;
+		case PROP_LOOP:
+			src->loop = g_value_get_boolean(value);
+			break;
+		case PROP_SSRC:
+			src->ssrc = g_value_get_uint(value);
+			break;
+		case PROP_SPREAD:
+			src->spread = g_value_get_uint(value);
+			break;
+		default:
+			G_OBJECT_WARN_INVALID_PROPERTY_ID(object, prop_id, pspec);
+			break;
+	}
+}
+
+/* Property getter */
+static void gst_mjr_replay_src_get_property(GObject *object, guint prop_id, GValue *value, GParamSpec *pspec) {
+	GstMjrReplaySrc *src = GST_MJR_REPLAY_SRC(object);
+	/* Get the specified property */
+	switch(prop_id) {
+		case PROP_SILENT:
+			g_value_set_boolean(value, src->silent);
+			break;
+		case PROP_LOCATIONS:
+			g_value_set_string(value, src->locations);
+			break;
+		case PROP_DIRECTORY:
+			g_value_set_string(value, src->directory);
+			break;
+		case PROP_COPIES:
+			g_value_set_uint(value, src->copies);
+			break;
+		case PROP_WORKERS:
+			g_value_set_uint(value, src->n_workers);
+			break;
+		case PROP_LOOP:
+			g_value_set_boolean(value, src->loop);
+			break;
+		case PROP_SSRC:
+			g_value_set_uint(value, src->ssrc);
+			break;
+		case PROP_SPREAD:
+			g_value_set_uint(value, src->spread);
+			break;
+		default:
+			G_OBJECT_WARN_INVALID_PROPERTY_ID(object, prop_id, pspec);
+			break;
+	}
+}
+
+/* Cleanup */
+static void gst_mjr_replay_src_finalize(GObject *object) {
+	GstMjrReplaySrc *src = GST_MJR_REPLAY_SRC(object);
+	g_free(src->locations);
+	g_free(src->directory);
+	g_ptr_array_free(src->recordings, TRUE);
+	g_ptr_array_free(src->streams, TRUE);
+	g_mutex_clear(&src->mutex);
+	g_cond_clear(&src->cond);
+	G_OBJECT_CLASS(parent_class)->finalize(object);
+}
+
+/* Helper to compute when the next packet of a stream should be sent (in microseconds) */
+static gint64 gst_mjr_replay_stream_next_time(gst_mjr_replay_stream *stream) {
+	gst_mjr_recording *recording = stream->recording;
+	gst_mjr_packet *packet = &g_array_index(recording->packets, gst_mjr_packet, stream->index);
+	gint64 ext_ts = packet->ext_ts + stream->iteration * recording->ts_span;
+	GstClockTime pts = gst_mjr_timestamp_to_time(ext_ts, gst_mjr_get_clock_rate(recording->info.codec));
+	return stream->offset + pts / GST_USECOND;
+}
+
+/* Push the next packet of a stream */
+static GstFlowReturn gst_mjr_replay_src_push(GstMjrReplaySrc *src, gst_mjr_replay_stream *stream) {
+	gst_mjr_recording *recording = stream->recording;
+	if(!stream->started) {
+		/* First packet, send the sticky events */
+		stream->started = TRUE;
+		gchar *stream_id = gst_pad_create_stream_id_printf(stream->srcpad,
+			GST_ELEMENT(src), "%u", stream->id);
+		GstEvent *event = gst_event_new_stream_start(stream_id);
+		gst_event_set_group_id(event, src->group_id);
+		gst_pad_push_event(stream->srcpad, event);
+		g_free(stream_id);
+		GstCaps *caps = gst_caps_new_simple("application/x-rtp",
+			"media", G_TYPE_STRING, (recording->info.video ? "video" : "audio"),
+			"encoding-name", G_TYPE_STRING, gst_mjr_get_encoding_name(recording->info.codec),
+			"clock-rate", G_TYPE_INT, gst_mjr_get_clock_rate(recording->info.codec),
+			"payload", G_TYPE_INT, recording->payload_type,
+			"ssrc", G_TYPE_UINT, stream->ssrc,
+			NULL);
+		gst_pad_push_event(stream->srcpad, gst_event_new_caps(caps));
+		gst_caps_unref(caps);
+		GstSegment segment;
+		gst_segment_init(&segment, GST_FORMAT_TIME);
+		gst_pad_push_event(stream->srcpad, gst_event_new_segment(&segment));
+	}
+	gst_mjr_packet *packet = &g_array_index(recording->packets, gst_mjr_packet, stream->index);
+	GstBuffer *outbuf = gst_mjr_packet_to_buffer(recording->data, packet,
+		stream->iteration * recording->seq_span, stream->iteration * recording->ts_span, stream->ssrc);
+	GST_BUFFER_TIMESTAMP(outbuf) = gst_mjr_replay_stream_next_time(stream) * GST_USECOND;
+	return gst_pad_push(stream->srcpad, outbuf);
+}
+
+/* Timer callback, invoked by a worker when a stream has packets to send */
+static void gst_mjr_replay_src_fire(gst_mjr_wheel_timer *timer, gpointer user_data) {
+	gst_mjr_replay_worker *worker = (gst_mjr_replay_worker *)user_data;
+	gst_mjr_replay_stream *stream = (gst_mjr_replay_stream *)timer;
+	GstMjrReplaySrc *src = worker->src;
+	gint64 now = g_get_monotonic_time() - src->start_time;
+	/* Send all the packets that are due, and schedule the stream again */
+	while(!stream->done) {
+		gint64 when = gst_mjr_replay_stream_next_time(stream);
+		if(when > now) {
+			gst_mjr_wheel_add(&worker->wheel, &stream->timer, when / 1000);
+			return;
+		}
+		GstFlowReturn ret = gst_mjr_replay_src_push(src, stream);
+		if(ret == GST_FLOW_FLUSHING) {
+			/* We're stopping, try again next time */
+			gst_mjr_wheel_add(&worker->wheel, &stream->timer, when / 1000);
+			return;
+		} else if(ret != GST_FLOW_OK) {
+			/* Nobody's interested in this stream anymore */
+			if(ret != GST_FLOW_NOT_LINKED && ret != GST_FLOW_EOS)
+				GST_ELEMENT_FLOW_ERROR(src, ret);
+			stream->done = TRUE;
+			break;
+		}
+		stream->index++;
+		if(stream->index == stream->recording->packets->len) {
+			if(!src->loop) {
+				stream->done = TRUE;
+				break;
+			}
+			stream->index = 0;
+			stream->iteration++;
+		}
+	}
+	if(!src->silent)
+		g_print("[mjrreplaysrc] Stream %u done\n", stream->id);
+	gst_pad_push_event(stream->srcpad, gst_event_new_eos());
+}
+
+/* Worker thread */
+static gpointer gst_mjr_replay_src_worker_thread(gpointer user_data) {
+	gst_mjr_replay_worker *worker = (gst_mjr_replay_worker *)user_data;
+	GstMjrReplaySrc *src = worker->src;
+	while(g_atomic_int_get(&src->running) && worker->wheel.count > 0) {
+		/* If we're paused, wait until we're playing again (or stopped) */
+		g_mutex_lock(&src->mutex);
+		while(src->paused && g_atomic_int_get(&src->running))
+			g_cond_wait(&src->cond, &src->mutex);
+		g_mutex_unlock(&src->mutex);
+		if(!g_atomic_int_get(&src->running))
+			break;
+		/* Fire all the timers that expired, and wait for the next tick */
+		gint64 elapsed = g_get_monotonic_time() - src->start_time;
+		guint64 tick = elapsed / 1000;
+		gst_mjr_wheel_advance(&worker->wheel, tick, gst_mjr_replay_src_fire, worker);
+		gint64 wait = (gint64)((tick + 1) * 1000) - (g_get_monotonic_time() - src->start_time);
+		if(wait > 0)
+			g_usleep(wait);
+	}
+	return NULL;
+}
+
+/* Start the worker threads, or resume them if they're paused */
+static void gst_mjr_replay_src_start_workers(GstMjrReplaySrc *src) {
+	g_mutex_lock(&src->mutex);
+	src->start_time = g_get_monotonic_time() - src->elapsed;
+	src->paused = FALSE;
+	if(g_atomic_int_get(&src->running)) {
+		g_cond_broadcast(&src->cond);
+		g_mutex_unlock(&src->mutex);
+		return;
+	}
+	g_atomic_int_set(&src->running, 1);
+	g_mutex_unlock(&src->mutex);
+	guint i = 0;
+	for(i=0; i<src->n_workers; i++) {
+		gchar *name = g_strdup_printf("mjrreplay%u", i);
+		src->workers[i].thread = g_thread_new(name, gst_mjr_replay_src_worker_thread, &src->workers[i]);
+		g_free(name);
+	}
+}
+
+/* Pause the worker threads: we don't join them here, as they may be
+ * blocked in a push waiting for a sink that's already paused to preroll */
+static void gst_mjr_replay_src_pause_workers(GstMjrReplaySrc *src) {
+	g_mutex_lock(&src->mutex);
+	src->paused = TRUE;
+	src->elapsed = g_get_monotonic_time() - src->start_time;
+	g_mutex_unlock(&src->mutex);
+}
+
+/* Stop the worker threads: this must be done after the pads have been
+ * deactivated, so that any push the workers are blocked in returns */
+static void gst_mjr_replay_src_stop_workers(GstMjrReplaySrc *src) {
+	if(src->workers == NULL)
+		return;
+	g_mutex_lock(&src->mutex);
+	g_atomic_int_set(&src->running, 0);
+	g_cond_broadcast(&src->cond);
+	g_mutex_unlock(&src->mutex);
+	guint i = 0;
+	for(i=0; i<src->n_workers; i++) {
+		if(src->workers[i].thread != NULL) {
+			g_thread_join(src->workers[i].thread);
+			src->workers[i].thread = NULL;
+		}
+	}
+	src->paused = FALSE;
+}
+
+/* Get rid of all the streams and recordings */
+static void gst_mjr_replay_src_close(GstMjrReplaySrc *src) {
+	guint i = 0;
+	for(i=0; i<src->streams->len; i++) {
+		gst_mjr_replay_stream *stream = g_ptr_array_index(src->streams, i);
+		gst_element_remove_pad(GST_ELEMENT(src), stream->srcpad);
+		g_free(stream);
+	}
+	g_ptr_array_set_size(src->streams, 0);
+	for(i=0; i<src->recordings->len; i++)
+		gst_mjr_recording_free(g_ptr_array_index(src->recordings, i));
+	g_ptr_array_set_size(src->recordings, 0);
+	g_free(src->workers);
+	src->workers = NULL;
+	src->elapsed = 0;
+}
+
+/* Load all the recordings in memory, and create the streams */
+static gboolean gst_mjr_replay_src_open(GstMjrReplaySrc *src) {
+	gchar *error = NULL;
+	GPtrArray *files = gst_mjr_list_files(src->locations, src->directory, &error);
+	if(!files) {
+		GST_ELEMENT_ERROR(src, RESOURCE, OPEN_READ, (NULL), ("%s", error));
+		g_free(error);
+		return FALSE;
+	}
+	guint i = 0, j = 0;
+	for(i=0; i<files->len; i++) {
+		const gchar *filename = g_ptr_array_index(files, i);
+		gst_mjr_recording *recording = gst_mjr_recording_load(filename, &error);
+		if(!recording) {
+			GST_ELEMENT_ERROR(src, RESOURCE, OPEN_READ, (NULL), ("%s", error));
+			g_free(error);
+			g_ptr_array_free(files, TRUE);
+			gst_mjr_replay_src_close(src);
+			return FALSE;
+		}
+		if(recording->packets->len == 0) {
+			/* No packets in there, skip it */
+			if(!src->silent)
+				g_print("[mjrreplaysrc] Skipping empty recording %s\n", filename);
+			gst_mjr_recording_free(recording);
+			continue;
+		}
+		if(!src->silent) {
+			g_print("[mjrreplaysrc] Loaded %s (%s, %s, %u packets)\n", filename,
+				recording->info.video ? "video" : "audio", gst_mjr_codec_string(recording->info.codec),
+				recording->packets->len);
+		}
+		g_ptr_array_add(src->recordings, recording);
+	}
+	g_ptr_array_free(files, TRUE);
+	if(src->recordings->len == 0) {
+		GST_ELEMENT_ERROR(src, RESOURCE, NOT_FOUND, (NULL), ("No MJR file to replay"));
+		return FALSE;
+	}
+	/* Create the workers */
+	src->workers = g_malloc0(src->n_workers * sizeof(gst_mjr_replay_worker));
+	for(i=0; i<src->n_workers; i++) {
+		src->workers[i].src = src;
+		src->workers[i].id = i;
+		gst_mjr_wheel_init(&src->workers[i].wheel, 0);
+	}
+	/* Create the streams, and distribute them among the workers */
+	src->group_id = gst_util_group_id_next();
+	guint total = src->recordings->len * src->copies;
+	for(j=0; j<src->copies; j++) {
+		for(i=0; i<src->recordings->len; i++) {
+			gst_mjr_replay_stream *stream = g_malloc0(sizeof(gst_mjr_replay_stream));
+			stream->id = src->streams->len;
+			stream->recording = g_ptr_array_index(src->recordings, i);
+			stream->ssrc = src->ssrc ? (src->ssrc + stream->id) : g_random_int();
+			stream->offset = (gint64)src->spread * 1000 * stream->id / total;
+			g_ptr_array_add(src->streams, stream);
+			gchar *name = g_strdup_printf("src_%u", stream->id);
+			stream->srcpad = gst_pad_new_from_static_template(&srctemplate, name);
+			g_free(name);
+			gst_pad_use_fixed_caps(stream->srcpad);
+			gst_element_add_pad(GST_ELEMENT(src), stream->srcpad);
+			gst_mjr_replay_worker *worker = &src->workers[stream->id % src->n_workers];
+			gst_mjr_wheel_add(&worker->wheel, &stream->timer, gst_mjr_replay_stream_next_time(stream) / 1000);
+		}
+	}
+	gst_element_no_more_pads(GST_ELEMENT(src));
+	return TRUE;
+}
+
+/* State changes, where we load the recordings and start/stop the workers */
+static GstStateChangeReturn gst_mjr_replay_src_change_state(GstElement *element, GstStateChange transition) {
+	GstMjrReplaySrc *src = GST_MJR_REPLAY_SRC(element);
+	GstStateChangeReturn ret = GST_STATE_CHANGE_SUCCESS;
+	switch(transition) {
+		case GST_STATE_CHANGE_READY_TO_PAUSED:
+			if(!gst_mjr_replay_src_open(src))
+				return GST_STATE_CHANGE_FAILURE;
+			break;
+		case GST_STATE_CHANGE_PLAYING_TO_PAUSED:
+			gst_mjr_replay_src_pause_workers(src);
+			break;
+		default:
+			break;
+	}
+	ret = GST_ELEMENT_CLASS(parent_class)->change_state(element, transition);
+	if(ret == GST_STATE_CHANGE_FAILURE)
+		return ret;
+	switch(transition) {
+		case GST_STATE_CHANGE_READY_TO_PAUSED:
+		case GST_STATE_CHANGE_PLAYING_TO_PAUSED:
+			/* We're a live source, we only send packets when playing */
+			ret = GST_STATE_CHANGE_NO_PREROLL;
+			break;
+		case GST_STATE_CHANGE_PAUSED_TO_PLAYING:
+			gst_mjr_replay_src_start_workers(src);
+			break;
+		case GST_STATE_CHANGE_PAUSED_TO_READY:
+			/* The pads are inactive now, so any pending push has returned */
+			gst_mjr_replay_src_stop_workers(src);
+			gst_mjr_replay_src_close(src);
+			break;
+		default:
+			break;
+	}
+	return ret;
+}
+
+/* Register the element in the plugin */
+gboolean mjr_replay_src_register(GstPlugin *plugin) {
+	return GST_ELEMENT_REGISTER(mjrreplaysrc, plugin);
+}
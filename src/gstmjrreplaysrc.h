@@ -0,0 +1,109 @@
+/*
+ * GStreamer
+ * Copyright (C) 2005 Thomas Vander Stichele <thomas@apestaart.org>
+ * Copyright (C) 2005 Ronald S. Bultje <rbultje@ronald.bitfreak.net>
+ * Copyright (C) 2024 Lorenzo Miniero <lorenzo@meetecho.com>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ *
+ * Alternatively, the contents of this file may be used under the
+ * GNU Lesser General Public License Version 2.1 (the "LGPL"), in
+ * which case the following provisions apply instead of the ones
+ * mentioned above:
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 02111-1307, USA.
+ */
+
+#ifndef __GST_MJR_REPLAY_SRC_H__
+#define __GST_MJR_REPLAY_SRC_H__
+
+#include <gst/gst.h>
+
+#include "gstmjrreader.h"
+#include "gstmjrwheel.h"
+
+G_BEGIN_DECLS
+
+#define GST_TYPE_MJR_REPLAY_SRC gst_mjr_replay_src_get_type()
+G_DECLARE_FINAL_TYPE(GstMjrReplaySrc, gst_mjr_replay_src, GST, MJR_REPLAY_SRC, GstElement)
+
+/* A stream replaying a recording: the timer must be the first member */
+typedef struct gst_mjr_replay_stream {
+	gst_mjr_wheel_timer timer;
+	guint id;
+	gst_mjr_recording *recording;
+	GstPad *srcpad;
+	gboolean started, done;
+	guint32 ssrc;
+	/* Next packet to send, and when the stream starts (in microseconds) */
+	guint index;
+	guint64 iteration;
+	gint64 offset;
+} gst_mjr_replay_stream;
+
+/* A worker thread, taking care of a subset of the streams */
+typedef struct gst_mjr_replay_worker {
+	struct _GstMjrReplaySrc *src;
+	guint id;
+	GThread *thread;
+	gst_mjr_wheel wheel;
+} gst_mjr_replay_worker;
+
+struct _GstMjrReplaySrc {
+	GstElement element;
+	gboolean silent;
+
+	/* Recordings to replay, and how */
+	gchar *locations, *directory;
+	guint copies, n_workers;
+	gboolean loop;
+	guint32 ssrc;
+	guint spread;
+
+	/* Recordings in memory, and streams replaying them */
+	GPtrArray *recordings, *streams;
+	gst_mjr_replay_worker *workers;
+	guint group_id;
+
+	/* Timing (monotonic time, in microseconds), and pausing */
+	volatile gint running;
+	gboolean paused;
+	GMutex mutex;
+	GCond cond;
+	gint64 start_time, elapsed;
+};
+
+G_END_DECLS
+
+gboolean mjr_replay_src_register(GstPlugin *plugin);
+
+#endif /* __GST_MJR_REPLAY_SRC_H__ */
@@ -0,0 +1,154 @@
+/*
+ * GStreamer
+ * Copyright (C) 2005 Thomas Vander Stichele <thomas@apestaart.org>
+ * Copyright (C) 2005 Ronald S. Bultje <rbultje@ronald.bitfreak.net>
+ * Copyright (C) 2024 Lorenzo Miniero <lorenzo@meetecho.com>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ *
+ * Alternatively, the contents of this file may be used under the
+ * GNU Lesser General Public License Version 2.1 (the "LGPL"), in
+ * which case the following provisions apply instead of the ones
+ * mentioned above:
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 02111-1307, USA.
+ */
+
+#ifdef HAVE_CONFIG_H
+#  include <config.h>
+#endif
+
+#include "gstmjrring.h"
+
+/* Create a new ring */
+gst_mjr_ring *gst_mjr_ring_new(guint size) {
+	gst_mjr_ring *ring = g_malloc0(sizeof(gst_mjr_ring));
+	ring->size = 2;
+	while(ring->size < size && ring->size < (1 << 30))
+		ring->size <<= 1;
+	ring->mask = ring->size - 1;
+	ring->items = g_malloc0(ring->size * sizeof(gpointer));
+	g_mutex_init(&ring->mutex);
+	g_cond_init(&ring->cond);
+	return ring;
+}
+
+/* Wake up the other side, if it's waiting */
+static void gst_mjr_ring_wakeup(gst_mjr_ring *ring) {
+	if(g_atomic_int_get(&ring->waiting) == 0)
+		return;
+	g_mutex_lock(&ring->mutex);
+	g_cond_broadcast(&ring->cond);
+	g_mutex_unlock(&ring->mutex);
+}
+
+/* Add an item to the ring */
+gboolean gst_mjr_ring_push(gst_mjr_ring *ring, gpointer item) {
+	guint head = (guint)g_atomic_int_get(&ring->head);
+	if(head - (guint)g_atomic_int_get(&ring->tail) >= ring->size) {
+		/* Full, wait for the consumer: we check again with the lock held,
+		 * after saying we're waiting, so that we can't miss a wakeup */
+		g_mutex_lock(&ring->mutex);
+		g_atomic_int_inc(&ring->waiting);
+		while(head - (guint)g_atomic_int_get(&ring->tail) >= ring->size &&
+				!g_atomic_int_get(&ring->flushing))
+			g_cond_wait(&ring->cond, &ring->mutex);
+		g_atomic_int_add(&ring->waiting, -1);
+		g_mutex_unlock(&ring->mutex);
+	}
+	if(g_atomic_int_get(&ring->flushing))
+		return FALSE;
+	ring->items[head & ring->mask] = item;
+	/* Publish the item */
+	g_atomic_int_set(&ring->head, (gint)(head + 1));
+	gst_mjr_ring_wakeup(ring);
+	return TRUE;
+}
+
+/* Get up to max items from the ring */
+guint gst_mjr_ring_pop(gst_mjr_ring *ring, gpointer *items, guint max) {
+	guint tail = (guint)g_atomic_int_get(&ring->tail);
+	guint available = (guint)g_atomic_int_get(&ring->head) - tail;
+	if(available == 0) {
+		/* Empty, wait for the producer */
+		g_mutex_lock(&ring->mutex);
+		g_atomic_int_inc(&ring->waiting);
+		while((available = (guint)g_atomic_int_get(&ring->head) - tail) == 0 &&
+				!g_atomic_int_get(&ring->flushing))
+			g_cond_wait(&ring->cond, &ring->mutex);
+		g_atomic_int_add(&ring->waiting, -1);
+		g_mutex_unlock(&ring->mutex);
+	}
+	if(g_atomic_int_get(&ring->flushing))
+		return 0;
+	guint count = MIN(available, max), i = 0;
+	for(i=0; i<count; i++) {
+		items[i] = ring->items[(tail + i) & ring->mask];
+		ring->items[(tail + i) & ring->mask] = NULL;
+	}
+	/* Give the slots back to the producer */
+	g_atomic_int_set(&ring->tail, (gint)(tail + count));
+	gst_mjr_ring_wakeup(ring);
+	return count;
+}
+
+/* Set or unset the flushing state */
+void gst_mjr_ring_set_flushing(gst_mjr_ring *ring, gboolean flushing) {
+	g_mutex_lock(&ring->mutex);
+	g_atomic_int_set(&ring->flushing, flushing ? 1 : 0);
+	g_cond_broadcast(&ring->cond);
+	g_mutex_unlock(&ring->mutex);
+}
+
+/* Get rid of all the items in the ring */
+void gst_mjr_ring_drain(gst_mjr_ring *ring, GDestroyNotify destroy) {
+	guint tail = (guint)g_atomic_int_get(&ring->tail);
+	guint head = (guint)g_atomic_int_get(&ring->head);
+	for(; tail != head; tail++) {
+		gpointer item = ring->items[tail & ring->mask];
+		ring->items[tail & ring->mask] = NULL;
+		if(item != NULL && destroy != NULL)
+			destroy(item);
+	}
+	g_atomic_int_set(&ring->tail, (gint)tail);
+}
+
+/* Free a ring */
+void gst_mjr_ring_free(gst_mjr_ring *ring, GDestroyNotify destroy) {
+	if(ring == NULL)
+		return;
+	gst_mjr_ring_drain(ring, destroy);
+	g_mutex_clear(&ring->mutex);
+	g_cond_clear(&ring->cond);
+	g_free(ring->items);
+	g_free(ring);
+}
@@ -0,0 +1,80 @@
+/*
+ * GStreamer
+ * Copyright (C) 2005 Thomas Vander Stichele <thomas@apestaart.org>
+ * Copyright (C) 2005 Ronald S. Bultje <rbultje@ronald.bitfreak.net>
+ * Copyright (C) 2024 Lorenzo Miniero <lorenzo@meetecho.com>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ *
+ * Alternatively, the contents of this file may be used under the
+ * GNU Lesser General Public License Version 2.1 (the "LGPL"), in
+ * which case the following provisions apply instead of the ones
+ * mentioned above:
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 02111-1307, USA.
+ */
+
+#ifndef __GST_MJR_RING_H__
+#define __GST_MJR_RING_H__
+
+#include <glib.h>
+
+/* Bounded single-producer/single-consumer ring of pointers: pushing and
+ * popping are lock-free, and the mutex is only used to sleep when the
+ * ring is full (producer) or empty (consumer), or to wake them up */
+typedef struct gst_mjr_ring {
+	gpointer *items;
+	guint size, mask;
+	/* Written by the producer and by the consumer respectively */
+	volatile gint head, tail;
+	volatile gint waiting, flushing;
+	GMutex mutex;
+	GCond cond;
+} gst_mjr_ring;
+
+/* Create a new ring (the size is rounded up to a power of two) */
+gst_mjr_ring *gst_mjr_ring_new(guint size);
+/* Add an item to the ring, waiting if it's full: returns FALSE if the
+ * ring is flushing, in which case the item was not added */
+gboolean gst_mjr_ring_push(gst_mjr_ring *ring, gpointer item);
+/* Get up to max items from the ring, waiting if it's empty: returns the
+ * number of items, which is 0 only if the ring is flushing */
+guint gst_mjr_ring_pop(gst_mjr_ring *ring, gpointer *items, guint max);
+/* Set or unset the flushing state, waking up whoever is waiting */
+void gst_mjr_ring_set_flushing(gst_mjr_ring *ring, gboolean flushing);
+/* Get rid of all the items in the ring: only safe when neither the
+ * producer nor the consumer are using it */
+void gst_mjr_ring_drain(gst_mjr_ring *ring, GDestroyNotify destroy);
+/* Free a ring, and the items still in it */
+void gst_mjr_ring_free(gst_mjr_ring *ring, GDestroyNotify destroy);
+
+#endif /* __GST_MJR_RING_H__ */
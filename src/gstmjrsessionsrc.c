@@ -0,0 +1,500 @@
+/*
+ * GStreamer
+ * Copyright (C) 2005 Thomas Vander Stichele <thomas@apestaart.org>
+ * Copyright (C) 2005 Ronald S. Bultje <rbultje@ronald.bitfreak.net>
+ * Copyright (C) 2024 Lorenzo Miniero <lorenzo@meetecho.com>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ *
+ * Alternatively, the contents of this file may be used under the
+ * GNU Lesser General Public License Version 2.1 (the "LGPL"), in
+ * which case the following provisions apply instead of the ones
+ * mentioned above:
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 02111-1307, USA.
+ */
+
+/**
+ * SECTION:element-mjrsessionsrc
+ *
+ * Reads all the MJR recordings of a Janus session, and outputs their
+ * RTP packets in a single global time order, using the timing info in
+ * the JSON headers of the recordings to align them. All recordings are
+ * read by the same thread, with a k-way merge over a min-heap, and each
+ * of them gets its own source pad.
+ *
+ * <refsect2>
+ * <title>Example launch line</title>
+ * |[
+ * gst-launch-1.0 mjrsessionsrc directory=/path/to/session name=s \
+ *     s.src_0 ! queue ! fakesink s.src_1 ! queue ! fakesink
+ * ]|
+ * </refsect2>
+ */
+
+#ifdef HAVE_CONFIG_H
+#  include <config.h>
+#endif
+
+#include <gst/gst.h>
+
+#include "gstmjrsessionsrc.h"
+#include "gstmjrutils.h"
+
+enum {
+	LAST_SIGNAL
+};
+
+enum {
+	PROP_0,
+	PROP_SILENT,
+	PROP_LOCATIONS,
+	PROP_DIRECTORY
+};
+
+/* Pad templates: we read files, and shoot RTP out on one pad per recording */
+static GstStaticPadTemplate srctemplate = GST_STATIC_PAD_TEMPLATE("src_%u",
+	GST_PAD_SRC,
+	GST_PAD_SOMETIMES,
+	GST_STATIC_CAPS("application/x-rtp")
+);
+
+#define gst_mjr_session_src_parent_class parent_class
+	G_DEFINE_TYPE(GstMjrSessionSrc, gst_mjr_session_src, GST_TYPE_ELEMENT);
+
+GST_ELEMENT_REGISTER_DEFINE(mjrsessionsrc, "mjrsessionsrc", GST_RANK_NONE,
+	GST_TYPE_MJR_SESSION_SRC);
+
+/* Property setters/getters */
+static void gst_mjr_session_src_set_property(GObject *object,
+	guint prop_id, const GValue *value, GParamSpec *pspec);
+static void gst_mjr_session_src_get_property(GObject *object,
+	guint prop_id, GValue *value, GParamSpec *pspec);
+static void gst_mjr_session_src_finalize(GObject *object);
+
+/* State changes, where we open and close the recordings */
+static GstStateChangeReturn gst_mjr_session_src_change_state(GstElement *element,
+	GstStateChange transition);
+
+/* Reading loop, where we merge the recordings */
+static void gst_mjr_session_src_loop(gpointer user_data);
+
+/* Initialize the mjrsessionsrc's class */
+static void gst_mjr_session_src_class_init(GstMjrSessionSrcClass *klass) {
+	GObjectClass *gobject_class;
+	GstElementClass *gstelement_class;
+
+	gobject_class = (GObjectClass *)klass;
+	gstelement_class = (GstElementClass *)klass;
+
+	gobject_class->set_property = gst_mjr_session_src_set_property;
+	gobject_class->get_property = gst_mjr_session_src_get_property;
+	gobject_class->finalize = gst_mjr_session_src_finalize;
+
+	g_object_class_install_property(gobject_class, PROP_SILENT,
+		g_param_spec_boolean("silent", "Silent", "Don't produce verbose output",
+			TRUE, G_PARAM_READWRITE | GST_PARAM_MUTABLE_PLAYING));
+	g_object_class_install_property(gobject_class, PROP_LOCATIONS,
+		g_param_spec_string("locations", "Locations", "Comma separated list of MJR files to read",
+			NULL, G_PARAM_READWRITE | GST_PARAM_MUTABLE_READY));
+	g_object_class_install_property(gobject_class, PROP_DIRECTORY,
+		g_param_spec_string("directory", "Directory", "Folder to read all MJR files from",
+			NULL, G_PARAM_READWRITE | GST_PARAM_MUTABLE_READY));
+
+	gstelement_class->change_state = GST_DEBUG_FUNCPTR(gst_mjr_session_src_change_state);
+
+	gst_element_class_set_details_simple(gstelement_class,
+		"Janus MJR Session Source",
+		"Source/Network/RTP",
+		"Read multiple MJR recordings in a synchronized way",
+		"Lorenzo Miniero <lorenzo@meetecho.com>");
+	gst_element_class_add_static_pad_template(gstelement_class, &srctemplate);
+}
+
+/* Initialize the new element */
+static void gst_mjr_session_src_init(GstMjrSessionSrc *src) {
+	src->silent = TRUE;
+	src->locations = NULL;
+	src->directory = NULL;
+	src->streams = g_ptr_array_new();
+	src->heap = NULL;
+	src->heap_size = 0;
+	src->group_id = 0;
+	src->flowcombiner = gst_flow_combiner_new();
+	/* Setup the reading task: pads will be added when we open the files */
+	g_rec_mutex_init(&src->task_lock);
+	src->task = gst_task_new(gst_mjr_session_src_loop, src, NULL);
+	gst_task_set_lock(src->task, &src->task_lock);
+}
+
+/* Property setter */
+static void gst_mjr_session_src_set_property(GObject *object, guint prop_id, const GValue *value, GParamSpec *pspec) {
+	GstMjrSessionSrc *src = GST_MJR_SESSION_SRC(object);
+	/* Set the specified property */
+	switch(prop_id) {
+		case PROP_SILENT:
+			src->silent = g_value_get_boolean(value);
+			break;
+		case PROP_LOCATIONS:
+			g_free(src->locations);
+			src->locations = g_value_dup_string(value);
+			break;
+		case PROP_DIRECTORY:
+			g_free(src->directory);
+			src->directory = g_value_dup_string(value);
+			break;
+		default:
+			G_OBJECT_WARN_INVALID_PROPERTY_ID(object, prop_id, pspec);
+			break;
+	}
+}
+
+/* Property getter */
+static void gst_mjr_session_src_get_property(GObject *object, guint prop_id, GValue *value, GParamSpec *pspec) {
+	GstMjrSessionSrc *src = GST_MJR_SESSION_SRC(object);
+	/* Get the specified property */
+	switch(prop_id) {
+		case PROP_SILENT:
+			g_value_set_boolean(value, src->silent);
+			break;
+		case PROP_LOCATIONS:
+			g_value_set_string(value, src->locations);
+			break;
+		case PROP_DIRECTORY:
+			g_value_set_string(value, src->directory);
+			break;
+		default:
+			G_OBJECT_WARN_INVALID_PROPERTY_ID(object, prop_id, pspec);
+			break;
+	}
+}
+
+/* Cleanup */
+static void gst_mjr_session_src_finalize(GObject *object) {
+	GstMjrSessionSrc *src = GST_MJR_SESSION_SRC(object);
+	g_free(src->locations);
+	g_free(src->directory);
+	g_ptr_array_free(src->streams, TRUE);
+	gst_flow_combiner_free(src->flowcombiner);
+	gst_object_unref(src->task);
+	g_rec_mutex_clear(&src->task_lock);
+	G_OBJECT_CLASS(parent_class)->finalize(object);
+}
+
+/* Min-heap helpers: streams are sorted by the timestamp of their next record,
+ * and by their order in the session in case the timestamps are the same */
+static gboolean gst_mjr_session_stream_before(gst_mjr_session_stream *a, gst_mjr_session_stream *b) {
+	if(a->next_pts != b->next_pts)
+		return a->next_pts < b->next_pts;
+	return a->id < b->id;
+}
+static void gst_mjr_session_src_heap_up(GstMjrSessionSrc *src, guint index) {
+	while(index > 0) {
+		guint parent = (index - 1) / 2;
+		if(!gst_mjr_session_stream_before(src->heap[index], src->heap[parent]))
+			break;
+		gst_mjr_session_stream *tmp = src->heap[index];
+		src->heap[index] = src->heap[parent];
+		src->heap[parent] = tmp;
+		index = parent;
+	}
+}
+static void gst_mjr_session_src_heap_down(GstMjrSessionSrc *src, guint index) {
+	while(TRUE) {
+		guint left = 2*index + 1, right = left + 1, min = index;
+		if(left < src->heap_size && gst_mjr_session_stream_before(src->heap[left], src->heap[min]))
+			min = left;
+		if(right < src->heap_size && gst_mjr_session_stream_before(src->heap[right], src->heap[min]))
+			min = right;
+		if(min == index)
+			break;
+		gst_mjr_session_stream *tmp = src->heap[index];
+		src->heap[index] = src->heap[min];
+		src->heap[min] = tmp;
+		index = min;
+	}
+}
+
+/* Read the next RTP packet of a stream, and compute its timestamp */
+static GstFlowReturn gst_mjr_session_src_read(GstMjrSessionSrc *src, gst_mjr_session_stream *stream) {
+	gst_mjr_reader *reader = stream->reader;
+	while(TRUE) {
+		gchar *error = NULL;
+		gst_mjr_reader_result res = gst_mjr_reader_next(reader, &error);
+		if(res == gst_mjr_reader_eof)
+			return GST_FLOW_EOS;
+		if(res == gst_mjr_reader_error) {
+			GST_ELEMENT_ERROR(src, STREAM, DECODE, (NULL), ("%s", error));
+			g_free(error);
+			return GST_FLOW_ERROR;
+		}
+		if(reader->length < 12) {
+			/* Too short to be an RTP packet, skip it */
+			continue;
+		}
+		gst_mjr_rtp *rtp = (gst_mjr_rtp *)reader->buffer;
+		if(stream->ssrc == 0) {
+			stream->ssrc = g_ntohl(rtp->ssrc);
+			stream->payload_type = rtp->type;
+		}
+		if(g_ntohl(rtp->ssrc) != stream->ssrc) {
+			/* Ignore packet */
+			continue;
+		}
+		gint64 ext_ts = gst_mjr_timestamp_update(&stream->ts, g_ntohl(rtp->timestamp));
+		stream->next_pts = stream->offset + gst_mjr_timestamp_to_time(ext_ts, stream->clock_rate);
+		return GST_FLOW_OK;
+	}
+}
+
+/* Push the RTP packet we have buffered for a stream */
+static GstFlowReturn gst_mjr_session_src_push(GstMjrSessionSrc *src, gst_mjr_session_stream *stream) {
+	gst_mjr_reader *reader = stream->reader;
+	if(!stream->started) {
+		/* First packet, send the sticky events */
+		stream->started = TRUE;
+		gchar *stream_id = gst_pad_create_stream_id_printf(stream->srcpad,
+			GST_ELEMENT(src), "%u", stream->id);
+		GstEvent *event = gst_event_new_stream_start(stream_id);
+		gst_event_set_group_id(event, src->group_id);
+		gst_pad_push_event(stream->srcpad, event);
+		g_free(stream_id);
+		GstCaps *caps = gst_caps_new_simple("application/x-rtp",
+			"media", G_TYPE_STRING, (reader->info.video ? "video" : "audio"),
+			"encoding-name", G_TYPE_STRING, gst_mjr_get_encoding_name(reader->info.codec),
+			"clock-rate", G_TYPE_INT, stream->clock_rate,
+			"payload", G_TYPE_INT, stream->payload_type,
+			"ssrc", G_TYPE_UINT, stream->ssrc,
+			NULL);
+		gst_pad_push_event(stream->srcpad, gst_event_new_caps(caps));
+		gst_caps_unref(caps);
+		GstSegment segment;
+		gst_segment_init(&segment, GST_FORMAT_TIME);
+		gst_pad_push_event(stream->srcpad, gst_event_new_segment(&segment));
+	}
+	if(!src->silent) {
+		gst_mjr_rtp *rtp = (gst_mjr_rtp *)reader->buffer;
+		g_print("[mjrsessionsrc][%u][RTP] seq=%5" G_GUINT16_FORMAT ", ts=%10" G_GUINT32_FORMAT ", pts=%" G_GUINT64_FORMAT "\n",
+			stream->id, g_ntohs(rtp->seq_number), g_ntohl(rtp->timestamp), stream->next_pts);
+	}
+	GstBuffer *outbuf = gst_buffer_new_memdup(reader->buffer, reader->length);
+	GST_BUFFER_TIMESTAMP(outbuf) = stream->next_pts;
+	return gst_pad_push(stream->srcpad, outbuf);
+}
+
+/* Send an EOS on all the pads, and stop reading */
+static void gst_mjr_session_src_stop(GstMjrSessionSrc *src) {
+	guint i = 0;
+	for(i=0; i<src->streams->len; i++) {
+		gst_mjr_session_stream *stream = g_ptr_array_index(src->streams, i);
+		gst_pad_push_event(stream->srcpad, gst_event_new_eos());
+	}
+	src->heap_size = 0;
+	gst_task_pause(src->task);
+}
+
+/* Reading loop, where we merge the recordings */
+static void gst_mjr_session_src_loop(gpointer user_data) {
+	GstMjrSessionSrc *src = GST_MJR_SESSION_SRC(user_data);
+	if(src->heap_size == 0) {
+		/* Nothing left to read */
+		if(!src->silent)
+			g_print("[mjrsessionsrc] All recordings read\n");
+		gst_task_pause(src->task);
+		return;
+	}
+	/* Push the earliest packet we have, from whatever stream it is */
+	gst_mjr_session_stream *stream = src->heap[0];
+	GstFlowReturn ret = gst_mjr_session_src_push(src, stream);
+	ret = gst_flow_combiner_update_pad_flow(src->flowcombiner, stream->srcpad, ret);
+	if(ret == GST_FLOW_FLUSHING) {
+		gst_task_pause(src->task);
+		return;
+	} else if(ret == GST_FLOW_EOS) {
+		gst_mjr_session_src_stop(src);
+		return;
+	} else if(ret != GST_FLOW_OK) {
+		GST_ELEMENT_FLOW_ERROR(src, ret);
+		gst_mjr_session_src_stop(src);
+		return;
+	}
+	/* Read the next packet of the same stream, and update the heap */
+	ret = gst_mjr_session_src_read(src, stream);
+	if(ret == GST_FLOW_ERROR) {
+		gst_mjr_session_src_stop(src);
+		return;
+	} else if(ret == GST_FLOW_EOS) {
+		/* We're done with this recording */
+		if(!src->silent)
+			g_print("[mjrsessionsrc] Done reading %s\n", stream->reader->filename);
+		gst_pad_push_event(stream->srcpad, gst_event_new_eos());
+		src->heap_size--;
+		src->heap[0] = src->heap[src->heap_size];
+	}
+	if(src->heap_size > 0)
+		gst_mjr_session_src_heap_down(src, 0);
+}
+
+/* Close all the recordings, and remove the related pads */
+static void gst_mjr_session_src_close(GstMjrSessionSrc *src) {
+	guint i = 0;
+	for(i=0; i<src->streams->len; i++) {
+		gst_mjr_session_stream *stream = g_ptr_array_index(src->streams, i);
+		if(stream->srcpad) {
+			gst_flow_combiner_remove_pad(src->flowcombiner, stream->srcpad);
+			gst_element_remove_pad(GST_ELEMENT(src), stream->srcpad);
+		}
+		gst_mjr_reader_close(stream->reader);
+		g_free(stream);
+	}
+	g_ptr_array_set_size(src->streams, 0);
+	g_free(src->heap);
+	src->heap = NULL;
+	src->heap_size = 0;
+}
+
+/* Open all the recordings, read their first packet and create the pads */
+static gboolean gst_mjr_session_src_open(GstMjrSessionSrc *src) {
+	gchar *error = NULL;
+	GPtrArray *files = gst_mjr_list_files(src->locations, src->directory, &error);
+	if(!files) {
+		GST_ELEMENT_ERROR(src, RESOURCE, OPEN_READ, (NULL), ("%s", error));
+		g_free(error);
+		return FALSE;
+	}
+	guint i = 0;
+	gint64 base = 0;
+	for(i=0; i<files->len; i++) {
+		const gchar *filename = g_ptr_array_index(files, i);
+		gst_mjr_reader *reader = gst_mjr_reader_open(filename, &error);
+		if(!reader) {
+			GST_ELEMENT_ERROR(src, RESOURCE, OPEN_READ, (NULL), ("%s", error));
+			g_free(error);
+			g_ptr_array_free(files, TRUE);
+			gst_mjr_session_src_close(src);
+			return FALSE;
+		}
+		gst_mjr_session_stream *stream = g_malloc0(sizeof(gst_mjr_session_stream));
+		stream->id = src->streams->len;
+		stream->reader = reader;
+		stream->clock_rate = gst_mjr_get_clock_rate(reader->info.codec);
+		gst_mjr_timestamp_reset(&stream->ts);
+		/* Read the first packet of the recording */
+		GstFlowReturn ret = gst_mjr_session_src_read(src, stream);
+		if(ret != GST_FLOW_OK) {
+			gst_mjr_reader_close(reader);
+			g_free(stream);
+			if(ret == GST_FLOW_EOS) {
+				/* No packets in there, skip it */
+				if(!src->silent)
+					g_print("[mjrsessionsrc] Skipping empty recording %s\n", filename);
+				continue;
+			}
+			g_ptr_array_free(files, TRUE);
+			gst_mjr_session_src_close(src);
+			return FALSE;
+		}
+		if(!src->silent) {
+			g_print("[mjrsessionsrc] Opened %s (%s, %s)\n", filename,
+				reader->info.video ? "video" : "audio", gst_mjr_codec_string(reader->info.codec));
+		}
+		g_ptr_array_add(src->streams, stream);
+		/* Legacy recordings have no timing info, so we just start them at 0 */
+		if(!reader->info.legacy && (base == 0 || reader->info.written < base))
+			base = reader->info.written;
+	}
+	g_ptr_array_free(files, TRUE);
+	if(src->streams->len == 0) {
+		GST_ELEMENT_ERROR(src, RESOURCE, NOT_FOUND, (NULL), ("No MJR file to read"));
+		return FALSE;
+	}
+	/* Align the recordings on when they were first written to, and prime
+	 * the heap with the first packet of each of them */
+	src->heap = g_malloc0(src->streams->len * sizeof(gst_mjr_session_stream *));
+	src->heap_size = 0;
+	src->group_id = gst_util_group_id_next();
+	for(i=0; i<src->streams->len; i++) {
+		gst_mjr_session_stream *stream = g_ptr_array_index(src->streams, i);
+		if(!stream->reader->info.legacy)
+			stream->offset = (stream->reader->info.written - base) * GST_USECOND;
+		stream->next_pts += stream->offset;
+		src->heap[src->heap_size] = stream;
+		src->heap_size++;
+		gst_mjr_session_src_heap_up(src, src->heap_size - 1);
+		/* Create the pad for this recording */
+		gchar *name = g_strdup_printf("src_%u", stream->id);
+		stream->srcpad = gst_pad_new_from_static_template(&srctemplate, name);
+		g_free(name);
+		gst_pad_use_fixed_caps(stream->srcpad);
+		gst_element_add_pad(GST_ELEMENT(src), stream->srcpad);
+		gst_flow_combiner_add_pad(src->flowcombiner, stream->srcpad);
+	}
+	gst_element_no_more_pads(GST_ELEMENT(src));
+	return TRUE;
+}
+
+/* State changes, where we open and close the recordings */
+static GstStateChangeReturn gst_mjr_session_src_change_state(GstElement *element, GstStateChange transition) {
+	GstMjrSessionSrc *src = GST_MJR_SESSION_SRC(element);
+	GstStateChangeReturn ret = GST_STATE_CHANGE_SUCCESS;
+	switch(transition) {
+		case GST_STATE_CHANGE_READY_TO_PAUSED:
+			if(!gst_mjr_session_src_open(src))
+				return GST_STATE_CHANGE_FAILURE;
+			gst_flow_combiner_reset(src->flowcombiner);
+			break;
+		default:
+			break;
+	}
+	ret = GST_ELEMENT_CLASS(parent_class)->change_state(element, transition);
+	if(ret == GST_STATE_CHANGE_FAILURE)
+		return ret;
+	switch(transition) {
+		case GST_STATE_CHANGE_READY_TO_PAUSED:
+			gst_task_start(src->task);
+			break;
+		case GST_STATE_CHANGE_PAUSED_TO_READY:
+			/* Pads are inactive now, so the task can't be blocked pushing */
+			gst_task_stop(src->task);
+			gst_task_join(src->task);
+			gst_mjr_session_src_close(src);
+			break;
+		default:
+			break;
+	}
+	return ret;
+}
+
+/* Register the element in the plugin */
+gboolean mjr_session_src_register(GstPlugin *plugin) {
+	return GST_ELEMENT_REGISTER(mjrsessionsrc, plugin);
+}
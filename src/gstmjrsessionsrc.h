@@ -0,0 +1,97 @@
+/*
+ * GStreamer
+ * Copyright (C) 2005 Thomas Vander Stichele <thomas@apestaart.org>
+ * Copyright (C) 2005 Ronald S. Bultje <rbultje@ronald.bitfreak.net>
+ * Copyright (C) 2024 Lorenzo Miniero <lorenzo@meetecho.com>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ *
+ * Alternatively, the contents of this file may be used under the
+ * GNU Lesser General Public License Version 2.1 (the "LGPL"), in
+ * which case the following provisions apply instead of the ones
+ * mentioned above:
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 02111-1307, USA.
+ */
+
+#ifndef __GST_MJR_SESSION_SRC_H__
+#define __GST_MJR_SESSION_SRC_H__
+
+#include <gst/gst.h>
+#include <gst/base/gstflowcombiner.h>
+
+#include "gstmjrreader.h"
+
+G_BEGIN_DECLS
+
+#define GST_TYPE_MJR_SESSION_SRC gst_mjr_session_src_get_type()
+G_DECLARE_FINAL_TYPE(GstMjrSessionSrc, gst_mjr_session_src, GST, MJR_SESSION_SRC, GstElement)
+
+/* A single MJR recording in the session */
+typedef struct gst_mjr_session_stream {
+	guint id;
+	gst_mjr_reader *reader;
+	GstPad *srcpad;
+	gboolean started;
+	/* RTP info */
+	guint32 ssrc;
+	guint8 payload_type;
+	guint32 clock_rate;
+	gst_mjr_timestamp ts;
+	/* Offset of the stream in the session, and timestamp of the next record */
+	GstClockTime offset, next_pts;
+} gst_mjr_session_stream;
+
+struct _GstMjrSessionSrc {
+	GstElement element;
+	gboolean silent;
+
+	/* Recordings to read */
+	gchar *locations, *directory;
+
+	/* Streams, and min-heap of the ones we still have records for */
+	GPtrArray *streams;
+	gst_mjr_session_stream **heap;
+	guint heap_size;
+	guint group_id;
+
+	/* Reading thread */
+	GstTask *task;
+	GRecMutex task_lock;
+	GstFlowCombiner *flowcombiner;
+};
+
+G_END_DECLS
+
+gboolean mjr_session_src_register(GstPlugin *plugin);
+
+#endif /* __GST_MJR_SESSION_SRC_H__ */
@@ -48,6 +48,10 @@
 #  include <config.h>
 #endif
 
+#include <zlib.h>
+
+#include <json-glib/json-glib.h>
+
 #include "gstmjrutils.h"
 
 /* Helper method to obtain an MJR codec string from a codec name */
@@ -171,3 +175,765 @@ guint32 gst_mjr_get_clock_rate(int codec) {
 	}
 	return 0;
 }
+
+/* Helper method to get the size of the RTP header of a packet */
+gsize gst_mjr_rtp_header_size(const guint8 *data, gsize len) {
+	if(!data || len < 12)
+		return 0;
+	gst_mjr_rtp *rtp = (gst_mjr_rtp *)data;
+	if(rtp->version != 2)
+		return 0;
+	gsize size = 12 + rtp->csrccount * 4;
+	if(rtp->extension) {
+		if(len < size + 4)
+			return 0;
+		guint16 ext_len = 0;
+		memcpy(&ext_len, data + size + 2, sizeof(ext_len));
+		size += 4 + g_ntohs(ext_len) * 4;
+	}
+	if(size > len)
+		return 0;
+	return size;
+}
+
+/* Helpers to check if a single H.264/H.265 NAL unit type is a keyframe */
+static gboolean gst_mjr_is_h264_keyframe(guint8 type) {
+	/* IDR, or SPS (which always precedes an IDR) */
+	return type == 5 || type == 7;
+}
+static gboolean gst_mjr_is_h265_keyframe(guint8 type) {
+	/* IRAP pictures, or VPS/SPS */
+	return (type >= 16 && type <= 21) || type == 32 || type == 33;
+}
+
+/* Helper method to check if an RTP payload contains a keyframe */
+gboolean gst_mjr_is_keyframe(int codec, const guint8 *payload, gsize len) {
+	if(codec > 0 && codec < GST_MJR_VP8) {
+		/* Audio: every packet is a keyframe */
+		return TRUE;
+	}
+	if(!payload || len < 1)
+		return FALSE;
+	if(codec == GST_MJR_VP8) {
+		/* Skip the payload descriptor first */
+		guint8 first = payload[0];
+		gsize offset = 1;
+		if(first & 0x80) {
+			/* Extended control bits */
+			if(len < 2)
+				return FALSE;
+			guint8 ext = payload[1];
+			offset++;
+			if(ext & 0x80) {
+				/* Picture ID, one or two bytes */
+				if(len <= offset)
+					return FALSE;
+				offset += (payload[offset] & 0x80) ? 2 : 1;
+			}
+			if(ext & 0x40)
+				offset++;	/* TL0PICIDX */
+			if(ext & 0x30)
+				offset++;	/* TID/KEYIDX */
+		}
+		/* Only the start of the first partition tells us what this is */
+		if(!(first & 0x10) || (first & 0x07) != 0 || len <= offset)
+			return FALSE;
+		/* Inverse key frame flag in the VP8 payload header */
+		return !(payload[offset] & 0x01);
+	} else if(codec == GST_MJR_VP9) {
+		/* Not inter-picture predicted, and start of a frame */
+		return !(payload[0] & 0x40) && (payload[0] & 0x08);
+	} else if(codec == GST_MJR_H264) {
+		guint8 type = payload[0] & 0x1F;
+		if(type == 24) {
+			/* STAP-A, check all the aggregated NAL units */
+			gsize offset = 1;
+			while(offset + 2 < len) {
+				guint16 size = (payload[offset] << 8) | payload[offset+1];
+				if(gst_mjr_is_h264_keyframe(payload[offset+2] & 0x1F))
+					return TRUE;
+				offset += 2 + size;
+			}
+			return FALSE;
+		} else if(type == 28) {
+			/* FU-A, only the start of a fragmented IDR counts */
+			return len > 1 && (payload[1] & 0x80) && gst_mjr_is_h264_keyframe(payload[1] & 0x1F);
+		}
+		return gst_mjr_is_h264_keyframe(type);
+	} else if(codec == GST_MJR_H265) {
+		if(len < 2)
+			return FALSE;
+		guint8 type = (payload[0] >> 1) & 0x3F;
+		if(type == 48) {
+			/* Aggregation packet, check all the aggregated NAL units */
+			gsize offset = 2;
+			while(offset + 2 < len) {
+				guint16 size = (payload[offset] << 8) | payload[offset+1];
+				if(gst_mjr_is_h265_keyframe((payload[offset+2] >> 1) & 0x3F))
+					return TRUE;
+				offset += 2 + size;
+			}
+			return FALSE;
+		} else if(type == 49) {
+			/* Fragmentation unit, only the start of a fragmented IRAP counts */
+			return len > 2 && (payload[2] & 0x80) && gst_mjr_is_h265_keyframe(payload[2] & 0x3F);
+		}
+		return gst_mjr_is_h265_keyframe(type);
+	} else if(codec == GST_MJR_AV1) {
+		/* N bit in the aggregation header: first packet of a coded video sequence */
+		return (payload[0] & 0x08) != 0;
+	}
+	return FALSE;
+}
+
+/* Helper to find an RTP extension element in a packet, by ID */
+static const guint8 *gst_mjr_rtp_extension_find(const guint8 *data, gsize len, guint8 id, gsize *ext_len) {
+	if(id == 0 || len < 12)
+		return NULL;
+	gst_mjr_rtp *rtp = (gst_mjr_rtp *)data;
+	if(rtp->version != 2 || !rtp->extension)
+		return NULL;
+	gsize offset = 12 + rtp->csrccount * 4;
+	if(len < offset + 4)
+		return NULL;
+	guint16 profile = (data[offset] << 8) | data[offset+1];
+	gsize end = offset + 4 + ((data[offset+2] << 8) | data[offset+3]) * 4;
+	if(end > len)
+		return NULL;
+	offset += 4;
+	gboolean one_byte = (profile == 0xBEDE);
+	if(!one_byte && (profile & 0xFFF0) != 0x1000)
+		return NULL;
+	while(offset < end) {
+		guint8 el_id = 0;
+		gsize el_len = 0;
+		if(one_byte) {
+			el_id = data[offset] >> 4;
+			if(el_id == 0) {
+				/* Padding */
+				offset++;
+				continue;
+			} else if(el_id == 15) {
+				/* Stop parsing */
+				return NULL;
+			}
+			el_len = (data[offset] & 0x0F) + 1;
+			offset++;
+		} else {
+			el_id = data[offset];
+			if(el_id == 0) {
+				/* Padding */
+				offset++;
+				continue;
+			}
+			if(offset + 1 >= end)
+				return NULL;
+			el_len = data[offset+1];
+			offset += 2;
+		}
+		if(offset + el_len > end)
+			return NULL;
+		if(el_id == id) {
+			*ext_len = el_len;
+			return data + offset;
+		}
+		offset += el_len;
+	}
+	return NULL;
+}
+
+/* Helper to read bits from a buffer, e.g., the dependency descriptor */
+typedef struct gst_mjr_bits {
+	const guint8 *data;
+	gsize len, bit;
+	gboolean error;
+} gst_mjr_bits;
+static guint32 gst_mjr_bits_read(gst_mjr_bits *bits, guint count) {
+	guint32 value = 0;
+	while(count > 0) {
+		if(bits->bit >= bits->len * 8) {
+			bits->error = TRUE;
+			return 0;
+		}
+		value = (value << 1) | ((bits->data[bits->bit / 8] >> (7 - bits->bit % 8)) & 0x01);
+		bits->bit++;
+		count--;
+	}
+	return value;
+}
+
+/* Helper method to get the layers an RTP packet belongs to */
+gboolean gst_mjr_get_layers(int codec, const guint8 *data, gsize len,
+		guint8 dd_ext_id, gst_mjr_dd_structure *dd,
+		int *spatial, int *temporal, gboolean *end_of_frame) {
+	gsize header = gst_mjr_rtp_header_size(data, len);
+	if(header == 0 || header >= len)
+		return FALSE;
+	const guint8 *payload = data + header;
+	gsize plen = len - header;
+	if(codec == GST_MJR_VP8) {
+		/* Only temporal layers: the TID is in the extended control bits */
+		if(!(payload[0] & 0x80) || plen < 2)
+			return FALSE;
+		guint8 ext = payload[1];
+		if(!(ext & 0x20))
+			return FALSE;
+		gsize offset = 2;
+		if(ext & 0x80) {
+			/* Picture ID, one or two bytes */
+			if(plen <= offset)
+				return FALSE;
+			offset += (payload[offset] & 0x80) ? 2 : 1;
+		}
+		if(ext & 0x40)
+			offset++;	/* TL0PICIDX */
+		if(plen <= offset)
+			return FALSE;
+		*spatial = 0;
+		*temporal = payload[offset] >> 6;
+		*end_of_frame = ((gst_mjr_rtp *)data)->markerbit;
+		return TRUE;
+	} else if(codec == GST_MJR_VP9) {
+		/* The layer indices follow the (optional) picture ID */
+		guint8 first = payload[0];
+		if(!(first & 0x20))
+			return FALSE;
+		gsize offset = 1;
+		if(first & 0x80) {
+			if(plen <= offset)
+				return FALSE;
+			offset += (payload[offset] & 0x80) ? 2 : 1;
+		}
+		if(plen <= offset)
+			return FALSE;
+		*temporal = payload[offset] >> 5;
+		*spatial = (payload[offset] >> 1) & 0x07;
+		*end_of_frame = (first & 0x04) != 0;
+		return TRUE;
+	} else if(codec == GST_MJR_AV1) {
+		/* We need the dependency descriptor */
+		gsize ext_len = 0;
+		const guint8 *ext = gst_mjr_rtp_extension_find(data, len, dd_ext_id, &ext_len);
+		if(ext == NULL || ext_len < 3 || dd == NULL)
+			return FALSE;
+		gst_mjr_bits bits = { .data = ext, .len = ext_len, .bit = 0, .error = FALSE };
+		gst_mjr_bits_read(&bits, 1);	/* start_of_frame */
+		gboolean end = gst_mjr_bits_read(&bits, 1);
+		guint8 template_id = gst_mjr_bits_read(&bits, 6);
+		gst_mjr_bits_read(&bits, 16);	/* frame_number */
+		if(ext_len > 3 && gst_mjr_bits_read(&bits, 1)) {
+			/* There's a new template structure: we skip the other flags,
+			 * and only parse the template layers, since they come first */
+			gst_mjr_bits_read(&bits, 4);
+			gst_mjr_dd_structure structure = { 0 };
+			structure.offset = gst_mjr_bits_read(&bits, 6);
+			gst_mjr_bits_read(&bits, 5);	/* dt_cnt_minus_one */
+			guint8 s = 0, t = 0, next = 0;
+			do {
+				if(structure.count == 64) {
+					bits.error = TRUE;
+					break;
+				}
+				structure.spatial[structure.count] = s;
+				structure.temporal[structure.count] = t;
+				structure.count++;
+				next = gst_mjr_bits_read(&bits, 2);
+				if(next == 1) {
+					t++;
+				} else if(next == 2) {
+					t = 0;
+					s++;
+				}
+			} while(next != 3 && !bits.error);
+			if(!bits.error) {
+				structure.valid = TRUE;
+				*dd = structure;
+			}
+		}
+		if(!dd->valid)
+			return FALSE;
+		guint8 index = (template_id + 64 - dd->offset) % 64;
+		if(index >= dd->count)
+			return FALSE;
+		*spatial = dd->spatial[index];
+		*temporal = dd->temporal[index];
+		*end_of_frame = end;
+		return TRUE;
+	}
+	return FALSE;
+}
+
+/* Helper method to check the MJR header, and whether it's a legacy one */
+gboolean gst_mjr_check_header(const char *data, gboolean *legacy, gboolean *compressed) {
+	if(!data)
+		return FALSE;
+	if(compressed)
+		*compressed = FALSE;
+	if(!memcmp(data, "MJR00002", GST_MJR_HEADER_SIZE)) {
+		/* New format (MJR00002) */
+		if(legacy)
+			*legacy = FALSE;
+		return TRUE;
+	} else if(!memcmp(data, "MJRZ0002", GST_MJR_HEADER_SIZE)) {
+		/* New format, with compressed blocks of records (MJRZ0002) */
+		if(legacy)
+			*legacy = FALSE;
+		if(compressed)
+			*compressed = TRUE;
+		return TRUE;
+	} else if(!memcmp(data, "MEETECHO", GST_MJR_HEADER_SIZE)) {
+		/* Legacy format (MEETECHO) */
+		if(legacy)
+			*legacy = TRUE;
+		return TRUE;
+	}
+	/* Not an MJR file, or unsupported version */
+	return FALSE;
+}
+
+/* Helper method to parse the MJR info header */
+gboolean gst_mjr_parse_info(const char *data, gsize len, gboolean legacy,
+		gst_mjr_info *info, gchar **error) {
+	if(!data || !info)
+		return FALSE;
+	memset(info, 0, sizeof(*info));
+	info->legacy = legacy;
+	if(legacy) {
+		/* Legacy MJR files always have only either "audio" or "video" */
+		if(len != 5) {
+			if(error)
+				*error = g_strdup("Invalid header length for legacy MJR file.");
+			return FALSE;
+		}
+		if(data[0] == 'a') {
+			/* Audio, so Opus in legacy MJR format */
+			info->video = FALSE;
+			info->codec = GST_MJR_OPUS;
+		} else if(data[0] == 'v') {
+			/* Video, so VP8 in legacy MJR format */
+			info->video = TRUE;
+			info->codec = GST_MJR_VP8;
+		} else {
+			/* Unsupported format */
+			if(error)
+				*error = g_strdup("Unsupported media format.");
+			return FALSE;
+		}
+		return TRUE;
+	}
+	/* Parse the header for info on codecs, start times, etc. */
+	JsonParser *parser = json_parser_new();
+	if(!json_parser_load_from_data(parser, data, len, NULL)) {
+		if(error)
+			*error = g_strdup("Invalid JSON header.");
+		g_object_unref(parser);
+		return FALSE;
+	}
+	JsonReader *reader = json_reader_new(json_parser_get_root(parser));
+	json_reader_read_member(reader, "t");
+	const gchar *t = json_reader_get_string_value(reader);
+	json_reader_end_member(reader);
+	json_reader_read_member(reader, "c");
+	const gchar *c = json_reader_get_string_value(reader);
+	json_reader_end_member(reader);
+	json_reader_read_member(reader, "s");
+	gint64 s = json_reader_get_int_value(reader);
+	json_reader_end_member(reader);
+	json_reader_read_member(reader, "u");
+	gint64 u = json_reader_get_int_value(reader);
+	json_reader_end_member(reader);
+	const gchar *z = NULL;
+	if(json_reader_read_member(reader, "z"))
+		z = json_reader_get_string_value(reader);
+	json_reader_end_member(reader);
+	gint64 l = 0;
+	if(json_reader_read_member(reader, "l"))
+		l = json_reader_get_int_value(reader);
+	json_reader_end_member(reader);
+	/* Check if the dependency descriptor extension was negotiated */
+	guint8 dd_ext_id = 0;
+	if(json_reader_read_member(reader, "x") && json_reader_is_object(reader)) {
+		gchar **ids = json_reader_list_members(reader);
+		guint i = 0;
+		for(i=0; ids && ids[i]; i++) {
+			json_reader_read_member(reader, ids[i]);
+			const gchar *uri = json_reader_get_string_value(reader);
+			if(uri && !strcasecmp(uri, GST_MJR_DD_EXTENSION)) {
+				gint64 id = g_ascii_strtoll(ids[i], NULL, 10);
+				if(id > 0 && id < 256)
+					dd_ext_id = id;
+			}
+			json_reader_end_member(reader);
+		}
+		g_strfreev(ids);
+	}
+	json_reader_end_member(reader);
+	gboolean ret = FALSE;
+	if(!t || !c || !s || !u) {
+		if(error)
+			*error = g_strdup("Invalid JSON header.");
+		goto done;
+	}
+	if(z && strcasecmp(z, GST_MJR_COMPRESSION)) {
+		if(error)
+			*error = g_strdup_printf("Unsupported compression (%s).", z);
+		goto done;
+	}
+	if(!strcasecmp(t, "v")) {
+		info->video = TRUE;
+	} else if(!strcasecmp(t, "a")) {
+		info->video = FALSE;
+	} else if(!strcasecmp(t, "d")) {
+		if(error)
+			*error = g_strdup("Unsupported media format.");
+		goto done;
+	}
+	info->codec = gst_mjr_get_codec(c, &info->video);
+	if(!info->codec) {
+		if(error)
+			*error = g_strdup_printf("Unsupported codec (%s).", c);
+		goto done;
+	}
+	info->created = s;
+	info->written = u;
+	info->dd_ext_id = dd_ext_id;
+	info->snaplen = CLAMP(l, 0, G_MAXUINT16);
+	ret = TRUE;
+
+done:
+	g_object_unref(reader);
+	g_object_unref(parser);
+	return ret;
+}
+
+/* Helper method to get the stored and original length of a packet in a record */
+guint16 gst_mjr_record_length(const gst_mjr_info *info, const guint8 *data,
+		guint16 len, guint16 *original) {
+	if(!info || !info->snaplen || !data || len < GST_MJR_SNAPLEN_TRAILER_SIZE) {
+		if(original)
+			*original = len;
+		return len;
+	}
+	len -= GST_MJR_SNAPLEN_TRAILER_SIZE;
+	if(original) {
+		guint16 value = 0;
+		memcpy(&value, data + len, sizeof(value));
+		*original = MAX(g_ntohs(value), len);
+	}
+	return len;
+}
+
+/* Helper method to check the header of a session archive */
+gboolean gst_mjr_archive_check_header(const char *data) {
+	return data && !memcmp(data, "MJRA0001", GST_MJR_ARCHIVE_HEADER_SIZE);
+}
+
+/* Helper method to parse a segment header */
+gboolean gst_mjr_archive_parse_segment(const char *data, guint32 *id, guint32 *length, gboolean *toc) {
+	if(toc)
+		*toc = FALSE;
+	if(!data)
+		return FALSE;
+	if(!memcmp(data, "MJRT", 4)) {
+		/* We reached the table of contents, there are no more segments */
+		if(toc)
+			*toc = TRUE;
+		return FALSE;
+	}
+	if(memcmp(data, "MJRS", 4))
+		return FALSE;
+	guint32 value = 0;
+	memcpy(&value, data + 4, sizeof(value));
+	if(id)
+		*id = g_ntohl(value);
+	memcpy(&value, data + 8, sizeof(value));
+	value = g_ntohl(value);
+	if(value == 0 || value > GST_MJR_ARCHIVE_MAX_SEGMENT_SIZE)
+		return FALSE;
+	if(length)
+		*length = value;
+	return TRUE;
+}
+
+/* Helper method to write a segment header */
+void gst_mjr_archive_write_segment(char *data, guint32 id, guint32 length) {
+	memcpy(data, "MJRS", 4);
+	id = g_htonl(id);
+	memcpy(data + 4, &id, sizeof(id));
+	length = g_htonl(length);
+	memcpy(data + 8, &length, sizeof(length));
+}
+
+/* Helper method to parse the trailer of a session archive */
+gboolean gst_mjr_archive_parse_trailer(const char *data, guint64 *toc_offset) {
+	if(!data || memcmp(data + 8, "MJRE", 4))
+		return FALSE;
+	guint64 offset = 0;
+	memcpy(&offset, data, sizeof(offset));
+	if(toc_offset)
+		*toc_offset = GUINT64_FROM_BE(offset);
+	return TRUE;
+}
+
+/* Helper method to parse a table of contents */
+GPtrArray *gst_mjr_archive_parse_toc(const guint8 *data, gsize len, gchar **error) {
+	if(!data || len < GST_MJR_ARCHIVE_TOC_SIZE || memcmp(data, "MJRT", 4)) {
+		if(error)
+			*error = g_strdup("Invalid table of contents.");
+		return NULL;
+	}
+	guint32 count = 0;
+	memcpy(&count, data + 4, sizeof(count));
+	count = g_ntohl(count);
+	GPtrArray *streams = g_ptr_array_new_with_free_func((GDestroyNotify)gst_mjr_archive_stream_free);
+	gsize offset = GST_MJR_ARCHIVE_TOC_SIZE;
+	guint32 i = 0, j = 0;
+	for(i=0; i<count; i++) {
+		/* ID, name length and name, size and number of segments */
+		guint32 id = 0, segments = 0;
+		guint16 name_len = 0;
+		guint64 size = 0;
+		if(offset + 6 > len)
+			goto error;
+		memcpy(&id, data + offset, sizeof(id));
+		memcpy(&name_len, data + offset + 4, sizeof(name_len));
+		name_len = g_ntohs(name_len);
+		offset += 6;
+		if(offset + name_len + 12 > len)
+			goto error;
+		gchar *name = g_strndup((const gchar *)data + offset, name_len);
+		gst_mjr_archive_stream *stream = gst_mjr_archive_stream_new(g_ntohl(id), name);
+		g_free(name);
+		g_ptr_array_add(streams, stream);
+		offset += name_len;
+		memcpy(&size, data + offset, sizeof(size));
+		stream->size = GUINT64_FROM_BE(size);
+		memcpy(&segments, data + offset + 8, sizeof(segments));
+		segments = g_ntohl(segments);
+		offset += 12;
+		if(segments > (len - offset) / 12)
+			goto error;
+		for(j=0; j<segments; j++) {
+			gst_mjr_archive_segment segment;
+			guint64 seg_offset = 0;
+			guint32 seg_length = 0;
+			memcpy(&seg_offset, data + offset, sizeof(seg_offset));
+			memcpy(&seg_length, data + offset + 8, sizeof(seg_length));
+			segment.offset = GUINT64_FROM_BE(seg_offset);
+			segment.length = g_ntohl(seg_length);
+			g_array_append_val(stream->segments, segment);
+			offset += 12;
+		}
+	}
+	return streams;
+
+error:
+	if(error)
+		*error = g_strdup("Truncated table of contents.");
+	g_ptr_array_free(streams, TRUE);
+	return NULL;
+}
+
+/* Helper method to serialize a table of contents */
+GByteArray *gst_mjr_archive_write_toc(GPtrArray *streams, guint64 offset) {
+	GByteArray *toc = g_byte_array_new();
+	guint32 value = g_htonl(streams->len);
+	g_byte_array_append(toc, (const guint8 *)"MJRT", 4);
+	g_byte_array_append(toc, (const guint8 *)&value, sizeof(value));
+	guint i = 0, j = 0;
+	for(i=0; i<streams->len; i++) {
+		gst_mjr_archive_stream *stream = g_ptr_array_index(streams, i);
+		value = g_htonl(stream->id);
+		g_byte_array_append(toc, (const guint8 *)&value, sizeof(value));
+		guint16 name_len = stream->name ? MIN(strlen(stream->name), G_MAXUINT16) : 0;
+		guint16 be16 = g_htons(name_len);
+		g_byte_array_append(toc, (const guint8 *)&be16, sizeof(be16));
+		g_byte_array_append(toc, (const guint8 *)stream->name, name_len);
+		guint64 be64 = GUINT64_TO_BE(stream->size);
+		g_byte_array_append(toc, (const guint8 *)&be64, sizeof(be64));
+		value = g_htonl(stream->segments->len);
+		g_byte_array_append(toc, (const guint8 *)&value, sizeof(value));
+		for(j=0; j<stream->segments->len; j++) {
+			gst_mjr_archive_segment *segment = &g_array_index(stream->segments, gst_mjr_archive_segment, j);
+			be64 = GUINT64_TO_BE(segment->offset);
+			g_byte_array_append(toc, (const guint8 *)&be64, sizeof(be64));
+			value = g_htonl(segment->length);
+			g_byte_array_append(toc, (const guint8 *)&value, sizeof(value));
+		}
+	}
+	/* Trailer */
+	guint64 be64 = GUINT64_TO_BE(offset);
+	g_byte_array_append(toc, (const guint8 *)&be64, sizeof(be64));
+	g_byte_array_append(toc, (const guint8 *)"MJRE", 4);
+	return toc;
+}
+
+/* Create a new stream for a table of contents */
+gst_mjr_archive_stream *gst_mjr_archive_stream_new(guint32 id, const gchar *name) {
+	gst_mjr_archive_stream *stream = g_malloc0(sizeof(gst_mjr_archive_stream));
+	stream->id = id;
+	stream->name = g_strdup(name);
+	stream->segments = g_array_new(FALSE, FALSE, sizeof(gst_mjr_archive_segment));
+	return stream;
+}
+
+/* Free a stream in a table of contents */
+void gst_mjr_archive_stream_free(gst_mjr_archive_stream *stream) {
+	if(!stream)
+		return;
+	g_free(stream->name);
+	g_array_free(stream->segments, TRUE);
+	g_free(stream);
+}
+
+/* Helper method to parse a block header */
+gboolean gst_mjr_parse_block(const char *data, gst_mjr_block *block, gboolean *index) {
+	if(index)
+		*index = FALSE;
+	if(!data || !block)
+		return FALSE;
+	if(!memcmp(data, "MJRI", 4)) {
+		/* We reached the index, there are no more blocks */
+		if(index)
+			*index = TRUE;
+		return FALSE;
+	}
+	if(memcmp(data, "MJRB", 4))
+		return FALSE;
+	guint32 value = 0;
+	memcpy(&value, data + 4, sizeof(value));
+	block->compressed_size = g_ntohl(value);
+	memcpy(&value, data + 8, sizeof(value));
+	block->size = g_ntohl(value);
+	memcpy(&value, data + 12, sizeof(value));
+	block->received = g_ntohl(value);
+	/* Make sure the sizes make sense, before anyone allocates memory */
+	if(block->size == 0 || block->size > GST_MJR_MAX_BLOCK_SIZE ||
+			block->compressed_size == 0 || block->compressed_size > compressBound(block->size))
+		return FALSE;
+	return TRUE;
+}
+
+/* Helper method to serialize a block header */
+void gst_mjr_write_block(char *data, const gst_mjr_block *block) {
+	memcpy(data, "MJRB", 4);
+	guint32 value = g_htonl(block->compressed_size);
+	memcpy(data + 4, &value, sizeof(value));
+	value = g_htonl(block->size);
+	memcpy(data + 8, &value, sizeof(value));
+	value = g_htonl(block->received);
+	memcpy(data + 12, &value, sizeof(value));
+}
+
+/* Compress a block of records */
+GBytes *gst_mjr_block_compress(const guint8 *data, gsize len) {
+	if(!data || len == 0 || len > GST_MJR_MAX_BLOCK_SIZE)
+		return NULL;
+	uLongf size = compressBound(len);
+	guint8 *out = g_malloc(size);
+	if(compress2(out, &size, data, len, Z_DEFAULT_COMPRESSION) != Z_OK) {
+		g_free(out);
+		return NULL;
+	}
+	return g_bytes_new_take(g_realloc(out, size), size);
+}
+
+/* Decompress a block of records */
+gboolean gst_mjr_block_decompress(const guint8 *data, gsize len, guint8 *out, gsize out_len) {
+	if(!data || !out)
+		return FALSE;
+	uLongf size = out_len;
+	if(uncompress(out, &size, data, len) != Z_OK)
+		return FALSE;
+	return size == out_len;
+}
+
+/* Reset an RTP timestamp context */
+void gst_mjr_timestamp_reset(gst_mjr_timestamp *ts) {
+	if(!ts)
+		return;
+	ts->initialized = FALSE;
+	ts->last_ts = 0;
+	ts->ext_ts = 0;
+}
+
+/* Update an RTP timestamp context with a new RTP timestamp */
+gint64 gst_mjr_timestamp_update(gst_mjr_timestamp *ts, guint32 rtp_ts) {
+	if(!ts->initialized) {
+		ts->initialized = TRUE;
+		ts->last_ts = rtp_ts;
+		ts->ext_ts = 0;
+		return 0;
+	}
+	/* Interpret the difference as signed, so that both wrap-arounds
+	 * and backwards jumps due to reordering are handled correctly */
+	ts->ext_ts += (gint32)(rtp_ts - ts->last_ts);
+	ts->last_ts = rtp_ts;
+	return ts->ext_ts;
+}
+
+/* Helper method to convert an extended RTP timestamp to a GstClockTime */
+GstClockTime gst_mjr_timestamp_to_time(gint64 ext_ts, guint32 clock_rate) {
+	if(ext_ts <= 0 || clock_rate == 0)
+		return 0;
+	return gst_util_uint64_scale(ext_ts, GST_SECOND, clock_rate);
+}
+
+/* Create a sequence number window */
+gst_mjr_seq_window *gst_mjr_seq_window_new(guint size) {
+	if(size == 0)
+		return NULL;
+	size = MIN(size, 16384);
+	size = MAX(size, 64);
+	/* Use a power of two, so that the ring wraps along with sequence numbers */
+	size = 1 << g_bit_storage(size - 1);
+	gst_mjr_seq_window *window = g_malloc0(sizeof(gst_mjr_seq_window));
+	window->size = size;
+	window->bits = g_malloc0(size/8);
+	return window;
+}
+
+/* Helpers to access the bit of a sequence number in the window */
+#define GST_MJR_SEQ_WORD(window, seq)	(window)->bits[((seq) % (window)->size)/64]
+#define GST_MJR_SEQ_MASK(seq)			((guint64)1 << ((seq) % 64))
+
+/* Check a sequence number, and mark it as seen */
+gboolean gst_mjr_seq_window_check(gst_mjr_seq_window *window, guint16 seq) {
+	if(!window)
+		return FALSE;
+	if(!window->initialized) {
+		window->initialized = TRUE;
+		window->highest = seq;
+		GST_MJR_SEQ_WORD(window, seq) |= GST_MJR_SEQ_MASK(seq);
+		return FALSE;
+	}
+	gint16 diff = (gint16)(seq - window->highest);
+	if(diff > 0) {
+		/* Newer packet: forget about what falls out of the window */
+		if((guint)diff >= window->size) {
+			memset(window->bits, 0, window->size/8);
+		} else {
+			guint16 s = window->highest + 1;
+			gint i = 0;
+			for(i=0; i<diff; i++, s++)
+				GST_MJR_SEQ_WORD(window, s) &= ~GST_MJR_SEQ_MASK(s);
+		}
+		window->highest = seq;
+	} else if((guint)(-diff) >= window->size) {
+		/* Too old, we can't tell */
+		return FALSE;
+	} else if(GST_MJR_SEQ_WORD(window, seq) & GST_MJR_SEQ_MASK(seq)) {
+		/* We've seen this one already */
+		return TRUE;
+	}
+	GST_MJR_SEQ_WORD(window, seq) |= GST_MJR_SEQ_MASK(seq);
+	return FALSE;
+}
+
+/* Free a sequence number window */
+void gst_mjr_seq_window_free(gst_mjr_seq_window *window) {
+	if(!window)
+		return;
+	g_free(window->bits);
+	g_free(window);
+}
@@ -105,4 +105,192 @@ const gchar *gst_mjr_get_encoding_name(int codec);
 /* Helper method to get a GStreamer clock-rate from an MJR codec */
 guint32 gst_mjr_get_clock_rate(int codec);
 
+/* Helper method to get the size of the RTP header (CSRCs and extensions
+ * included) of a packet, or 0 if the available data is not enough */
+gsize gst_mjr_rtp_header_size(const guint8 *data, gsize len);
+/* Helper method to check if an RTP payload contains (the beginning of) a
+ * keyframe for the specified codec: for audio codecs, it's always TRUE */
+gboolean gst_mjr_is_keyframe(int codec, const guint8 *payload, gsize len);
+
+/* Template structure of the AV1 dependency descriptor: it's only sent
+ * with some packets (e.g., keyframes), and tells us the spatial and
+ * temporal layer of the frames using each template ID */
+typedef struct gst_mjr_dd_structure {
+	gboolean valid;
+	guint8 offset, count;
+	guint8 spatial[64], temporal[64];
+} gst_mjr_dd_structure;
+/* Helper method to get the spatial and temporal layer an RTP packet (header
+ * included) belongs to, and whether it's the last packet of the frame in
+ * that layer: VP8 (temporal layers only), VP9 (payload descriptor) and AV1
+ * (dependency descriptor, which needs the negotiated extension ID and the
+ * latest template structure, updated when a new one is found) are supported.
+ * Returns FALSE if the packet carries no layer information */
+gboolean gst_mjr_get_layers(int codec, const guint8 *data, gsize len,
+	guint8 dd_ext_id, gst_mjr_dd_structure *dd,
+	int *spatial, int *temporal, gboolean *end_of_frame);
+
+/* Size of the MJR header, of the JSON length and of the frame header */
+#define GST_MJR_HEADER_SIZE			8
+#define GST_MJR_JSON_LENGTH_SIZE	2
+#define GST_MJR_FRAME_HEADER_SIZE	10
+
+/* Compressed MJR files use a different header, and after the info header
+ * contain blocks of records compressed independently, each prefixed by a
+ * block header ("MJRB", compressed size, uncompressed size, and received
+ * time of the first record in the block). Blocks are followed by an index
+ * ("MJRI", number of entries, and for each block its offset in the file
+ * and the received time of its first record) and by a trailer (offset of
+ * the index in the file, and "MJRX"), which allows readers to seek by
+ * time without going through the whole file */
+#define GST_MJR_BLOCK_HEADER_SIZE	16
+#define GST_MJR_INDEX_HEADER_SIZE	8
+#define GST_MJR_INDEX_ENTRY_SIZE	12
+#define GST_MJR_TRAILER_SIZE		12
+/* Default and maximum size of the uncompressed data in a block */
+#define GST_MJR_DEFAULT_BLOCK_SIZE	(64*1024)
+#define GST_MJR_MAX_BLOCK_SIZE		(4*1024*1024)
+/* Compression algorithm, as advertised in the info header */
+#define GST_MJR_COMPRESSION			"zlib"
+
+/* Recordings written with a snaplen (advertised as "l" in the info header)
+ * only contain the RTP header of each packet (extensions included) and up
+ * to snaplen bytes of its payload: each record is then followed by the
+ * original length of the packet, so that statistics can still be computed */
+#define GST_MJR_SNAPLEN_TRAILER_SIZE	2
+
+/* Session archives bundle many MJR files in a single file: after the
+ * archive header ("MJRA0001"), the content of the MJR files is stored in
+ * segments ("MJRS", ID of the stream, and length of the data), that for
+ * each stream, once concatenated, are exactly the original MJR file. They
+ * are followed by a table of contents ("MJRT" and number of streams, and
+ * for each stream its ID, name, size and list of segments, each with the
+ * offset of its data in the archive and its length), and by a trailer
+ * (offset of the table of contents in the archive, and "MJRE") */
+#define GST_MJR_ARCHIVE_HEADER_SIZE		8
+#define GST_MJR_ARCHIVE_SEGMENT_SIZE	12
+#define GST_MJR_ARCHIVE_TOC_SIZE		8
+#define GST_MJR_ARCHIVE_TRAILER_SIZE	12
+/* Default and maximum size of the data in a segment */
+#define GST_MJR_ARCHIVE_DEFAULT_SEGMENT_SIZE	(64*1024)
+#define GST_MJR_ARCHIVE_MAX_SEGMENT_SIZE		(16*1024*1024)
+
+/* Segment of a stream in a session archive */
+typedef struct gst_mjr_archive_segment {
+	guint64 offset;
+	guint32 length;
+} gst_mjr_archive_segment;
+/* Stream in a session archive, as listed in the table of contents */
+typedef struct gst_mjr_archive_stream {
+	guint32 id;
+	gchar *name;
+	guint64 size;
+	GArray *segments;
+} gst_mjr_archive_stream;
+
+/* Helper method to check the header of a session archive */
+gboolean gst_mjr_archive_check_header(const char *data);
+/* Helper method to parse a segment header: returns FALSE if it's not a
+ * segment, in which case toc is set to TRUE if it's the table of contents */
+gboolean gst_mjr_archive_parse_segment(const char *data, guint32 *id, guint32 *length, gboolean *toc);
+/* Helper method to write a segment header */
+void gst_mjr_archive_write_segment(char *data, guint32 id, guint32 length);
+/* Helper method to parse the trailer of a session archive, to get the
+ * offset of the table of contents */
+gboolean gst_mjr_archive_parse_trailer(const char *data, guint64 *toc_offset);
+/* Helper method to parse a table of contents (header included): returns
+ * a GPtrArray of streams (freed along with the array), or NULL in case
+ * of errors, in which case a description is returned in the error
+ * argument, and has to be freed by the caller */
+GPtrArray *gst_mjr_archive_parse_toc(const guint8 *data, gsize len, gchar **error);
+/* Helper method to serialize a table of contents, and the trailer that
+ * points to it, given the offset it will be written at */
+GByteArray *gst_mjr_archive_write_toc(GPtrArray *streams, guint64 offset);
+/* Create a new stream for a table of contents */
+gst_mjr_archive_stream *gst_mjr_archive_stream_new(guint32 id, const gchar *name);
+/* Free a stream in a table of contents */
+void gst_mjr_archive_stream_free(gst_mjr_archive_stream *stream);
+
+/* URI of the AV1 dependency descriptor RTP extension */
+#define GST_MJR_DD_EXTENSION		"https://aomediacodec.github.io/av1-rtp-spec/#dependency-descriptor-rtp-header-extension"
+
+/* Info on an MJR recording, as advertised in its header */
+typedef struct gst_mjr_info {
+	gboolean legacy;
+	gboolean compressed;
+	gboolean video;
+	int codec;
+	gint64 created, written;
+	/* ID of the dependency descriptor RTP extension, if negotiated */
+	guint8 dd_ext_id;
+	/* How much of the payload was stored, if the recording was truncated */
+	guint16 snaplen;
+} gst_mjr_info;
+
+/* Helper method to check the MJR header, and whether it's a legacy or
+ * a compressed one */
+gboolean gst_mjr_check_header(const char *data, gboolean *legacy, gboolean *compressed);
+/* Helper method to parse the MJR info header (JSON, or "audio"/"video"
+ * in legacy recordings): in case of errors, a description is returned
+ * in the error argument, and has to be freed by the caller */
+gboolean gst_mjr_parse_info(const char *data, gsize len, gboolean legacy,
+	gst_mjr_info *info, gchar **error);
+
+/* Helper method to get the length of the packet stored in a record, and
+ * its original length, which is larger if it was truncated by a snaplen */
+guint16 gst_mjr_record_length(const gst_mjr_info *info, const guint8 *data,
+	guint16 len, guint16 *original);
+
+/* Header of a block of records in a compressed MJR file */
+typedef struct gst_mjr_block {
+	guint32 compressed_size;
+	guint32 size;
+	guint32 received;
+} gst_mjr_block;
+
+/* Helper method to parse a block header: if this is the beginning of
+ * the index instead, index is set to TRUE and FALSE is returned */
+gboolean gst_mjr_parse_block(const char *data, gst_mjr_block *block, gboolean *index);
+/* Helper method to serialize a block header */
+void gst_mjr_write_block(char *data, const gst_mjr_block *block);
+/* Compress a block of records: returns NULL in case of errors */
+GBytes *gst_mjr_block_compress(const guint8 *data, gsize len);
+/* Decompress a block of records, whose size must be exactly out_len */
+gboolean gst_mjr_block_decompress(const guint8 *data, gsize len, guint8 *out, gsize out_len);
+
+/* Context to unwrap 32-bit RTP timestamps to a 64-bit timeline */
+typedef struct gst_mjr_timestamp {
+	gboolean initialized;
+	guint32 last_ts;
+	gint64 ext_ts;
+} gst_mjr_timestamp;
+
+/* Reset an RTP timestamp context */
+void gst_mjr_timestamp_reset(gst_mjr_timestamp *ts);
+/* Update an RTP timestamp context with a new RTP timestamp, returning the
+ * extended timestamp relative to the first packet: the result may be
+ * negative for packets reordered before the first one we saw */
+gint64 gst_mjr_timestamp_update(gst_mjr_timestamp *ts, guint32 rtp_ts);
+/* Helper method to convert an extended RTP timestamp to a GstClockTime */
+GstClockTime gst_mjr_timestamp_to_time(gint64 ext_ts, guint32 clock_rate);
+
+/* Sliding window of recently seen RTP sequence numbers, used to detect
+ * duplicates: a bit per sequence number, in a ring of 64-bit words */
+typedef struct gst_mjr_seq_window {
+	gboolean initialized;
+	guint16 highest;
+	guint size;
+	guint64 *bits;
+} gst_mjr_seq_window;
+
+/* Create a sequence number window of the specified size (rounded up to
+ * a power of two, and capped to a quarter of the sequence number space) */
+gst_mjr_seq_window *gst_mjr_seq_window_new(guint size);
+/* Check a sequence number: returns TRUE if it's a duplicate of one in the
+ * window, and otherwise marks it as seen; sequence numbers that are too
+ * old to be in the window are never considered duplicates */
+gboolean gst_mjr_seq_window_check(gst_mjr_seq_window *window, guint16 seq);
+/* Free a sequence number window */
+void gst_mjr_seq_window_free(gst_mjr_seq_window *window);
+
 #endif /* __GST_MJR_UTILS_H__ */
@@ -0,0 +1,174 @@
+/*
+ * GStreamer
+ * Copyright (C) 2005 Thomas Vander Stichele <thomas@apestaart.org>
+ * Copyright (C) 2005 Ronald S. Bultje <rbultje@ronald.bitfreak.net>
+ * Copyright (C) 2024 Lorenzo Miniero <lorenzo@meetecho.com>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ *
+ * Alternatively, the contents of this file may be used under the
+ * GNU Lesser General Public License Version 2.1 (the "LGPL"), in
+ * which case the following provisions apply instead of the ones
+ * mentioned above:
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 02111-1307, USA.
+ */
+
+#ifdef HAVE_CONFIG_H
+#  include <config.h>
+#endif
+
+#include "gstmjrwheel.h"
+
+/* Slots are circular lists, whose head is the slot itself */
+static void gst_mjr_wheel_list_init(gst_mjr_wheel_timer *head) {
+	head->prev = head;
+	head->next = head;
+}
+static void gst_mjr_wheel_list_append(gst_mjr_wheel_timer *head, gst_mjr_wheel_timer *timer) {
+	timer->prev = head->prev;
+	timer->next = head;
+	head->prev->next = timer;
+	head->prev = timer;
+}
+static void gst_mjr_wheel_list_unlink(gst_mjr_wheel_timer *timer) {
+	timer->prev->next = timer->next;
+	timer->next->prev = timer->prev;
+	timer->prev = NULL;
+	timer->next = NULL;
+}
+
+/* Initialize a timer wheel */
+void gst_mjr_wheel_init(gst_mjr_wheel *wheel, guint64 tick) {
+	wheel->current = tick;
+	wheel->count = 0;
+	int level = 0, slot = 0;
+	for(level=0; level<GST_MJR_WHEEL_LEVELS; level++) {
+		for(slot=0; slot<GST_MJR_WHEEL_SLOTS; slot++)
+			gst_mjr_wheel_list_init(&wheel->slots[level][slot]);
+	}
+}
+
+/* Put a timer in the right slot, depending on how far in the future it is */
+static void gst_mjr_wheel_insert(gst_mjr_wheel *wheel, gst_mjr_wheel_timer *timer) {
+	guint64 expires = timer->expires;
+	if(expires < wheel->current)
+		expires = wheel->current;
+	guint64 delta = expires - wheel->current;
+	int level = 0;
+	for(level=0; level<GST_MJR_WHEEL_LEVELS-1; level++) {
+		if(delta < ((guint64)1 << (GST_MJR_WHEEL_BITS * (level + 1))))
+			break;
+	}
+	if(level == GST_MJR_WHEEL_LEVELS-1) {
+		/* Clamp timers too far in the future to the last level */
+		guint64 max = ((guint64)1 << (GST_MJR_WHEEL_BITS * GST_MJR_WHEEL_LEVELS)) - 1;
+		if(delta > max)
+			expires = wheel->current + max;
+	}
+	int slot = (expires >> (GST_MJR_WHEEL_BITS * level)) & GST_MJR_WHEEL_MASK;
+	gst_mjr_wheel_list_append(&wheel->slots[level][slot], timer);
+}
+
+/* Schedule a timer */
+void gst_mjr_wheel_add(gst_mjr_wheel *wheel, gst_mjr_wheel_timer *timer, guint64 expires) {
+	if(timer->pending)
+		gst_mjr_wheel_remove(wheel, timer);
+	timer->expires = expires;
+	timer->pending = TRUE;
+	wheel->count++;
+	gst_mjr_wheel_insert(wheel, timer);
+}
+
+/* Remove a scheduled timer */
+void gst_mjr_wheel_remove(gst_mjr_wheel *wheel, gst_mjr_wheel_timer *timer) {
+	if(!timer->pending)
+		return;
+	gst_mjr_wheel_list_unlink(timer);
+	timer->pending = FALSE;
+	wheel->count--;
+}
+
+/* Move all timers in a slot of a higher level to the lower levels */
+static int gst_mjr_wheel_cascade(gst_mjr_wheel *wheel, int level) {
+	int slot = (wheel->current >> (GST_MJR_WHEEL_BITS * level)) & GST_MJR_WHEEL_MASK;
+	gst_mjr_wheel_timer list, *head = &wheel->slots[level][slot];
+	if(head->next != head) {
+		/* Detach the whole list first, as timers may end up in the same slot */
+		list.next = head->next;
+		list.prev = head->prev;
+		list.next->prev = &list;
+		list.prev->next = &list;
+		gst_mjr_wheel_list_init(head);
+		while(list.next != &list) {
+			gst_mjr_wheel_timer *timer = list.next;
+			gst_mjr_wheel_list_unlink(timer);
+			gst_mjr_wheel_insert(wheel, timer);
+		}
+	}
+	return slot;
+}
+
+/* Advance the wheel up to a specific tick */
+void gst_mjr_wheel_advance(gst_mjr_wheel *wheel, guint64 tick,
+		gst_mjr_wheel_callback callback, gpointer user_data) {
+	while(wheel->current <= tick) {
+		int slot = wheel->current & GST_MJR_WHEEL_MASK;
+		if(slot == 0) {
+			/* We wrapped the first level, cascade timers from the upper ones */
+			int level = 1;
+			for(level=1; level<GST_MJR_WHEEL_LEVELS; level++) {
+				if(gst_mjr_wheel_cascade(wheel, level) != 0)
+					break;
+			}
+		}
+		/* Detach the timers in this slot, and move to the next tick before
+		 * firing them: this way, timers scheduled again from the callback
+		 * for an expired tick will fire at the next one, at the latest */
+		gst_mjr_wheel_timer list, *head = &wheel->slots[0][slot];
+		wheel->current++;
+		if(head->next == head)
+			continue;
+		list.next = head->next;
+		list.prev = head->prev;
+		list.next->prev = &list;
+		list.prev->next = &list;
+		gst_mjr_wheel_list_init(head);
+		while(list.next != &list) {
+			gst_mjr_wheel_timer *timer = list.next;
+			gst_mjr_wheel_list_unlink(timer);
+			timer->pending = FALSE;
+			wheel->count--;
+			callback(timer, user_data);
+		}
+	}
+}
@@ -0,0 +1,88 @@
+/*
+ * GStreamer
+ * Copyright (C) 2005 Thomas Vander Stichele <thomas@apestaart.org>
+ * Copyright (C) 2005 Ronald S. Bultje <rbultje@ronald.bitfreak.net>
+ * Copyright (C) 2024 Lorenzo Miniero <lorenzo@meetecho.com>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ *
+ * Alternatively, the contents of this file may be used under the
+ * GNU Lesser General Public License Version 2.1 (the "LGPL"), in
+ * which case the following provisions apply instead of the ones
+ * mentioned above:
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 02111-1307, USA.
+ */
+
+#ifndef __GST_MJR_WHEEL_H__
+#define __GST_MJR_WHEEL_H__
+
+#include <glib.h>
+
+/* Hierarchical timer wheel: 4 levels of 64 slots each, which with
+ * millisecond ticks means timers up to ~4.6 hours can be scheduled
+ * without overflowing (later timers are clamped to the last level) */
+#define GST_MJR_WHEEL_BITS		6
+#define GST_MJR_WHEEL_SLOTS		(1 << GST_MJR_WHEEL_BITS)
+#define GST_MJR_WHEEL_MASK		(GST_MJR_WHEEL_SLOTS - 1)
+#define GST_MJR_WHEEL_LEVELS	4
+
+/* Timer: meant to be embedded in the structure that needs scheduling */
+typedef struct gst_mjr_wheel_timer {
+	struct gst_mjr_wheel_timer *prev, *next;
+	guint64 expires;
+	gboolean pending;
+} gst_mjr_wheel_timer;
+
+/* Callback invoked when a timer expires */
+typedef void (*gst_mjr_wheel_callback)(gst_mjr_wheel_timer *timer, gpointer user_data);
+
+/* Timer wheel: not thread safe, so each thread should use its own */
+typedef struct gst_mjr_wheel {
+	guint64 current;
+	guint count;
+	gst_mjr_wheel_timer slots[GST_MJR_WHEEL_LEVELS][GST_MJR_WHEEL_SLOTS];
+} gst_mjr_wheel;
+
+/* Initialize a timer wheel, starting from a specific tick */
+void gst_mjr_wheel_init(gst_mjr_wheel *wheel, guint64 tick);
+/* Schedule a timer to expire at a specific tick (in the past means the next tick) */
+void gst_mjr_wheel_add(gst_mjr_wheel *wheel, gst_mjr_wheel_timer *timer, guint64 expires);
+/* Remove a scheduled timer */
+void gst_mjr_wheel_remove(gst_mjr_wheel *wheel, gst_mjr_wheel_timer *timer);
+/* Advance the wheel up to a specific tick, invoking the callback for all
+ * the timers that expired in the meanwhile: timers can be scheduled again
+ * from within the callback */
+void gst_mjr_wheel_advance(gst_mjr_wheel *wheel, guint64 tick,
+	gst_mjr_wheel_callback callback, gpointer user_data);
+
+#endif /* __GST_MJR_WHEEL_H__ */
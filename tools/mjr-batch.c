@@ -0,0 +1,381 @@
+/*
+ * GStreamer
+ * Copyright (C) 2005 Thomas Vander Stichele <thomas@apestaart.org>
+ * Copyright (C) 2005 Ronald S. Bultje <rbultje@ronald.bitfreak.net>
+ * Copyright (C) 2024 Lorenzo Miniero <lorenzo@meetecho.com>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ *
+ * Alternatively, the contents of this file may be used under the
+ * GNU Lesser General Public License Version 2.1 (the "LGPL"), in
+ * which case the following provisions apply instead of the ones
+ * mentioned above:
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 02111-1307, USA.
+ */
+
+/*
+ * mjr-batch: processes a single MJR recording using multiple pipelines in
+ * parallel. The recording is split in chunks that start with a keyframe,
+ * and each chunk is fed (via an appsrc) to a separate pipeline, built out
+ * of the provided description: each pipeline writes to a separate file,
+ * and all files are concatenated in order at the end. As such, the output
+ * must be in a format that supports concatenation (e.g., MPEG-TS, or an
+ * elementary stream). Timestamps are relative to the beginning of the
+ * recording in all chunks, so that the concatenated output is consistent.
+ *
+ * Example:
+ *
+ *   mjr-batch -i rec-video.mjr -o out.ts -j 8 \
+ *     -p "rtpvp8depay ! vp8dec ! x264enc ! h264parse ! mpegtsmux"
+ */
+
+#ifdef HAVE_CONFIG_H
+#  include <config.h>
+#endif
+
+#include <gst/gst.h>
+#include <gst/app/gstappsrc.h>
+
+#include <glib/gstdio.h>
+
+#include "gstmjrreader.h"
+
+/* Command line options */
+static gchar *input = NULL, *output = NULL, *description = NULL;
+static gint jobs = 0, chunks = 0;
+static gboolean keep_parts = FALSE, verbose = FALSE;
+static GOptionEntry options[] = {
+	{ "input", 'i', 0, G_OPTION_ARG_FILENAME, &input, "MJR recording to process", "FILE" },
+	{ "output", 'o', 0, G_OPTION_ARG_FILENAME, &output, "File to write the concatenated output to", "FILE" },
+	{ "pipeline", 'p', 0, G_OPTION_ARG_STRING, &description, "Pipeline to process each chunk with (RTP in, muxed data out)", "PIPELINE" },
+	{ "jobs", 'j', 0, G_OPTION_ARG_INT, &jobs, "How many chunks to process at the same time (default: number of cores)", "N" },
+	{ "chunks", 'c', 0, G_OPTION_ARG_INT, &chunks, "How many chunks to split the recording in (default: same as jobs)", "N" },
+	{ "keep-parts", 'k', 0, G_OPTION_ARG_NONE, &keep_parts, "Don't delete the output of each chunk when done", NULL },
+	{ "verbose", 'v', 0, G_OPTION_ARG_NONE, &verbose, "Print more info on what's happening", NULL },
+	{ NULL }
+};
+
+/* Chunk to process */
+typedef struct mjr_batch_job {
+	guint index;
+	gst_mjr_chunk chunk;
+	gchar *part;
+	gboolean success;
+	/* Flow control with appsrc, and whether the pipeline failed */
+	GMutex mutex;
+	GCond cond;
+	gboolean enough, failed;
+} mjr_batch_job;
+
+/* Info on the recording, shared by all jobs */
+static gst_mjr_info info;
+static guint32 ssrc = 0;
+static guint8 payload_type = 0;
+
+/* appsrc callbacks, to know when we should stop or resume feeding */
+static void mjr_batch_need_data(GstAppSrc *appsrc, guint length, gpointer user_data) {
+	mjr_batch_job *job = (mjr_batch_job *)user_data;
+	g_mutex_lock(&job->mutex);
+	job->enough = FALSE;
+	g_cond_signal(&job->cond);
+	g_mutex_unlock(&job->mutex);
+}
+static void mjr_batch_enough_data(GstAppSrc *appsrc, gpointer user_data) {
+	mjr_batch_job *job = (mjr_batch_job *)user_data;
+	g_mutex_lock(&job->mutex);
+	job->enough = TRUE;
+	g_mutex_unlock(&job->mutex);
+}
+static GstAppSrcCallbacks mjr_batch_callbacks = {
+	.need_data = mjr_batch_need_data,
+	.enough_data = mjr_batch_enough_data,
+};
+
+/* Bus sync handler: if the pipeline fails, appsrc won't ask for more
+ * data anymore, so we wake up the feeding thread to let it give up */
+static GstBusSyncReply mjr_batch_bus_sync(GstBus *bus, GstMessage *msg, gpointer user_data) {
+	mjr_batch_job *job = (mjr_batch_job *)user_data;
+	if(GST_MESSAGE_TYPE(msg) == GST_MESSAGE_ERROR) {
+		g_mutex_lock(&job->mutex);
+		job->failed = TRUE;
+		g_cond_signal(&job->cond);
+		g_mutex_unlock(&job->mutex);
+	}
+	return GST_BUS_PASS;
+}
+
+/* Wait until appsrc wants more data: returns FALSE if the pipeline failed */
+static gboolean mjr_batch_wait(mjr_batch_job *job) {
+	g_mutex_lock(&job->mutex);
+	while(job->enough && !job->failed)
+		g_cond_wait(&job->cond, &job->mutex);
+	gboolean ok = !job->failed;
+	g_mutex_unlock(&job->mutex);
+	return ok;
+}
+
+/* Feed the packets of a chunk to the pipeline */
+static gboolean mjr_batch_feed(mjr_batch_job *job, GstAppSrc *appsrc) {
+	gchar *error = NULL;
+	gst_mjr_reader *reader = gst_mjr_reader_open(input, &error);
+	if(!reader) {
+		g_printerr("[chunk %u] %s\n", job->index, error);
+		g_free(error);
+		return FALSE;
+	}
+	if(!gst_mjr_reader_seek(reader, job->chunk.offset) ||
+			gst_mjr_reader_skip(reader, job->chunk.skip, &error) != gst_mjr_reader_ok) {
+		g_printerr("[chunk %u] Error seeking to the beginning of the chunk%s%s\n", job->index,
+			error ? ": " : "", error ? error : "");
+		g_free(error);
+		gst_mjr_reader_close(reader);
+		return FALSE;
+	}
+	guint32 clock_rate = gst_mjr_get_clock_rate(info.codec);
+	gst_mjr_timestamp ts;
+	gst_mjr_timestamp_reset(&ts);
+	guint64 packets = 0;
+	gst_mjr_reader_result res = gst_mjr_reader_ok;
+	while(packets < job->chunk.packets && (res = gst_mjr_reader_next(reader, &error)) == gst_mjr_reader_ok) {
+		if(reader->length < 12)
+			continue;
+		gst_mjr_rtp *rtp = (gst_mjr_rtp *)reader->buffer;
+		if(g_ntohl(rtp->ssrc) != ssrc)
+			continue;
+		packets++;
+		/* Timestamps are relative to the beginning of the recording */
+		gint64 ext_ts = job->chunk.ext_ts + gst_mjr_timestamp_update(&ts, g_ntohl(rtp->timestamp));
+		GstBuffer *buffer = gst_buffer_new_memdup(reader->buffer, reader->length);
+		GST_BUFFER_PTS(buffer) = gst_mjr_timestamp_to_time(ext_ts, clock_rate);
+		if(packets == 1)
+			GST_BUFFER_FLAG_SET(buffer, GST_BUFFER_FLAG_DISCONT);
+		if(!mjr_batch_wait(job)) {
+			/* The pipeline failed, no point in going on */
+			gst_buffer_unref(buffer);
+			break;
+		}
+		if(gst_app_src_push_buffer(appsrc, buffer) != GST_FLOW_OK)
+			break;
+	}
+	gst_mjr_reader_close(reader);
+	if(res == gst_mjr_reader_error) {
+		g_printerr("[chunk %u] %s\n", job->index, error);
+		g_free(error);
+		return FALSE;
+	}
+	gst_app_src_end_of_stream(appsrc);
+	if(verbose)
+		g_print("[chunk %u] Fed %" G_GUINT64_FORMAT " packets\n", job->index, packets);
+	return TRUE;
+}
+
+/* Process a chunk: this is called by the workers in the thread pool */
+static void mjr_batch_process(gpointer data, gpointer user_data) {
+	mjr_batch_job *job = (mjr_batch_job *)data;
+	GError *err = NULL;
+	gchar *launch = g_strdup_printf("appsrc name=mjrsrc format=time ! %s ! filesink location=\"%s\"",
+		description, job->part);
+	GstElement *pipeline = gst_parse_launch(launch, &err);
+	g_free(launch);
+	if(pipeline == NULL || err != NULL) {
+		g_printerr("[chunk %u] Error creating pipeline: %s\n", job->index, err ? err->message : "??");
+		g_clear_error(&err);
+		if(pipeline)
+			gst_object_unref(pipeline);
+		return;
+	}
+	GstElement *appsrc = gst_bin_get_by_name(GST_BIN(pipeline), "mjrsrc");
+	GstCaps *caps = gst_caps_new_simple("application/x-rtp",
+		"media", G_TYPE_STRING, (info.video ? "video" : "audio"),
+		"encoding-name", G_TYPE_STRING, gst_mjr_get_encoding_name(info.codec),
+		"clock-rate", G_TYPE_INT, gst_mjr_get_clock_rate(info.codec),
+		"payload", G_TYPE_INT, payload_type,
+		NULL);
+	/* Don't read the whole chunk in memory if the pipeline is slower: we
+	 * don't let appsrc block, though, as we'd never wake up if it fails */
+	g_object_set(appsrc, "caps", caps, "max-bytes", (guint64)(4*1024*1024), NULL);
+	gst_caps_unref(caps);
+	g_mutex_init(&job->mutex);
+	g_cond_init(&job->cond);
+	job->enough = FALSE;
+	job->failed = FALSE;
+	gst_app_src_set_callbacks(GST_APP_SRC(appsrc), &mjr_batch_callbacks, job, NULL);
+	GstBus *bus = gst_element_get_bus(pipeline);
+	gst_bus_set_sync_handler(bus, mjr_batch_bus_sync, job, NULL);
+	gst_element_set_state(pipeline, GST_STATE_PLAYING);
+	gboolean fed = mjr_batch_feed(job, GST_APP_SRC(appsrc));
+	gst_object_unref(appsrc);
+	if(fed) {
+		/* Wait for the pipeline to be done */
+		GstMessage *msg = gst_bus_timed_pop_filtered(bus, GST_CLOCK_TIME_NONE,
+			GST_MESSAGE_EOS | GST_MESSAGE_ERROR);
+		if(msg && GST_MESSAGE_TYPE(msg) == GST_MESSAGE_ERROR) {
+			gchar *debug = NULL;
+			gst_message_parse_error(msg, &err, &debug);
+			g_printerr("[chunk %u] Error processing chunk: %s (%s)\n", job->index,
+				err->message, debug ? debug : "no details");
+			g_clear_error(&err);
+			g_free(debug);
+		} else if(msg) {
+			job->success = TRUE;
+		}
+		if(msg)
+			gst_message_unref(msg);
+	}
+	gst_element_set_state(pipeline, GST_STATE_NULL);
+	gst_bus_set_sync_handler(bus, NULL, NULL, NULL);
+	gst_object_unref(bus);
+	gst_object_unref(pipeline);
+	g_mutex_clear(&job->mutex);
+	g_cond_clear(&job->cond);
+	if(verbose)
+		g_print("[chunk %u] %s\n", job->index, job->success ? "Done" : "Failed");
+}
+
+/* Append a file to the output */
+static gboolean mjr_batch_append(FILE *out, const gchar *filename) {
+	FILE *in = g_fopen(filename, "rb");
+	if(in == NULL)
+		return FALSE;
+	char buffer[65536];
+	size_t len = 0;
+	gboolean ok = TRUE;
+	while((len = fread(buffer, 1, sizeof(buffer), in)) > 0) {
+		if(fwrite(buffer, 1, len, out) != len) {
+			ok = FALSE;
+			break;
+		}
+	}
+	if(ferror(in))
+		ok = FALSE;
+	fclose(in);
+	return ok;
+}
+
+int main(int argc, char *argv[]) {
+	GError *err = NULL;
+	GOptionContext *context = g_option_context_new("- process an MJR recording in parallel chunks");
+	g_option_context_add_main_entries(context, options, NULL);
+	g_option_context_add_group(context, gst_init_get_option_group());
+	if(!g_option_context_parse(context, &argc, &argv, &err)) {
+		g_printerr("%s\n", err->message);
+		g_error_free(err);
+		g_option_context_free(context);
+		return 1;
+	}
+	g_option_context_free(context);
+	if(input == NULL || output == NULL || description == NULL) {
+		g_printerr("Missing input, output or pipeline (see --help)\n");
+		return 1;
+	}
+	if(jobs <= 0)
+		jobs = g_get_num_processors();
+	if(chunks <= 0)
+		chunks = jobs;
+	/* Get info on the recording first */
+	gchar *error = NULL;
+	gst_mjr_reader *reader = gst_mjr_reader_open(input, &error);
+	if(reader == NULL) {
+		g_printerr("%s\n", error);
+		g_free(error);
+		return 1;
+	}
+	info = reader->info;
+	while(gst_mjr_reader_next(reader, NULL) == gst_mjr_reader_ok) {
+		if(reader->length >= 12) {
+			payload_type = ((gst_mjr_rtp *)reader->buffer)->type;
+			break;
+		}
+	}
+	gst_mjr_reader_close(reader);
+	/* Split the recording in chunks */
+	GArray *list = gst_mjr_split_chunks(input, chunks, &ssrc, &error);
+	if(list == NULL) {
+		g_printerr("%s\n", error);
+		g_free(error);
+		return 1;
+	}
+	g_print("Processing %s (%s) in %u chunks, %d at a time\n", input,
+		gst_mjr_codec_string(info.codec), list->len, jobs);
+	/* Process all the chunks in a thread pool */
+	mjr_batch_job *all = g_malloc0(list->len * sizeof(mjr_batch_job));
+	GThreadPool *pool = g_thread_pool_new(mjr_batch_process, NULL, jobs, TRUE, NULL);
+	guint i = 0;
+	for(i=0; i<list->len; i++) {
+		all[i].index = i;
+		all[i].chunk = g_array_index(list, gst_mjr_chunk, i);
+		all[i].part = g_strdup_printf("%s.part%u", output, i);
+		if(verbose) {
+			g_print("[chunk %u] Offset %" G_GOFFSET_FORMAT " (+%u), %" G_GUINT64_FORMAT " packets\n",
+				i, all[i].chunk.offset, all[i].chunk.skip, all[i].chunk.packets);
+		}
+		g_thread_pool_push(pool, &all[i], NULL);
+	}
+	/* Wait for all chunks to be processed */
+	g_thread_pool_free(pool, FALSE, TRUE);
+	/* Concatenate the output of all chunks, in order */
+	int ret = 0;
+	for(i=0; i<list->len; i++) {
+		if(!all[i].success) {
+			g_printerr("Chunk %u failed, not writing the output\n", i);
+			ret = 1;
+			break;
+		}
+	}
+	if(ret == 0) {
+		FILE *out = g_fopen(output, "wb");
+		if(out == NULL) {
+			g_printerr("Error opening output file %s\n", output);
+			ret = 1;
+		}
+		for(i=0; out != NULL && i<list->len; i++) {
+			if(!mjr_batch_append(out, all[i].part)) {
+				g_printerr("Error appending chunk %u to the output\n", i);
+				ret = 1;
+				break;
+			}
+		}
+		if(out != NULL)
+			fclose(out);
+	}
+	for(i=0; i<list->len; i++) {
+		if(!keep_parts)
+			g_unlink(all[i].part);
+		g_free(all[i].part);
+	}
+	g_free(all);
+	g_array_free(list, TRUE);
+	if(ret == 0)
+		g_print("Done, output written to %s\n", output);
+	return ret;
+}
@@ -0,0 +1,166 @@
+/*
+ * GStreamer
+ * Copyright (C) 2005 Thomas Vander Stichele <thomas@apestaart.org>
+ * Copyright (C) 2005 Ronald S. Bultje <rbultje@ronald.bitfreak.net>
+ * Copyright (C) 2024 Lorenzo Miniero <lorenzo@meetecho.com>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ *
+ * Alternatively, the contents of this file may be used under the
+ * GNU Lesser General Public License Version 2.1 (the "LGPL"), in
+ * which case the following provisions apply instead of the ones
+ * mentioned above:
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 02111-1307, USA.
+ */
+
+/*
+ * mjr-probe: prints info on MJR recordings (codec, media type, creation
+ * and first write times, SSRC, first and last RTP timestamps, approximate
+ * duration) without demuxing them, one JSON object per line. Files can be
+ * passed on the command line, or a whole directory can be scanned using
+ * a pool of threads, in which case lines are printed in no specific order.
+ *
+ * Example:
+ *
+ *   mjr-probe -d /path/to/recordings -r -j 16
+ */
+
+#ifdef HAVE_CONFIG_H
+#  include <config.h>
+#endif
+
+#include <json-glib/json-glib.h>
+
+#include "gstmjrprobe.h"
+
+/* Command line options */
+static gchar *directory = NULL;
+static gboolean recursive = FALSE;
+static gint jobs = 0;
+static gchar **files = NULL;
+static GOptionEntry options[] = {
+	{ "directory", 'd', 0, G_OPTION_ARG_FILENAME, &directory, "Directory to probe all MJR files from", "DIR" },
+	{ "recursive", 'r', 0, G_OPTION_ARG_NONE, &recursive, "Probe the subdirectories of the directory too", NULL },
+	{ "jobs", 'j', 0, G_OPTION_ARG_INT, &jobs, "How many files to probe at the same time (default: number of cores)", "N" },
+	{ G_OPTION_REMAINING, 0, 0, G_OPTION_ARG_FILENAME_ARRAY, &files, "MJR files to probe", "FILE..." },
+	{ NULL }
+};
+
+/* Lines may be printed by different threads */
+static GMutex mutex;
+static gint failed = 0;
+
+/* Print the result of a probe */
+static void mjr_probe_print(const gchar *filename, gst_mjr_probe *probe, const gchar *error, gpointer user_data) {
+	JsonBuilder *builder = json_builder_new();
+	json_builder_begin_object(builder);
+	json_builder_set_member_name(builder, "file");
+	json_builder_add_string_value(builder, filename);
+	if(probe == NULL) {
+		json_builder_set_member_name(builder, "error");
+		json_builder_add_string_value(builder, error ? error : "Unknown error");
+		g_atomic_int_inc(&failed);
+	} else {
+		json_builder_set_member_name(builder, "type");
+		json_builder_add_string_value(builder, probe->info.video ? "video" : "audio");
+		json_builder_set_member_name(builder, "codec");
+		json_builder_add_string_value(builder, gst_mjr_codec_string(probe->info.codec));
+		json_builder_set_member_name(builder, "size");
+		json_builder_add_int_value(builder, probe->size);
+		if(!probe->info.legacy) {
+			json_builder_set_member_name(builder, "created");
+			json_builder_add_int_value(builder, probe->info.created);
+			json_builder_set_member_name(builder, "written");
+			json_builder_add_int_value(builder, probe->info.written);
+		}
+		if(probe->has_packets) {
+			json_builder_set_member_name(builder, "ssrc");
+			json_builder_add_int_value(builder, probe->ssrc);
+			json_builder_set_member_name(builder, "payload-type");
+			json_builder_add_int_value(builder, probe->payload_type);
+			json_builder_set_member_name(builder, "first-ts");
+			json_builder_add_int_value(builder, probe->first_ts);
+			json_builder_set_member_name(builder, "last-ts");
+			json_builder_add_int_value(builder, probe->last_ts);
+			json_builder_set_member_name(builder, "duration");
+			json_builder_add_double_value(builder, (gdouble)probe->duration / GST_SECOND);
+		}
+	}
+	json_builder_end_object(builder);
+	JsonGenerator *generator = json_generator_new();
+	JsonNode *root = json_builder_get_root(builder);
+	json_generator_set_root(generator, root);
+	gchar *line = json_generator_to_data(generator, NULL);
+	g_mutex_lock(&mutex);
+	g_print("%s\n", line);
+	g_mutex_unlock(&mutex);
+	g_free(line);
+	json_node_unref(root);
+	g_object_unref(generator);
+	g_object_unref(builder);
+	gst_mjr_probe_free(probe);
+}
+
+int main(int argc, char *argv[]) {
+	GError *err = NULL;
+	GOptionContext *context = g_option_context_new("- get info on MJR recordings without demuxing them");
+	g_option_context_add_main_entries(context, options, NULL);
+	if(!g_option_context_parse(context, &argc, &argv, &err)) {
+		g_printerr("%s\n", err->message);
+		g_error_free(err);
+		g_option_context_free(context);
+		return 1;
+	}
+	g_option_context_free(context);
+	if(directory == NULL && files == NULL) {
+		g_printerr("Missing files or directory to probe (see --help)\n");
+		return 1;
+	}
+	int i = 0;
+	for(i=0; files != NULL && files[i] != NULL; i++) {
+		gchar *error = NULL;
+		gst_mjr_probe *probe = gst_mjr_probe_file(files[i], &error);
+		mjr_probe_print(files[i], probe, error, NULL);
+		g_free(error);
+	}
+	if(directory != NULL) {
+		gchar *error = NULL;
+		if(gst_mjr_probe_directory(directory, recursive, jobs > 0 ? jobs : 0,
+				mjr_probe_print, NULL, &error) < 0) {
+			g_printerr("%s\n", error);
+			g_free(error);
+			return 1;
+		}
+	}
+	return g_atomic_int_get(&failed) > 0 ? 1 : 0;
+}
@@ -0,0 +1,476 @@
+/*
+ * GStreamer
+ * Copyright (C) 2005 Thomas Vander Stichele <thomas@apestaart.org>
+ * Copyright (C) 2005 Ronald S. Bultje <rbultje@ronald.bitfreak.net>
+ * Copyright (C) 2024 Lorenzo Miniero <lorenzo@meetecho.com>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ *
+ * Alternatively, the contents of this file may be used under the
+ * GNU Lesser General Public License Version 2.1 (the "LGPL"), in
+ * which case the following provisions apply instead of the ones
+ * mentioned above:
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 02111-1307, USA.
+ */
+
+/*
+ * mjr-scale: a harness to figure out how mjrmux and mjrdemux scale with
+ * the number of concurrent instances. For each of the requested instance
+ * counts, it creates that many muxers (fed synthetic RTP packets) and/or
+ * demuxers (fed a synthetic MJR recording), all in the same process and
+ * each followed by a fakesink, and pushes data to all of them at the
+ * configured packet rate for a while. It then reports, per instance:
+ *
+ *   - the size of the element instance struct;
+ *   - the RSS growth after creating them, and after pushing data;
+ *   - the CPU time spent per second of traffic;
+ *   - how many allocations were performed per packet (including the
+ *     buffer the harness itself allocates for each packet, when muxing);
+ *   - the 50th and 99th percentile of the time spent pushing a buffer to
+ *     the element, which includes its chain function and the fakesink.
+ *
+ * Data is pushed directly to the sink pad of each element from a small
+ * pool of driver threads, rather than from an appsrc per instance, as
+ * otherwise we'd need one streaming thread per instance, and we'd end up
+ * measuring the scheduler rather than the elements.
+ *
+ * Example:
+ *
+ *   mjr-scale -n 1,10,100,1000,10000 -r 50 -d 5 -m both
+ */
+
+#ifdef HAVE_CONFIG_H
+#  include <config.h>
+#endif
+
+#include <string.h>
+#include <unistd.h>
+#include <sys/resource.h>
+
+#include <gst/gst.h>
+
+#include "gstmjrdemux.h"
+#include "gstmjrmux.h"
+#include "gstmjrutils.h"
+
+/* Command line options */
+static gchar *counts = NULL, *mode = NULL;
+static gint rate = 50, duration = 5, threads = 0, size = 1200;
+static GOptionEntry options[] = {
+	{ "instances", 'n', 0, G_OPTION_ARG_STRING, &counts, "Comma separated list of instance counts to test (default: 1,10,100,1000)", "N,N,..." },
+	{ "mode", 'm', 0, G_OPTION_ARG_STRING, &mode, "Elements to test: mux, demux or both (default: both)", "MODE" },
+	{ "rate", 'r', 0, G_OPTION_ARG_INT, &rate, "Packets per second to push to each instance (default: 50)", "PPS" },
+	{ "duration", 'd', 0, G_OPTION_ARG_INT, &duration, "How many seconds to push packets for, for each test (default: 5)", "SECONDS" },
+	{ "threads", 't', 0, G_OPTION_ARG_INT, &threads, "How many threads to push packets from (default: number of cores)", "N" },
+	{ "size", 's', 0, G_OPTION_ARG_INT, &size, "Size of the RTP packets, header included (default: 1200)", "BYTES" },
+	{ NULL }
+};
+
+/* Allocation counter: on glibc, we wrap the allocator to count how many
+ * allocations the elements perform, which is what matters at scale */
+static gsize allocations = 0;
+#ifdef __GLIBC__
+extern void *__libc_malloc(size_t size);
+extern void *__libc_calloc(size_t nmemb, size_t size);
+extern void *__libc_realloc(void *ptr, size_t size);
+void *malloc(size_t size) {
+	g_atomic_pointer_add(&allocations, 1);
+	return __libc_malloc(size);
+}
+void *calloc(size_t nmemb, size_t size) {
+	g_atomic_pointer_add(&allocations, 1);
+	return __libc_calloc(nmemb, size);
+}
+void *realloc(void *ptr, size_t size) {
+	if(ptr == NULL)
+		g_atomic_pointer_add(&allocations, 1);
+	return __libc_realloc(ptr, size);
+}
+#define MJR_SCALE_ALLOCATIONS	TRUE
+#else
+#define MJR_SCALE_ALLOCATIONS	FALSE
+#endif
+
+/* Instance we're testing */
+typedef struct mjr_scale_stream {
+	GstElement *element, *sink;
+	GstPad *srcpad;
+	guint32 ssrc;
+	guint16 seq;
+	guint32 ts;
+	gsize offset;
+} mjr_scale_stream;
+
+/* Thread pushing data to a subset of the instances */
+typedef struct mjr_scale_worker {
+	GThread *thread;
+	gboolean demux;
+	mjr_scale_stream *streams;
+	guint count;
+	gint64 start;
+	GArray *latencies;
+	guint64 packets;
+	gboolean failed;
+} mjr_scale_worker;
+
+/* Synthetic data: an RTP packet to mux, and an MJR recording to demux */
+static guint8 *packet = NULL;
+static GBytes *recording = NULL;
+static gsize recording_header = 0;
+
+/* Get the current RSS of the process, in bytes */
+static gsize mjr_scale_rss(void) {
+	gsize pages = 0, rss = 0;
+	FILE *statm = fopen("/proc/self/statm", "r");
+	if(statm == NULL)
+		return 0;
+	if(fscanf(statm, "%" G_GSIZE_FORMAT " %" G_GSIZE_FORMAT, &pages, &rss) != 2)
+		rss = 0;
+	fclose(statm);
+	return rss * sysconf(_SC_PAGESIZE);
+}
+
+/* Get the CPU time (user and system) used by the process, in microseconds */
+static gint64 mjr_scale_cpu(void) {
+	struct rusage usage;
+	getrusage(RUSAGE_SELF, &usage);
+	return (gint64)(usage.ru_utime.tv_sec + usage.ru_stime.tv_sec) * G_USEC_PER_SEC +
+		usage.ru_utime.tv_usec + usage.ru_stime.tv_usec;
+}
+
+/* Drop all the output of the elements while testing */
+static void mjr_scale_print_nothing(const gchar *string) {
+}
+
+/* Create the synthetic data we feed the instances with */
+static void mjr_scale_prepare(void) {
+	/* RTP packet: VP8 with a fake payload */
+	packet = g_malloc0(size);
+	gst_mjr_rtp *rtp = (gst_mjr_rtp *)packet;
+	rtp->version = 2;
+	rtp->type = 96;
+	memset(packet + 12, 0x42, size - 12);
+	packet[12] = 0x10;
+	/* MJR recording: header, and as many records as we'll need */
+	gint64 now = g_get_real_time();
+	gchar *json = g_strdup_printf("{\"t\":\"v\",\"c\":\"vp8\",\"s\":%" G_GINT64_FORMAT ",\"u\":%" G_GINT64_FORMAT "}",
+		now, now);
+	guint16 json_len = strlen(json);
+	GByteArray *mjr = g_byte_array_new();
+	g_byte_array_append(mjr, (const guint8 *)"MJR00002", GST_MJR_HEADER_SIZE);
+	guint16 be16 = g_htons(json_len);
+	g_byte_array_append(mjr, (const guint8 *)&be16, sizeof(be16));
+	g_byte_array_append(mjr, (const guint8 *)json, json_len);
+	g_free(json);
+	recording_header = mjr->len;
+	guint64 records = (guint64)rate * duration + rate;
+	guint64 i = 0;
+	for(i=0; i<records; i++) {
+		rtp->seq_number = g_htons((guint16)i);
+		rtp->timestamp = g_htonl((guint32)(i * 90000 / rate));
+		rtp->ssrc = g_htonl(1);
+		guint32 received = g_htonl((guint32)(i * 1000 / rate));
+		be16 = g_htons(size);
+		g_byte_array_append(mjr, (const guint8 *)"MEET", 4);
+		g_byte_array_append(mjr, (const guint8 *)&received, sizeof(received));
+		g_byte_array_append(mjr, (const guint8 *)&be16, sizeof(be16));
+		g_byte_array_append(mjr, packet, size);
+	}
+	recording = g_byte_array_free_to_bytes(mjr);
+}
+
+/* Create an instance, and link it to our pad and to a fakesink */
+static gboolean mjr_scale_stream_create(mjr_scale_stream *stream, GstElement *pipeline, gboolean demux, guint index) {
+	stream->element = gst_element_factory_make(demux ? "mjrdemux" : "mjrmux", NULL);
+	stream->sink = gst_element_factory_make("fakesink", NULL);
+	if(stream->element == NULL || stream->sink == NULL)
+		return FALSE;
+	g_object_set(stream->sink, "sync", FALSE, "async", FALSE, NULL);
+	gst_bin_add_many(GST_BIN(pipeline), stream->element, stream->sink, NULL);
+	if(!gst_element_link(stream->element, stream->sink))
+		return FALSE;
+	stream->srcpad = gst_pad_new("src", GST_PAD_SRC);
+	GstPad *sinkpad = gst_element_get_static_pad(stream->element, "sink");
+	GstPadLinkReturn res = gst_pad_link(stream->srcpad, sinkpad);
+	gst_object_unref(sinkpad);
+	if(res != GST_PAD_LINK_OK)
+		return FALSE;
+	stream->ssrc = index + 1;
+	stream->seq = 0;
+	stream->ts = 0;
+	stream->offset = 0;
+	return TRUE;
+}
+
+/* Send the initial events on our pad */
+static void mjr_scale_stream_start(mjr_scale_stream *stream, gboolean demux, guint index) {
+	gst_pad_set_active(stream->srcpad, TRUE);
+	gchar *stream_id = g_strdup_printf("mjr-scale-%s-%u", demux ? "demux" : "mux", index);
+	gst_pad_push_event(stream->srcpad, gst_event_new_stream_start(stream_id));
+	g_free(stream_id);
+	GstSegment segment;
+	if(demux) {
+		GstCaps *caps = gst_caps_new_empty_simple("application/x-mjr");
+		gst_pad_push_event(stream->srcpad, gst_event_new_caps(caps));
+		gst_caps_unref(caps);
+		gst_segment_init(&segment, GST_FORMAT_BYTES);
+	} else {
+		GstCaps *caps = gst_caps_new_simple("application/x-rtp",
+			"media", G_TYPE_STRING, "video",
+			"encoding-name", G_TYPE_STRING, "VP8",
+			"clock-rate", G_TYPE_INT, 90000,
+			"payload", G_TYPE_INT, 96,
+			NULL);
+		gst_pad_push_event(stream->srcpad, gst_event_new_caps(caps));
+		gst_caps_unref(caps);
+		gst_segment_init(&segment, GST_FORMAT_TIME);
+	}
+	gst_pad_push_event(stream->srcpad, gst_event_new_segment(&segment));
+}
+
+/* Create the next buffer to push to an instance */
+static GstBuffer *mjr_scale_stream_next(mjr_scale_stream *stream, gboolean demux) {
+	if(demux) {
+		/* Next record in the recording (with the header, the first time) */
+		gsize record = GST_MJR_FRAME_HEADER_SIZE + size;
+		gsize len = stream->offset == 0 ? recording_header + record : record;
+		if(stream->offset + len > g_bytes_get_size(recording))
+			return NULL;
+		GstBuffer *buffer = gst_buffer_new_wrapped_bytes(recording);
+		gst_buffer_resize(buffer, stream->offset, len);
+		stream->offset += len;
+		return buffer;
+	}
+	/* New RTP packet */
+	GstBuffer *buffer = gst_buffer_new_memdup(packet, size);
+	GstMapInfo map;
+	gst_buffer_map(buffer, &map, GST_MAP_WRITE);
+	gst_mjr_rtp *rtp = (gst_mjr_rtp *)map.data;
+	rtp->seq_number = g_htons(stream->seq);
+	rtp->timestamp = g_htonl(stream->ts);
+	rtp->ssrc = g_htonl(stream->ssrc);
+	gst_buffer_unmap(buffer, &map);
+	GST_BUFFER_PTS(buffer) = gst_util_uint64_scale(stream->ts, GST_SECOND, 90000);
+	stream->seq++;
+	stream->ts += 90000 / rate;
+	return buffer;
+}
+
+/* Thread pushing packets to its instances at the configured rate */
+static gpointer mjr_scale_worker_thread(gpointer data) {
+	mjr_scale_worker *worker = (mjr_scale_worker *)data;
+	gint64 interval = G_USEC_PER_SEC / rate, ticks = (gint64)rate * duration, tick = 0;
+	guint i = 0;
+	for(tick=0; tick<ticks && !worker->failed; tick++) {
+		/* Wait for the next tick, if we're not late */
+		gint64 when = worker->start + tick * interval, now = g_get_monotonic_time();
+		if(when > now)
+			g_usleep(when - now);
+		for(i=0; i<worker->count; i++) {
+			mjr_scale_stream *stream = &worker->streams[i];
+			GstBuffer *buffer = mjr_scale_stream_next(stream, worker->demux);
+			if(buffer == NULL)
+				continue;
+			GstClockTime before = gst_util_get_timestamp();
+			GstFlowReturn ret = gst_pad_push(stream->srcpad, buffer);
+			guint32 latency = (guint32)MIN(gst_util_get_timestamp() - before, G_MAXUINT32);
+			if(ret != GST_FLOW_OK) {
+				worker->failed = TRUE;
+				break;
+			}
+			g_array_append_val(worker->latencies, latency);
+			worker->packets++;
+		}
+	}
+	return NULL;
+}
+
+/* Sort latencies */
+static gint mjr_scale_compare(gconstpointer a, gconstpointer b) {
+	guint32 la = *(const guint32 *)a, lb = *(const guint32 *)b;
+	return (la > lb) - (la < lb);
+}
+
+/* Test a specific number of instances of an element */
+static gboolean mjr_scale_run(gboolean demux, guint instances, guint workers) {
+	GPrintFunc print = g_set_print_handler(mjr_scale_print_nothing);
+	gboolean ok = TRUE;
+	gsize rss_before = mjr_scale_rss();
+	GstElement *pipeline = gst_pipeline_new(NULL);
+	mjr_scale_stream *streams = g_malloc0(instances * sizeof(mjr_scale_stream));
+	guint i = 0;
+	for(i=0; i<instances && ok; i++)
+		ok = mjr_scale_stream_create(&streams[i], pipeline, demux, i);
+	if(ok && gst_element_set_state(pipeline, GST_STATE_PLAYING) == GST_STATE_CHANGE_FAILURE)
+		ok = FALSE;
+	for(i=0; i<instances && ok; i++)
+		mjr_scale_stream_start(&streams[i], demux, i);
+	gsize rss_idle = mjr_scale_rss();
+	/* Push data from all the workers */
+	if(workers > instances)
+		workers = instances;
+	mjr_scale_worker *all = g_malloc0(workers * sizeof(mjr_scale_worker));
+	gint64 start = g_get_monotonic_time() + 100000;
+	gint64 cpu_before = mjr_scale_cpu();
+	gsize allocations_before = g_atomic_pointer_get(&allocations);
+	guint first = 0;
+	for(i=0; i<workers && ok; i++) {
+		all[i].demux = demux;
+		all[i].count = instances / workers + (i < instances % workers ? 1 : 0);
+		all[i].streams = &streams[first];
+		all[i].start = start;
+		all[i].latencies = g_array_sized_new(FALSE, FALSE, sizeof(guint32), all[i].count * rate * duration);
+		first += all[i].count;
+		all[i].thread = g_thread_new("mjr-scale", mjr_scale_worker_thread, &all[i]);
+	}
+	guint64 packets = 0;
+	GArray *latencies = g_array_new(FALSE, FALSE, sizeof(guint32));
+	for(i=0; i<workers && ok; i++) {
+		g_thread_join(all[i].thread);
+		if(all[i].failed)
+			ok = FALSE;
+		packets += all[i].packets;
+		g_array_append_vals(latencies, all[i].latencies->data, all[i].latencies->len);
+		g_array_free(all[i].latencies, TRUE);
+	}
+	gsize allocations_after = g_atomic_pointer_get(&allocations);
+	gint64 cpu_after = mjr_scale_cpu();
+	gint64 elapsed = g_get_monotonic_time() - start;
+	gsize rss_active = mjr_scale_rss();
+	/* Get rid of the instances */
+	gst_element_set_state(pipeline, GST_STATE_NULL);
+	for(i=0; i<instances; i++) {
+		if(streams[i].srcpad != NULL) {
+			gst_pad_set_active(streams[i].srcpad, FALSE);
+			gst_object_unref(streams[i].srcpad);
+		}
+	}
+	gst_object_unref(pipeline);
+	g_free(streams);
+	g_free(all);
+	g_set_print_handler(print);
+	if(!ok) {
+		g_printerr("Error testing %u %s instances\n", instances, demux ? "mjrdemux" : "mjrmux");
+		g_array_free(latencies, TRUE);
+		return FALSE;
+	}
+	/* Report the results */
+	guint32 p50 = 0, p99 = 0;
+	if(latencies->len > 0) {
+		g_array_sort(latencies, mjr_scale_compare);
+		p50 = g_array_index(latencies, guint32, latencies->len / 2);
+		p99 = g_array_index(latencies, guint32, MIN(latencies->len - 1, latencies->len * 99 / 100));
+	}
+	g_array_free(latencies, TRUE);
+	gdouble seconds = (gdouble)elapsed / G_USEC_PER_SEC;
+	g_print("%-8s %8u %10.0f %10.1f %9" G_GSIZE_FORMAT " %9" G_GSIZE_FORMAT " ",
+		demux ? "mjrdemux" : "mjrmux", instances, packets / seconds,
+		(gdouble)(cpu_after - cpu_before) / instances / seconds,
+		(rss_idle > rss_before ? rss_idle - rss_before : 0) / instances,
+		(rss_active > rss_before ? rss_active - rss_before : 0) / instances);
+	if(MJR_SCALE_ALLOCATIONS && packets > 0)
+		g_print("%9.2f ", (gdouble)(allocations_after - allocations_before) / packets);
+	else
+		g_print("%9s ", "n/a");
+	g_print("%9.1f %9.1f\n", p50 / 1000.0, p99 / 1000.0);
+	return TRUE;
+}
+
+/* Initialize the elements we need, without installing the plugin */
+static gboolean mjr_scale_plugin_init(GstPlugin *plugin) {
+	gboolean ret = FALSE;
+	ret |= mjr_demux_register(plugin);
+	ret |= mjr_mux_register(plugin);
+	return ret;
+}
+
+int main(int argc, char *argv[]) {
+	GError *err = NULL;
+	GOptionContext *context = g_option_context_new("- measure how mjrmux and mjrdemux scale");
+	g_option_context_add_main_entries(context, options, NULL);
+	g_option_context_add_group(context, gst_init_get_option_group());
+	if(!g_option_context_parse(context, &argc, &argv, &err)) {
+		g_printerr("%s\n", err->message);
+		g_error_free(err);
+		g_option_context_free(context);
+		return 1;
+	}
+	g_option_context_free(context);
+	if(rate <= 0 || duration <= 0 || size < 13 || size > GST_MJR_MAX_RECORD_SIZE) {
+		g_printerr("Invalid rate, duration or packet size (see --help)\n");
+		return 1;
+	}
+	gboolean test_mux = TRUE, test_demux = TRUE;
+	if(mode != NULL && !strcasecmp(mode, "mux")) {
+		test_demux = FALSE;
+	} else if(mode != NULL && !strcasecmp(mode, "demux")) {
+		test_mux = FALSE;
+	} else if(mode != NULL && strcasecmp(mode, "both")) {
+		g_printerr("Invalid mode '%s' (see --help)\n", mode);
+		return 1;
+	}
+	if(threads <= 0)
+		threads = g_get_num_processors();
+	gst_plugin_register_static(GST_VERSION_MAJOR, GST_VERSION_MINOR,
+		"mjrscale", "Janus MJR elements for the scale harness", mjr_scale_plugin_init,
+		PACKAGE_VERSION, GST_LICENSE, "mjr-scale", GST_PACKAGE_NAME, GST_PACKAGE_ORIGIN);
+	mjr_scale_prepare();
+	/* Print the size of the instance structs, since they're always allocated */
+	GTypeQuery query;
+	g_type_query(GST_TYPE_MJR_MUX, &query);
+	g_print("mjrmux instance size: %u bytes\n", query.instance_size);
+	g_type_query(GST_TYPE_MJR_DEMUX, &query);
+	g_print("mjrdemux instance size: %u bytes\n", query.instance_size);
+	g_print("Pushing %d packets/s (%d bytes) per instance for %ds, from %d threads\n\n",
+		rate, size, duration, threads);
+	g_print("%-8s %8s %10s %10s %9s %9s %9s %9s %9s\n", "element", "count", "pkts/s",
+		"cpu us/s", "rss idle", "rss busy", "allocs", "p50 us", "p99 us");
+	gchar **list = g_strsplit(counts ? counts : "1,10,100,1000", ",", -1);
+	int ret = 0, i = 0;
+	for(i=0; list[i] != NULL && ret == 0; i++) {
+		guint64 instances = g_ascii_strtoull(list[i], NULL, 10);
+		if(instances == 0 || instances > G_MAXUINT) {
+			g_printerr("Invalid instance count '%s'\n", list[i]);
+			ret = 1;
+			break;
+		}
+		if(test_mux && !mjr_scale_run(FALSE, instances, threads))
+			ret = 1;
+		if(ret == 0 && test_demux && !mjr_scale_run(TRUE, instances, threads))
+			ret = 1;
+	}
+	g_strfreev(list);
+	g_bytes_unref(recording);
+	g_free(packet);
+	return ret;
+}